@@ -0,0 +1,197 @@
+// Benchmark suite for loading, routing and rendering. The extract comes from
+// ROUTEMS_BENCH_OSM, by default the one main() loads; queries and points are
+// drawn from fixed seeds so runs compare. `cmake --build . --target bench`
+// writes the results to bench.json.
+#include "mapped_file.h"
+#include "pbf_reader.h"
+#include "route_model.h"
+#include "route_planner.h"
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef ROUTEMS_WITH_IO2D
+#include "render.h"
+#endif
+
+namespace {
+
+constexpr std::size_t kQueries = 200;
+constexpr std::size_t kPoints = 4096;
+constexpr std::uint32_t kSeed = 42;
+
+std::string ExtractPath()
+{
+    auto path = std::getenv("ROUTEMS_BENCH_OSM");
+    return path ? path : "../new-york-latest.osm.pbf";
+}
+
+const MappedFile *Extract()
+{
+    static auto file = MappedFile::Open(ExtractPath());
+    return file ? &*file : nullptr;
+}
+
+// Built once on first use and shared by the routing and rendering benchmarks.
+RouteModel *SharedModel()
+{
+    static std::unique_ptr<RouteModel> model = []{
+        auto file = Extract();
+        return file ? std::make_unique<RouteModel>(*file) : nullptr;
+    }();
+    return model.get();
+}
+
+bool Require(benchmark::State &state, const void *data)
+{
+    if( !data )
+        state.SkipWithError(("cannot read " + ExtractPath() + ", set ROUTEMS_BENCH_OSM").c_str());
+    return data != nullptr;
+}
+
+// Adds latency percentiles in microseconds as counters, they end up in the JSON.
+void ReportPercentiles(benchmark::State &state, std::vector<double> micros)
+{
+    if( micros.empty() )
+        return;
+    std::sort(micros.begin(), micros.end());
+    auto at = [&](double q) { return micros[std::min(micros.size() - 1, static_cast<std::size_t>(q * micros.size()))]; };
+    state.counters["p50_us"] = at(0.50);
+    state.counters["p90_us"] = at(0.90);
+    state.counters["p99_us"] = at(0.99);
+    state.counters["max_us"] = micros.back();
+}
+
+// Maps the extract and touches every page, the cost of getting it into memory.
+void BM_MapFile(benchmark::State &state)
+{
+    if( !Require(state, Extract()) )
+        return;
+    std::size_t bytes = 0;
+    for( auto _: state ) {
+        auto file = MappedFile::Open(ExtractPath());
+        unsigned sum = 0;
+        for( std::size_t i = 0; i < file->size(); i += 4096 )
+            sum += static_cast<unsigned char>(file->data()[i]);
+        benchmark::DoNotOptimize(sum);
+        bytes += file->size();
+    }
+    state.SetBytesProcessed(static_cast<std::int64_t>(bytes));
+}
+BENCHMARK(BM_MapFile)->Unit(benchmark::kMillisecond);
+
+// Inflates and decodes every block, on 1 worker and on all cores.
+void BM_PbfDecode(benchmark::State &state)
+{
+    auto file = Extract();
+    if( !Require(state, file) )
+        return;
+    auto threads = state.range(0) ? static_cast<unsigned>(state.range(0)) : std::thread::hardware_concurrency();
+    std::size_t elements = 0;
+    for( auto _: state ) {
+        PbfReader reader{reinterpret_cast<const std::byte *>(file->data()), file->size()};
+        reader.Read([&](OsmBlock &block) { elements += block.nodes.size() + block.ways.size() + block.relations.size(); }, threads);
+    }
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * file->size()));
+    state.counters["elements"] = benchmark::Counter(static_cast<double>(elements), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_PbfDecode)->Arg(1)->Arg(0)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Decode plus building the model, the road index and the graph.
+void BM_ModelBuild(benchmark::State &state)
+{
+    auto file = Extract();
+    if( !Require(state, file) )
+        return;
+    for( auto _: state ) {
+        RouteModel model{*file};
+        benchmark::DoNotOptimize(model.Graph().EdgeCount());
+    }
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * file->size()));
+}
+BENCHMARK(BM_ModelBuild)->Unit(benchmark::kMillisecond)->UseRealTime()->Iterations(3);
+
+void BM_NearestNode(benchmark::State &state)
+{
+    auto model = SharedModel();
+    if( !Require(state, model) )
+        return;
+    std::mt19937 rng{kSeed};
+    std::uniform_real_distribution<float> coordinate{0.f, 1.f};
+    std::vector<std::pair<float, float>> points(kPoints);
+    for( auto &point: points )
+        point = {coordinate(rng), coordinate(rng)};
+
+    std::size_t i = 0;
+    for( auto _: state ) {
+        auto [x, y] = points[i++ % points.size()];
+        benchmark::DoNotOptimize(model->FindClosestNode(x, y));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_NearestNode);
+
+// One iteration runs the whole query set between random road nodes.
+void BM_AStarQueries(benchmark::State &state)
+{
+    auto model = SharedModel();
+    if( !Require(state, model) )
+        return;
+    auto &graph = model->Graph();
+    auto &roads = model->RoadNodes();
+    if( roads.empty() ) {
+        state.SkipWithError("the extract has no roads");
+        return;
+    }
+    std::mt19937 rng{kSeed};
+    std::uniform_int_distribution<std::size_t> pick{0, roads.size() - 1};
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> queries(kQueries);
+    for( auto &query: queries )
+        query = {graph.Vertex(roads[pick(rng)]), graph.Vertex(roads[pick(rng)])};
+
+    RoutePlanner planner{*model};
+    std::vector<double> micros;
+    std::size_t expanded = 0;
+    for( auto _: state )
+        for( auto [from, to]: queries ) {
+            auto started = std::chrono::steady_clock::now();
+            benchmark::DoNotOptimize(planner.AStarSearch(from, to));
+            micros.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - started).count());
+            expanded += planner.ExpandedNodes();
+        }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * queries.size()));
+    state.counters["expanded"] = static_cast<double>(expanded) / static_cast<double>(micros.size());
+    ReportPercentiles(state, std::move(micros));
+}
+BENCHMARK(BM_AStarQueries)->Unit(benchmark::kMillisecond);
+
+#ifdef ROUTEMS_WITH_IO2D
+// Frame time of a 1024x1024 view centred on the map, by zoom level.
+void BM_RenderFrame(benchmark::State &state)
+{
+    namespace io2d = std::experimental::io2d;
+    auto model = SharedModel();
+    if( !Require(state, model) )
+        return;
+    constexpr int kSize = 1024;
+    auto zoom = static_cast<float>(state.range(0));
+    Render render{*model};
+    auto extent = 1.f / zoom;
+    render.SetView({0.5f - extent / 2, 0.5f - extent / 2}, zoom);
+    for( auto _: state ) {
+        io2d::image_surface image{io2d::format::argb32, kSize, kSize};
+        render.Display(image);
+    }
+}
+BENCHMARK(BM_RenderFrame)->RangeMultiplier(2)->Range(1, 16)->Unit(benchmark::kMillisecond)->UseRealTime();
+#endif
+
+}
+
+BENCHMARK_MAIN();
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "span.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// Monotonic allocator for trivially copyable arrays. Memory is carved out of
+// large blocks and only released all at once when the arena goes away, so
+// millions of small lists cost a handful of allocations. Blocks never move,
+// the returned spans stay valid when the arena itself is moved.
+class Arena {
+public:
+    static constexpr std::size_t kBlockSize = std::size_t{1} << 20;
+
+    Arena() = default;
+    Arena(Arena &&) noexcept = default;
+    Arena &operator=(Arena &&) noexcept = default;
+
+    template <typename T>
+    Span<const T> Copy(Span<const T> items) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if( items.empty() )
+            return {};
+        auto p = static_cast<T *>(Allocate(items.size() * sizeof(T), alignof(T)));
+        std::memcpy(p, items.data(), items.size() * sizeof(T));
+        return {p, items.size()};
+    }
+
+    template <typename T>
+    Span<const T> Copy(const std::vector<T> &items) { return Copy(Span<const T>{items}); }
+
+    std::size_t Capacity() const noexcept { return m_Capacity; }        // bytes held in blocks
+
+private:
+    void *Allocate(std::size_t bytes, std::size_t alignment) {
+        auto offset = (m_Used + alignment - 1) & ~(alignment - 1);
+        if( m_Blocks.empty() || offset + bytes > m_BlockCapacity ) {
+            m_BlockCapacity = std::max(kBlockSize, bytes);          // oversized lists get a block of their own
+            m_Blocks.push_back(std::make_unique<std::byte[]>(m_BlockCapacity));
+            m_Capacity += m_BlockCapacity;
+            offset = 0;
+        }
+        m_Used = offset + bytes;
+        return m_Blocks.back().get() + offset;
+    }
+
+    std::vector<std::unique_ptr<std::byte[]>> m_Blocks;
+    std::size_t m_BlockCapacity = 0;        // of the last block
+    std::size_t m_Used = 0;                 // bytes of the last block handed out
+    std::size_t m_Capacity = 0;
+};
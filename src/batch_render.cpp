@@ -0,0 +1,98 @@
+#include "batch_render.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <deque>
+#include <future>
+#include <istream>
+#include <sstream>
+#include <string>
+
+using namespace std::experimental;
+
+static constexpr float kFitMargin = 1.2f;          // the route spans this fraction of the image less than all of it
+
+BatchRenderer::BatchRenderer(RouteModel &model, int width, int height) :
+    m_Model(model),
+    m_Width(width),
+    m_Height(height),
+    m_Render(model),
+    m_Planner(model)
+{
+    if( !model.Hierarchy().Empty() )
+        m_Hierarchy.emplace(model.Hierarchy(), model.Graph());
+}
+
+std::optional<std::vector<BatchRenderer::Trip>> BatchRenderer::ReadTrips(std::istream &in)
+{
+    std::vector<Trip> trips;
+    for( std::string line; std::getline(in, line); ) {
+        if( line.empty() || line[0] == '#' )
+            continue;
+        std::istringstream fields{line};
+        Trip trip;
+        if( !(fields >> trip.start_x >> trip.start_y >> trip.end_x >> trip.end_y) )
+            return std::nullopt;
+        trips.push_back(trip);
+    }
+    return trips;
+}
+
+std::optional<Route> BatchRenderer::FindRoute(const Trip &trip)
+{
+    auto start = m_Model.FindClosestNode(trip.start_x * 0.01f, trip.start_y * 0.01f);
+    auto end = m_Model.FindClosestNode(trip.end_x * 0.01f, trip.end_y * 0.01f);
+    if( start < 0 || end < 0 )
+        return std::nullopt;
+    auto &graph = m_Model.Graph();
+    if( m_Hierarchy )
+        return m_Hierarchy->Search(graph.Vertex(start), graph.Vertex(end));
+    return m_Planner.AStarSearch(graph.Vertex(start), graph.Vertex(end));
+}
+
+void BatchRenderer::FitView(const Route &route)
+{
+    Box box;
+    for( auto node: route.nodes )
+        box.Extend(static_cast<float>(m_Model.Nodes()[node].x), static_cast<float>(m_Model.Nodes()[node].y));
+
+    // Display() maps min(width, height) pixels to 1 / zoom model units
+    auto side = static_cast<float>(std::min(m_Width, m_Height));
+    auto extent = std::max({(box.max_x - box.min_x) * side / m_Width, (box.max_y - box.min_y) * side / m_Height, 1e-4f});
+    auto zoom = 1.f / (extent * kFitMargin);
+    auto scale = side * zoom;
+    io2d::point_2d origin{(box.min_x + box.max_x) / 2 - m_Width / (2 * scale), (box.min_y + box.max_y) / 2 - m_Height / (2 * scale)};
+    m_Render.SetView(origin, zoom);
+}
+
+std::size_t BatchRenderer::Run(const std::vector<Trip> &trips, const std::filesystem::path &dir)
+{
+    std::filesystem::create_directories(dir);
+
+    ThreadPool encoder{1};
+    std::deque<std::future<void>> encoding;
+    std::size_t written = 0;
+    for( std::size_t i = 0; i < trips.size(); ++i ) {
+        auto route = FindRoute(trips[i]);
+        if( !route || route->nodes.empty() )
+            continue;
+        FitView(*route);
+        m_Render.SetRoute(*route);
+
+        io2d::image_surface image{io2d::format::argb32, m_Width, m_Height};
+        m_Render.Display(image);
+
+        // bounded like PbfReader's decode window, rendering stays at most a few images ahead of the encoder
+        if( encoding.size() >= kEncodeWindow ) {
+            encoding.front().get();
+            encoding.pop_front();
+        }
+        auto path = dir / ("route_" + std::to_string(i) + ".png");
+        encoding.push_back(encoder.Submit([image = std::move(image), path]() mutable {
+            image.save(path, io2d::image_file_format::png);
+        }));
+        ++written;
+    }
+    for( auto &job: encoding )
+        job.get();
+    return written;
+}
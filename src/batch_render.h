@@ -0,0 +1,42 @@
+#pragma once
+
+#include "contraction_hierarchy.h"
+#include "render.h"
+#include "route_model.h"
+#include "route_planner.h"
+#include <filesystem>
+#include <iosfwd>
+#include <optional>
+#include <vector>
+
+// Offline route images: the model is loaded once, every trip is routed,
+// framed and rendered offscreen, and the PNGs are encoded on a separate
+// thread while the next trip is being drawn.
+class BatchRenderer {
+public:
+    struct Trip {
+        float start_x, start_y;         // percent of the map, like the interactive prompt
+        float end_x, end_y;
+    };
+
+    BatchRenderer(RouteModel &model, int width, int height);
+
+    // One start/end pair per line, blank lines and lines starting with # are skipped.
+    static std::optional<std::vector<Trip>> ReadTrips(std::istream &in);
+
+    // Writes route_<n>.png into dir for every trip that has a route, returns how many.
+    std::size_t Run(const std::vector<Trip> &trips, const std::filesystem::path &dir);
+
+private:
+    static constexpr std::size_t kEncodeWindow = 4;            // rendered images waiting for the encoder
+
+    std::optional<Route> FindRoute(const Trip &trip);
+    void FitView(const Route &route);                           // centres the route in the image
+
+    RouteModel &m_Model;
+    int m_Width;
+    int m_Height;
+    Render m_Render;
+    std::optional<CHQuery> m_Hierarchy;
+    RoutePlanner m_Planner;
+};
@@ -0,0 +1,207 @@
+#include "batch_router.h"
+#include "instrument.h"
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <optional>
+
+BatchRouter::BatchRouter(const RouteModel &model, unsigned threads) :
+    m_Model(model),
+    m_Graph(model.Graph()),
+    m_Pool(threads),
+    m_Buffers(m_Pool.Size()),
+    m_BucketBegin(model.Graph().VertexCount(), 0)
+{
+    for( auto &buffers: m_Buffers ) {
+        buffers.open.Reserve(m_Graph.VertexCount());
+        buffers.labels.Resize(m_Graph.VertexCount(), Label{kInfinity, kInfinity});
+        buffers.targets.Resize(m_Graph.VertexCount(), 0);
+    }
+}
+
+template <typename F>
+void BatchRouter::ForEach(std::size_t count, F &&body)
+{
+    std::atomic<std::size_t> next{0};       // workers pull items, so slow searches don't stall a whole chunk
+    std::vector<std::future<void>> done;
+    for( std::size_t worker = 0; worker < m_Buffers.size() && worker < count; ++worker )
+        done.push_back(m_Pool.Submit([&, worker]{
+            try {
+                for( auto i = next++; i < count; i = next++ )
+                    body(worker, m_Buffers[worker], i);
+            } catch( ... ) {
+                next = count;       // the others stop at their next item
+                throw;
+            }
+        }));
+    for( auto &worker: done )
+        worker.wait();              // they use the locals here, even when one failed
+    for( auto &worker: done )
+        worker.get();
+}
+
+std::vector<std::uint32_t> BatchRouter::Snap(const std::vector<Point> &points) const
+{
+    std::vector<std::uint32_t> vertices;
+    for( auto &point: points ) {
+        auto node = m_Model.FindClosestNode(point.x, point.y);
+        vertices.push_back(node < 0 ? RouteGraph::kNoVertex : m_Graph.Vertex(node));
+    }
+    return vertices;
+}
+
+RouteMatrix BatchRouter::Route(const std::vector<Point> &sources, const std::vector<Point> &targets)
+{
+    return RouteVertices(Snap(sources), Snap(targets));
+}
+
+RouteMatrix BatchRouter::RouteVertices(const std::vector<std::uint32_t> &sources, const std::vector<std::uint32_t> &targets)
+{
+    ROUTEMS_TRACE_SCOPE("route.matrix");
+    RouteMatrix matrix;
+    matrix.rows = sources.size();
+    matrix.cols = targets.size();
+    matrix.distances.assign(matrix.rows * matrix.cols, kInfinity);
+    matrix.durations.assign(matrix.rows * matrix.cols, kInfinity);
+
+    auto &ch = m_Model.Hierarchy();
+    std::optional<TrafficWeights::Pin> traffic;         // held by this thread while the workers read it
+    if( m_Traffic )
+        traffic.emplace(m_Traffic->Read());
+    if( ch.Empty() ) {
+        auto seconds = traffic ? (*traffic)->seconds.data() : nullptr;
+        ForEach(sources.size(), [&](std::size_t, Buffers &buffers, std::size_t i) {
+            OneToMany(buffers, sources[i], targets, seconds, &matrix.distances[i * matrix.cols], &matrix.durations[i * matrix.cols]);
+        });
+        return matrix;
+    }
+    // a hierarchy built after the traffic tables were customized has no times there
+    auto ch_seconds = traffic && (*traffic)->ch_seconds.size() == ch.EdgeCount() ? (*traffic)->ch_seconds.data() : nullptr;
+
+    // backward searches fill the buckets, each worker collects its own entries first
+    std::vector<std::vector<BucketEntry>> partial(m_Buffers.size());
+    ForEach(targets.size(), [&](std::size_t worker, Buffers &buffers, std::size_t j) {
+        if( targets[j] == RouteGraph::kNoVertex )
+            return;
+        UpwardSearch(buffers, targets[j], ContractionHierarchy::Backward, ch_seconds);
+        for( auto v: buffers.settled )
+            partial[worker].push_back({v, (std::uint32_t)j, buffers.labels.Get(v)});
+    });
+
+    m_Buckets.clear();
+    for( auto &entries: partial )
+        m_Buckets.insert(m_Buckets.end(), entries.begin(), entries.end());
+    std::sort(m_Buckets.begin(), m_Buckets.end(), [](auto &l, auto &r){
+        return l.vertex != r.vertex ? l.vertex < r.vertex : l.target < r.target;
+    });
+    m_BucketBegin.Clear();
+    for( std::size_t k = m_Buckets.size(); k-- > 0; )
+        m_BucketBegin.Set(m_Buckets[k].vertex, (std::uint32_t)k);
+
+    ForEach(sources.size(), [&](std::size_t, Buffers &buffers, std::size_t i) {
+        if( sources[i] == RouteGraph::kNoVertex )
+            return;
+        UpwardSearch(buffers, sources[i], ContractionHierarchy::Forward, ch_seconds);
+        auto distances = &matrix.distances[i * matrix.cols];
+        auto durations = &matrix.durations[i * matrix.cols];
+        for( auto v: buffers.settled ) {
+            if( !m_BucketBegin.Has(v) )
+                continue;
+            auto up = buffers.labels.Get(v);
+            for( auto k = m_BucketBegin.Get(v); k < m_Buckets.size() && m_Buckets[k].vertex == v; ++k ) {
+                auto &entry = m_Buckets[k];
+                auto distance = up.distance + entry.label.distance;
+                if( distance < distances[entry.target] ) {
+                    distances[entry.target] = distance;
+                    durations[entry.target] = up.duration + entry.label.duration;
+                }
+            }
+        }
+    });
+    return matrix;
+}
+
+// Complete Dijkstra over the upward edges of one direction, no stopping criterion.
+void BatchRouter::UpwardSearch(Buffers &buffers, std::uint32_t root, ContractionHierarchy::Direction d,
+                               const float *seconds) const
+{
+    auto &ch = m_Model.Hierarchy();
+    buffers.labels.Clear();
+    buffers.open.Clear();
+    buffers.settled.clear();
+
+    buffers.labels.Set(root, {0.f, 0.f});
+    instrument::Tally expanded{instrument::NodesExpanded}, relaxed{instrument::EdgesRelaxed};
+    instrument::Tally pushes{instrument::HeapPushes}, pops{instrument::HeapPops};
+    buffers.open.Push(root, 0.f);
+    ++pushes;
+    while( !buffers.open.Empty() ) {
+        auto v = buffers.open.Pop();
+        ++expanded;
+        ++pops;
+        buffers.settled.push_back(v);
+        auto label = buffers.labels.Get(v);
+        for( auto e = ch.FirstEdge(v), last = ch.FirstEdge(v + 1); e < last; ++e ) {
+            if( !ch.Has(e, d) )
+                continue;
+            auto w = ch.Target(e);
+            auto distance = label.distance + ch.Weight(e);
+            ++relaxed;
+            if( distance < buffers.labels.Get(w).distance ) {
+                buffers.labels.Set(w, {distance, label.duration + (seconds ? seconds[e] : ch.Duration(e))});
+                buffers.open.Push(w, distance);
+                ++pushes;
+            }
+        }
+    }
+}
+
+void BatchRouter::OneToMany(Buffers &buffers, std::uint32_t source, const std::vector<std::uint32_t> &targets,
+                            const float *seconds, float *distances, float *durations) const
+{
+    if( source == RouteGraph::kNoVertex )
+        return;
+    buffers.labels.Clear();
+    buffers.targets.Clear();
+    buffers.open.Clear();
+
+    std::size_t remaining = 0;
+    for( auto t: targets )
+        if( t != RouteGraph::kNoVertex && !buffers.targets.Has(t) ) {
+            buffers.targets.Set(t, 1);
+            ++remaining;
+        }
+
+    buffers.labels.Set(source, {0.f, 0.f});
+    instrument::Tally expanded{instrument::NodesExpanded}, relaxed{instrument::EdgesRelaxed};
+    instrument::Tally pushes{instrument::HeapPushes}, pops{instrument::HeapPops};
+    buffers.open.Push(source, 0.f);
+    ++pushes;
+    while( remaining > 0 && !buffers.open.Empty() ) {
+        auto v = buffers.open.Pop();
+        ++expanded;
+        ++pops;
+        if( buffers.targets.Has(v) )
+            --remaining;
+        auto label = buffers.labels.Get(v);
+        for( auto e = m_Graph.FirstEdge(v), last = m_Graph.FirstEdge(v + 1); e < last; ++e ) {
+            if( !CarProfile::kAccess[m_Graph.Type(e)] )
+                continue;
+            auto w = m_Graph.Target(e);
+            auto distance = label.distance + m_Graph.Weight(e);
+            ++relaxed;
+            if( distance < buffers.labels.Get(w).distance ) {
+                buffers.labels.Set(w, {distance, label.duration + (seconds ? seconds[e] : m_Graph.Duration(e))});
+                buffers.open.Push(w, distance);
+                ++pushes;
+            }
+        }
+    }
+
+    for( std::size_t j = 0; j < targets.size(); ++j )
+        if( targets[j] != RouteGraph::kNoVertex && buffers.labels.Has(targets[j]) ) {
+            auto label = buffers.labels.Get(targets[j]);
+            distances[j] = label.distance;
+            durations[j] = label.duration;
+        }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "open_list.h"
+#include "route_model.h"
+#include "stamped_array.h"
+#include "thread_pool.h"
+#include "traffic.h"
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Distance and duration matrix between N sources and M targets, row major by source.
+struct RouteMatrix {
+    std::size_t rows = 0;
+    std::size_t cols = 0;
+    std::vector<float> distances;       // metres, infinity if unreachable
+    std::vector<float> durations;       // seconds at the default road speeds, or the traffic's
+
+    float Distance(std::size_t source, std::size_t target) const noexcept { return distances[source * cols + target]; }
+    float Duration(std::size_t source, std::size_t target) const noexcept { return durations[source * cols + target]; }
+};
+
+// Many-to-many routing. With a contraction hierarchy this is the bucket
+// algorithm: one backward upward search per target fills per-vertex buckets,
+// one forward upward search per source scans them. Without a hierarchy every
+// source runs a Dijkstra that stops once all targets are settled. Searches
+// are spread over a thread pool, and every worker reuses its buffers across
+// searches and calls; they are reset by bumping a generation counter.
+class BatchRouter {
+public:
+    struct Point {
+        float x;            // normalized model coordinates, as FindClosestNode() takes them
+        float y;
+    };
+
+    explicit BatchRouter(const RouteModel &model, unsigned threads = std::thread::hardware_concurrency());
+
+    // Durations at live speeds, each call uses the table current when it starts.
+    // Distances and therefore the paths stay the same. nullptr for the defaults.
+    void SetTraffic(const TrafficWeights *traffic) noexcept { m_Traffic = traffic; }
+
+    RouteMatrix Route(const std::vector<Point> &sources, const std::vector<Point> &targets);
+    RouteMatrix RouteVertices(const std::vector<std::uint32_t> &sources, const std::vector<std::uint32_t> &targets);
+
+private:
+    static constexpr auto kInfinity = std::numeric_limits<float>::infinity();
+
+    struct Label {
+        float distance;
+        float duration;
+    };
+
+    struct Buffers {
+        OpenList open;
+        StampedArray<Label> labels;
+        StampedArray<std::uint8_t> targets;         // marks the targets of a one-to-many search
+        std::vector<std::uint32_t> settled;
+    };
+
+    struct BucketEntry {
+        std::uint32_t vertex;
+        std::uint32_t target;           // column in the matrix
+        Label label;
+    };
+
+    std::vector<std::uint32_t> Snap(const std::vector<Point> &points) const;
+    // seconds per hierarchy or graph edge, nullptr for the durations at default speeds
+    void UpwardSearch(Buffers &buffers, std::uint32_t root, ContractionHierarchy::Direction d, const float *seconds) const;
+    void OneToMany(Buffers &buffers, std::uint32_t source, const std::vector<std::uint32_t> &targets,
+                   const float *seconds, float *distances, float *durations) const;
+
+    // Runs body(worker, buffers, item) for every item in [0, count); the workers pull
+    // the next item when done. Waits for all of them, then rethrows the first failure.
+    template <typename F>
+    void ForEach(std::size_t count, F &&body);
+
+    const RouteModel &m_Model;
+    const RouteGraph &m_Graph;
+    const TrafficWeights *m_Traffic = nullptr;
+    ThreadPool m_Pool;
+    std::vector<Buffers> m_Buffers;                 // one per worker
+    std::vector<BucketEntry> m_Buckets;             // sorted by vertex
+    StampedArray<std::uint32_t> m_BucketBegin;      // first entry of a vertex' bucket
+};
@@ -0,0 +1,69 @@
+#include "box_index.h"
+#include "hilbert.h"
+#include <numeric>
+#include <utility>
+
+BoxIndex::BoxIndex(const std::vector<Box> &items)
+{
+    Box extent;
+    for( std::uint32_t i = 0; i < items.size(); ++i )
+        if( !items[i].Empty() ) {
+            m_Items.push_back(i);
+            extent.Extend(items[i]);
+        }
+    m_ItemCount = m_Items.size();
+    if( m_Items.empty() )
+        return;
+
+    // leaves in Hilbert order of the box centres
+    auto width = std::max(extent.max_x - extent.min_x, 1e-9f);
+    auto height = std::max(extent.max_y - extent.min_y, 1e-9f);
+    auto grid = [](float t) { return (std::uint32_t)(std::clamp(t, 0.f, 1.f) * 65535.f); };
+    std::vector<std::uint64_t> keys(items.size());
+    for( auto i: m_Items ) {
+        auto &box = items[i];
+        keys[i] = HilbertIndex(grid(((box.min_x + box.max_x) * 0.5f - extent.min_x) / width),
+                               grid(((box.min_y + box.max_y) * 0.5f - extent.min_y) / height));
+    }
+    std::sort(m_Items.begin(), m_Items.end(), [&](auto a, auto b){ return keys[a] < keys[b]; });
+    for( auto i: m_Items )
+        m_Boxes.push_back(items[i]);
+
+    // every level bounds groups of kNodeSize boxes of the level below, up to a single root
+    m_LevelBegin.push_back(0);
+    for( auto begin = std::size_t{0}, end = m_Boxes.size(); end - begin > 1; begin = end, end = m_Boxes.size() ) {
+        m_LevelBegin.push_back(end);
+        for( auto first = begin; first < end; first += kNodeSize ) {
+            Box node;
+            for( auto child = first; child < std::min(first + kNodeSize, end); ++child )
+                node.Extend(m_Boxes[child]);
+            m_Boxes.push_back(node);
+        }
+    }
+    m_LevelBegin.push_back(m_Boxes.size());
+}
+
+void BoxIndex::Query(const Box &box, std::vector<std::uint32_t> &out) const
+{
+    if( m_Boxes.empty() || box.Empty() )
+        return;
+
+    auto first = out.size();
+    auto top = m_LevelBegin.size() - 2;
+    std::vector<std::pair<std::size_t, std::size_t>> stack{{top, m_LevelBegin[top]}};       // level, box
+    while( !stack.empty() ) {
+        auto [level, node] = stack.back();
+        stack.pop_back();
+        if( !m_Boxes[node].Intersects(box) )
+            continue;
+        if( level == 0 ) {
+            out.push_back(m_Items[node]);
+            continue;
+        }
+        auto child_begin = m_LevelBegin[level - 1] + (node - m_LevelBegin[level]) * kNodeSize;
+        auto child_end = std::min(child_begin + kNodeSize, m_LevelBegin[level]);
+        for( auto child = child_begin; child < child_end; ++child )
+            stack.push_back({level - 1, child});
+    }
+    std::sort(out.begin() + first, out.end());
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Axis aligned rectangle in the model's normalized coordinates.
+struct Box {
+    float min_x = 0.f;
+    float min_y = 0.f;
+    float max_x = -1.f;         // empty until something is added
+    float max_y = -1.f;
+
+    bool Empty() const noexcept { return max_x < min_x || max_y < min_y; }
+    bool Intersects(const Box &other) const noexcept {
+        return min_x <= other.max_x && other.min_x <= max_x && min_y <= other.max_y && other.min_y <= max_y;
+    }
+    void Extend(float x, float y) noexcept {
+        if( Empty() ) {
+            *this = {x, y, x, y};
+            return;
+        }
+        min_x = std::min(min_x, x); min_y = std::min(min_y, y);
+        max_x = std::max(max_x, x); max_y = std::max(max_y, y);
+    }
+    void Extend(const Box &other) noexcept {
+        if( !other.Empty() ) {
+            Extend(other.min_x, other.min_y);
+            Extend(other.max_x, other.max_y);
+        }
+    }
+};
+
+// Static packed R-tree over the bounding boxes of a feature layer. Items are
+// sorted along a Hilbert curve by the centre of their box and packed bottom
+// up into nodes of kNodeSize children, so the whole tree is a few flat arrays.
+class BoxIndex {
+public:
+    static constexpr std::uint32_t kNodeSize = 16;
+
+    BoxIndex() = default;
+    explicit BoxIndex(const std::vector<Box> &items);       // empty boxes are never returned
+
+    std::size_t Size() const noexcept { return m_ItemCount; }
+
+    // Appends the items intersecting box to out, in ascending item order so
+    // callers keep drawing in model order.
+    void Query(const Box &box, std::vector<std::uint32_t> &out) const;
+
+private:
+    std::size_t m_ItemCount = 0;
+    std::vector<Box> m_Boxes;                   // all levels, leaves first
+    std::vector<std::uint32_t> m_Items;         // item of each leaf
+    std::vector<std::size_t> m_LevelBegin;      // first box of every level, plus the end
+};
@@ -0,0 +1,244 @@
+#include "chunk_reader.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define ROUTEMS_HAVE_IO_URING 1
+#endif
+
+#if defined(ROUTEMS_HAVE_IO_URING) && defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+
+// Minimal io_uring over the raw system calls: one submission per read, completions reaped one at a time.
+class ChunkReader::Ring {
+public:
+    static std::unique_ptr<Ring> Create(unsigned entries)
+    {
+        io_uring_params params{};
+        auto fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+        if(fd < 0)
+            return nullptr;         // old kernel, or disabled by seccomp or sysctl
+        std::unique_ptr<Ring> ring{new Ring{fd}};
+        return ring->Map(params) ? std::move(ring) : nullptr;
+    }
+
+    ~Ring()
+    {
+        if(m_Sqes)
+            ::munmap(m_Sqes, m_SqesSize);
+        if(m_CqRing && m_CqRing != m_SqRing)
+            ::munmap(m_CqRing, m_CqSize);
+        if(m_SqRing)
+            ::munmap(m_SqRing, m_SqSize);
+        ::close(m_Fd);
+    }
+
+    // Queues a readv of one iovec and submits it, false if the kernel refused.
+    bool Read(int fd, const iovec *iov, std::uint64_t offset, std::uint64_t user_data)
+    {
+        auto tail = *m_SqTail;
+        auto index = tail & *m_SqMask;
+        auto &sqe = m_Sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READV;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<std::uint64_t>(iov);
+        sqe.len = 1;
+        sqe.off = offset;
+        sqe.user_data = user_data;
+        m_SqArray[index] = index;
+        __atomic_store_n(m_SqTail, tail + 1, __ATOMIC_RELEASE);
+        long submitted;
+        do
+            submitted = ::syscall(__NR_io_uring_enter, m_Fd, 1, 0, 0, nullptr, 0);
+        while(submitted < 0 && errno == EINTR);
+        if(submitted == 1)
+            return true;
+        __atomic_store_n(m_SqTail, tail, __ATOMIC_RELEASE);         // not consumed, take it back
+        return false;
+    }
+
+    // Blocks until a read completes; its user data and result, bytes or -errno.
+    std::pair<std::uint64_t, long> Reap()
+    {
+        for(;;) {
+            auto head = *m_CqHead;
+            if(head != __atomic_load_n(m_CqTail, __ATOMIC_ACQUIRE)) {
+                auto &cqe = m_Cqes[head & *m_CqMask];
+                std::pair<std::uint64_t, long> completion{cqe.user_data, cqe.res};
+                __atomic_store_n(m_CqHead, head + 1, __ATOMIC_RELEASE);
+                return completion;
+            }
+            if(::syscall(__NR_io_uring_enter, m_Fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+                throw std::runtime_error{std::string{"read: io_uring_enter failed: "} + std::strerror(errno)};
+        }
+    }
+
+private:
+    explicit Ring(int fd) noexcept : m_Fd(fd) {}
+
+    bool Map(const io_uring_params &params)
+    {
+        m_SqSize = params.sq_off.array + params.sq_entries * sizeof(std::uint32_t);
+        m_CqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        auto single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if(single)
+            m_SqSize = m_CqSize = std::max(m_SqSize, m_CqSize);
+        auto map = [&](std::size_t size, off_t offset) -> char * {
+            auto addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_Fd, offset);
+            return addr == MAP_FAILED ? nullptr : static_cast<char *>(addr);
+        };
+        m_SqRing = map(m_SqSize, IORING_OFF_SQ_RING);
+        if(!m_SqRing)
+            return false;
+        m_CqRing = single ? m_SqRing : map(m_CqSize, IORING_OFF_CQ_RING);
+        if(!m_CqRing)
+            return false;
+        m_SqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        auto sqes = map(m_SqesSize, IORING_OFF_SQES);
+        if(!sqes)
+            return false;
+        m_Sqes = reinterpret_cast<io_uring_sqe *>(sqes);
+
+        m_SqTail = reinterpret_cast<unsigned *>(m_SqRing + params.sq_off.tail);
+        m_SqMask = reinterpret_cast<unsigned *>(m_SqRing + params.sq_off.ring_mask);
+        m_SqArray = reinterpret_cast<unsigned *>(m_SqRing + params.sq_off.array);
+        m_CqHead = reinterpret_cast<unsigned *>(m_CqRing + params.cq_off.head);
+        m_CqTail = reinterpret_cast<unsigned *>(m_CqRing + params.cq_off.tail);
+        m_CqMask = reinterpret_cast<unsigned *>(m_CqRing + params.cq_off.ring_mask);
+        m_Cqes = reinterpret_cast<io_uring_cqe *>(m_CqRing + params.cq_off.cqes);
+        return true;
+    }
+
+    int m_Fd;
+    char *m_SqRing = nullptr;
+    char *m_CqRing = nullptr;
+    std::size_t m_SqSize = 0, m_CqSize = 0, m_SqesSize = 0;
+    io_uring_sqe *m_Sqes = nullptr;
+    unsigned *m_SqTail = nullptr, *m_SqMask = nullptr, *m_SqArray = nullptr;
+    unsigned *m_CqHead = nullptr, *m_CqTail = nullptr, *m_CqMask = nullptr;
+    io_uring_cqe *m_Cqes = nullptr;
+};
+
+#else
+
+class ChunkReader::Ring {
+public:
+    static std::unique_ptr<Ring> Create(unsigned) { return nullptr; }
+    bool Read(int, const iovec *, std::uint64_t, std::uint64_t) { return false; }
+    std::pair<std::uint64_t, long> Reap() { return {0, -ENOSYS}; }
+};
+
+#endif
+
+std::unique_ptr<ChunkReader> ChunkReader::Open(const std::string &path, unsigned depth, Backend backend) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return nullptr;
+    struct stat st;
+    if(::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+        ::close(fd);
+        return nullptr;
+    }
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return std::unique_ptr<ChunkReader>{new ChunkReader{fd, static_cast<std::uint64_t>(st.st_size), std::max(depth, 1u), backend}};
+}
+
+ChunkReader::ChunkReader(int fd, std::uint64_t size, unsigned depth, Backend backend) :
+    m_Fd(fd),
+    m_Size(size),
+    m_Slots(depth)
+{
+    if(backend == Backend::Auto)
+        m_Ring = Ring::Create(depth);
+    if(!m_Ring)
+        m_Pool = std::make_unique<ThreadPool>(depth);
+    for(auto &slot : m_Slots)
+        slot.buffer.resize(kChunkSize);
+    for(auto &slot : m_Slots) {
+        if(m_NextChunk * kChunkSize >= m_Size)
+            break;
+        slot.offset = m_NextChunk++ * kChunkSize;
+        slot.size = static_cast<std::size_t>(std::min<std::uint64_t>(kChunkSize, m_Size - slot.offset));
+        Submit(slot);
+    }
+}
+
+ChunkReader::~ChunkReader() {
+    for(auto &slot : m_Slots) {
+        try {
+            if(slot.pending)
+                Wait(slot);
+        } catch(...) {
+            // the buffers only have to outlive the reads
+        }
+    }
+    m_Pool.reset();
+    ::close(m_Fd);
+}
+
+void ChunkReader::Submit(Slot &slot) {
+    slot.iov.iov_base = slot.buffer.data() + slot.done;
+    slot.iov.iov_len = slot.size - slot.done;
+    slot.pending = true;
+    auto offset = slot.offset + slot.done;
+    auto user_data = static_cast<std::uint64_t>(&slot - m_Slots.data());
+    auto read = [fd = m_Fd, iov = slot.iov, offset]() -> long {
+        auto n = ::pread(fd, iov.iov_base, iov.iov_len, static_cast<off_t>(offset));
+        return n < 0 ? -errno : n;
+    };
+    if(m_Pool)
+        slot.read = m_Pool->Submit(read);
+    else if(!m_Ring->Read(m_Fd, &slot.iov, offset, user_data))
+        Complete(slot, read());         // the ring is full or refused, read this one in place
+}
+
+void ChunkReader::Complete(Slot &slot, long result) {
+    slot.pending = false;
+    if(result == -EINTR || result == -EAGAIN)
+        result = 0;                 // try again
+    else if(result < 0)
+        throw std::runtime_error{std::string{"read: "} + std::strerror(static_cast<int>(-result))};
+    else if(result == 0)
+        throw std::runtime_error{"read: the file got shorter while it was read"};
+    slot.done += static_cast<std::size_t>(result);
+    if(slot.done < slot.size)
+        Submit(slot);               // short read, queue the rest
+}
+
+void ChunkReader::Wait(Slot &slot) {
+    while(slot.pending) {
+        if(slot.read.valid()) {
+            Complete(slot, slot.read.get());
+            continue;
+        }
+        // completions come in any order, account for them until this slot's is in
+        auto [user_data, result] = m_Ring->Reap();
+        Complete(m_Slots[user_data], result);
+    }
+}
+
+Span<const std::byte> ChunkReader::Next() {
+    auto depth = m_Slots.size();
+    if(m_Current > 0) {
+        // the caller is done with the previous chunk, its buffer reads ahead
+        auto &previous = m_Slots[(m_Current - 1) % depth];
+        if(m_NextChunk * kChunkSize < m_Size) {
+            previous.offset = m_NextChunk++ * kChunkSize;
+            previous.size = static_cast<std::size_t>(std::min<std::uint64_t>(kChunkSize, m_Size - previous.offset));
+            previous.done = 0;
+            Submit(previous);
+        }
+    }
+    if(m_Current * kChunkSize >= m_Size)
+        return {};
+    auto &slot = m_Slots[m_Current++ % depth];
+    Wait(slot);
+    return {slot.buffer.data(), slot.size};
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "span.h"
+#include "thread_pool.h"
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/uio.h>
+
+// Reads a file front to back in fixed size chunks with several reads in
+// flight, so the latency of one read overlaps with the next ones and with
+// whatever the caller does with the data. Reads go through io_uring where
+// the kernel and the sandbox allow it, otherwise through pread on a small
+// thread pool. The chunk buffers are allocated once and recycled: the one
+// Next() returned is resubmitted for a later chunk on the next call.
+// Throws std::runtime_error on read errors.
+class ChunkReader {
+public:
+    static constexpr std::size_t kChunkSize = std::size_t{4} << 20;
+    static constexpr unsigned kDepth = 8;           // reads in flight
+
+    enum class Backend { Auto, Threads };
+
+    // nullptr if the file is missing, empty or not a regular file
+    static std::unique_ptr<ChunkReader> Open(const std::string &path, unsigned depth = kDepth, Backend backend = Backend::Auto);
+    ChunkReader(const ChunkReader &) = delete;
+    ChunkReader &operator=(const ChunkReader &) = delete;
+    ~ChunkReader();             // waits for the reads still in flight
+
+    std::uint64_t Size() const noexcept { return m_Size; }
+    bool UsesUring() const noexcept { return m_Ring != nullptr; }
+
+    // The next chunk in file order, valid until the next call; empty at the end.
+    Span<const std::byte> Next();
+
+private:
+    class Ring;
+    struct Slot {
+        std::vector<std::byte> buffer;
+        std::uint64_t offset = 0;           // of the chunk in the file
+        std::size_t size = 0;               // bytes wanted
+        std::size_t done = 0;               // bytes read so far
+        iovec iov{};                        // the pending part, stable while the kernel reads it
+        bool pending = false;
+        std::future<long> read;             // thread pool backend
+    };
+
+    ChunkReader(int fd, std::uint64_t size, unsigned depth, Backend backend);
+    void Submit(Slot &slot);                // reads what is left of the slot's chunk
+    void Complete(Slot &slot, long result);
+    void Wait(Slot &slot);                  // until the whole chunk is in
+
+    int m_Fd;
+    std::uint64_t m_Size;
+    std::uint64_t m_NextChunk = 0;          // first chunk not submitted yet
+    std::uint64_t m_Current = 0;            // chunk the next Next() returns
+    std::vector<Slot> m_Slots;              // chunk c lives in slot c % depth
+    std::unique_ptr<Ring> m_Ring;
+    std::unique_ptr<ThreadPool> m_Pool;
+};
@@ -0,0 +1,451 @@
+#include "contraction_hierarchy.h"
+#include "instrument.h"
+#include "snapshot.h"
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <stdexcept>
+
+namespace {
+
+constexpr auto kInfinity = std::numeric_limits<float>::infinity();
+constexpr std::size_t kWitnessSettleLimit = 500;        // local searches give up on long witnesses
+
+struct DynamicEdge {
+    std::uint32_t other;
+    float weight;
+    std::uint32_t middle;
+    float duration;
+};
+
+struct UpwardEdge {
+    std::uint32_t target;
+    float weight;
+    std::uint32_t middle;
+    float duration;
+    std::uint8_t directions;
+};
+
+// Mutable graph the vertices are contracted out of, one at a time.
+class Contractor {
+public:
+    explicit Contractor(const RouteGraph &graph);
+    void Run();
+
+    std::vector<std::uint32_t> ranks;
+    std::vector<std::vector<UpwardEdge>> upward;
+
+private:
+    std::size_t Contract(std::uint32_t v, bool add_shortcuts);
+    float Priority(std::uint32_t v);
+    void WitnessSearch(std::uint32_t from, std::uint32_t skip, float max_dist);
+    void AddShortcut(std::uint32_t from, std::uint32_t to, float weight, std::uint32_t middle, float duration);
+    void RecordUpwardEdges(std::uint32_t v);
+    void Remove(std::uint32_t v);
+
+    std::vector<std::vector<DynamicEdge>> m_Out;
+    std::vector<std::vector<DynamicEdge>> m_In;
+    std::vector<std::uint32_t> m_DeletedNeighbours;
+
+    IndexedHeap m_Heap;             // witness search scratch
+    std::vector<float> m_Dist;
+    std::vector<std::uint32_t> m_Touched;
+};
+
+Contractor::Contractor(const RouteGraph &graph) :
+    ranks(graph.VertexCount(), RouteGraph::kNoVertex),
+    upward(graph.VertexCount()),
+    m_Out(graph.VertexCount()),
+    m_In(graph.VertexCount()),
+    m_DeletedNeighbours(graph.VertexCount(), 0),
+    m_Heap(graph.VertexCount()),
+    m_Dist(graph.VertexCount(), kInfinity)
+{
+    for( std::uint32_t v = 0; v < graph.VertexCount(); ++v )
+        for( auto e = graph.FirstEdge(v), last = graph.FirstEdge(v + 1); e < last; ++e ) {
+            if( !CarProfile::kAccess[graph.Type(e)] )
+                continue;
+            m_Out[v].push_back({graph.Target(e), graph.Weight(e), RouteGraph::kNoVertex, graph.Duration(e)});
+            m_In[graph.Target(e)].push_back({v, graph.Weight(e), RouteGraph::kNoVertex, graph.Duration(e)});
+        }
+}
+
+// Edge difference plus the number of contracted neighbours, which spreads the
+// contraction evenly over the map.
+float Contractor::Priority(std::uint32_t v)
+{
+    auto shortcuts = Contract(v, false);
+    auto removed = m_In[v].size() + m_Out[v].size();
+    return (float)shortcuts - (float)removed + (float)m_DeletedNeighbours[v];
+}
+
+void Contractor::Run()
+{
+    using Entry = std::pair<float, std::uint32_t>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+    std::vector<float> priority(m_Out.size());
+    for( std::uint32_t v = 0; v < m_Out.size(); ++v ) {
+        priority[v] = Priority(v);
+        queue.push({priority[v], v});
+    }
+
+    std::uint32_t next_rank = 0;
+    while( !queue.empty() ) {
+        auto [p, v] = queue.top();
+        queue.pop();
+        if( ranks[v] != RouteGraph::kNoVertex || p != priority[v] )
+            continue;           // stale entry
+
+        // lazy update: contracting the neighbours may have made v more expensive
+        priority[v] = Priority(v);
+        if( !queue.empty() && priority[v] > queue.top().first ) {
+            queue.push({priority[v], v});
+            continue;
+        }
+
+        RecordUpwardEdges(v);
+        Contract(v, true);
+        ranks[v] = next_rank++;
+
+        std::vector<std::uint32_t> neighbours;
+        for( auto &edge: m_Out[v] ) neighbours.push_back(edge.other);
+        for( auto &edge: m_In[v] ) neighbours.push_back(edge.other);
+        Remove(v);
+        std::sort(neighbours.begin(), neighbours.end());
+        neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+        for( auto u: neighbours ) {
+            ++m_DeletedNeighbours[u];
+            priority[u] = Priority(u);
+            queue.push({priority[u], u});
+        }
+    }
+}
+
+// Counts, and optionally adds, the shortcuts that replace paths through v.
+std::size_t Contractor::Contract(std::uint32_t v, bool add_shortcuts)
+{
+    std::size_t shortcuts = 0;
+    for( std::size_t i = 0; i < m_In[v].size(); ++i ) {
+        auto in = m_In[v][i];
+        auto max_out = 0.f;
+        auto has_out = false;           // weights can be 0, between distinct nodes at the same spot
+        for( auto &out: m_Out[v] )
+            if( out.other != in.other ) {
+                max_out = std::max(max_out, out.weight);
+                has_out = true;
+            }
+        if( !has_out )
+            continue;
+
+        WitnessSearch(in.other, v, in.weight + max_out);
+        for( auto &out: m_Out[v] ) {
+            if( out.other == in.other )
+                continue;
+            auto via = in.weight + out.weight;
+            if( m_Dist[out.other] <= via )
+                continue;           // a path around v is at least as short
+            ++shortcuts;
+            if( add_shortcuts )
+                AddShortcut(in.other, out.other, via, v, in.duration + out.duration);
+        }
+    }
+    return shortcuts;
+}
+
+void Contractor::WitnessSearch(std::uint32_t from, std::uint32_t skip, float max_dist)
+{
+    for( auto u: m_Touched )
+        m_Dist[u] = kInfinity;
+    m_Touched.clear();
+    m_Heap.Clear();
+
+    m_Dist[from] = 0.f;
+    m_Touched.push_back(from);
+    m_Heap.Push(from, 0.f);
+    for( std::size_t settled = 0; !m_Heap.Empty() && settled < kWitnessSettleLimit; ++settled ) {
+        if( m_Heap.TopKey() > max_dist )
+            break;
+        auto u = m_Heap.Pop();
+        for( auto &edge: m_Out[u] ) {
+            if( edge.other == skip )
+                continue;
+            auto d = m_Dist[u] + edge.weight;
+            if( !(d < m_Dist[edge.other]) )
+                continue;
+            if( m_Dist[edge.other] == kInfinity )
+                m_Touched.push_back(edge.other);
+            m_Dist[edge.other] = d;
+            m_Heap.Push(edge.other, d);
+        }
+    }
+}
+
+void Contractor::AddShortcut(std::uint32_t from, std::uint32_t to, float weight, std::uint32_t middle, float duration)
+{
+    auto update = [&](std::vector<DynamicEdge> &edges, std::uint32_t other) {
+        for( auto &edge: edges )
+            if( edge.other == other ) {
+                if( weight < edge.weight )
+                    edge = {other, weight, middle, duration};
+                return;
+            }
+        edges.push_back({other, weight, middle, duration});
+    };
+    update(m_Out[from], to);
+    update(m_In[to], from);
+}
+
+// Everything still attached to v is ranked higher, so these are its upward edges.
+void Contractor::RecordUpwardEdges(std::uint32_t v)
+{
+    auto &up = upward[v];
+    for( auto &edge: m_Out[v] )
+        up.push_back({edge.other, edge.weight, edge.middle, edge.duration, ContractionHierarchy::Forward});
+    for( auto &edge: m_In[v] ) {
+        auto same = std::find_if(up.begin(), up.end(), [&](auto &u){
+            return u.target == edge.other && u.weight == edge.weight && u.middle == edge.middle;
+        });
+        if( same != up.end() )
+            same->directions |= ContractionHierarchy::Backward;
+        else
+            up.push_back({edge.other, edge.weight, edge.middle, edge.duration, ContractionHierarchy::Backward});
+    }
+}
+
+void Contractor::Remove(std::uint32_t v)
+{
+    auto erase_v = [v](std::vector<DynamicEdge> &edges) {
+        edges.erase(std::remove_if(edges.begin(), edges.end(), [v](auto &e){ return e.other == v; }), edges.end());
+    };
+    for( auto &edge: m_Out[v] )
+        erase_v(m_In[edge.other]);
+    for( auto &edge: m_In[v] )
+        erase_v(m_Out[edge.other]);
+    std::vector<DynamicEdge>{}.swap(m_Out[v]);
+    std::vector<DynamicEdge>{}.swap(m_In[v]);
+}
+
+}
+
+ContractionHierarchy::ContractionHierarchy(const RouteGraph &graph)
+{
+    ROUTEMS_TRACE_SCOPE("ch.build");
+    Contractor contractor{graph};
+    contractor.Run();
+
+    std::vector<std::uint32_t> offsets{0}, targets, middles;
+    std::vector<float> weights, durations;
+    std::vector<std::uint8_t> directions;
+    for( auto &edges: contractor.upward ) {
+        for( auto &edge: edges ) {
+            targets.push_back(edge.target);
+            weights.push_back(edge.weight);
+            durations.push_back(edge.duration);
+            middles.push_back(edge.middle);
+            directions.push_back(edge.directions);
+        }
+        offsets.push_back((std::uint32_t)targets.size());
+    }
+
+    m_Ranks = std::move(contractor.ranks);
+    m_Offsets = std::move(offsets);
+    m_Targets = std::move(targets);
+    m_Weights = std::move(weights);
+    m_Durations = std::move(durations);
+    m_Middles = std::move(middles);
+    m_Directions = std::move(directions);
+}
+
+ContractionHierarchy::ContractionHierarchy(const Snapshot &snapshot) :
+    m_Ranks(snapshot.Array<std::uint32_t>(Snapshot::CHRanks)),
+    m_Offsets(snapshot.Array<std::uint32_t>(Snapshot::CHOffsets)),
+    m_Targets(snapshot.Array<std::uint32_t>(Snapshot::CHTargets)),
+    m_Weights(snapshot.Array<float>(Snapshot::CHWeights)),
+    m_Durations(snapshot.Array<float>(Snapshot::CHDurations)),
+    m_Middles(snapshot.Array<std::uint32_t>(Snapshot::CHMiddles)),
+    m_Directions(snapshot.Array<std::uint8_t>(Snapshot::CHDirections))
+{
+    if( !m_Ranks.empty() && (m_Offsets.size() != m_Ranks.size() + 1 || m_Offsets[m_Ranks.size()] != m_Targets.size() ||
+        m_Weights.size() != m_Targets.size() || m_Durations.size() != m_Targets.size() || m_Middles.size() != m_Targets.size() || m_Directions.size() != m_Targets.size()) )
+        throw std::runtime_error("snapshot: malformed contraction hierarchy");
+
+    // queries index with these unchecked, like the graph's
+    const auto vertex_count = m_Ranks.size();
+    auto malformed = !m_Offsets.empty() && m_Offsets[0] != 0;
+    for( std::size_t v = 0; v < vertex_count && !malformed; ++v )
+        malformed = m_Offsets[v] > m_Offsets[v + 1];
+    for( std::size_t e = 0; e < m_Targets.size() && !malformed; ++e )
+        malformed = m_Targets[e] >= vertex_count ||
+                    (m_Middles[e] != RouteGraph::kNoVertex && m_Middles[e] >= vertex_count);
+    if( malformed )
+        throw std::runtime_error("snapshot: malformed contraction hierarchy");
+}
+
+void ContractionHierarchy::Serialize(SnapshotWriter &writer) const
+{
+    if( Empty() )
+        return;
+    writer.Add<std::uint32_t>(Snapshot::CHRanks, m_Ranks);
+    writer.Add<std::uint32_t>(Snapshot::CHOffsets, m_Offsets);
+    writer.Add<std::uint32_t>(Snapshot::CHTargets, m_Targets);
+    writer.Add<float>(Snapshot::CHWeights, m_Weights);
+    writer.Add<float>(Snapshot::CHDurations, m_Durations);
+    writer.Add<std::uint32_t>(Snapshot::CHMiddles, m_Middles);
+    writer.Add<std::uint8_t>(Snapshot::CHDirections, m_Directions);
+}
+
+std::uint32_t ContractionHierarchy::FindEdge(std::uint32_t at, std::uint32_t target, Direction d) const noexcept
+{
+    for( auto e = FirstEdge(at), last = FirstEdge(at + 1); e < last; ++e )
+        if( Target(e) == target && Has(e, d) )
+            return e;
+    return RouteGraph::kNoVertex;
+}
+
+// A shortcut from -> to via m was made when m was contracted, so both halves
+// are upward edges of m: from -> m stored Backward, m -> to stored Forward.
+void ContractionHierarchy::Unpack(std::uint32_t from, std::uint32_t to, std::uint32_t middle,
+                                  std::vector<std::uint32_t> &out) const
+{
+    if( middle == RouteGraph::kNoVertex ) {
+        out.push_back(to);
+        return;
+    }
+    auto first = FindEdge(middle, from, Backward);
+    auto second = FindEdge(middle, to, Forward);
+    if( first == RouteGraph::kNoVertex || second == RouteGraph::kNoVertex )
+        throw std::logic_error("contraction hierarchy: shortcut halves are missing");
+    Unpack(from, middle, Middle(first), out);
+    Unpack(middle, to, Middle(second), out);
+}
+
+std::vector<float> ContractionHierarchy::Durations(const RouteGraph &graph, Span<const float> seconds) const
+{
+    std::vector<std::uint32_t> order(VertexCount());
+    for( std::uint32_t v = 0; v < VertexCount(); ++v )
+        order[Rank(v)] = v;
+
+    // the halves of a shortcut are upward edges of its middle, which is ranked lower
+    std::vector<float> durations(EdgeCount());
+    for( auto v: order )
+        for( auto e = FirstEdge(v), last = FirstEdge(v + 1); e < last; ++e ) {
+            auto forward = Has(e, Forward);
+            auto from = forward ? v : Target(e), to = forward ? Target(e) : v;
+            if( Middle(e) != RouteGraph::kNoVertex ) {
+                auto first = FindEdge(Middle(e), from, Backward);
+                auto second = FindEdge(Middle(e), to, Forward);
+                if( first == RouteGraph::kNoVertex || second == RouteGraph::kNoVertex )
+                    throw std::logic_error("contraction hierarchy: shortcut halves are missing");
+                durations[e] = durations[first] + durations[second];
+                continue;
+            }
+            // the graph edge it was made from, the shortest if there are parallel ones
+            auto best = kInfinity;
+            durations[e] = kInfinity;
+            for( auto g = graph.FirstEdge(from), g_last = graph.FirstEdge(from + 1); g < g_last; ++g )
+                if( graph.Target(g) == to && CarProfile::kAccess[graph.Type(g)] && graph.Weight(g) < best ) {
+                    best = graph.Weight(g);
+                    durations[e] = seconds[g];
+                }
+        }
+    return durations;
+}
+
+CHQuery::CHQuery(const ContractionHierarchy &ch, const RouteGraph &graph) :
+    m_CH(ch),
+    m_Graph(graph)
+{
+    for( auto side: {&m_Forward, &m_Backward} ) {
+        side->open.Reserve(ch.VertexCount());
+        side->dist.assign(ch.VertexCount(), kInfinity);
+        side->parent_edge.assign(ch.VertexCount(), RouteGraph::kNoVertex);
+        side->parent.assign(ch.VertexCount(), RouteGraph::kNoVertex);
+    }
+}
+
+void CHQuery::Reset(Side &side)
+{
+    for( auto v: side.touched ) {
+        side.dist[v] = kInfinity;
+        side.parent_edge[v] = RouteGraph::kNoVertex;
+        side.parent[v] = RouteGraph::kNoVertex;
+    }
+    side.touched.clear();
+    side.open.Clear();
+}
+
+void CHQuery::Settle(Side &side, const Side &other, ContractionHierarchy::Direction d)
+{
+    auto v = side.open.Pop();
+    ++m_Settled;
+    instrument::Tally relaxed{instrument::EdgesRelaxed}, pushes{instrument::HeapPushes};
+    if( auto through = side.dist[v] + other.dist[v]; through < m_Best ) {
+        m_Best = through;
+        m_Meeting = v;
+    }
+    for( auto e = m_CH.FirstEdge(v), last = m_CH.FirstEdge(v + 1); e < last; ++e ) {
+        if( !m_CH.Has(e, d) )
+            continue;
+        auto w = m_CH.Target(e);
+        auto dist = side.dist[v] + m_CH.Weight(e);
+        ++relaxed;
+        if( !(dist < side.dist[w]) )
+            continue;
+        if( side.dist[w] == kInfinity )
+            side.touched.push_back(w);
+        side.dist[w] = dist;
+        side.parent[w] = v;
+        side.parent_edge[w] = e;
+        side.open.Push(w, dist);
+        ++pushes;
+    }
+}
+
+std::optional<Route> CHQuery::Search(std::uint32_t from, std::uint32_t to)
+{
+    ROUTEMS_TRACE_SCOPE("route.ch");
+    Reset(m_Forward);
+    Reset(m_Backward);
+    m_Best = kInfinity;
+    m_Meeting = RouteGraph::kNoVertex;
+    m_Settled = 0;
+
+    for( auto [side, root]: {std::pair{&m_Forward, from}, std::pair{&m_Backward, to}} ) {
+        side->dist[root] = 0.f;
+        side->touched.push_back(root);
+        side->open.Push(root, 0.f);
+    }
+
+    // a side is done once nothing it could still settle beats the best meeting point
+    for( bool forward_turn = true;; forward_turn = !forward_turn ) {
+        auto forward = !m_Forward.open.Empty() && m_Forward.open.TopKey() < m_Best;
+        auto backward = !m_Backward.open.Empty() && m_Backward.open.TopKey() < m_Best;
+        if( !forward && !backward )
+            break;
+        if( forward && (forward_turn || !backward) )
+            Settle(m_Forward, m_Backward, ContractionHierarchy::Forward);
+        else
+            Settle(m_Backward, m_Forward, ContractionHierarchy::Backward);
+    }
+    instrument::Add(instrument::NodesExpanded, m_Settled);
+    instrument::Add(instrument::HeapPops, m_Settled);
+    instrument::Add(instrument::HeapPushes, 2);
+    if( m_Meeting == RouteGraph::kNoVertex )
+        return std::nullopt;
+
+    std::vector<std::uint32_t> up;          // upward edges from `from` to the meeting vertex
+    for( auto v = m_Meeting; v != from; v = m_Forward.parent[v] )
+        up.push_back(v);
+    std::vector<std::uint32_t> vertices{from};
+    for( auto it = up.rbegin(); it != up.rend(); ++it )
+        m_CH.Unpack(m_Forward.parent[*it], *it, m_CH.Middle(m_Forward.parent_edge[*it]), vertices);
+    for( auto v = m_Meeting; v != to; v = m_Backward.parent[v] )
+        m_CH.Unpack(v, m_Backward.parent[v], m_CH.Middle(m_Backward.parent_edge[v]), vertices);
+
+    Route route;
+    route.distance = m_Best;
+    for( auto v: vertices )
+        route.nodes.push_back(m_Graph.ModelNode(v));
+    return route;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "flat_array.h"
+#include "open_list.h"
+#include "route_graph.h"
+#include "route.h"
+#include "span.h"
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// Contraction Hierarchy over the drivable part of a RouteGraph. Vertices are
+// contracted from least to most important; every vertex keeps its edges to
+// higher ranked vertices, shortcuts remember the contracted middle vertex so
+// routes can be unpacked into graph edges again.
+class ContractionHierarchy {
+public:
+    enum Direction : std::uint8_t { Forward = 1, Backward = 2 };
+
+    ContractionHierarchy() = default;
+    explicit ContractionHierarchy(const RouteGraph &graph);         // offline preprocessing, minutes on a state
+    explicit ContractionHierarchy(const Snapshot &snapshot);         // views into the snapshot
+
+    void Serialize(SnapshotWriter &writer) const;
+
+    bool Empty() const noexcept { return m_Ranks.empty(); }
+    std::uint32_t VertexCount() const noexcept { return static_cast<std::uint32_t>(m_Ranks.size()); }
+    std::uint32_t EdgeCount() const noexcept { return static_cast<std::uint32_t>(m_Targets.size()); }
+
+    // Upward edges of v are [FirstEdge(v), FirstEdge(v + 1)). A Forward edge
+    // runs v -> Target(e), a Backward edge Target(e) -> v.
+    std::uint32_t FirstEdge(std::uint32_t v) const noexcept { return m_Offsets[v]; }
+    std::uint32_t Target(std::uint32_t e) const noexcept { return m_Targets[e]; }
+    float Weight(std::uint32_t e) const noexcept { return m_Weights[e]; }
+    float Duration(std::uint32_t e) const noexcept { return m_Durations[e]; }       // seconds along the unpacked edge
+    std::uint32_t Middle(std::uint32_t e) const noexcept { return m_Middles[e]; }     // kNoVertex if not a shortcut
+    bool Has(std::uint32_t e, Direction d) const noexcept { return m_Directions[e] & d; }
+
+    std::uint32_t Rank(std::uint32_t v) const noexcept { return m_Ranks[v]; }
+
+    // Appends the graph vertices after `from` on the edge from -> to that runs via `middle`.
+    void Unpack(std::uint32_t from, std::uint32_t to, std::uint32_t middle, std::vector<std::uint32_t> &out) const;
+
+    // Customization: Duration() of every upward edge if graph edge e takes
+    // seconds[e]. Shortcuts keep the paths chosen by distance, only their
+    // travel times change; one pass over the edges in rank order.
+    std::vector<float> Durations(const RouteGraph &graph, Span<const float> seconds) const;
+
+private:
+    std::uint32_t FindEdge(std::uint32_t at, std::uint32_t target, Direction d) const noexcept;
+
+    FlatArray<std::uint32_t> m_Ranks;
+    FlatArray<std::uint32_t> m_Offsets;
+    FlatArray<std::uint32_t> m_Targets;
+    FlatArray<float> m_Weights;
+    FlatArray<float> m_Durations;
+    FlatArray<std::uint32_t> m_Middles;
+    FlatArray<std::uint8_t> m_Directions;
+};
+
+// Bidirectional upward Dijkstra on a ContractionHierarchy. Holds the search
+// state, so every thread needs its own query object.
+class CHQuery {
+public:
+    CHQuery(const ContractionHierarchy &ch, const RouteGraph &graph);
+
+    std::optional<Route> Search(std::uint32_t from, std::uint32_t to);      // graph vertices
+
+    std::size_t SettledNodes() const noexcept { return m_Settled; }        // by the last search
+
+private:
+    struct Side {
+        OpenList open;
+        std::vector<float> dist;
+        std::vector<std::uint32_t> parent_edge;     // upward edge that reached the vertex, kNoVertex at the root
+        std::vector<std::uint32_t> parent;
+        std::vector<std::uint32_t> touched;
+    };
+
+    void Reset(Side &side);
+    void Settle(Side &side, const Side &other, ContractionHierarchy::Direction d);
+
+    const ContractionHierarchy &m_CH;
+    const RouteGraph &m_Graph;
+    Side m_Forward;
+    Side m_Backward;
+    float m_Best = 0.f;
+    std::uint32_t m_Meeting = RouteGraph::kNoVertex;
+    std::size_t m_Settled = 0;
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "span.h"
+#include <utility>
+#include <vector>
+
+// Read-only array that either owns its elements or views memory owned
+// elsewhere, typically a mapped snapshot. Moving keeps the view valid because
+// a moved std::vector keeps its buffer.
+template <typename T>
+class FlatArray {
+public:
+    FlatArray() = default;
+    FlatArray(std::vector<T> owned) noexcept : m_Owned(std::move(owned)), m_View(m_Owned) {}
+    FlatArray(Span<const T> borrowed) noexcept : m_View(borrowed) {}
+    FlatArray(const FlatArray &) = delete;
+    FlatArray &operator=(const FlatArray &) = delete;
+    FlatArray(FlatArray &&) noexcept = default;
+    FlatArray &operator=(FlatArray &&) noexcept = default;
+
+    const T *data() const noexcept { return m_View.data(); }
+    std::size_t size() const noexcept { return m_View.size(); }
+    bool empty() const noexcept { return m_View.empty(); }
+    const T *begin() const noexcept { return m_View.begin(); }
+    const T *end() const noexcept { return m_View.end(); }
+    const T &operator[](std::size_t i) const noexcept { return m_View[i]; }
+    operator Span<const T>() const noexcept { return m_View; }
+
+    // Changes the elements through f(std::vector<T> &), a borrowed view is copied first.
+    template <typename F>
+    void Modify(F &&f) {
+        if( m_View.data() != m_Owned.data() )
+            m_Owned.assign(m_View.begin(), m_View.end());
+        f(m_Owned);
+        m_View = m_Owned;
+    }
+
+private:
+    std::vector<T> m_Owned;
+    Span<const T> m_View;
+};
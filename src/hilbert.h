@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+
+// Position of (x, y) along a Hilbert curve filling a 65536 x 65536 grid.
+inline std::uint64_t HilbertIndex(std::uint32_t x, std::uint32_t y)
+{
+    const std::uint32_t n = 1u << 16;
+    std::uint64_t d = 0;
+    for( std::uint32_t s = n / 2; s > 0; s /= 2 ) {
+        std::uint32_t rx = (x & s) > 0;
+        std::uint32_t ry = (y & s) > 0;
+        d += std::uint64_t{s} * s * ((3 * rx) ^ ry);
+        if( ry == 0 ) {
+            if( rx == 1 ) {
+                x = n - 1 - x;
+                y = n - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
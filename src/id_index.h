@@ -0,0 +1,81 @@
+#pragma once
+
+#include "flat_array.h"
+#include <algorithm>
+#include <cstdint>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// OSM id -> model index, kept so change files can be applied to a built
+// model. The ids known when the model was built are a sorted array searched
+// in place, possibly straight from a snapshot; ids added later go to a hash.
+class IdIndex {
+public:
+    IdIndex() = default;
+    IdIndex(FlatArray<std::int64_t> ids, FlatArray<std::int32_t> indices) noexcept :     // ids ascending
+        m_Ids(std::move(ids)), m_Indices(std::move(indices)) {}
+
+    explicit IdIndex(std::vector<std::pair<std::int64_t, std::int32_t>> entries) {     // any order
+        if( !std::is_sorted(entries.begin(), entries.end()) )
+            std::sort(entries.begin(), entries.end());
+        std::vector<std::int64_t> ids(entries.size());
+        std::vector<std::int32_t> indices(entries.size());
+        for( std::size_t i = 0; i < entries.size(); ++i )
+            std::tie(ids[i], indices[i]) = entries[i];
+        m_Ids = std::move(ids);
+        m_Indices = std::move(indices);
+    }
+
+    bool Empty() const noexcept { return m_Ids.empty() && m_Added.empty(); }
+
+    int Find(std::int64_t id) const noexcept {              // -1 if unknown
+        auto it = std::lower_bound(m_Ids.begin(), m_Ids.end(), id);
+        if( it != m_Ids.end() && *it == id )
+            return m_Indices[it - m_Ids.begin()];
+        auto added = m_Added.find(id);
+        return added == m_Added.end() ? -1 : added->second;
+    }
+
+    void Add(std::int64_t id, int index) { m_Added[id] = index; }
+
+    // Renumbers the indices to remap[index], entries mapped to -1 are dropped.
+    void Remap(const std::vector<int> &remap) {
+        std::vector<std::int64_t> ids;
+        std::vector<std::int32_t> indices;
+        for( std::size_t i = 0; i < m_Ids.size(); ++i )
+            if( auto index = remap[m_Indices[i]]; index >= 0 ) {
+                ids.push_back(m_Ids[i]);
+                indices.push_back(index);
+            }
+        m_Ids = std::move(ids);
+        m_Indices = std::move(indices);
+        for( auto it = m_Added.begin(); it != m_Added.end(); )
+            if( (it->second = remap[it->second]) < 0 )
+                it = m_Added.erase(it);
+            else
+                ++it;
+    }
+
+    // Every entry in id order, as written to a snapshot.
+    std::pair<std::vector<std::int64_t>, std::vector<std::int32_t>> Sorted() const {
+        std::vector<std::pair<std::int64_t, std::int32_t>> entries;
+        entries.reserve(m_Ids.size() + m_Added.size());
+        for( std::size_t i = 0; i < m_Ids.size(); ++i )
+            entries.emplace_back(m_Ids[i], m_Indices[i]);
+        entries.insert(entries.end(), m_Added.begin(), m_Added.end());
+        std::sort(entries.begin(), entries.end());
+        std::pair<std::vector<std::int64_t>, std::vector<std::int32_t>> sorted;
+        for( auto [id, index]: entries ) {
+            sorted.first.push_back(id);
+            sorted.second.push_back(index);
+        }
+        return sorted;
+    }
+
+private:
+    FlatArray<std::int64_t> m_Ids;
+    FlatArray<std::int32_t> m_Indices;
+    std::unordered_map<std::int64_t, std::int32_t> m_Added;
+};
@@ -0,0 +1,218 @@
+#include "instrument.h"
+
+#ifdef ROUTEMS_INSTRUMENT
+
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace instrument {
+
+namespace {
+
+constexpr std::uint32_t kMaxSites = 64;             // later sites are not recorded
+constexpr std::size_t kBuckets = 24;                // bucket b: below 2^b microseconds, the last one the rest
+constexpr std::size_t kTraceCapacity = 1 << 16;     // spans per thread
+
+constexpr const char *kCounterNames[kCounterCount] = {
+    "routems_nodes_expanded_total", "routems_edges_relaxed_total", "routems_heap_pushes_total",
+    "routems_heap_pops_total", "routems_vertices_drawn_total", "routems_route_cache_hits_total",
+    "routems_route_cache_misses_total",
+};
+
+struct Histogram {
+    std::array<std::atomic<std::uint64_t>, kBuckets> buckets{};
+    std::atomic<std::uint64_t> count{0};
+    std::atomic<std::uint64_t> nanos{0};
+};
+
+struct Span {
+    std::uint32_t site;
+    std::int64_t start;         // nanoseconds since the registry was made
+    std::int64_t end;
+};
+
+// Written by its thread only, read by the exporters.
+struct ThreadData {
+    std::uint32_t tid = 0;
+    std::array<std::atomic<std::uint64_t>, kCounterCount> counters{};
+    std::array<Histogram, kMaxSites> histograms;
+    std::unique_ptr<Span[]> spans;          // allocated when the thread records its first span
+    std::atomic<std::size_t> span_count{0};
+};
+
+struct Registry {
+    std::mutex lock;                        // guards threads and the site names
+    std::vector<std::unique_ptr<ThreadData>> threads;       // kept after the thread ends, its counts stay
+    std::array<const char *, kMaxSites> names{};
+    std::atomic<std::uint32_t> sites{0};
+    std::atomic<bool> tracing{false};
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+};
+
+Registry &Global()
+{
+    static auto registry = new Registry;    // never destroyed, threads may record during static destruction
+    return *registry;
+}
+
+ThreadData &Local()
+{
+    thread_local ThreadData *data = []{
+        auto &registry = Global();
+        std::lock_guard lock{registry.lock};
+        auto &added = registry.threads.emplace_back(std::make_unique<ThreadData>());
+        added->tid = static_cast<std::uint32_t>(registry.threads.size());
+        return added.get();
+    }();
+    return *data;
+}
+
+// Only the owning thread writes, a plain load and store is enough.
+void Bump(std::atomic<std::uint64_t> &value, std::uint64_t n) noexcept
+{
+    value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+std::size_t Bucket(std::uint64_t nanos) noexcept
+{
+    std::size_t bucket = 0;
+    for( auto micros = nanos / 1000; micros != 0 && bucket + 1 < kBuckets; micros >>= 1 )
+        ++bucket;
+    return bucket;
+}
+
+std::string Escape(const char *name)
+{
+    std::string escaped;
+    for( ; *name; ++name ) {
+        if( *name == '"' || *name == '\\' )
+            escaped += '\\';
+        escaped += *name;
+    }
+    return escaped;
+}
+
+}
+
+Site::Site(const char *name) noexcept
+{
+    auto &registry = Global();
+    std::lock_guard lock{registry.lock};
+    auto count = registry.sites.load(std::memory_order_relaxed);
+    for( m_Id = 0; m_Id < count; ++m_Id )
+        if( std::strcmp(registry.names[m_Id], name) == 0 )
+            return;
+    if( count < kMaxSites ) {
+        registry.names[count] = name;
+        registry.sites.store(count + 1, std::memory_order_release);
+    }
+}
+
+void Record(std::uint32_t site, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) noexcept
+{
+    if( site >= kMaxSites )
+        return;
+    auto &data = Local();
+    auto nanos = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    auto &histogram = data.histograms[site];
+    Bump(histogram.buckets[Bucket(nanos)], 1);
+    Bump(histogram.count, 1);
+    Bump(histogram.nanos, nanos);
+
+    auto &registry = Global();
+    if( !registry.tracing.load(std::memory_order_relaxed) )
+        return;
+    auto count = data.span_count.load(std::memory_order_relaxed);
+    if( count == kTraceCapacity )
+        return;
+    if( !data.spans ) {
+        std::lock_guard lock{registry.lock};            // once per thread, the exporter reads the pointer under the lock
+        data.spans.reset(new (std::nothrow) Span[kTraceCapacity]);
+        if( !data.spans )
+            return;
+    }
+    auto since = [&](auto t) { return std::chrono::duration_cast<std::chrono::nanoseconds>(t - registry.epoch).count(); };
+    data.spans[count] = {site, since(start), since(end)};
+    data.span_count.store(count + 1, std::memory_order_release);
+}
+
+void Add(Counter counter, std::uint64_t n) noexcept
+{
+    if( n != 0 )
+        Bump(Local().counters[counter], n);
+}
+
+void StartTrace() noexcept
+{
+    Global().tracing.store(true, std::memory_order_relaxed);
+}
+
+void WriteChromeTrace(std::ostream &out)
+{
+    auto &registry = Global();
+    std::lock_guard lock{registry.lock};
+    auto flags = out.flags();
+    auto precision = out.precision(3);              // microseconds to the nanosecond
+    out << std::fixed << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    auto first = true;
+    for( auto &thread: registry.threads ) {
+        auto count = thread->span_count.load(std::memory_order_acquire);
+        for( std::size_t i = 0; i < count; ++i ) {
+            auto &span = thread->spans[i];
+            out << (first ? "" : ",") << "\n{\"name\":\"" << Escape(registry.names[span.site])
+                << "\",\"cat\":\"routems\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread->tid
+                << ",\"ts\":" << span.start / 1000.0 << ",\"dur\":" << (span.end - span.start) / 1000.0 << '}';
+            first = false;
+        }
+    }
+    out << "\n]}\n";
+    out.flags(flags);
+    out.precision(precision);
+}
+
+void WritePrometheus(std::ostream &out)
+{
+    auto &registry = Global();
+    std::lock_guard lock{registry.lock};
+
+    for( std::size_t counter = 0; counter < kCounterCount; ++counter ) {
+        std::uint64_t total = 0;
+        for( auto &thread: registry.threads )
+            total += thread->counters[counter].load(std::memory_order_relaxed);
+        out << "# TYPE " << kCounterNames[counter] << " counter\n" << kCounterNames[counter] << ' ' << total << '\n';
+    }
+
+    out << "# TYPE routems_scope_seconds histogram\n";
+    auto sites = registry.sites.load(std::memory_order_acquire);
+    for( std::uint32_t site = 0; site < sites; ++site ) {
+        std::array<std::uint64_t, kBuckets> buckets{};
+        std::uint64_t count = 0, nanos = 0;
+        for( auto &thread: registry.threads ) {
+            auto &histogram = thread->histograms[site];
+            for( std::size_t b = 0; b < kBuckets; ++b )
+                buckets[b] += histogram.buckets[b].load(std::memory_order_relaxed);
+            count += histogram.count.load(std::memory_order_relaxed);
+            nanos += histogram.nanos.load(std::memory_order_relaxed);
+        }
+        auto label = "{scope=\"" + Escape(registry.names[site]) + "\"";
+        std::uint64_t cumulative = 0;
+        for( std::size_t b = 0; b + 1 < kBuckets; ++b ) {
+            cumulative += buckets[b];
+            out << "routems_scope_seconds_bucket" << label << ",le=\"" << static_cast<double>(1ull << b) * 1e-6 << "\"} " << cumulative << '\n';
+        }
+        out << "routems_scope_seconds_bucket" << label << ",le=\"+Inf\"} " << count << '\n';
+        out << "routems_scope_seconds_sum" << label << "} " << static_cast<double>(nanos) * 1e-9 << '\n';
+        out << "routems_scope_seconds_count" << label << "} " << count << '\n';
+    }
+}
+
+}
+
+#endif
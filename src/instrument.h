@@ -0,0 +1,107 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+// Instrumentation of the hot paths: scoped timers that feed a latency
+// histogram per scope and, once StartTrace() was called, a per-thread span
+// log, plus per-thread event counters. Every thread writes only its own
+// counters, without locks or atomic read-modify-writes; the exporters sum
+// over the threads. Counters and histograms go out in the Prometheus text
+// format, spans as Chrome trace JSON (chrome://tracing, Perfetto).
+//
+// Only built with ROUTEMS_INSTRUMENT defined, the CMake option of the same
+// name. Otherwise the timers, tallies and exporters below are empty inline
+// functions and compile to nothing, so the calls stay in production code.
+namespace instrument {
+
+enum Counter : std::uint8_t {
+    NodesExpanded,          // vertices settled by a search
+    EdgesRelaxed,           // edges scanned from settled vertices
+    HeapPushes,             // open list inserts and decrease keys
+    HeapPops,
+    VerticesDrawn,          // path points handed to the renderer
+    RouteCacheHits,         // queries answered from the route cache
+    RouteCacheMisses,
+    kCounterCount
+};
+
+#ifdef ROUTEMS_INSTRUMENT
+
+constexpr bool kEnabled = true;
+
+// An instrumented scope, registered on first use. Sites with the same name
+// share one histogram. Names must be string literals.
+class Site {
+public:
+    explicit Site(const char *name) noexcept;
+    std::uint32_t Id() const noexcept { return m_Id; }
+
+private:
+    std::uint32_t m_Id;
+};
+
+void Record(std::uint32_t site, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) noexcept;
+void Add(Counter counter, std::uint64_t n) noexcept;
+
+class ScopedTimer {
+public:
+    explicit ScopedTimer(const Site &site) noexcept : m_Site(site.Id()), m_Start(std::chrono::steady_clock::now()) {}
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+    ~ScopedTimer() { Record(m_Site, m_Start, std::chrono::steady_clock::now()); }
+
+private:
+    std::uint32_t m_Site;
+    std::chrono::steady_clock::time_point m_Start;
+};
+
+// Counts in a local inside a hot loop and adds the total to the thread's
+// counter once, when it goes out of scope.
+class Tally {
+public:
+    explicit Tally(Counter counter) noexcept : m_Counter(counter) {}
+    Tally(const Tally &) = delete;
+    Tally &operator=(const Tally &) = delete;
+    ~Tally() { Add(m_Counter, m_Count); }
+
+    Tally &operator++() noexcept { ++m_Count; return *this; }
+    Tally &operator+=(std::uint64_t n) noexcept { m_Count += n; return *this; }
+
+private:
+    Counter m_Counter;
+    std::uint64_t m_Count = 0;
+};
+
+void StartTrace() noexcept;                     // keep spans from now on, up to 65536 per thread
+void WriteChromeTrace(std::ostream &out);       // the spans so far; call when the traced threads are idle
+void WritePrometheus(std::ostream &out);        // counters and histograms, any time
+
+#define ROUTEMS_INSTRUMENT_CONCAT_(a, b) a##b
+#define ROUTEMS_INSTRUMENT_CONCAT(a, b) ROUTEMS_INSTRUMENT_CONCAT_(a, b)
+#define ROUTEMS_TRACE_SCOPE(name) \
+    static const ::instrument::Site ROUTEMS_INSTRUMENT_CONCAT(routems_site_, __LINE__){name}; \
+    ::instrument::ScopedTimer ROUTEMS_INSTRUMENT_CONCAT(routems_timer_, __LINE__){ROUTEMS_INSTRUMENT_CONCAT(routems_site_, __LINE__)}
+
+#else
+
+constexpr bool kEnabled = false;
+
+class Tally {
+public:
+    explicit constexpr Tally(Counter) noexcept {}
+    constexpr Tally &operator++() noexcept { return *this; }
+    constexpr Tally &operator+=(std::uint64_t) noexcept { return *this; }
+};
+
+inline void Add(Counter, std::uint64_t) noexcept {}
+inline void StartTrace() noexcept {}
+inline void WriteChromeTrace(std::ostream &out) { out << "{\"traceEvents\":[]}\n"; }
+inline void WritePrometheus(std::ostream &) {}
+
+#define ROUTEMS_TRACE_SCOPE(name) static_cast<void>(0)
+
+#endif
+
+}
@@ -0,0 +1,205 @@
+#include "landmarks.h"
+#include "open_list.h"
+#include "profile.h"
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+// Stands in for infinity in the tables: the bounds stay finite, and a vertex
+// a landmark can't reach gives 1e30 - d, correctly saying the goal is out of
+// reach, or a negative term that the max ignores.
+constexpr float kUnreachable = 1e30f;
+
+bool Open(const RouteGraph &graph, std::uint32_t e) noexcept
+{
+    return CarProfile::kAccess[graph.Type(e)];
+}
+
+// Reverse CSR of the open edges, for the distances to a landmark.
+struct Reverse {
+    std::vector<std::uint32_t> offsets;
+    std::vector<std::uint32_t> sources;
+    std::vector<float> weights;
+};
+
+Reverse ReverseGraph(const RouteGraph &graph)
+{
+    Reverse reverse;
+    reverse.offsets.assign(graph.VertexCount() + 1, 0);
+    for( std::uint32_t e = 0; e < graph.EdgeCount(); ++e )
+        if( Open(graph, e) )
+            ++reverse.offsets[graph.Target(e) + 1];
+    for( std::uint32_t v = 0; v < graph.VertexCount(); ++v )
+        reverse.offsets[v + 1] += reverse.offsets[v];
+    auto next = reverse.offsets;
+    reverse.sources.resize(reverse.offsets.back());
+    reverse.weights.resize(reverse.offsets.back());
+    for( std::uint32_t v = 0; v < graph.VertexCount(); ++v )
+        for( auto e = graph.FirstEdge(v), last = graph.FirstEdge(v + 1); e < last; ++e )
+            if( Open(graph, e) ) {
+                auto slot = next[graph.Target(e)]++;
+                reverse.sources[slot] = v;
+                reverse.weights[slot] = graph.Weight(e);
+            }
+    return reverse;
+}
+
+// Every open edge has an open twin of the same weight in the other direction.
+bool Symmetric(const RouteGraph &graph)
+{
+    for( std::uint32_t v = 0; v < graph.VertexCount(); ++v )
+        for( auto e = graph.FirstEdge(v), last = graph.FirstEdge(v + 1); e < last; ++e ) {
+            if( !Open(graph, e) )
+                continue;
+            auto w = graph.Target(e);
+            auto twin = false;
+            for( auto r = graph.FirstEdge(w), r_last = graph.FirstEdge(w + 1); r < r_last && !twin; ++r )
+                twin = graph.Target(r) == v && Open(graph, r) && graph.Weight(r) == graph.Weight(e);
+            if( !twin )
+                return false;
+        }
+    return true;
+}
+
+// Any vertex of the largest weakly connected component, where the landmarks go.
+std::uint32_t LargestComponentVertex(const RouteGraph &graph, const Reverse *reverse)
+{
+    std::vector<bool> seen(graph.VertexCount(), false);
+    std::vector<std::uint32_t> stack;
+    std::size_t best_size = 0;
+    std::uint32_t best = 0;
+    for( std::uint32_t root = 0; root < graph.VertexCount(); ++root ) {
+        if( seen[root] )
+            continue;
+        std::size_t size = 0;
+        seen[root] = true;
+        stack.push_back(root);
+        while( !stack.empty() ) {
+            auto v = stack.back();
+            stack.pop_back();
+            ++size;
+            auto visit = [&](std::uint32_t w) {
+                if( !seen[w] ) {
+                    seen[w] = true;
+                    stack.push_back(w);
+                }
+            };
+            for( auto e = graph.FirstEdge(v), last = graph.FirstEdge(v + 1); e < last; ++e )
+                if( Open(graph, e) )
+                    visit(graph.Target(e));
+            if( reverse )
+                for( auto i = reverse->offsets[v]; i < reverse->offsets[v + 1]; ++i )
+                    visit(reverse->sources[i]);
+        }
+        if( size > best_size ) {
+            best_size = size;
+            best = root;
+        }
+    }
+    return best;
+}
+
+// Dijkstra from root over the open edges, or over the reverse graph towards root.
+void ShortestDistances(const RouteGraph &graph, const Reverse *reverse, std::uint32_t root,
+                       IndexedHeap &heap, std::vector<float> &dist)
+{
+    dist.assign(graph.VertexCount(), kUnreachable);
+    heap.Clear();
+    dist[root] = 0.f;
+    heap.Push(root, 0.f);
+    while( !heap.Empty() ) {
+        auto v = heap.Pop();
+        auto relax = [&](std::uint32_t w, float weight) {
+            auto d = dist[v] + weight;
+            if( d < dist[w] ) {
+                dist[w] = d;
+                heap.Push(w, d);
+            }
+        };
+        if( reverse ) {
+            for( auto i = reverse->offsets[v]; i < reverse->offsets[v + 1]; ++i )
+                relax(reverse->sources[i], reverse->weights[i]);
+        } else {
+            for( auto e = graph.FirstEdge(v), last = graph.FirstEdge(v + 1); e < last; ++e )
+                if( Open(graph, e) )
+                    relax(graph.Target(e), graph.Weight(e));
+        }
+    }
+}
+
+}
+
+Landmarks::Landmarks(const RouteGraph &graph, std::size_t count)
+{
+    auto vertex_count = graph.VertexCount();
+    if( vertex_count == 0 || count == 0 )
+        return;
+    std::optional<Reverse> reverse;
+    if( !Symmetric(graph) )
+        reverse = ReverseGraph(graph);
+
+    IndexedHeap heap{vertex_count};
+    std::vector<float> dist;
+    std::vector<std::uint32_t> chosen;
+    std::vector<std::vector<float>> from, to;
+
+    // the first landmark is the vertex farthest from an arbitrary start, every
+    // next one the vertex whose nearest landmark is farthest away
+    ShortestDistances(graph, nullptr, LargestComponentVertex(graph, reverse ? &*reverse : nullptr), heap, dist);
+    std::vector<float> nearest(vertex_count, kUnreachable);
+    while( chosen.size() < count ) {
+        std::uint32_t next = 0;
+        auto farthest = 0.f;
+        for( std::uint32_t v = 0; v < vertex_count; ++v ) {
+            auto d = chosen.empty() ? dist[v] : nearest[v];
+            if( d < kUnreachable && d > farthest ) {
+                farthest = d;
+                next = v;
+            }
+        }
+        if( farthest == 0.f )
+            break;          // fewer reachable vertices than landmarks
+        chosen.push_back(next);
+        ShortestDistances(graph, nullptr, next, heap, dist);
+        for( std::uint32_t v = 0; v < vertex_count; ++v )
+            nearest[v] = std::min(nearest[v], dist[v]);
+        from.push_back(dist);
+        if( reverse ) {
+            ShortestDistances(graph, &*reverse, next, heap, dist);
+            to.push_back(dist);
+        }
+    }
+
+    auto interleave = [&](const std::vector<std::vector<float>> &tables) {
+        std::vector<float> rows(std::size_t{vertex_count} * chosen.size());
+        for( std::size_t i = 0; i < tables.size(); ++i )
+            for( std::uint32_t v = 0; v < vertex_count; ++v )
+                rows[v * chosen.size() + i] = tables[i][v];
+        return rows;
+    };
+    m_From = interleave(from);
+    if( reverse )
+        m_To = interleave(to);
+    m_Vertices = std::move(chosen);
+}
+
+Landmarks::Landmarks(const Snapshot &snapshot) :
+    m_Vertices(snapshot.Array<std::uint32_t>(Snapshot::LandmarkVertices)),
+    m_From(snapshot.Array<float>(Snapshot::LandmarkFrom)),
+    m_To(snapshot.Array<float>(Snapshot::LandmarkTo))
+{
+    if( !m_Vertices.empty() && (m_From.size() % m_Vertices.size() != 0 || (!m_To.empty() && m_To.size() != m_From.size())) )
+        throw std::runtime_error("snapshot: malformed landmark tables");
+}
+
+void Landmarks::Serialize(SnapshotWriter &writer) const
+{
+    if( Empty() )
+        return;
+    writer.Add<std::uint32_t>(Snapshot::LandmarkVertices, m_Vertices);
+    writer.Add<float>(Snapshot::LandmarkFrom, m_From);
+    if( !m_To.empty() )
+        writer.Add<float>(Snapshot::LandmarkTo, m_To);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "flat_array.h"
+#include "route_graph.h"
+#include "snapshot.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+// ALT landmarks: exact road distances between a few landmark vertices and
+// every vertex, over the roads CarProfile may use. By the triangle inequality
+// d(v, t) >= d(L, t) - d(L, v) and d(v, t) >= d(v, L) - d(t, L) for every
+// landmark L, which bounds the distance to the goal far tighter than the
+// straight line where the roads detour, around water or through a grid.
+//
+// Landmarks are picked by farthest point selection, each one the vertex
+// farthest by road from those already chosen, which puts them on the edge
+// of the map. Tables are vertex major, the rows of one vertex are one or two
+// cache lines. Distances to the landmarks are only stored when the graph is
+// not symmetric, otherwise they equal the distances from them.
+class Landmarks {
+public:
+    static constexpr std::size_t kDefaultCount = 16;
+
+    Landmarks() = default;
+    Landmarks(const RouteGraph &graph, std::size_t count = kDefaultCount);     // one Dijkstra per landmark and direction
+    explicit Landmarks(const Snapshot &snapshot);        // views into the snapshot
+
+    void Serialize(SnapshotWriter &writer) const;
+
+    bool Empty() const noexcept { return m_Vertices.empty(); }
+    std::size_t Count() const noexcept { return m_Vertices.size(); }
+    std::size_t VertexCount() const noexcept { return Empty() ? 0 : m_From.size() / Count(); }       // of the graph
+    std::uint32_t Vertex(std::size_t i) const noexcept { return m_Vertices[i]; }
+
+    // Lower bound in metres on the road distance from v to t.
+    float LowerBound(std::uint32_t v, std::uint32_t t) const noexcept {
+        auto count = Count();
+        auto from_v = &m_From[v * count], from_t = &m_From[t * count];
+        auto to = m_To.empty() ? m_From.data() : m_To.data();
+        auto to_v = &to[v * count], to_t = &to[t * count];
+        float bound = 0.f;
+        for( std::size_t i = 0; i < count; ++i )
+            bound = std::max({bound, from_t[i] - from_v[i], to_v[i] - to_t[i]});
+        return bound;
+    }
+
+private:
+    FlatArray<std::uint32_t> m_Vertices;
+    FlatArray<float> m_From;        // [v * Count() + i] = d(landmark i, v)
+    FlatArray<float> m_To;          // [v * Count() + i] = d(v, landmark i), empty if the same as m_From
+};
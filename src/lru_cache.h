@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+// Map that keeps its capacity most recently used entries. Not synchronized.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class LruCache {
+public:
+    explicit LruCache(std::size_t capacity = 0) : m_Capacity(capacity) {}
+
+    std::size_t Size() const noexcept { return m_Index.size(); }
+    std::size_t Capacity() const noexcept { return m_Capacity; }
+
+    void SetCapacity(std::size_t capacity) {
+        m_Capacity = capacity;
+        Trim();
+    }
+
+    // Marks the entry as most recently used, nullptr if it isn't cached.
+    const Value *Find(const Key &key) {
+        auto it = m_Index.find(key);
+        if( it == m_Index.end() )
+            return nullptr;
+        m_Entries.splice(m_Entries.begin(), m_Entries, it->second);
+        return &it->second->second;
+    }
+
+    bool Contains(const Key &key) const { return m_Index.count(key) > 0; }
+
+    void Insert(const Key &key, Value value) {
+        if( auto it = m_Index.find(key); it != m_Index.end() ) {
+            it->second->second = std::move(value);
+            m_Entries.splice(m_Entries.begin(), m_Entries, it->second);
+            return;
+        }
+        m_Entries.emplace_front(key, std::move(value));
+        m_Index.emplace(key, m_Entries.begin());
+        Trim();
+    }
+
+    template <typename Predicate>
+    void EraseIf(Predicate predicate) {             // predicate(key, value)
+        for( auto it = m_Entries.begin(); it != m_Entries.end(); ) {
+            if( !predicate(it->first, it->second) ) {
+                ++it;
+                continue;
+            }
+            m_Index.erase(it->first);
+            it = m_Entries.erase(it);
+        }
+    }
+
+    void Clear() {
+        m_Entries.clear();
+        m_Index.clear();
+    }
+
+private:
+    using Entry = std::pair<Key, Value>;
+
+    void Trim() {
+        while( m_Index.size() > m_Capacity ) {
+            m_Index.erase(m_Entries.back().first);
+            m_Entries.pop_back();
+        }
+    }
+
+    std::size_t m_Capacity;
+    std::list<Entry> m_Entries;         // most recently used first
+    std::unordered_map<Key, typename std::list<Entry>::iterator, Hash> m_Index;
+};
@@ -1,45 +1,306 @@
+#include <algorithm>
+#include <csignal>
 #include <cstdlib>
 #include <ctime>
-#include <optional>
+#include <exception>
+#include <filesystem>
 #include <fstream>
+#include <optional>
 #include <iostream>
 #include <set>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
-#include <opencv2/core.hpp>
+#include <pthread.h>
+#include "instrument.h"
+#include "osc_reader.h"
+#include "route_model.h"
+#include "route_planner.h"
+#include "route_server.h"
+#include "snapshot.h"
+#include "traffic.h"
+#ifdef ROUTEMS_WITH_IO2D
+#include "batch_render.h"
+#endif
 
 
-static std::optional<std::vector<std::byte>> ReadFile(const std::string &path) {
-    std::ifstream is{path, std::ios::binary | std::ios::ate};       // ate sets file pointer to end of file
+// Writes the spans recorded since StartTrace() on every way out of main().
+struct TraceWriter {
+    std::string path;
+    ~TraceWriter() {
+        if(path.empty())
+            return;
+        std::ofstream out{path};
+        instrument::WriteChromeTrace(out);
+        std::cout << "Trace written to " << path << (instrument::kEnabled ? "" : " (built without ROUTEMS_INSTRUMENT, no spans)") << std::endl;
+    }
+};
 
-    if(!is)
-        return std::nullopt;        // absence of value
-    
-    auto size = is.tellg();         // current position of get pointer
-    std::vector<std::byte> contents(size);
+int main(int argc, const char **argv) {
+    std::string osm_data_file = "../new-york-latest.osm.pbf";
+    std::string snapshot_file;          // load a prebuilt model instead of parsing the extract
+    std::string export_file;            // write the built model as a snapshot and exit
+    std::string ingest_dir;             // stream the extract, keeping the node index on disk here
+    std::vector<std::string> diff_files;        // osmChange diffs applied to the loaded model, in order
+    bool build_ch = false;              // contract the graph before exporting
+    int landmarks = 0;                  // ALT landmarks to select before exporting
+    bool compact_geometry = false;      // quantized way coordinates, exported and drawn from
+    bool use_astar = false;             // route with the reference A* even if a hierarchy is loaded
+    std::string traffic_file;           // live speeds, routes are then the fastest ones
+    std::string profile;                // car, bike or foot: the fastest route at the profile's speeds
+    int serve_port = -1;                // answer queries over TCP instead of prompting
+    unsigned threads = std::thread::hardware_concurrency();
+    std::size_t cached_routes = RouteCache::kDefaultCapacity;
+    std::string trips_file;             // render one PNG per start/end pair instead of prompting
+    std::string output_dir = ".";
+    std::string trace_file;             // Chrome trace JSON of the instrumented scopes, written on exit
+#ifdef ROUTEMS_WITH_IO2D
+    int image_width = 1024, image_height = 1024;
+#endif
 
-    is.seekg(0);        // set pointer to beginning of stream
-    is.read((char*)contents.data(), size);           // read data into contents vector
+    for(int i = 1; i < argc; ++i) {
+        std::string_view arg{argv[i]};
+        if(arg == "-f" && i + 1 < argc)
+            osm_data_file = argv[++i];
+        else if(arg == "-s" && i + 1 < argc)
+            snapshot_file = argv[++i];
+        else if(arg == "--export-snapshot" && i + 1 < argc)
+            export_file = argv[++i];
+        else if(arg == "--ingest-dir" && i + 1 < argc)
+            ingest_dir = argv[++i];
+        else if(arg == "--apply-diff" && i + 1 < argc)
+            diff_files.push_back(argv[++i]);
+        else if(arg == "--build-ch")
+            build_ch = true;
+        else if(arg == "--build-landmarks" && i + 1 < argc)
+            landmarks = std::max(std::atoi(argv[++i]), 0);
+        else if(arg == "--compact-geometry")
+            compact_geometry = true;
+        else if(arg == "--astar")
+            use_astar = true;
+        else if(arg == "--traffic" && i + 1 < argc)
+            traffic_file = argv[++i];
+        else if(arg == "--profile" && i + 1 < argc)
+            profile = argv[++i];
+        else if(arg == "--serve" && i + 1 < argc)
+            serve_port = std::atoi(argv[++i]);
+        else if(arg == "--threads" && i + 1 < argc)
+            threads = std::max(std::atoi(argv[++i]), 1);
+        else if(arg == "--route-cache" && i + 1 < argc)
+            cached_routes = std::strtoull(argv[++i], nullptr, 10);
+        else if(arg == "--render-batch" && i + 1 < argc)
+            trips_file = argv[++i];
+        else if(arg == "--trace" && i + 1 < argc)
+            trace_file = argv[++i];
+        else if(arg == "--out" && i + 1 < argc)
+            output_dir = argv[++i];
+#ifdef ROUTEMS_WITH_IO2D
+        else if(arg == "--size" && i + 2 < argc) {          // without io2d it falls through to the usage
+            image_width = std::max(std::atoi(argv[++i]), 1);
+            image_height = std::max(std::atoi(argv[++i]), 1);
+        }
+#endif
+        else {
+            std::cout << "Usage: [executable] [-f filename.osm.pbf [--ingest-dir dir]] [-s snapshot] [--apply-diff file.osc ...] [--export-snapshot snapshot [--build-ch] [--build-landmarks n]] [--compact-geometry] [--astar] [--traffic speeds.txt | --profile car|bike|foot] [--serve port [--threads n] [--route-cache routes]] [--render-batch trips [--out dir] [--size w h]] [--trace file.json]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
 
-    if (contents.empty())
-        return std::nullopt;
-    return std::move(contents);
-}
+    TraceWriter trace_writer{trace_file};
+    if(!trace_file.empty())
+        instrument::StartTrace();
 
-int main() {
-    std::string osm_data_file = "../new-york-latest.osm.pbf";
+    std::optional<RouteModel> model;
+    try {
+        if(!snapshot_file.empty()) {
+            std::cout << "Loading snapshot: " << snapshot_file << std::endl;
+            auto snapshot = Snapshot::Open(snapshot_file);
+            if(!snapshot) {
+                std::cout << "Failed to open snapshot (missing, truncated or written by another version)." << std::endl;
+                return EXIT_FAILURE;
+            }
+            model.emplace(std::move(*snapshot));
+        } else if(!osm_data_file.empty()) {
+            std::cout << "Reading OSP data from the following file: " <<  osm_data_file << std::endl;
+            std::error_code error;
+            if(!std::filesystem::is_regular_file(osm_data_file, error)) {
+                std::cout << "Failed to read." << std::endl;
+                return EXIT_FAILURE;
+            }
+            if(ingest_dir.empty())
+                model.emplace(std::filesystem::path{osm_data_file});     // reads ahead with io_uring while the blocks decode in parallel
+            else
+                model.emplace(std::filesystem::path{osm_data_file}, ingest_dir);     // bounded memory, the node index lives on disk
+        } else {
+            return EXIT_FAILURE;
+        }
+    } catch(const std::exception &e) {
+        std::cout << "Failed to load: " << e.what() << std::endl;       // malformed extract or snapshot
+        return EXIT_FAILURE;
+    }
+    std::cout << "Loaded " << model->Nodes().size() << " nodes, " << model->Ways().size() << " ways, "
+              << model->Roads().size() << " roads." << std::endl;
 
-    std::vector<std::byte> osm_data;
+    for(auto &diff_file : diff_files) {
+        auto xml = ReadOsmChangeFile(diff_file);
+        if(!xml) {
+            std::cout << "Failed to read diff: " << diff_file << std::endl;
+            return EXIT_FAILURE;
+        }
+        Model::Changes changes;
+        try {
+            changes = model->Apply(ParseOsmChange(*xml));
+        } catch(const std::exception &e) {
+            std::cout << "Failed to apply " << diff_file << ": " << e.what() << std::endl;     // malformed diff, or a model without ids
+            return EXIT_FAILURE;
+        }
+        std::cout << "Applied " << diff_file << ": " << changes.nodes.size() << " nodes, " << changes.ways.size()
+                  << " ways, " << changes.roads.size() << " roads changed." << std::endl;
+    }
 
-    if(osm_data.empty() && !osm_data_file.empty()) {
-        std::cout << "Reading OSP data from the following file: " <<  osm_data_file << std::endl;
-        auto data = ReadFile(osm_data_file);
+    if(compact_geometry && model->Geometry().Empty()) {
+        auto nodes = model->Nodes().size();
+        model->BuildGeometry();
+        std::cout << "Compact geometry: " << model->Geometry().Bytes() << " bytes for " << model->Geometry().WayCount()
+                  << " ways, " << nodes - model->Nodes().size() << " area nodes dropped." << std::endl;
+    }
 
-        if(!data){
-            std::cout << "Failed to read." << std::endl;
-        } else {
-            osm_data = std::move(*data);          // move to other object without the need for a deep copy
+    if(!export_file.empty()) {
+        if(build_ch) {
+            std::cout << "Building contraction hierarchy..." << std::endl;
+            model->BuildHierarchy();
+            std::cout << model->Hierarchy().EdgeCount() << " upward edges." << std::endl;
+        }
+        if(landmarks > 0) {
+            std::cout << "Selecting " << landmarks << " landmarks..." << std::endl;
+            model->BuildLandmarks(landmarks);
+            std::cout << model->GraphLandmarks().Count() << " landmarks." << std::endl;
         }
+        SnapshotWriter writer{model->MetricScale()};
+        model->Serialize(writer);
+        if(!writer.Save(export_file)) {
+            std::cout << "Failed to write snapshot: " << export_file << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::cout << "Snapshot written to " << export_file << std::endl;
+        return 0;
     }
+
+    if(!trips_file.empty()) {
+#ifdef ROUTEMS_WITH_IO2D
+        std::ifstream trips_in{trips_file};
+        auto trips = BatchRenderer::ReadTrips(trips_in);
+        if(!trips_in.is_open() || !trips) {
+            std::cout << "Failed to read trips: " << trips_file << std::endl;
+            return EXIT_FAILURE;
+        }
+        BatchRenderer renderer{*model, image_width, image_height};
+        auto written = renderer.Run(*trips, output_dir);
+        std::cout << "Rendered " << written << " of " << trips->size() << " routes to " << output_dir << std::endl;
+        return 0;
+#else
+        std::cout << "Built without io2d, rendering is not available." << std::endl;
+        return EXIT_FAILURE;
+#endif
+    }
+
+    auto load_traffic = [&](TrafficWeights &traffic) {
+        std::ifstream feed{traffic_file};
+        if(!feed.is_open()) {
+            std::cout << "Failed to read traffic: " << traffic_file << std::endl;
+            return false;
+        }
+        auto speeds = traffic.LoadFeed(feed);
+        std::cout << "Loaded " << speeds << " speeds from " << traffic_file << std::endl;
+        return true;
+    };
+
+    if(serve_port >= 0) {
+        // SIGINT and SIGTERM stop the server, so it returns from main() and the trace is written;
+        // blocked before the workers start, they inherit the mask and only the waiter takes them
+        sigset_t stop_signals;
+        sigemptyset(&stop_signals);
+        sigaddset(&stop_signals, SIGINT);
+        sigaddset(&stop_signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
+
+        RouteServer server{*model, threads, cached_routes};
+        if(!traffic_file.empty() && !load_traffic(server.Traffic()))
+            return EXIT_FAILURE;
+        if(!server.Start(static_cast<std::uint16_t>(serve_port))) {
+            std::cout << "Failed to listen on port " << serve_port << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::thread stopper{[&]{
+            int signal = 0;
+            sigwait(&stop_signals, &signal);
+            server.Stop();
+        }};
+        std::cout << "Serving routes on port " << serve_port << " with " << threads << " threads." << std::endl;
+        server.Wait();
+        pthread_kill(stopper.native_handle(), SIGTERM);     // in case the workers ended on their own
+        stopper.join();
+        std::cout << "Stopped serving." << std::endl;
         return 0;
-    }
\ No newline at end of file
+    }
+
+    float start_x, start_y, end_x, end_y;
+    std::cout << "Enter start x and y between 0 and 100: ";
+    std::cin >> start_x >> start_y;
+    std::cout << "Enter end x and y between 0 and 100: ";
+    std::cin >> end_x >> end_y;
+    if(!std::cin) {
+        std::cout << "Invalid coordinates." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    auto start = model->FindClosestNode(start_x * 0.01f, start_y * 0.01f);
+    auto end = model->FindClosestNode(end_x * 0.01f, end_y * 0.01f);
+    if(start < 0 || end < 0) {
+        std::cout << "The map has no roads." << std::endl;
+        return EXIT_FAILURE;
+    }
+    auto &graph = model->Graph();
+
+    std::optional<Route> route;
+    if(!traffic_file.empty()) {
+        TrafficWeights traffic{graph, model->Hierarchy()};
+        if(!load_traffic(traffic))
+            return EXIT_FAILURE;
+        RoutePlanner route_planner{*model};
+        route = route_planner.FastestSearch(graph.Vertex(start), graph.Vertex(end), *traffic.Read());
+        std::cout << "A* expanded " << route_planner.ExpandedNodes() << " nodes." << std::endl;
+        if(route)
+            std::cout << "Travel time: " << route->duration << " seconds." << std::endl;
+    } else if(!profile.empty()) {
+        RoutePlanner route_planner{*model};
+        if(profile == "car")
+            route = route_planner.FastestSearch<CarProfile>(graph.Vertex(start), graph.Vertex(end));
+        else if(profile == "bike")
+            route = route_planner.FastestSearch<BikeProfile>(graph.Vertex(start), graph.Vertex(end));
+        else if(profile == "foot")
+            route = route_planner.FastestSearch<FootProfile>(graph.Vertex(start), graph.Vertex(end));
+        else {
+            std::cout << "Unknown profile: " << profile << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::cout << "A* expanded " << route_planner.ExpandedNodes() << " nodes." << std::endl;
+        if(route)
+            std::cout << "Travel time: " << route->duration << " seconds." << std::endl;
+    } else if(!use_astar && !model->Hierarchy().Empty()) {
+        CHQuery query{model->Hierarchy(), graph};
+        route = query.Search(graph.Vertex(start), graph.Vertex(end));
+        std::cout << "Contraction hierarchy settled " << query.SettledNodes() << " nodes." << std::endl;
+    } else {
+        RoutePlanner route_planner{*model};
+        route = route_planner.AStarSearch(graph.Vertex(start), graph.Vertex(end));
+        std::cout << "A* expanded " << route_planner.ExpandedNodes() << " nodes." << std::endl;
+    }
+    if(!route) {
+        std::cout << "No route found." << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Distance: " << route->distance << " meters, " << route->nodes.size() << " nodes." << std::endl;
+    return 0;
+}
@@ -0,0 +1,60 @@
+#include "mapped_file.h"
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(MappedFile &&other) noexcept :
+    m_Data(std::exchange(other.m_Data, nullptr)),
+    m_Size(std::exchange(other.m_Size, 0))
+{
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+    if(this != &other) {
+        Unmap();
+        m_Data = std::exchange(other.m_Data, nullptr);
+        m_Size = std::exchange(other.m_Size, 0);
+    }
+    return *this;
+}
+
+MappedFile::~MappedFile() {
+    Unmap();
+}
+
+std::optional<MappedFile> MappedFile::Open(const std::string &path, Access access) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return std::nullopt;
+
+    struct stat st;
+    if(::fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ::close(fd);
+        return std::nullopt;
+    }
+
+    auto size = static_cast<std::size_t>(st.st_size);
+    void *addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);        // the mapping keeps its own reference to the file
+    if(addr == MAP_FAILED)
+        return std::nullopt;
+
+    if(access == Access::Sequential) {
+        // the file is decoded front to back, so ask for aggressive read-ahead
+        ::madvise(addr, size, MADV_SEQUENTIAL);
+        ::madvise(addr, size, MADV_WILLNEED);
+    } else {
+        ::madvise(addr, size, MADV_RANDOM);
+    }
+
+    return MappedFile{static_cast<const std::byte *>(addr), size};
+}
+
+void MappedFile::Unmap() noexcept {
+    if(m_Data)
+        ::munmap(const_cast<std::byte *>(m_Data), m_Size);
+    m_Data = nullptr;
+    m_Size = 0;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+
+// Read-only memory mapped view of a file. The parser reads the bytes in place,
+// so only the pages that are actually touched get loaded.
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+    ~MappedFile();
+
+    // How the pages will be touched, sets the kernel's read-ahead.
+    enum class Access { Sequential, Random };
+
+    static std::optional<MappedFile> Open(const std::string &path, Access access = Access::Sequential);     // nullopt if the file is missing, empty or can't be mapped
+
+    const std::byte *data() const noexcept { return m_Data; }
+    std::size_t size() const noexcept { return m_Size; }
+    bool empty() const noexcept { return m_Size == 0; }
+    const std::byte *begin() const noexcept { return m_Data; }
+    const std::byte *end() const noexcept { return m_Data + m_Size; }
+
+private:
+    MappedFile(const std::byte *data, std::size_t size) noexcept : m_Data(data), m_Size(size) {}
+    void Unmap() noexcept;
+
+    const std::byte *m_Data = nullptr;
+    std::size_t m_Size = 0;
+};
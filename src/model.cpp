@@ -0,0 +1,744 @@
+#include "model.h"
+#include "instrument.h"
+#include "mapped_file.h"
+#include "node_store.h"
+#include "osc_reader.h"
+#include "pbf_reader.h"
+#include "snapshot.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+static constexpr double kPi = 3.14159265358979323846264338327950288;
+static constexpr double kEarthRadius = 6378137.;
+
+static double Lon2Xm(double lon) { return lon * (2. * kPi / 360.) / 2 * kEarthRadius; }
+static double Lat2Ym(double lat) { return std::log(std::tan(lat * (2. * kPi / 360.) / 2 + kPi / 4)) / 2 * kEarthRadius; }
+
+static Model::Road::Type String2RoadType(std::string_view type)
+{
+    if( type == "motorway" )        return Model::Road::Motorway;
+    if( type == "trunk" )           return Model::Road::Trunk;
+    if( type == "primary" )         return Model::Road::Primary;
+    if( type == "secondary" )       return Model::Road::Secondary;
+    if( type == "tertiary" )        return Model::Road::Tertiary;
+    if( type == "residential" )     return Model::Road::Residential;
+    if( type == "living_street" )   return Model::Road::Residential;
+    if( type == "service" )         return Model::Road::Service;
+    if( type == "unclassified" )    return Model::Road::Unclassified;
+    if( type == "footway" )         return Model::Road::Footway;
+    if( type == "bridleway" )       return Model::Road::Footway;
+    if( type == "steps" )           return Model::Road::Footway;
+    if( type == "path" )            return Model::Road::Footway;
+    if( type == "pedestrian" )      return Model::Road::Footway;
+    return Model::Road::Invalid;
+}
+
+static Model::Landuse::Type String2LanduseType(std::string_view type)
+{
+    if( type == "commercial" )      return Model::Landuse::Commercial;
+    if( type == "construction" )    return Model::Landuse::Construction;
+    if( type == "grass" )           return Model::Landuse::Grass;
+    if( type == "forest" )          return Model::Landuse::Forest;
+    if( type == "industrial" )      return Model::Landuse::Industrial;
+    if( type == "railway" )         return Model::Landuse::Railway;
+    if( type == "residential" )     return Model::Landuse::Residential;
+    return Model::Landuse::Invalid;
+}
+
+static bool IsLeisure(std::string_view category, std::string_view type)
+{
+    return category == "leisure" ||
+        (category == "natural" && (type == "wood" || type == "tree_row" || type == "scrub" || type == "grassland")) ||
+        (category == "landcover" && type == "grass");
+}
+
+// Writes one area layer as CSR over way indices, outer rings first in every polygon.
+template <typename Layer>
+static void SaveAreas(SnapshotWriter &writer, const std::vector<Layer> &areas,
+                      Snapshot::Section offsets_id, Snapshot::Section rings_id, Snapshot::Section outer_id)
+{
+    std::vector<std::uint32_t> offsets{0}, outer_counts;
+    std::vector<std::int32_t> rings;
+    for( auto &area: areas ) {
+        rings.insert(rings.end(), area.outer.begin(), area.outer.end());
+        rings.insert(rings.end(), area.inner.begin(), area.inner.end());
+        offsets.push_back((std::uint32_t)rings.size());
+        outer_counts.push_back((std::uint32_t)area.outer.size());
+    }
+    writer.Add(offsets_id, offsets);
+    writer.Add(rings_id, rings);
+    writer.Add(outer_id, outer_counts);
+}
+
+// True if every index is in [0, count), what a section referring into another must hold.
+static bool AllBelow(Span<const std::int32_t> indices, std::size_t count)
+{
+    return std::all_of(indices.begin(), indices.end(), [count](std::int32_t i){ return i >= 0 && (std::size_t)i < count; });
+}
+
+template <typename Layer>
+static void LoadAreas(const Snapshot &snapshot, std::vector<Layer> &areas, std::size_t way_count,
+                      Snapshot::Section offsets_id, Snapshot::Section rings_id, Snapshot::Section outer_id)
+{
+    auto offsets = snapshot.Array<std::uint32_t>(offsets_id);
+    auto rings = snapshot.Array<std::int32_t>(rings_id);
+    auto outer_counts = snapshot.Array<std::uint32_t>(outer_id);
+    if( offsets.empty() || outer_counts.size() + 1 != offsets.size() || offsets.back() != rings.size() )
+        throw std::runtime_error("snapshot: malformed area layer");
+    if( !AllBelow(rings, way_count) )
+        throw std::runtime_error("snapshot: area ring outside the way table");
+
+    areas.resize(outer_counts.size());
+    for( std::size_t i = 0; i < areas.size(); ++i ) {
+        if( offsets[i] > offsets[i + 1] || outer_counts[i] > offsets[i + 1] - offsets[i] )
+            throw std::runtime_error("snapshot: malformed area layer");
+        areas[i].outer = rings.subspan(offsets[i], outer_counts[i]);
+        areas[i].inner = rings.subspan(offsets[i] + outer_counts[i], offsets[i + 1] - offsets[i] - outer_counts[i]);
+    }
+}
+
+Model::Model(const MappedFile &osm_data)
+{
+    ROUTEMS_TRACE_SCOPE("load.model");
+    PbfReader reader{osm_data.data(), osm_data.size()};
+    LoadData([&](auto &pool, auto &sink){ reader.Read(sink, pool); return reader.Bounds(); }, nullptr);
+}
+
+Model::Model(const std::filesystem::path &osm_file, const std::filesystem::path &scratch_dir)
+{
+    ROUTEMS_TRACE_SCOPE("load.model");
+    NodeStore store{scratch_dir / ("routems-nodes-" + std::to_string(::getpid()) + ".bin")};
+    LoadData([&](auto &pool, auto &sink){ return PbfReader::ReadFile(osm_file.string(), sink, pool); }, &store);
+}
+
+Model::Model(const std::filesystem::path &osm_file)
+{
+    ROUTEMS_TRACE_SCOPE("load.model");
+    LoadData([&](auto &pool, auto &sink){ return PbfReader::ReadFile(osm_file.string(), sink, pool); }, nullptr);
+}
+
+Model::Model(const Snapshot &snapshot) :
+    m_MetricScale(snapshot.MetricScale())
+{
+    using S = Snapshot;
+    auto xs = snapshot.Array<double>(S::NodeX);
+    auto ys = snapshot.Array<double>(S::NodeY);
+    if( xs.size() != ys.size() )
+        throw std::runtime_error("snapshot: node coordinate arrays differ in length");
+    m_NodeX = xs;
+    m_NodeY = ys;
+
+    auto way_offsets = snapshot.Array<std::uint32_t>(S::WayOffsets);
+    auto way_nodes = snapshot.Array<std::int32_t>(S::WayNodes);
+    if( way_offsets.empty() || way_offsets.back() != way_nodes.size() )
+        throw std::runtime_error("snapshot: malformed way table");
+    if( !AllBelow(way_nodes, xs.size()) )
+        throw std::runtime_error("snapshot: way node outside the node table");
+    m_Ways.resize(way_offsets.size() - 1);
+    for( std::size_t i = 0; i < m_Ways.size(); ++i ) {
+        if( way_offsets[i] > way_offsets[i + 1] )
+            throw std::runtime_error("snapshot: malformed way table");
+        m_Ways[i].nodes = way_nodes.subspan(way_offsets[i], way_offsets[i + 1] - way_offsets[i]);
+    }
+
+    auto road_ways = snapshot.Array<std::int32_t>(S::RoadWays);
+    auto road_types = snapshot.Array<std::uint8_t>(S::RoadTypes);
+    if( road_ways.size() != road_types.size() )
+        throw std::runtime_error("snapshot: road arrays differ in length");
+    if( !AllBelow(road_ways, m_Ways.size()) )
+        throw std::runtime_error("snapshot: road outside the way table");
+    for( std::size_t i = 0; i < road_ways.size(); ++i ) {
+        if( road_types[i] == Road::Invalid || road_types[i] > Road::Footway )
+            throw std::runtime_error("snapshot: unknown road type");
+        m_Roads.push_back({road_ways[i], static_cast<Road::Type>(road_types[i])});
+    }
+
+    auto railway_ways = snapshot.Array<std::int32_t>(S::RailwayWays);
+    if( !AllBelow(railway_ways, m_Ways.size()) )
+        throw std::runtime_error("snapshot: railway outside the way table");
+    for( auto way: railway_ways )
+        m_Railways.push_back({way});
+
+    LoadAreas(snapshot, m_Buildings, m_Ways.size(), S::BuildingOffsets, S::BuildingRings, S::BuildingOuterCounts);
+    LoadAreas(snapshot, m_Leisures, m_Ways.size(), S::LeisureOffsets, S::LeisureRings, S::LeisureOuterCounts);
+    LoadAreas(snapshot, m_Waters, m_Ways.size(), S::WaterOffsets, S::WaterRings, S::WaterOuterCounts);
+    LoadAreas(snapshot, m_Landuses, m_Ways.size(), S::LanduseOffsets, S::LanduseRings, S::LanduseOuterCounts);
+    auto landuse_types = snapshot.Array<std::uint8_t>(S::LanduseTypes);
+    if( landuse_types.size() != m_Landuses.size() )
+        throw std::runtime_error("snapshot: landuse types do not match the landuse layer");
+    for( std::size_t i = 0; i < m_Landuses.size(); ++i ) {
+        if( landuse_types[i] > Landuse::Residential )
+            throw std::runtime_error("snapshot: unknown landuse type");
+        m_Landuses[i].type = static_cast<Landuse::Type>(landuse_types[i]);
+    }
+
+    auto load_ids = [&](Snapshot::Section ids_id, Snapshot::Section indices_id, std::size_t count) {
+        auto ids = snapshot.Array<std::int64_t>(ids_id);
+        auto indices = snapshot.Array<std::int32_t>(indices_id);
+        if( ids.size() != indices.size() || !std::is_sorted(ids.begin(), ids.end()) || !AllBelow(indices, count) )
+            throw std::runtime_error("snapshot: malformed id index");
+        return IdIndex{ids, indices};
+    };
+    m_NodeIds = load_ids(S::NodeIds, S::NodeIdIndices, m_NodeX.size());
+    m_WayIds = load_ids(S::WayIds, S::WayIdIndices, m_Ways.size());
+    if( auto projection = snapshot.Array<double>(S::Projection); projection.size() == 2 ) {
+        m_OriginX = projection[0];
+        m_OriginY = projection[1];
+    }
+}
+
+void Model::Serialize(SnapshotWriter &writer) const
+{
+    using S = Snapshot;
+    writer.Add(S::NodeX, Span<const double>{m_NodeX});
+    writer.Add(S::NodeY, Span<const double>{m_NodeY});
+
+    std::vector<std::uint32_t> way_offsets{0};
+    std::vector<std::int32_t> way_nodes;
+    for( auto &way: m_Ways ) {
+        way_nodes.insert(way_nodes.end(), way.nodes.begin(), way.nodes.end());
+        way_offsets.push_back((std::uint32_t)way_nodes.size());
+    }
+    writer.Add(S::WayOffsets, way_offsets);
+    writer.Add(S::WayNodes, way_nodes);
+
+    std::vector<std::int32_t> road_ways, railway_ways;
+    std::vector<std::uint8_t> road_types, landuse_types;
+    for( auto &road: m_Roads ) {
+        road_ways.push_back(road.way);
+        road_types.push_back((std::uint8_t)road.type);
+    }
+    for( auto &railway: m_Railways )
+        railway_ways.push_back(railway.way);
+    for( auto &landuse: m_Landuses )
+        landuse_types.push_back((std::uint8_t)landuse.type);
+    writer.Add(S::RoadWays, road_ways);
+    writer.Add(S::RoadTypes, road_types);
+    writer.Add(S::RailwayWays, railway_ways);
+
+    SaveAreas(writer, m_Buildings, S::BuildingOffsets, S::BuildingRings, S::BuildingOuterCounts);
+    SaveAreas(writer, m_Leisures, S::LeisureOffsets, S::LeisureRings, S::LeisureOuterCounts);
+    SaveAreas(writer, m_Waters, S::WaterOffsets, S::WaterRings, S::WaterOuterCounts);
+    SaveAreas(writer, m_Landuses, S::LanduseOffsets, S::LanduseRings, S::LanduseOuterCounts);
+    writer.Add(S::LanduseTypes, landuse_types);
+
+    auto [node_ids, node_indices] = m_NodeIds.Sorted();
+    auto [way_ids, way_indices] = m_WayIds.Sorted();
+    writer.Add(S::NodeIds, node_ids);
+    writer.Add(S::NodeIdIndices, node_indices);
+    writer.Add(S::WayIds, way_ids);
+    writer.Add(S::WayIdIndices, way_indices);
+    writer.Add(S::Projection, std::vector<double>{m_OriginX, m_OriginY});
+}
+
+void Model::LoadData(const BlockSource &read, NodeStore *store)
+{
+    ThreadPool pool;                // decodes the blocks and helps merging them, one pool for both
+    Builder builder;
+    builder.store = store;
+    builder.pool = &pool;
+    auto header_bounds = read(pool, [&](OsmBlock &block){ MergeBlock(builder, block); });
+    BuildPendingAreas(builder);
+
+    if( store ) {
+        // the way lists hold store rows so far; only the rows they use become
+        // model nodes, numbered in id order like an extract read in memory
+        if( !store->Finished() )
+            store->Finish();
+        std::vector<int> rows;
+        for( auto &way: m_Ways )
+            rows.insert(rows.end(), way.nodes.begin(), way.nodes.end());
+        std::sort(rows.begin(), rows.end());
+        rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+        rows.shrink_to_fit();
+        builder.xs.resize(rows.size());
+        builder.ys.resize(rows.size());
+        builder.node_ids.resize(rows.size());
+        for( std::size_t i = 0; i < rows.size(); ++i ) {
+            builder.xs[i] = store->Lon(rows[i]);
+            builder.ys[i] = store->Lat(rows[i]);
+            builder.node_ids[i] = {store->Id(rows[i]), (int)i};
+        }
+        RewriteWays([&](std::size_t way_num, std::vector<int> &nodes) {
+            for( auto row: m_Ways[way_num].nodes )
+                nodes.push_back((int)(std::lower_bound(rows.begin(), rows.end(), row) - rows.begin()));
+        });
+        if( builder.xs.empty() )
+            throw std::logic_error("The OSM extract contains no ways.");
+    }
+    m_NodeIds = IdIndex{std::move(builder.node_ids)};
+    m_WayIds = IdIndex{std::move(builder.way_ids)};
+
+    if( builder.xs.empty() )
+        throw std::logic_error("The OSM extract contains no nodes.");
+
+    // nodes still hold raw lon/lat here, fall back to their extent if the header has no bbox
+    auto bounds = OsmBounds{ std::numeric_limits<double>::max(), std::numeric_limits<double>::max(),
+                             std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest() };
+    if( header_bounds )
+        bounds = *header_bounds;
+    else
+        for( std::size_t i = 0; i < builder.xs.size(); ++i ) {
+            bounds.min_lon = std::min(bounds.min_lon, builder.xs[i]);
+            bounds.max_lon = std::max(bounds.max_lon, builder.xs[i]);
+            bounds.min_lat = std::min(bounds.min_lat, builder.ys[i]);
+            bounds.max_lat = std::max(bounds.max_lat, builder.ys[i]);
+        }
+    AdjustCoordinates(builder, bounds);
+}
+
+// The ways of a block in chunks of this many are resolved and classified on the pool.
+static constexpr std::size_t kWayChunk = 1024;
+
+struct Model::WayChunk {
+    struct Way {
+        std::size_t source;                 // index into the block's ways
+        std::size_t nodes_end;              // into nodes, the way's list starts where the last one's ended
+        std::size_t areas_end;              // into areas
+        Road::Type road;
+        bool railway;
+    };
+
+    std::vector<int> nodes;
+    std::vector<Way> ways;                  // the ones with at least two nodes in the extract
+    std::vector<std::pair<AreaLayer, Landuse::Type>> areas;     // of closed ways, in tag order
+};
+
+Model::Builder::Builder() = default;
+Model::Builder::~Builder() = default;
+
+int Model::Builder::FindNode(std::int64_t id) const
+{
+    if( store )
+        return (int)store->Find(id);
+    auto it = node_index.find(id);
+    return it == node_index.end() ? -1 : it->second;
+}
+
+int Model::Builder::FindWay(std::int64_t id) const
+{
+    if( store ) {
+        auto it = std::lower_bound(way_ids.begin(), way_ids.end(), std::make_pair(id, std::numeric_limits<int>::min()));
+        return it == way_ids.end() || it->first != id ? -1 : it->second;
+    }
+    auto it = way_index.find(id);
+    return it == way_index.end() ? -1 : it->second;
+}
+
+void Model::Builder::AddWay(std::int64_t id, int way_num)
+{
+    if( !store )
+        way_index.emplace(id, way_num);
+    else if( !way_ids.empty() && id <= way_ids.back().first )
+        throw std::runtime_error("ingest: ways are not sorted by id, sort the extract first");
+    way_ids.emplace_back(id, way_num);
+}
+
+// Blocks arrive in file order, and sorted extracts store nodes before ways
+// before relations, so every reference can be resolved when it is first seen.
+void Model::MergeBlock(Builder &builder, const OsmBlock &block)
+{
+    for( auto &node: block.nodes ) {
+        if( builder.store ) {
+            if( builder.store->Finished() )
+                throw std::runtime_error("ingest: nodes after ways, sort the extract first");
+            if( builder.store->Size() == (std::size_t)std::numeric_limits<int>::max() )
+                throw std::runtime_error("ingest: too many nodes for 32 bit indices");
+            builder.store->Append(node.id, node.lon, node.lat);
+            continue;
+        }
+        builder.node_index.emplace(node.id, (int)builder.xs.size());
+        builder.node_ids.emplace_back(node.id, (int)builder.xs.size());
+        builder.xs.push_back(node.lon);
+        builder.ys.push_back(node.lat);
+    }
+
+    // the streamed nodes are complete with the first way, resolve against them from here
+    if( builder.store && !builder.store->Finished() && (!block.ways.empty() || !block.relations.empty()) )
+        builder.store->Finish();
+
+    // the id lookups and tag comparisons run on the pool, the model is appended to here in block order
+    auto chunk_count = (block.ways.size() + kWayChunk - 1) / kWayChunk;
+    if( builder.chunks.size() < chunk_count )
+        builder.chunks.resize(chunk_count);
+    ParallelFor(*builder.pool, chunk_count, [&](std::size_t c) {
+        ParseWays(builder, block, c * kWayChunk, std::min(block.ways.size(), (c + 1) * kWayChunk), builder.chunks[c]);
+    });
+    for( std::size_t c = 0; c < chunk_count; ++c ) {
+        auto &chunk = builder.chunks[c];
+        std::size_t nodes_begin = 0, areas_begin = 0;
+        for( auto &way: chunk.ways ) {
+            auto way_num = (int)m_Ways.size();
+            builder.AddWay(block.ways[way.source].id, way_num);
+            m_Ways.push_back({m_Arena.Copy(Span<const int>{chunk.nodes.data() + nodes_begin, way.nodes_end - nodes_begin})});
+            if( way.road != Road::Invalid )
+                m_Roads.push_back({way_num, way.road});
+            if( way.railway )
+                m_Railways.push_back({way_num});
+            for( auto i = areas_begin; i < way.areas_end; ++i ) {
+                auto &area = Area(chunk.areas[i].first, AddArea(chunk.areas[i].first, chunk.areas[i].second));
+                area.outer = m_Arena.Copy(std::vector<int>{way_num});
+            }
+            nodes_begin = way.nodes_end;
+            areas_begin = way.areas_end;
+        }
+    }
+
+    for( auto &relation: block.relations ) {
+        auto is_multipolygon = std::any_of(relation.tags.begin(), relation.tags.end(), [](auto &tag){
+            return tag.key == "type" && tag.value == "multipolygon";
+        });
+        if( !is_multipolygon )
+            continue;
+
+        auto &rings = builder.rings;
+        rings.outer.clear();
+        rings.inner.clear();
+        for( auto &member: relation.members ) {
+            if( member.type != OsmMember::Way )
+                continue;
+            auto way_num = builder.FindWay(member.ref);
+            if( way_num < 0 )
+                continue;
+            (member.role == "inner" ? rings.inner : rings.outer).push_back(way_num);
+        }
+        if( rings.outer.empty() )
+            continue;
+
+        auto layer = AreaLayer::None;
+        auto landuse = Landuse::Invalid;
+        for( auto &tag: relation.tags )
+            if( (layer = ClassifyArea(tag.key, tag.value, landuse)) != AreaLayer::None )
+                break;
+        if( layer == AreaLayer::None )
+            continue;
+
+        auto is_closed = [&](int way_num) {
+            auto &nodes = m_Ways[way_num].nodes;
+            return nodes.front() == nodes.back();
+        };
+        auto area = AddArea(layer, landuse);
+        if( std::all_of(rings.outer.begin(), rings.outer.end(), is_closed) &&
+            std::all_of(rings.inner.begin(), rings.inner.end(), is_closed) ) {
+            Area(layer, area).outer = m_Arena.Copy(rings.outer);        // the common case, plain closed ways
+            Area(layer, area).inner = m_Arena.Copy(rings.inner);
+        } else {
+            builder.pending.push_back({layer, area, rings});
+        }
+    }
+}
+
+void Model::ParseWays(const Builder &builder, const OsmBlock &block, std::size_t first, std::size_t last, WayChunk &chunk)
+{
+    chunk.nodes.clear();
+    chunk.ways.clear();
+    chunk.areas.clear();
+    for( auto i = first; i < last; ++i ) {
+        auto &osm_way = block.ways[i];
+        auto nodes_begin = chunk.nodes.size();
+        for( auto ref: osm_way.refs )
+            if( auto node = builder.FindNode(ref); node >= 0 )
+                chunk.nodes.push_back(node);
+        if( chunk.nodes.size() - nodes_begin < 2 ) {
+            chunk.nodes.resize(nodes_begin);
+            continue;           // clipped away by the extract
+        }
+
+        WayChunk::Way way{i, chunk.nodes.size(), 0, Road::Invalid, false};
+        auto closed = chunk.nodes[nodes_begin] == chunk.nodes.back();       // only closed ways describe an area
+        for( auto &tag: osm_way.tags ) {
+            if( tag.key == "highway" ) {
+                if( auto road_type = String2RoadType(tag.value); road_type != Road::Invalid )
+                    way.road = road_type;
+            }
+            else if( tag.key == "railway" ) {
+                if( tag.value != "abandoned" && tag.value != "razed" && tag.value != "disused" )
+                    way.railway = true;
+            }
+            else if( closed ) {
+                auto landuse = Landuse::Invalid;
+                if( auto layer = ClassifyArea(tag.key, tag.value, landuse); layer != AreaLayer::None )
+                    chunk.areas.emplace_back(layer, landuse);
+            }
+        }
+        way.areas_end = chunk.areas.size();
+        chunk.ways.push_back(way);
+    }
+}
+
+// The area layer the tag names, if the renderer knows about it.
+Model::AreaLayer Model::ClassifyArea(std::string_view category, std::string_view type, Landuse::Type &landuse)
+{
+    if( category == "building" )
+        return type == "no" ? AreaLayer::None : AreaLayer::Building;
+    if( IsLeisure(category, type) )
+        return AreaLayer::Leisure;
+    if( category == "natural" && type == "water" )
+        return AreaLayer::Water;
+    if( category == "landuse" ) {
+        landuse = String2LanduseType(type);
+        return landuse == Landuse::Invalid ? AreaLayer::None : AreaLayer::Landuse;
+    }
+    return AreaLayer::None;
+}
+
+std::size_t Model::AddArea(AreaLayer layer, Landuse::Type landuse)
+{
+    switch( layer ) {
+        case AreaLayer::Building: m_Buildings.emplace_back(); return m_Buildings.size() - 1;
+        case AreaLayer::Leisure: m_Leisures.emplace_back(); return m_Leisures.size() - 1;
+        case AreaLayer::Water: m_Waters.emplace_back(); return m_Waters.size() - 1;
+        case AreaLayer::Landuse: m_Landuses.emplace_back().type = landuse; return m_Landuses.size() - 1;
+        case AreaLayer::None: break;
+    }
+    throw std::logic_error("Model::AddArea: no layer");
+}
+
+Model::Multipolygon &Model::Area(AreaLayer layer, std::size_t area)
+{
+    switch( layer ) {
+        case AreaLayer::Building: return m_Buildings[area];
+        case AreaLayer::Leisure: return m_Leisures[area];
+        case AreaLayer::Water: return m_Waters[area];
+        case AreaLayer::Landuse: return m_Landuses[area];
+        case AreaLayer::None: break;
+    }
+    throw std::logic_error("Model::Area: no layer");
+}
+
+Model::Changes Model::Apply(const OsmChange &change)
+{
+    if( m_NodeIds.Empty() )
+        throw std::runtime_error("diff: the model has no OSM ids, rebuild it from the extract");
+    Changes changes;
+
+    // nodes first, the ways of the same diff refer to them
+    std::vector<std::pair<int, Node>> placed;
+    auto node_count = m_NodeX.size();
+    for( auto &osm_node: change.nodes ) {
+        if( osm_node.action == OsmChange::Delete )
+            continue;           // the ways still using it are patched by the same diff
+        auto node = m_NodeIds.Find(osm_node.id);
+        if( node < 0 ) {
+            if( node_count == (std::size_t)std::numeric_limits<int>::max() )
+                throw std::runtime_error("diff: too many nodes for 32 bit indices");
+            node = (int)node_count++;
+            m_NodeIds.Add(osm_node.id, node);
+        }
+        placed.push_back({node, {(Lon2Xm(osm_node.lon) - m_OriginX) / m_MetricScale,
+                                 (Lat2Ym(osm_node.lat) - m_OriginY) / m_MetricScale}});
+        changes.nodes.push_back(node);
+    }
+    if( !placed.empty() ) {
+        m_NodeX.Modify([&](std::vector<double> &xs){
+            xs.resize(node_count);
+            for( auto &[node, coords]: placed )
+                xs[node] = coords.x;
+        });
+        m_NodeY.Modify([&](std::vector<double> &ys){
+            ys.resize(node_count);
+            for( auto &[node, coords]: placed )
+                ys[node] = coords.y;
+        });
+    }
+
+    std::unordered_map<int, int> road_of_way;
+    for( std::size_t i = 0; i < m_Roads.size(); ++i )
+        road_of_way.emplace(m_Roads[i].way, (int)i);
+
+    std::vector<int> nodes;
+    for( auto &osm_way: change.ways ) {
+        nodes.clear();
+        if( osm_way.action != OsmChange::Delete )
+            for( auto ref: osm_way.refs )
+                if( auto node = m_NodeIds.Find(ref); node >= 0 )
+                    nodes.push_back(node);
+        if( nodes.size() < 2 )
+            nodes.clear();          // deleted, or clipped away by the extract
+
+        auto way_num = m_WayIds.Find(osm_way.id);
+        if( way_num < 0 ) {
+            if( nodes.empty() )
+                continue;
+            way_num = (int)m_Ways.size();
+            m_Ways.emplace_back();
+            m_WayIds.Add(osm_way.id, way_num);
+        }
+        m_Ways[way_num].nodes = m_Arena.Copy(nodes);        // the old list stays in the arena or snapshot
+        changes.ways.push_back(way_num);
+
+        auto road_type = Road::Invalid;
+        if( !nodes.empty() )
+            for( auto &[key, value]: osm_way.tags )
+                if( key == "highway" )
+                    road_type = String2RoadType(value);
+        if( auto it = road_of_way.find(way_num); it != road_of_way.end() )
+            m_Roads[it->second].type = road_type;
+        else if( road_type != Road::Invalid ) {
+            road_of_way.emplace(way_num, (int)m_Roads.size());
+            m_Roads.push_back({way_num, road_type});
+        }
+    }
+
+    // ways whose geometry changed through their nodes
+    std::sort(changes.nodes.begin(), changes.nodes.end());
+    changes.nodes.erase(std::unique(changes.nodes.begin(), changes.nodes.end()), changes.nodes.end());
+    if( !changes.nodes.empty() ) {
+        std::vector<bool> moved(node_count, false);
+        for( auto node: changes.nodes )
+            moved[node] = true;
+        for( int way_num = 0; way_num < (int)m_Ways.size(); ++way_num ) {
+            auto &way_nodes = m_Ways[way_num].nodes;
+            if( std::any_of(way_nodes.begin(), way_nodes.end(), [&](int node){ return moved[node]; }) )
+                changes.ways.push_back(way_num);
+        }
+    }
+    std::sort(changes.ways.begin(), changes.ways.end());
+    changes.ways.erase(std::unique(changes.ways.begin(), changes.ways.end()), changes.ways.end());
+
+    for( int i = 0; i < (int)m_Roads.size(); ++i )
+        if( std::binary_search(changes.ways.begin(), changes.ways.end(), m_Roads[i].way) )
+            changes.roads.push_back(i);
+    return changes;
+}
+
+template <typename F>
+void Model::RewriteWays(F &&rewrite)
+{
+    Arena arena;
+    std::vector<int> nodes;
+    for( std::size_t way_num = 0; way_num < m_Ways.size(); ++way_num ) {
+        nodes.clear();
+        rewrite(way_num, nodes);
+        m_Ways[way_num].nodes = arena.Copy(nodes);
+    }
+    auto move_rings = [&](auto &areas) {
+        for( auto &area: areas ) {
+            area.outer = arena.Copy(area.outer);
+            area.inner = arena.Copy(area.inner);
+        }
+    };
+    move_rings(m_Buildings);
+    move_rings(m_Leisures);
+    move_rings(m_Waters);
+    move_rings(m_Landuses);
+    m_Arena = std::move(arena);
+}
+
+std::vector<int> Model::DropAreaWays()
+{
+    std::vector<bool> kept_way(m_Ways.size(), false), kept_node(m_NodeX.size(), false);
+    for( auto &road: m_Roads )
+        kept_way[road.way] = true;
+    for( auto &railway: m_Railways )
+        kept_way[railway.way] = true;
+    for( std::size_t way_num = 0; way_num < m_Ways.size(); ++way_num )
+        if( kept_way[way_num] )
+            for( auto node: m_Ways[way_num].nodes )
+                kept_node[node] = true;
+
+    std::vector<int> remap(m_NodeX.size(), -1);
+    std::vector<double> xs, ys;
+    for( std::size_t node = 0; node < remap.size(); ++node )
+        if( kept_node[node] ) {
+            remap[node] = (int)xs.size();
+            xs.push_back(m_NodeX[node]);
+            ys.push_back(m_NodeY[node]);
+        }
+    m_NodeX = std::move(xs);
+    m_NodeY = std::move(ys);
+    m_NodeIds.Remap(remap);
+    RewriteWays([&](std::size_t way_num, std::vector<int> &nodes) {
+        if( kept_way[way_num] )
+            for( auto node: m_Ways[way_num].nodes )
+                nodes.push_back(remap[node]);
+    });
+    return remap;
+}
+
+void Model::AdjustCoordinates(Builder &builder, const OsmBounds &bounds)
+{
+    const auto dx = Lon2Xm(bounds.max_lon) - Lon2Xm(bounds.min_lon);
+    const auto dy = Lat2Ym(bounds.max_lat) - Lat2Ym(bounds.min_lat);
+    m_OriginX = Lon2Xm(bounds.min_lon);
+    m_OriginY = Lat2Ym(bounds.min_lat);
+    m_MetricScale = std::min(dx, dy);
+    if( !(m_MetricScale > 0.) )
+        m_MetricScale = std::max({dx, dy, 1.});        // degenerate extract, e.g. a single node
+    for( auto &x: builder.xs )
+        x = (Lon2Xm(x) - m_OriginX) / m_MetricScale;
+    for( auto &y: builder.ys )
+        y = (Lat2Ym(y) - m_OriginY) / m_MetricScale;
+    m_NodeX = std::move(builder.xs);
+    m_NodeY = std::move(builder.ys);
+}
+
+// Merges the open member ways of a multipolygon into closed rings. Rings that
+// cannot be closed are dropped, they would only render as garbage. Only reads
+// the model, so the polygons can be joined concurrently.
+Model::JoinedRings Model::JoinRings(const std::vector<int> &way_nums) const
+{
+    JoinedRings rings;
+    std::vector<int> open;
+    for( auto way_num: way_nums ) {
+        auto &nodes = m_Ways[way_num].nodes;
+        (nodes.front() == nodes.back() ? rings.closed : open).push_back(way_num);
+    }
+
+    std::vector<bool> used(open.size(), false);
+    for( std::size_t seed = 0; seed < open.size(); ++seed ) {
+        if( used[seed] )
+            continue;
+        used[seed] = true;
+        std::vector<int> ring(m_Ways[open[seed]].nodes.begin(), m_Ways[open[seed]].nodes.end());
+        for( bool extended = true; extended && ring.front() != ring.back(); ) {
+            extended = false;
+            for( std::size_t i = 0; i < open.size() && !extended; ++i ) {
+                if( used[i] )
+                    continue;
+                auto &nodes = m_Ways[open[i]].nodes;
+                if( nodes.front() == ring.back() )
+                    ring.insert(ring.end(), nodes.begin() + 1, nodes.end());
+                else if( nodes.back() == ring.back() )
+                    ring.insert(ring.end(), nodes.rbegin() + 1, nodes.rend());
+                else
+                    continue;
+                used[i] = extended = true;
+            }
+        }
+        if( ring.front() == ring.back() )
+            rings.joined.push_back(std::move(ring));
+    }
+    return rings;
+}
+
+// Joins the rings of all pending polygons on the pool, then appends the new
+// ways in the order the relations came in, so the way indices and with them
+// the snapshots don't depend on the scheduling.
+void Model::BuildPendingAreas(Builder &builder)
+{
+    ROUTEMS_TRACE_SCOPE("load.rings");
+    std::vector<std::pair<JoinedRings, JoinedRings>> joined(builder.pending.size());
+    ParallelFor(*builder.pool, builder.pending.size(), [&](std::size_t i) {
+        joined[i] = {JoinRings(builder.pending[i].rings.outer), JoinRings(builder.pending[i].rings.inner)};
+    });
+
+    auto commit = [&](JoinedRings &rings) {
+        for( auto &ring: rings.joined ) {
+            rings.closed.push_back((int)m_Ways.size());
+            m_Ways.push_back({m_Arena.Copy(ring)});
+        }
+        return m_Arena.Copy(rings.closed);
+    };
+    for( std::size_t i = 0; i < builder.pending.size(); ++i ) {
+        auto &area = Area(builder.pending[i].layer, builder.pending[i].area);
+        area.outer = commit(joined[i].first);
+        area.inner = commit(joined[i].second);
+    }
+    builder.pending.clear();
+}
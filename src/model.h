@@ -0,0 +1,219 @@
+#pragma once
+
+#include "arena.h"
+#include "flat_array.h"
+#include "id_index.h"
+#include "span.h"
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class MappedFile;
+class NodeStore;
+class Snapshot;
+class SnapshotWriter;
+class ThreadPool;
+struct OsmBlock;
+struct OsmBounds;
+struct OsmChange;
+
+// Map features extracted from an OSM extract. Node coordinates are projected
+// to Web Mercator and normalized so the shorter side of the map spans 1.0;
+// MetricScale() converts those units back to metres. The x and y coordinates
+// of the nodes are kept in two separate arrays. Node and ring lists are
+// spans into flat storage: the model's arena when it was built from an
+// extract, the mapped snapshot when it was loaded from one.
+class Model {
+public:
+    struct Node {
+        double x = 0.;
+        double y = 0.;
+    };
+
+    // The node coordinates as one array of x and one of y, so bulk passes read
+    // them contiguously; indexing assembles a Node.
+    class NodeArray {
+    public:
+        NodeArray(Span<const double> x, Span<const double> y) noexcept : m_X(x), m_Y(y) {}
+
+        std::size_t size() const noexcept { return m_X.size(); }
+        bool empty() const noexcept { return m_X.empty(); }
+        Node operator[](std::size_t i) const noexcept { return {m_X[i], m_Y[i]}; }
+        Span<const double> X() const noexcept { return m_X; }
+        Span<const double> Y() const noexcept { return m_Y; }
+
+    private:
+        Span<const double> m_X;
+        Span<const double> m_Y;
+    };
+
+    struct Way {
+        Span<const int> nodes;          // indices into Nodes()
+    };
+
+    struct Road {
+        enum Type { Invalid, Unclassified, Service, Residential,
+            Tertiary, Secondary, Primary, Trunk, Motorway, Footway };
+        int way;
+        Type type;
+    };
+
+    struct Railway {
+        int way;
+    };
+
+    struct Multipolygon {
+        Span<const int> outer;          // indices into Ways(), every way is a closed ring
+        Span<const int> inner;
+    };
+
+    struct Building : Multipolygon {};
+
+    struct Leisure : Multipolygon {};
+
+    struct Water : Multipolygon {};
+
+    struct Landuse : Multipolygon {
+        enum Type { Invalid, Commercial, Construction, Grass, Forest, Industrial, Railway, Residential };
+        Type type;
+    };
+
+    explicit Model(const MappedFile &osm_data);     // decodes an .osm.pbf extract, throws on malformed input
+
+    // Streaming ingest for extracts whose nodes don't fit in memory: the file
+    // is read in chunks like below, raw node coordinates go to a scratch file
+    // in scratch_dir and way geometry is resolved against it once the nodes
+    // are through. Only the nodes the ways use are loaded from it at the end.
+    // Needs an extract sorted by type and id, as distributed; throws otherwise.
+    Model(const std::filesystem::path &osm_file, const std::filesystem::path &scratch_dir);
+    explicit Model(const std::filesystem::path &osm_file);  // reads the extract with overlapped I/O instead of mapping it, see PbfReader::ReadFile
+    explicit Model(const Snapshot &snapshot);       // views into a model written by Serialize(), the snapshot must outlive it
+
+    void Serialize(SnapshotWriter &writer) const;
+
+    // What Apply() touched, for the structures derived from the model. Every
+    // list is sorted and unique.
+    struct Changes {
+        std::vector<int> nodes;         // moved or created
+        std::vector<int> ways;          // new node list, created, deleted or with moved nodes
+        std::vector<int> roads;         // indices into Roads() on such ways, retyped, retired or created
+        bool Empty() const noexcept { return nodes.empty() && ways.empty() && roads.empty(); }
+    };
+
+    // Patches node coordinates, way node lists and road types from an
+    // osmChange diff. Indices stay stable: deleted ways keep an empty node list
+    // and roads that lose their highway tag become Road::Invalid. Area and
+    // railway tags and relations are not patched. Throws if the model has no
+    // OSM ids, i.e. comes from a snapshot written without them.
+    Changes Apply(const OsmChange &change);
+
+    auto MetricScale() const noexcept { return m_MetricScale; }
+
+    NodeArray Nodes() const noexcept { return {m_NodeX, m_NodeY}; }
+    auto &Ways() const noexcept { return m_Ways; }
+    auto &Roads() const noexcept { return m_Roads; }
+    auto &Buildings() const noexcept { return m_Buildings; }
+    auto &Leisures() const noexcept { return m_Leisures; }
+    auto &Waters() const noexcept { return m_Waters; }
+    auto &Landuses() const noexcept { return m_Landuses; }
+    auto &Railways() const noexcept { return m_Railways; }
+
+protected:
+    // Empties the node lists of the ways that are no road or railway, i.e.
+    // are only drawn as area rings, and drops the nodes no other way uses.
+    // For a model whose areas are drawn from a WayGeometry built before; node
+    // moves of a later diff don't reach such ways unless it changes them too.
+    // Returns the new index of every old node, -1 where it was dropped; the
+    // order of the kept nodes doesn't change.
+    std::vector<int> DropAreaWays();
+
+private:
+    enum class AreaLayer : std::uint8_t { None, Building, Leisure, Water, Landuse };
+
+    // Member ways of a polygon while it is assembled, copied to the arena once done.
+    struct Rings {
+        std::vector<int> outer;
+        std::vector<int> inner;
+    };
+
+    // A multipolygon with open member ways. Its area is placed when the
+    // relation is merged, the rings are joined after the last block, in
+    // parallel, and the joined ways appended in relation order.
+    struct PendingArea {
+        AreaLayer layer;
+        std::size_t area;               // index into the layer
+        Rings rings;
+    };
+
+    // Closed rings of one side of a polygon: member ways that were closed
+    // already, then the node lists joined from the open ones.
+    struct JoinedRings {
+        std::vector<int> closed;
+        std::vector<std::vector<int>> joined;
+    };
+
+    struct WayChunk;
+
+    // id lookups and scratch lists needed while the blocks are merged, dropped
+    // afterwards. With a store, node ids are looked up on disk and way ids in
+    // a sorted list instead of the hash maps.
+    struct Builder {
+        NodeStore *store = nullptr;
+        ThreadPool *pool = nullptr;     // resolves the ways of a block and joins rings, see MergeBlock()
+        std::unordered_map<std::int64_t, int> node_index;
+        std::unordered_map<std::int64_t, int> way_index;
+        std::vector<std::pair<std::int64_t, int>> node_ids;    // for m_NodeIds
+        std::vector<std::pair<std::int64_t, int>> way_ids;     // for m_WayIds, searched when streaming
+        std::vector<double> xs;         // raw lon/lat until AdjustCoordinates()
+        std::vector<double> ys;
+        std::vector<WayChunk> chunks;
+        Rings rings;
+        std::vector<PendingArea> pending;
+
+        Builder();
+        ~Builder();
+        int FindNode(std::int64_t id) const;            // -1 if not in the extract
+        int FindWay(std::int64_t id) const;
+        void AddWay(std::int64_t id, int way_num);
+    };
+
+    // feeds every block to the sink in file order, decoding on the pool, returns the header bounds
+    using BlockSource = std::function<std::optional<OsmBounds>(ThreadPool &, const std::function<void(OsmBlock &)> &)>;
+
+    void LoadData(const BlockSource &read, NodeStore *store);
+    void MergeBlock(Builder &builder, const OsmBlock &block);
+    static void ParseWays(const Builder &builder, const OsmBlock &block, std::size_t first, std::size_t last, WayChunk &chunk);
+    static AreaLayer ClassifyArea(std::string_view category, std::string_view type, Landuse::Type &landuse);
+    std::size_t AddArea(AreaLayer layer, Landuse::Type landuse);        // empty, returns its index in the layer
+    Multipolygon &Area(AreaLayer layer, std::size_t area);
+    void AdjustCoordinates(Builder &builder, const OsmBounds &bounds);
+    JoinedRings JoinRings(const std::vector<int> &way_nums) const;
+    void BuildPendingAreas(Builder &builder);
+    // Fills every way's node list again with rewrite(way_num, nodes), into a
+    // fresh arena that the area rings move to as well; the old one is freed.
+    template <typename F>
+    void RewriteWays(F &&rewrite);
+
+    Arena m_Arena;          // owns the node and ring lists of a model built from an extract or patched
+
+    IdIndex m_NodeIds;
+    IdIndex m_WayIds;
+    double m_OriginX = 0.;          // Web Mercator metres of the normalized origin, to place new nodes
+    double m_OriginY = 0.;
+
+    FlatArray<double> m_NodeX;      // owned, or views into the snapshot
+    FlatArray<double> m_NodeY;
+    std::vector<Way> m_Ways;
+    std::vector<Road> m_Roads;
+    std::vector<Railway> m_Railways;
+    std::vector<Building> m_Buildings;
+    std::vector<Leisure> m_Leisures;
+    std::vector<Water> m_Waters;
+    std::vector<Landuse> m_Landuses;
+
+    double m_MetricScale = 1.;
+};
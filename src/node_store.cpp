@@ -0,0 +1,56 @@
+#include "node_store.h"
+#include <algorithm>
+#include <stdexcept>
+#include <system_error>
+
+NodeStore::NodeStore(std::filesystem::path path) :
+    m_Path(std::move(path)),
+    m_Out(m_Path, std::ios::binary | std::ios::trunc)
+{
+    if(!m_Out)
+        throw std::runtime_error{"ingest: cannot create " + m_Path.string()};
+}
+
+NodeStore::~NodeStore() {
+    m_File.reset();
+    m_Out.close();
+    std::error_code ec;
+    std::filesystem::remove(m_Path, ec);
+}
+
+void NodeStore::Append(std::int64_t id, double lon, double lat) {
+    if(m_Size > 0 && id <= m_LastId)
+        throw std::runtime_error{"ingest: nodes are not sorted by id, sort the extract first"};
+    if(m_Size % kPageSize == 0)
+        m_Directory.push_back(id);
+    Record record{id, lon, lat};
+    m_Out.write(reinterpret_cast<const char *>(&record), sizeof(record));
+    m_LastId = id;
+    ++m_Size;
+}
+
+void NodeStore::Finish() {
+    m_Out.close();
+    if(!m_Out)
+        throw std::runtime_error{"ingest: failed to write " + m_Path.string()};
+    if(m_Size == 0) {
+        m_File.emplace();           // nothing to map, every lookup misses
+        return;
+    }
+    m_File = MappedFile::Open(m_Path.string(), MappedFile::Access::Random);
+    if(!m_File || m_File->size() != m_Size * sizeof(Record))
+        throw std::runtime_error{"ingest: cannot map " + m_Path.string()};
+}
+
+std::int64_t NodeStore::Find(std::int64_t id) const noexcept {
+    auto page = std::upper_bound(m_Directory.begin(), m_Directory.end(), id);
+    if(page == m_Directory.begin())
+        return -1;
+    auto first = static_cast<std::size_t>(page - m_Directory.begin() - 1) * kPageSize;
+    auto last = std::min(first + kPageSize, m_Size);
+    auto records = Records();
+    auto it = std::lower_bound(records + first, records + last, id, [](const Record &r, std::int64_t id){ return r.id < id; });
+    if(it == records + last || it->id != id)
+        return -1;
+    return it - records;
+}
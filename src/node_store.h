@@ -0,0 +1,49 @@
+#pragma once
+
+#include "mapped_file.h"
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <vector>
+
+// On-disk id -> coordinate index used by the streaming ingest. Nodes are
+// appended in ascending id order, as sorted extracts store them, to a scratch
+// file that is mapped once complete. A lookup binary searches a sparse
+// in-memory directory holding the id of every kPageSize-th record, then one
+// page of the file, so memory stays at a few bytes per thousand nodes.
+class NodeStore {
+public:
+    static constexpr std::size_t kPageSize = 1024;         // records per directory entry
+
+    explicit NodeStore(std::filesystem::path path);         // truncates path, throws if it can't be created
+    NodeStore(const NodeStore &) = delete;
+    NodeStore &operator=(const NodeStore &) = delete;
+    ~NodeStore();                                           // removes the file
+
+    void Append(std::int64_t id, double lon, double lat);   // throws unless ids ascend
+    void Finish();                                          // maps the file, no more Append() after this
+    bool Finished() const noexcept { return m_File.has_value(); }
+
+    std::size_t Size() const noexcept { return m_Size; }
+    std::int64_t Find(std::int64_t id) const noexcept;      // row, -1 if absent; needs Finish()
+    std::int64_t Id(std::size_t row) const noexcept { return Records()[row].id; }
+    double Lon(std::size_t row) const noexcept { return Records()[row].lon; }
+    double Lat(std::size_t row) const noexcept { return Records()[row].lat; }
+
+private:
+    struct Record {
+        std::int64_t id;
+        double lon;
+        double lat;
+    };
+
+    const Record *Records() const noexcept { return reinterpret_cast<const Record *>(m_File->data()); }
+
+    std::filesystem::path m_Path;
+    std::ofstream m_Out;
+    std::optional<MappedFile> m_File;
+    std::vector<std::int64_t> m_Directory;      // id of records 0, kPageSize, 2 * kPageSize, ...
+    std::size_t m_Size = 0;
+    std::int64_t m_LastId = 0;
+};
@@ -0,0 +1,236 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+// Open lists for the shortest path searches, keyed by vertex id. Both offer
+// the same interface: Push() inserts a vertex or lowers its key, Pop()
+// removes the vertex with the smallest key, Clear() empties the list in time
+// proportional to what was pushed since the last Clear().
+
+// Indexed 4-ary min-heap with true decrease-key.
+class IndexedHeap {
+public:
+    explicit IndexedHeap(std::uint32_t capacity = 0) : m_Position(capacity, kAbsent) {}
+
+    void Reserve(std::uint32_t capacity) {
+        if(m_Position.size() < capacity)
+            m_Position.resize(capacity, kAbsent);
+    }
+
+    bool Empty() const noexcept { return m_Heap.empty(); }
+    std::size_t Size() const noexcept { return m_Heap.size(); }
+    bool Contains(std::uint32_t v) const noexcept { return m_Position[v] != kAbsent; }
+    float Key(std::uint32_t v) const noexcept { return m_Heap[m_Position[v]].key; }
+    float TopKey() const noexcept { return m_Heap.front().key; }
+
+    void Push(std::uint32_t v, float key) {
+        auto pos = m_Position[v];
+        if(pos == kAbsent) {
+            pos = static_cast<std::uint32_t>(m_Heap.size());
+            m_Heap.push_back({key, v});
+        } else if(key < m_Heap[pos].key) {
+            m_Heap[pos].key = key;
+        } else {
+            return;
+        }
+        SiftUp(pos);
+    }
+
+    std::uint32_t Pop() {
+        auto top = m_Heap.front().vertex;
+        m_Position[top] = kAbsent;
+        auto last = m_Heap.back();
+        m_Heap.pop_back();
+        if(!m_Heap.empty()) {
+            m_Heap.front() = last;
+            m_Position[last.vertex] = 0;
+            SiftDown(0);
+        }
+        return top;
+    }
+
+    void Clear() noexcept {
+        for(auto &entry : m_Heap)
+            m_Position[entry.vertex] = kAbsent;
+        m_Heap.clear();
+    }
+
+private:
+    static constexpr std::uint32_t kAbsent = std::numeric_limits<std::uint32_t>::max();
+    static constexpr std::uint32_t kArity = 4;
+
+    struct Entry {
+        float key;
+        std::uint32_t vertex;
+    };
+
+    void SiftUp(std::uint32_t pos) {
+        auto entry = m_Heap[pos];
+        while(pos > 0) {
+            auto parent = (pos - 1) / kArity;
+            if(!(entry.key < m_Heap[parent].key))
+                break;
+            Place(pos, m_Heap[parent]);
+            pos = parent;
+        }
+        Place(pos, entry);
+    }
+
+    void SiftDown(std::uint32_t pos) {
+        auto entry = m_Heap[pos];
+        const auto size = static_cast<std::uint32_t>(m_Heap.size());
+        for(;;) {
+            auto first = pos * kArity + 1;
+            if(first >= size)
+                break;
+            auto best = first;
+            auto last = first + kArity < size ? first + kArity : size;
+            for(auto child = first + 1; child < last; ++child)
+                if(m_Heap[child].key < m_Heap[best].key)
+                    best = child;
+            if(!(m_Heap[best].key < entry.key))
+                break;
+            Place(pos, m_Heap[best]);
+            pos = best;
+        }
+        Place(pos, entry);
+    }
+
+    void Place(std::uint32_t pos, Entry entry) noexcept {
+        m_Heap[pos] = entry;
+        m_Position[entry.vertex] = pos;
+    }
+
+    std::vector<Entry> m_Heap;
+    std::vector<std::uint32_t> m_Position;      // slot in m_Heap per vertex, kAbsent if not queued
+};
+
+// Monotone radix heap. Keys must be non-negative and no smaller than the last
+// popped key, which holds for Dijkstra and for A* with a consistent heuristic;
+// smaller keys are clamped up to the last popped one. Non-negative floats
+// compare like their bit patterns, so the buckets work on those. Decrease-key
+// pushes a second entry and the stale one is dropped when it surfaces.
+class RadixHeap {
+public:
+    explicit RadixHeap(std::uint32_t capacity = 0) : m_Key(capacity, kAbsent) {}
+
+    void Reserve(std::uint32_t capacity) {
+        if(m_Key.size() < capacity)
+            m_Key.resize(capacity, kAbsent);
+    }
+
+    bool Empty() noexcept { return !Settle(); }
+    std::size_t Size() const noexcept { return m_Live; }
+    bool Contains(std::uint32_t v) const noexcept { return m_Key[v] != kAbsent; }
+    float Key(std::uint32_t v) const noexcept { return ToFloat(m_Key[v]); }
+    float TopKey() noexcept { Settle(); return ToFloat(m_Buckets[0].back().key); }
+
+    void Push(std::uint32_t v, float key) {
+        auto bits = ToBits(key);
+        if(bits < m_Last)
+            bits = m_Last;
+        if(m_Key[v] == kAbsent) {
+            ++m_Live;
+            m_Touched.push_back(v);
+        } else if(bits >= m_Key[v]) {
+            return;
+        }
+        m_Key[v] = bits;
+        m_Buckets[Bucket(bits)].push_back({bits, v});
+    }
+
+    std::uint32_t Pop() {
+        Settle();
+        auto v = m_Buckets[0].back().vertex;
+        m_Buckets[0].pop_back();
+        m_Key[v] = kAbsent;
+        --m_Live;
+        return v;
+    }
+
+    void Clear() noexcept {
+        for(auto v : m_Touched)
+            m_Key[v] = kAbsent;
+        m_Touched.clear();
+        for(auto &bucket : m_Buckets)
+            bucket.clear();
+        m_Last = 0;
+        m_Live = 0;
+    }
+
+private:
+    static constexpr std::uint32_t kAbsent = std::numeric_limits<std::uint32_t>::max();
+
+    struct Entry {
+        std::uint32_t key;
+        std::uint32_t vertex;
+    };
+
+    static std::uint32_t ToBits(float key) noexcept {
+        if(!(key > 0.f))
+            return 0;           // also maps -0 and NaN onto the smallest key
+        std::uint32_t bits;
+        std::memcpy(&bits, &key, sizeof(bits));
+        return bits;
+    }
+
+    static float ToFloat(std::uint32_t bits) noexcept {
+        float key;
+        std::memcpy(&key, &bits, sizeof(key));
+        return key;
+    }
+
+    std::size_t Bucket(std::uint32_t bits) const noexcept {
+        return bits == m_Last ? 0 : 32 - static_cast<std::size_t>(__builtin_clz(bits ^ m_Last));
+    }
+
+    bool IsStale(const Entry &entry) const noexcept { return m_Key[entry.vertex] != entry.key; }
+
+    // Makes sure bucket 0 ends with a live entry, false if the heap is empty.
+    bool Settle() noexcept {
+        auto &front = m_Buckets[0];
+        while(!front.empty() && IsStale(front.back()))
+            front.pop_back();
+        if(!front.empty())
+            return true;
+        if(m_Live == 0)
+            return false;
+
+        // refill bucket 0 from the first non-empty bucket, re-keyed on its minimum
+        for(std::size_t i = 1; i < m_Buckets.size(); ++i) {
+            auto &bucket = m_Buckets[i];
+            auto min_key = kAbsent;
+            for(auto &entry : bucket)
+                if(!IsStale(entry) && entry.key < min_key)
+                    min_key = entry.key;
+            if(min_key == kAbsent) {
+                bucket.clear();
+                continue;
+            }
+            m_Last = min_key;
+            for(auto &entry : bucket)
+                if(!IsStale(entry))
+                    m_Buckets[Bucket(entry.key)].push_back(entry);
+            bucket.clear();
+            return true;
+        }
+        return false;
+    }
+
+    std::array<std::vector<Entry>, 33> m_Buckets;
+    std::vector<std::uint32_t> m_Key;           // current key bits per vertex, kAbsent if not queued
+    std::vector<std::uint32_t> m_Touched;
+    std::uint32_t m_Last = 0;
+    std::size_t m_Live = 0;
+};
+
+// Picked at build time, define ROUTEMS_RADIX_HEAP to benchmark the radix heap.
+#ifdef ROUTEMS_RADIX_HEAP
+using OpenList = RadixHeap;
+#else
+using OpenList = IndexedHeap;
+#endif
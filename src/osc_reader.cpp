@@ -0,0 +1,282 @@
+#include "osc_reader.h"
+#include <cerrno>
+#include <cstdlib>
+#include <stdexcept>
+#include <zlib.h>
+
+namespace {
+
+// Pull parser over the element tags of an XML document. Text content,
+// comments, processing instructions and declarations are skipped, which is
+// all osmChange needs.
+class TagScanner {
+public:
+    struct Tag {
+        std::string_view name;
+        bool closing = false;           // </name>
+        bool empty = false;             // <name ... />
+        std::vector<std::pair<std::string_view, std::string>> attributes;
+
+        const std::string *Attribute(std::string_view key) const noexcept {
+            for(auto &attribute : attributes)
+                if(attribute.first == key)
+                    return &attribute.second;
+            return nullptr;
+        }
+    };
+
+    explicit TagScanner(std::string_view xml) noexcept : m_Xml(xml) {}
+
+    bool Next(Tag &tag) {
+        while(true) {
+            auto open = m_Xml.find('<', m_Pos);
+            if(open == std::string_view::npos)
+                return false;
+            m_Pos = open;
+            if(Skip("<!--", "-->") || Skip("<?", "?>") || Skip("<!", ">"))
+                continue;
+            ParseTag(tag);
+            return true;
+        }
+    }
+
+private:
+    bool Skip(std::string_view start, std::string_view end) {
+        if(m_Xml.compare(m_Pos, start.size(), start) != 0)
+            return false;
+        auto close = m_Xml.find(end, m_Pos + start.size());
+        if(close == std::string_view::npos)
+            throw std::runtime_error{"osc: unterminated markup"};
+        m_Pos = close + end.size();
+        return true;
+    }
+
+    static bool IsSpace(char c) noexcept { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+    char Peek() const {
+        if(m_Pos >= m_Xml.size())
+            throw std::runtime_error{"osc: unterminated tag"};
+        return m_Xml[m_Pos];
+    }
+
+    void SkipSpace() {
+        while(IsSpace(Peek()))
+            ++m_Pos;
+    }
+
+    std::string_view ReadName() {
+        auto first = m_Pos;
+        while(!IsSpace(Peek()) && Peek() != '/' && Peek() != '>' && Peek() != '=')
+            ++m_Pos;
+        if(m_Pos == first)
+            throw std::runtime_error{"osc: expected a name"};
+        return m_Xml.substr(first, m_Pos - first);
+    }
+
+    void ParseTag(Tag &tag) {
+        ++m_Pos;            // '<'
+        tag.closing = Peek() == '/';
+        if(tag.closing)
+            ++m_Pos;
+        tag.name = ReadName();
+        tag.empty = false;
+        tag.attributes.clear();
+        while(true) {
+            SkipSpace();
+            if(Peek() == '>') {
+                ++m_Pos;
+                return;
+            }
+            if(Peek() == '/') {
+                ++m_Pos;
+                if(Peek() != '>')
+                    throw std::runtime_error{"osc: malformed empty element"};
+                ++m_Pos;
+                tag.empty = true;
+                return;
+            }
+            auto key = ReadName();
+            SkipSpace();
+            if(Peek() != '=')
+                throw std::runtime_error{"osc: attribute without value"};
+            ++m_Pos;
+            SkipSpace();
+            auto quote = Peek();
+            if(quote != '"' && quote != '\'')
+                throw std::runtime_error{"osc: unquoted attribute value"};
+            auto close = m_Xml.find(quote, ++m_Pos);
+            if(close == std::string_view::npos)
+                throw std::runtime_error{"osc: unterminated attribute value"};
+            tag.attributes.emplace_back(key, Unescape(m_Xml.substr(m_Pos, close - m_Pos)));
+            m_Pos = close + 1;
+        }
+    }
+
+    static void AppendUtf8(std::string &out, unsigned long code) {
+        if(code < 0x80) {
+            out += static_cast<char>(code);
+        } else if(code < 0x800) {
+            out += static_cast<char>(0xc0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3f));
+        } else if(code < 0x10000) {
+            out += static_cast<char>(0xe0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (code & 0x3f));
+        } else if(code < 0x110000) {
+            out += static_cast<char>(0xf0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (code & 0x3f));
+        } else {
+            throw std::runtime_error{"osc: character reference out of range"};
+        }
+    }
+
+    static std::string Unescape(std::string_view raw) {
+        std::string out;
+        out.reserve(raw.size());
+        for(std::size_t i = 0; i < raw.size(); ++i) {
+            if(raw[i] != '&') {
+                out += raw[i];
+                continue;
+            }
+            auto semicolon = raw.find(';', i);
+            if(semicolon == std::string_view::npos)
+                throw std::runtime_error{"osc: unterminated entity"};
+            auto entity = raw.substr(i + 1, semicolon - i - 1);
+            if(entity == "amp") out += '&';
+            else if(entity == "lt") out += '<';
+            else if(entity == "gt") out += '>';
+            else if(entity == "quot") out += '"';
+            else if(entity == "apos") out += '\'';
+            else if(entity.size() > 1 && entity[0] == '#') {
+                std::string digits{entity.substr(1)};
+                auto hex = digits[0] == 'x' || digits[0] == 'X';
+                char *end = nullptr;
+                auto code = std::strtoul(digits.c_str() + (hex ? 1 : 0), &end, hex ? 16 : 10);
+                if(*end != '\0')
+                    throw std::runtime_error{"osc: malformed character reference"};
+                AppendUtf8(out, code);
+            }
+            else
+                throw std::runtime_error{"osc: unknown entity"};
+            i = semicolon;
+        }
+        return out;
+    }
+
+    std::string_view m_Xml;
+    std::size_t m_Pos = 0;
+};
+
+std::int64_t ParseId(const TagScanner::Tag &tag, std::string_view key) {
+    auto value = tag.Attribute(key);
+    if(!value)
+        throw std::runtime_error{"osc: " + std::string{tag.name} + " without " + std::string{key}};
+    char *end = nullptr;
+    errno = 0;
+    auto id = std::strtoll(value->c_str(), &end, 10);
+    if(value->empty() || *end != '\0' || errno == ERANGE)
+        throw std::runtime_error{"osc: malformed " + std::string{key} + " \"" + *value + "\""};
+    return id;
+}
+
+double ParseCoordinate(const TagScanner::Tag &tag, std::string_view key) {
+    auto value = tag.Attribute(key);
+    if(!value)
+        throw std::runtime_error{"osc: node without " + std::string{key}};
+    char *end = nullptr;
+    auto coordinate = std::strtod(value->c_str(), &end);
+    if(value->empty() || *end != '\0')
+        throw std::runtime_error{"osc: malformed " + std::string{key} + " \"" + *value + "\""};
+    return coordinate;
+}
+
+}
+
+OsmChange ParseOsmChange(std::string_view xml) {
+    OsmChange change;
+    auto action = OsmChange::Modify;
+    bool in_action = false;                 // inside create, modify or delete
+    OsmChange::Way *way = nullptr;          // open <way>, collects nd and tag children
+    bool in_relation = false;
+    bool seen_root = false;
+
+    TagScanner scanner{xml};
+    TagScanner::Tag tag;
+    while(scanner.Next(tag)) {
+        auto name = tag.name;
+        if(name == "osmChange") {
+            seen_root = true;
+            continue;
+        }
+        if(name == "create" || name == "modify" || name == "delete") {
+            in_action = !tag.closing && !tag.empty;
+            action = name == "create" ? OsmChange::Create : name == "modify" ? OsmChange::Modify : OsmChange::Delete;
+            continue;
+        }
+        if(tag.closing) {
+            if(name == "way")
+                way = nullptr;
+            else if(name == "relation")
+                in_relation = false;
+            continue;
+        }
+        if(in_relation)
+            continue;           // members and tags of a skipped relation
+
+        if(name == "node" || name == "way" || name == "relation") {
+            if(!in_action)
+                throw std::runtime_error{"osc: " + std::string{name} + " outside create, modify or delete"};
+            if(way)
+                throw std::runtime_error{"osc: unterminated way"};
+        }
+        if(name == "node") {
+            OsmChange::Node node;
+            node.action = action;
+            node.id = ParseId(tag, "id");
+            if(node.action != OsmChange::Delete) {
+                node.lat = ParseCoordinate(tag, "lat");
+                node.lon = ParseCoordinate(tag, "lon");
+            }
+            change.nodes.push_back(node);
+        } else if(name == "way") {
+            auto &added = change.ways.emplace_back();
+            added.action = action;
+            added.id = ParseId(tag, "id");
+            if(!tag.empty)
+                way = &added;
+        } else if(name == "relation") {
+            ++change.relations;
+            in_relation = !tag.empty;
+        } else if(name == "nd" && way) {
+            way->refs.push_back(ParseId(tag, "ref"));
+        } else if(name == "tag" && way) {
+            auto key = tag.Attribute("k"), value = tag.Attribute("v");
+            if(!key || !value)
+                throw std::runtime_error{"osc: tag without k or v"};
+            way->tags.emplace_back(*key, *value);
+        }
+    }
+    if(!seen_root)
+        throw std::runtime_error{"osc: not an osmChange document"};
+    if(way || in_relation)
+        throw std::runtime_error{"osc: truncated document"};
+    return change;
+}
+
+std::optional<std::string> ReadOsmChangeFile(const std::string &path) {
+    auto file = gzopen(path.c_str(), "rb");         // reads uncompressed files as they are
+    if(!file)
+        return std::nullopt;
+    std::string xml;
+    char buffer[1 << 16];
+    int read;
+    while((read = gzread(file, buffer, sizeof(buffer))) > 0)
+        xml.append(buffer, static_cast<std::size_t>(read));
+    auto ok = read == 0;
+    gzclose(file);
+    if(!ok)
+        return std::nullopt;
+    return xml;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Contents of an osmChange (.osc) file, the format of the minutely, hourly and
+// daily replication diffs. Nodes and ways keep their file order; relations are
+// only counted, the model doesn't patch polygons.
+struct OsmChange {
+    enum Action { Create, Modify, Delete };
+
+    struct Node {
+        Action action = Modify;
+        std::int64_t id = 0;
+        double lat = 0.;
+        double lon = 0.;
+    };
+
+    struct Way {
+        Action action = Modify;
+        std::int64_t id = 0;
+        std::vector<std::int64_t> refs;
+        std::vector<std::pair<std::string, std::string>> tags;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<Way> ways;
+    std::size_t relations = 0;
+};
+
+// Parses osmChange XML, throws std::runtime_error on malformed input.
+OsmChange ParseOsmChange(std::string_view xml);
+
+// Reads a plain or gzip compressed .osc file, nullopt if it can't be read.
+std::optional<std::string> ReadOsmChangeFile(const std::string &path);
@@ -0,0 +1,570 @@
+#include "pbf_reader.h"
+#include "chunk_reader.h"
+#include "instrument.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <zlib.h>
+
+namespace {
+
+// Minimal protobuf wire format reader, just enough for the OSM PBF messages.
+class ProtoReader {
+public:
+    enum WireType { Varint = 0, Fixed64 = 1, Bytes = 2, Fixed32 = 5 };
+
+    ProtoReader() = default;
+    ProtoReader(const char *data, std::size_t size) : m_Pos(data), m_End(data + size) {}
+    explicit ProtoReader(std::string_view bytes) : ProtoReader(bytes.data(), bytes.size()) {}
+
+    // Advances to the next field, false at the end of the message.
+    bool Next() {
+        if(m_Pos == m_End)
+            return false;
+        auto key = Varint64();
+        m_Field = static_cast<std::uint32_t>(key >> 3);
+        m_WireType = static_cast<int>(key & 7);
+        return true;
+    }
+
+    std::uint32_t Field() const noexcept { return m_Field; }
+    int Wire() const noexcept { return m_WireType; }
+
+    std::uint64_t Varint64() {
+        std::uint64_t value = 0;
+        for(int shift = 0; shift < 64; shift += 7) {
+            if(m_Pos == m_End)
+                throw std::runtime_error{"pbf: truncated varint"};
+            auto byte = static_cast<std::uint8_t>(*m_Pos++);
+            value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+            if(!(byte & 0x80))
+                return value;
+        }
+        throw std::runtime_error{"pbf: varint too long"};
+    }
+
+    std::int64_t Int64() { return static_cast<std::int64_t>(Varint64()); }
+    std::int64_t SInt64() {
+        auto v = Varint64();
+        return static_cast<std::int64_t>(v >> 1) ^ -static_cast<std::int64_t>(v & 1);      // zigzag
+    }
+
+    std::string_view View() {
+        auto size = Varint64();
+        if(size > static_cast<std::uint64_t>(m_End - m_Pos))
+            throw std::runtime_error{"pbf: field runs past the end of its message"};
+        std::string_view bytes{m_Pos, static_cast<std::size_t>(size)};
+        m_Pos += size;
+        return bytes;
+    }
+
+    void Skip() {
+        switch(m_WireType) {
+            case Varint: Varint64(); break;
+            case Fixed64: Advance(8); break;
+            case Bytes: View(); break;
+            case Fixed32: Advance(4); break;
+            default: throw std::runtime_error{"pbf: unsupported wire type"};
+        }
+    }
+
+    // Repeated scalar fields may be written packed or one value per key.
+    template <typename F>
+    void Repeated(F &&append) {
+        if(m_WireType == Bytes) {
+            ProtoReader packed{View()};
+            while(packed.m_Pos != packed.m_End)
+                append(packed);
+        } else {
+            append(*this);
+        }
+    }
+
+private:
+    void Advance(std::size_t n) {
+        if(n > static_cast<std::size_t>(m_End - m_Pos))
+            throw std::runtime_error{"pbf: truncated fixed field"};
+        m_Pos += n;
+    }
+
+    const char *m_Pos = nullptr;
+    const char *m_End = nullptr;
+    std::uint32_t m_Field = 0;
+    int m_WireType = 0;
+};
+
+std::string_view AsView(const PbfReader::Frame &frame) {
+    return {reinterpret_cast<const char *>(frame.data), frame.size};
+}
+
+// Limits of the format spec; checked before anything is allocated for a blob.
+constexpr std::size_t kMaxBlobHeaderSize = 64 * 1024;
+constexpr std::size_t kMaxBlobSize = 32 * 1024 * 1024;         // compressed and inflated
+
+std::uint32_t ReadBigEndian32(const std::byte *p) {
+    return (std::to_integer<std::uint32_t>(p[0]) << 24) | (std::to_integer<std::uint32_t>(p[1]) << 16) |
+           (std::to_integer<std::uint32_t>(p[2]) << 8) | std::to_integer<std::uint32_t>(p[3]);
+}
+
+struct BlobHeader {
+    std::string_view type;
+    std::uint64_t blob_size = 0;
+};
+
+BlobHeader ParseBlobHeader(const std::byte *data, std::size_t size) {
+    BlobHeader header;
+    for(ProtoReader pr{reinterpret_cast<const char *>(data), size}; pr.Next();) {
+        switch(pr.Field()) {
+            case 1: header.type = pr.View(); break;
+            case 3: header.blob_size = pr.Varint64(); break;
+            default: pr.Skip();
+        }
+    }
+    return header;
+}
+
+// Waits for the decodes still queued when reading stops early, on an error,
+// so none of them outlives the data or the buffers it works on.
+struct WaitForAll {
+    std::deque<std::future<OsmBlock>> &futures;
+
+    ~WaitForAll() {
+        for(auto &future : futures)
+            if(future.valid())
+                future.wait();
+    }
+};
+
+// Blob buffers handed from the reading thread to the decode workers and back,
+// keeping their capacity. At most `limit` are out at once, Take() waits for
+// one to come back, so at most limit times the largest blob is held.
+class BlobBuffers {
+public:
+    explicit BlobBuffers(std::size_t limit) : m_Limit(limit) {}
+
+    std::vector<std::byte> Take() {
+        std::unique_lock<std::mutex> lock{m_Mutex};
+        m_Returned.wait(lock, [&]{ return m_Out < m_Limit; });
+        ++m_Out;
+        if(m_Free.empty())
+            return {};
+        auto buffer = std::move(m_Free.back());
+        m_Free.pop_back();
+        return buffer;
+    }
+
+    void Give(std::vector<std::byte> buffer) {
+        {
+            std::lock_guard<std::mutex> lock{m_Mutex};
+            --m_Out;
+            m_Free.push_back(std::move(buffer));
+        }
+        m_Returned.notify_one();
+    }
+
+private:
+    std::mutex m_Mutex;
+    std::condition_variable m_Returned;
+    std::vector<std::vector<std::byte>> m_Free;
+    std::size_t m_Limit;
+    std::size_t m_Out = 0;
+};
+
+// Scratch state shared by the groups of one PrimitiveBlock.
+struct BlockContext {
+    std::vector<std::string_view> strings;
+    std::int64_t granularity = 100;
+    std::int64_t lat_offset = 0;
+    std::int64_t lon_offset = 0;
+
+    std::string_view String(std::uint64_t index) const {
+        if(index >= strings.size())
+            throw std::runtime_error{"pbf: string table index out of range"};
+        return strings[index];
+    }
+    double Lat(std::int64_t raw) const noexcept { return 1e-9 * static_cast<double>(lat_offset + granularity * raw); }
+    double Lon(std::int64_t raw) const noexcept { return 1e-9 * static_cast<double>(lon_offset + granularity * raw); }
+};
+
+// A list that is still being appended to its pool only records its length,
+// the pool can reallocate; FixUp() points it at the pool once the block is decoded.
+template <typename T>
+Span<const T> Placeholder(std::size_t count) { return {nullptr, count}; }
+
+template <typename T>
+void FixUp(const std::vector<T> &pool, Span<const T> &span, std::size_t &offset) {
+    span = {pool.data() + offset, span.size()};
+    offset += span.size();
+}
+
+// Appends the tags to the pool.
+Span<const OsmTag> ZipTags(const BlockContext &ctx, const std::vector<std::uint32_t> &keys,
+                           const std::vector<std::uint32_t> &vals, std::vector<OsmTag> &pool) {
+    if(keys.size() != vals.size())
+        throw std::runtime_error{"pbf: tag keys and values differ in length"};
+    for(std::size_t i = 0; i < keys.size(); ++i)
+        pool.push_back({ctx.String(keys[i]), ctx.String(vals[i])});
+    return Placeholder<OsmTag>(keys.size());
+}
+
+void DecodeNode(const BlockContext &ctx, std::string_view message, std::vector<OsmNode> &nodes) {
+    OsmNode node;
+    std::int64_t lat = 0, lon = 0;
+    for(ProtoReader pr{message}; pr.Next();) {
+        switch(pr.Field()) {
+            case 1: node.id = pr.SInt64(); break;
+            case 8: lat = pr.SInt64(); break;
+            case 9: lon = pr.SInt64(); break;
+            default: pr.Skip();
+        }
+    }
+    node.lat = ctx.Lat(lat);
+    node.lon = ctx.Lon(lon);
+    nodes.push_back(node);
+}
+
+void DecodeDenseNodes(const BlockContext &ctx, std::string_view message, std::vector<OsmNode> &nodes) {
+    std::vector<std::int64_t> ids, lats, lons;
+    for(ProtoReader pr{message}; pr.Next();) {
+        switch(pr.Field()) {
+            case 1: pr.Repeated([&](ProtoReader &r){ ids.push_back(r.SInt64()); }); break;
+            case 8: pr.Repeated([&](ProtoReader &r){ lats.push_back(r.SInt64()); }); break;
+            case 9: pr.Repeated([&](ProtoReader &r){ lons.push_back(r.SInt64()); }); break;
+            default: pr.Skip();         // denseinfo and keys_vals are not used by the model
+        }
+    }
+    if(ids.size() != lats.size() || ids.size() != lons.size())
+        throw std::runtime_error{"pbf: dense node arrays differ in length"};
+
+    std::int64_t id = 0, lat = 0, lon = 0;        // all three columns are delta coded
+    nodes.reserve(nodes.size() + ids.size());
+    for(std::size_t i = 0; i < ids.size(); ++i) {
+        id += ids[i];
+        lat += lats[i];
+        lon += lons[i];
+        nodes.push_back({id, ctx.Lat(lat), ctx.Lon(lon)});
+    }
+}
+
+void DecodeWay(const BlockContext &ctx, std::string_view message, OsmBlock &block) {
+    OsmWay way;
+    auto refs = block.refs.size();
+    std::vector<std::uint32_t> keys, vals;
+    for(ProtoReader pr{message}; pr.Next();) {
+        switch(pr.Field()) {
+            case 1: way.id = pr.Int64(); break;
+            case 2: pr.Repeated([&](ProtoReader &r){ keys.push_back(static_cast<std::uint32_t>(r.Varint64())); }); break;
+            case 3: pr.Repeated([&](ProtoReader &r){ vals.push_back(static_cast<std::uint32_t>(r.Varint64())); }); break;
+            case 8: {
+                std::int64_t ref = 0;
+                pr.Repeated([&](ProtoReader &r){ ref += r.SInt64(); block.refs.push_back(ref); });
+                break;
+            }
+            default: pr.Skip();
+        }
+    }
+    way.refs = Placeholder<std::int64_t>(block.refs.size() - refs);
+    way.tags = ZipTags(ctx, keys, vals, block.way_tags);
+    block.ways.push_back(way);
+}
+
+void DecodeRelation(const BlockContext &ctx, std::string_view message, OsmBlock &block) {
+    OsmRelation relation;
+    std::vector<std::uint32_t> keys, vals;
+    std::vector<std::int64_t> roles, memids, types;
+    for(ProtoReader pr{message}; pr.Next();) {
+        switch(pr.Field()) {
+            case 1: relation.id = pr.Int64(); break;
+            case 2: pr.Repeated([&](ProtoReader &r){ keys.push_back(static_cast<std::uint32_t>(r.Varint64())); }); break;
+            case 3: pr.Repeated([&](ProtoReader &r){ vals.push_back(static_cast<std::uint32_t>(r.Varint64())); }); break;
+            case 8: pr.Repeated([&](ProtoReader &r){ roles.push_back(r.Int64()); }); break;
+            case 9: pr.Repeated([&](ProtoReader &r){ memids.push_back(r.SInt64()); }); break;
+            case 10: pr.Repeated([&](ProtoReader &r){ types.push_back(r.Int64()); }); break;
+            default: pr.Skip();
+        }
+    }
+    if(roles.size() != memids.size() || roles.size() != types.size())
+        throw std::runtime_error{"pbf: relation member arrays differ in length"};
+
+    std::int64_t ref = 0;
+    for(std::size_t i = 0; i < memids.size(); ++i) {
+        ref += memids[i];
+        if(types[i] < OsmMember::Node || types[i] > OsmMember::Relation)
+            throw std::runtime_error{"pbf: unknown relation member type"};
+        block.members.push_back({static_cast<OsmMember::Type>(types[i]), ref,
+                                    ctx.String(static_cast<std::uint64_t>(roles[i]))});
+    }
+    relation.members = Placeholder<OsmMember>(memids.size());
+    relation.tags = ZipTags(ctx, keys, vals, block.relation_tags);
+    block.relations.push_back(relation);
+}
+
+void DecodeGroup(const BlockContext &ctx, std::string_view message, OsmBlock &block) {
+    for(ProtoReader pr{message}; pr.Next();) {
+        switch(pr.Field()) {
+            case 1: DecodeNode(ctx, pr.View(), block.nodes); break;
+            case 2: DecodeDenseNodes(ctx, pr.View(), block.nodes); break;
+            case 3: DecodeWay(ctx, pr.View(), block); break;
+            case 4: DecodeRelation(ctx, pr.View(), block); break;
+            default: pr.Skip();         // changesets
+        }
+    }
+}
+
+}
+
+PbfReader::PbfReader(const std::byte *data, std::size_t size) {
+    std::size_t pos = 0;
+    while(pos < size) {
+        if(size - pos < 4)
+            throw std::runtime_error{"pbf: truncated blob header length"};
+        auto header_size = ReadBigEndian32(data + pos);
+        pos += 4;
+        if(header_size > kMaxBlobHeaderSize)
+            throw std::runtime_error{"pbf: blob header too large"};
+        if(header_size > size - pos)
+            throw std::runtime_error{"pbf: truncated blob header"};
+
+        auto [type, blob_size] = ParseBlobHeader(data + pos, header_size);
+        pos += header_size;
+        if(blob_size > kMaxBlobSize)
+            throw std::runtime_error{"pbf: blob too large"};
+        if(blob_size > size - pos)
+            throw std::runtime_error{"pbf: truncated blob"};
+
+        Frame blob{data + pos, static_cast<std::size_t>(blob_size)};
+        pos += blob_size;
+        if(type == "OSMHeader")
+            m_Bounds = ReadHeader(blob);
+        else if(type == "OSMData")
+            m_Frames.push_back(blob);
+        // unknown blob types must be skipped according to the format spec
+    }
+}
+
+std::optional<OsmBounds> PbfReader::ReadHeader(const Frame &blob) {
+    std::optional<OsmBounds> bounds;
+    auto bytes = Inflate(blob);
+    for(ProtoReader pr{bytes.data(), bytes.size()}; pr.Next();) {
+        if(pr.Field() == 1) {
+            std::int64_t left = 0, right = 0, top = 0, bottom = 0;       // nanodegrees
+            for(ProtoReader bbox{pr.View()}; bbox.Next();) {
+                switch(bbox.Field()) {
+                    case 1: left = bbox.SInt64(); break;
+                    case 2: right = bbox.SInt64(); break;
+                    case 3: top = bbox.SInt64(); break;
+                    case 4: bottom = bbox.SInt64(); break;
+                    default: bbox.Skip();
+                }
+            }
+            bounds = OsmBounds{1e-9 * bottom, 1e-9 * left, 1e-9 * top, 1e-9 * right};
+        } else if(pr.Field() == 4) {
+            auto feature = pr.View();
+            if(feature != "OsmSchema-V0.6" && feature != "DenseNodes")
+                throw std::runtime_error{"pbf: unsupported required feature " + std::string{feature}};
+        } else {
+            pr.Skip();
+        }
+    }
+    return bounds;
+}
+
+std::vector<char> PbfReader::Inflate(const Frame &blob) {
+    std::string_view raw, zlib_data;
+    std::uint64_t raw_size = 0;
+    for(ProtoReader pr{AsView(blob)}; pr.Next();) {
+        switch(pr.Field()) {
+            case 1: raw = pr.View(); break;
+            case 2: raw_size = pr.Varint64(); break;
+            case 3: zlib_data = pr.View(); break;
+            case 4: case 5: case 6: case 7:
+                throw std::runtime_error{"pbf: only raw and zlib compressed blobs are supported"};
+            default: pr.Skip();
+        }
+    }
+
+    if(!raw.empty() || zlib_data.empty())
+        return std::vector<char>(raw.begin(), raw.end());
+
+    if(raw_size > kMaxBlobSize)
+        throw std::runtime_error{"pbf: inflated blob too large"};
+    std::vector<char> out(raw_size);
+    z_stream zs{};
+    zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(zlib_data.data()));
+    zs.avail_in = static_cast<uInt>(zlib_data.size());
+    zs.next_out = reinterpret_cast<Bytef *>(out.data());
+    zs.avail_out = static_cast<uInt>(out.size());
+    if(inflateInit(&zs) != Z_OK)
+        throw std::runtime_error{"pbf: inflateInit failed"};
+    auto status = inflate(&zs, Z_FINISH);
+    inflateEnd(&zs);
+    if(status != Z_STREAM_END || zs.total_out != raw_size)
+        throw std::runtime_error{"pbf: corrupt zlib blob"};
+    return out;
+}
+
+OsmBlock PbfReader::DecodeBlock(const Frame &blob) {
+    ROUTEMS_TRACE_SCOPE("pbf.decode_block");
+    OsmBlock block;
+    auto storage = std::make_shared<const std::vector<char>>(Inflate(blob));
+    block.storage = storage;
+
+    BlockContext ctx;
+    std::vector<std::string_view> groups;
+    for(ProtoReader pr{storage->data(), storage->size()}; pr.Next();) {
+        switch(pr.Field()) {
+            case 1:
+                for(ProtoReader st{pr.View()}; st.Next();)
+                    if(st.Field() == 1) ctx.strings.push_back(st.View()); else st.Skip();
+                break;
+            case 2: groups.push_back(pr.View()); break;
+            case 17: ctx.granularity = pr.Int64(); break;
+            case 19: ctx.lat_offset = pr.Int64(); break;
+            case 20: ctx.lon_offset = pr.Int64(); break;
+            default: pr.Skip();
+        }
+    }
+
+    // groups can precede the granularity fields in the stream, so decode them last
+    for(auto group : groups)
+        DecodeGroup(ctx, group, block);
+
+    // the pools are complete, the lists were appended in primitive order
+    std::size_t refs = 0, way_tags = 0, members = 0, relation_tags = 0;
+    for(auto &way : block.ways) {
+        FixUp(block.refs, way.refs, refs);
+        FixUp(block.way_tags, way.tags, way_tags);
+    }
+    for(auto &relation : block.relations) {
+        FixUp(block.members, relation.members, members);
+        FixUp(block.relation_tags, relation.tags, relation_tags);
+    }
+    return block;
+}
+
+void PbfReader::Read(const std::function<void(OsmBlock &)> &sink, unsigned threads) const {
+    ThreadPool pool{threads};
+    Read(sink, pool);
+}
+
+void PbfReader::Read(const std::function<void(OsmBlock &)> &sink, ThreadPool &pool) const {
+    const std::size_t window = 2 * pool.Size();        // bounds the number of decoded blocks held in memory
+    std::deque<std::future<OsmBlock>> in_flight;
+    WaitForAll pending{in_flight};
+
+    auto drain_one = [&]{
+        auto block = in_flight.front().get();       // rethrows decode errors
+        in_flight.pop_front();
+        sink(block);
+    };
+
+    for(const auto &frame : m_Frames) {
+        if(in_flight.size() >= window)
+            drain_one();
+        in_flight.push_back(pool.Submit([frame]{ return DecodeBlock(frame); }));
+    }
+    while(!in_flight.empty())
+        drain_one();
+}
+
+std::optional<OsmBounds> PbfReader::ReadFile(const std::string &path, const std::function<void(OsmBlock &)> &sink, unsigned threads) {
+    ThreadPool pool{threads};
+    return ReadFile(path, sink, pool);
+}
+
+std::optional<OsmBounds> PbfReader::ReadFile(const std::string &path, const std::function<void(OsmBlock &)> &sink, ThreadPool &pool) {
+    auto file = ChunkReader::Open(path);
+    if(!file)
+        throw std::runtime_error{"pbf: cannot read " + path};
+
+    const std::size_t window = 2 * pool.Size();
+    BlobBuffers buffers{window + 1};        // one per decode in flight and the one being read; the workers give them back
+    std::deque<std::future<OsmBlock>> in_flight;
+    WaitForAll pending{in_flight};  // declared after the buffers, so the decodes are done before they go
+
+    auto drain_one = [&]{
+        auto block = in_flight.front().get();
+        in_flight.pop_front();
+        sink(block);
+    };
+
+    // copies the next bytes of the file to out across chunk boundaries, fewer at the end
+    Span<const std::byte> chunk;
+    std::size_t chunk_pos = 0;
+    auto read = [&](std::byte *out, std::size_t size) {
+        std::size_t copied = 0;
+        while(copied < size) {
+            if(chunk_pos == chunk.size()) {
+                chunk = file->Next();
+                chunk_pos = 0;
+                if(chunk.empty())
+                    break;
+            }
+            auto n = std::min(size - copied, chunk.size() - chunk_pos);
+            std::memcpy(out + copied, chunk.data() + chunk_pos, n);
+            copied += n;
+            chunk_pos += n;
+        }
+        return copied;
+    };
+
+    std::optional<OsmBounds> bounds;
+    std::vector<std::byte> header;
+    for(std::uint64_t pos = 0;;) {
+        std::byte length[4];
+        auto got = read(length, sizeof(length));
+        if(got == 0)
+            break;
+        if(got < sizeof(length))
+            throw std::runtime_error{"pbf: truncated blob header length"};
+        auto header_size = ReadBigEndian32(length);
+        pos += sizeof(length);
+        if(header_size > kMaxBlobHeaderSize)
+            throw std::runtime_error{"pbf: blob header too large"};
+        if(header_size > file->Size() - pos)
+            throw std::runtime_error{"pbf: truncated blob header"};
+        header.resize(header_size);
+        if(read(header.data(), header.size()) < header.size())
+            throw std::runtime_error{"pbf: truncated blob header"};
+        pos += header.size();
+
+        auto [type, blob_size] = ParseBlobHeader(header.data(), header.size());
+        if(blob_size > kMaxBlobSize)
+            throw std::runtime_error{"pbf: blob too large"};
+        if(blob_size > file->Size() - pos)
+            throw std::runtime_error{"pbf: truncated blob"};
+        auto blob = buffers.Take();
+        blob.resize(static_cast<std::size_t>(blob_size));
+        if(read(blob.data(), blob.size()) < blob.size())
+            throw std::runtime_error{"pbf: truncated blob"};
+        pos += blob_size;
+
+        if(type == "OSMData") {
+            if(in_flight.size() >= window)
+                drain_one();
+            in_flight.push_back(pool.Submit([&buffers, blob = std::move(blob)]() mutable {
+                try {
+                    auto block = DecodeBlock({blob.data(), blob.size()});
+                    buffers.Give(std::move(blob));
+                    return block;
+                } catch(...) {
+                    buffers.Give(std::move(blob));      // or the reader would wait for it in Take()
+                    throw;
+                }
+            }));
+            continue;
+        }
+        if(type == "OSMHeader")
+            bounds = ReadHeader({blob.data(), blob.size()});
+        buffers.Give(std::move(blob));
+    }
+    while(!in_flight.empty())
+        drain_one();
+    return bounds;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include "span.h"
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+class ThreadPool;
+
+// OSM primitives decoded from one PrimitiveBlock. Tag keys, values and member
+// roles are views into the inflated block, refs, tags and members are views
+// into the pools of their OsmBlock, which keeps both alive.
+struct OsmTag {
+    std::string_view key;
+    std::string_view value;
+};
+
+struct OsmNode {
+    std::int64_t id = 0;
+    double lat = 0.;
+    double lon = 0.;
+};
+
+struct OsmWay {
+    std::int64_t id = 0;
+    Span<const std::int64_t> refs;
+    Span<const OsmTag> tags;
+};
+
+struct OsmMember {
+    enum Type { Node, Way, Relation };
+    Type type = Node;
+    std::int64_t ref = 0;
+    std::string_view role;
+};
+
+struct OsmRelation {
+    std::int64_t id = 0;
+    Span<const OsmMember> members;
+    Span<const OsmTag> tags;
+};
+
+struct OsmBlock {
+    std::vector<OsmNode> nodes;
+    std::vector<OsmWay> ways;
+    std::vector<OsmRelation> relations;
+    std::vector<std::int64_t> refs;         // pools of the variable length lists, one allocation each per block
+    std::vector<OsmTag> way_tags;
+    std::vector<OsmTag> relation_tags;
+    std::vector<OsmMember> members;
+    std::shared_ptr<const std::vector<char>> storage;     // inflated bytes the string views point into
+};
+
+struct OsmBounds {
+    double min_lat = 0.;
+    double min_lon = 0.;
+    double max_lat = 0.;
+    double max_lon = 0.;
+};
+
+// Decoder for the .osm.pbf format. The file is a sequence of independent
+// BlobHeader/Blob frames, so the PrimitiveBlocks are inflated and decoded on
+// a worker pool and handed out in file order.
+// Throws std::runtime_error on malformed or unsupported input.
+class PbfReader {
+public:
+    struct Frame {
+        const std::byte *data = nullptr;        // serialized Blob message
+        std::size_t size = 0;
+    };
+
+    PbfReader(const std::byte *data, std::size_t size);
+
+    const std::optional<OsmBounds> &Bounds() const noexcept { return m_Bounds; }
+    const std::vector<Frame> &Frames() const noexcept { return m_Frames; }      // OSMData blobs only
+
+    // Decodes every data blob on `threads` workers and calls `sink` for each block in file order.
+    void Read(const std::function<void(OsmBlock &)> &sink,
+              unsigned threads = std::thread::hardware_concurrency()) const;
+    // Same on the caller's pool, which the sink may use too; returns once no decode is queued any more.
+    void Read(const std::function<void(OsmBlock &)> &sink, ThreadPool &pool) const;
+
+    // Reads the file with ChunkReader instead of a mapping: several reads stay
+    // in flight while the workers decode, each blob is copied out of the
+    // chunks into a recycled buffer and decoded from there. There are at most
+    // 2 * threads + 1 buffers, the reader waits for one when all are taken.
+    // Calls `sink` in file order like Read() and returns the bounds from the header.
+    static std::optional<OsmBounds> ReadFile(const std::string &path, const std::function<void(OsmBlock &)> &sink,
+                                             unsigned threads = std::thread::hardware_concurrency());
+    static std::optional<OsmBounds> ReadFile(const std::string &path, const std::function<void(OsmBlock &)> &sink,
+                                             ThreadPool &pool);
+
+    static std::vector<char> Inflate(const Frame &blob);
+    static OsmBlock DecodeBlock(const Frame &blob);
+
+private:
+    static std::optional<OsmBounds> ReadHeader(const Frame &blob);
+
+    std::vector<Frame> m_Frames;
+    std::optional<OsmBounds> m_Bounds;
+};
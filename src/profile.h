@@ -0,0 +1,65 @@
+#pragma once
+
+#include "model.h"
+#include <algorithm>
+#include <cstddef>
+
+// Routing profiles. RoutePlanner's search is a template over the profile, so
+// which road types are open and how fast they are come from constexpr tables
+// indexed by Model::Road::Type, and the edge relaxation of every profile is
+// compiled on its own without a branch on the mode.
+//
+// A profile has:
+//   kAccess[type]      whether the profile may use roads of the type
+//   kSpeed[type]       free flow speed on them, metres per second; applied to
+//                      the graph's projected metres, see RouteGraph::Weight()
+//   kMaxSpeed          the largest speed on an open road, scales the A* heuristic
+namespace profile_detail {
+
+constexpr std::size_t kRoadTypes = Model::Road::Footway + 1;
+
+constexpr float MaxSpeed(const bool (&access)[kRoadTypes], const float (&speeds)[kRoadTypes]) noexcept {
+    float max = 0.f;
+    for( std::size_t type = 0; type < kRoadTypes; ++type )
+        if( access[type] )
+            max = std::max(max, speeds[type]);
+    return max;
+}
+
+}
+
+// Order of the tables:
+// Invalid, Unclassified, Service, Residential, Tertiary, Secondary, Primary, Trunk, Motorway, Footway
+
+struct CarProfile {
+    static constexpr const char *kName = "car";
+    static constexpr bool kAccess[profile_detail::kRoadTypes] = {
+        false, true, true, true, true, true, true, true, true, false};
+    static constexpr float kSpeed[profile_detail::kRoadTypes] = {
+        10.f / 3.6f, 30.f / 3.6f, 20.f / 3.6f, 30.f / 3.6f,
+        40.f / 3.6f, 50.f / 3.6f, 60.f / 3.6f, 80.f / 3.6f,
+        100.f / 3.6f, 5.f / 3.6f};
+    static constexpr float kMaxSpeed = profile_detail::MaxSpeed(kAccess, kSpeed);
+};
+
+struct BikeProfile {
+    static constexpr const char *kName = "bike";
+    static constexpr bool kAccess[profile_detail::kRoadTypes] = {
+        false, true, true, true, true, true, true, false, false, true};
+    static constexpr float kSpeed[profile_detail::kRoadTypes] = {
+        10.f / 3.6f, 18.f / 3.6f, 15.f / 3.6f, 18.f / 3.6f,
+        18.f / 3.6f, 18.f / 3.6f, 18.f / 3.6f, 18.f / 3.6f,
+        18.f / 3.6f, 8.f / 3.6f};
+    static constexpr float kMaxSpeed = profile_detail::MaxSpeed(kAccess, kSpeed);
+};
+
+struct FootProfile {
+    static constexpr const char *kName = "foot";
+    static constexpr bool kAccess[profile_detail::kRoadTypes] = {
+        false, true, true, true, true, true, true, false, false, true};
+    static constexpr float kSpeed[profile_detail::kRoadTypes] = {
+        5.f / 3.6f, 5.f / 3.6f, 5.f / 3.6f, 5.f / 3.6f,
+        5.f / 3.6f, 5.f / 3.6f, 5.f / 3.6f, 5.f / 3.6f,
+        5.f / 3.6f, 5.f / 3.6f};
+    static constexpr float kMaxSpeed = profile_detail::MaxSpeed(kAccess, kSpeed);
+};
@@ -1,33 +1,753 @@
 #include "render.h"
+#include "instrument.h"
+#include "road_batches.h"
+#include "simplify.h"
+#include "tile_grid.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <type_traits>
 
-static float RoadMetricWidth(Model::Road::Type type); 
+using namespace std::experimental;
+
+static float RoadMetricWidth(Model::Road::Type type);
 static io2d::rgba_color RoadColor(Model::Road::Type type);
-static io2d::dashes RoadDashes(Model::Road::Type type);
+static std::vector<float> RoadDashes(Model::Road::Type type);
 static io2d::point_2d ToPoint2D(const Model::Node &node) noexcept; //checks whether the given expression will throw an exception or not.
 
+static constexpr float kMaxRoadMetricWidth = 6.f;      // widest road stroke, features this close to the viewport may show up
+static constexpr float kMinFeaturePixels = 1.f;         // smaller features are not drawn at all
+static constexpr float kLodPixelTolerance = 0.5f;
+static constexpr int kDefaultTileSize = 256;
+
 Render::Render(RouteModel &model):        // constructor for Render, refers RouteModel
     m_Model(model)                       // member initialization
     {
         BuildRoadReps();
         BuildLanduseBrushes();
+        BuildLayers();
     }
 
+void Render::SetView(io2d::point_2d origin, float zoom)
+{
+    m_Origin = origin;
+    m_Zoom = std::max(zoom, 1e-3f);
+}
+
+void Render::SetRoute(const Route &route)
+{
+    m_Route = route;
+}
+
+void Render::Quiesce()
+{
+    CollectTiles(true);
+}
+
+void Render::ModelChanged()
+{
+    CollectTiles(true);         // nothing may still be drawing from the old layers
+    m_Tiles.Clear();
+    BuildLayers();
+}
+
+void Render::ModelChanged(const Model::Changes &changes)
+{
+    CollectTiles(true);
+    std::vector<bool> dirty(m_Model.Ways().size(), false);
+    for( auto way_num: changes.ways )
+        dirty[way_num] = true;
+    auto way_dirty = [&](auto &feature){ return dirty[feature.way]; };
+    auto mp_dirty = [&](auto &mp){
+        auto is_dirty = [&](int way_num){ return dirty[way_num]; };
+        return std::any_of(mp.outer.begin(), mp.outer.end(), is_dirty) || std::any_of(mp.inner.begin(), mp.inner.end(), is_dirty);
+    };
+
+    std::vector<Box> damaged;
+    UpdateLayer(m_Landuses, m_Model.Landuses(), mp_dirty, &damaged);
+    UpdateLayer(m_Leisures, m_Model.Leisures(), mp_dirty, &damaged);
+    UpdateLayer(m_Waters, m_Model.Waters(), mp_dirty, &damaged);
+    UpdateLayer(m_Buildings, m_Model.Buildings(), mp_dirty, &damaged, m_Model.Geometry().Empty());
+    UpdateLayer(m_Railways, m_Model.Railways(), way_dirty, &damaged);
+    UpdateLayer(m_Roads, m_Model.Roads(), way_dirty, &damaged, false);
+    UpdateRoadBatches(&dirty);
+    damaged.erase(std::remove_if(damaged.begin(), damaged.end(), [](auto &box){ return box.Empty(); }), damaged.end());
+    if( !damaged.empty() )
+        DropTiles(damaged);
+}
+
+void Render::SetTiling(int tile_size, unsigned threads)
+{
+    CollectTiles(true);
+    m_Tiles.Clear();
+    m_TileSize = std::max(tile_size, 0);
+    m_Pool = m_TileSize > 0 ? std::make_unique<ThreadPool>(threads) : nullptr;
+}
+
+void Render::SetTileCache(std::size_t capacity, std::filesystem::path disk_dir)
+{
+    if( !m_Pool )
+        SetTiling(kDefaultTileSize);
+    m_Tiles.SetCapacity(capacity);
+    m_TileDir = std::move(disk_dir);
+}
+
 void Render::Display(io2d::output_surface &surface)
 {
-    m_Scale = static_cast<float>(std::min(surface.dimensions().x(), surface.dimensions.y()));       // convert to float
-    m_PixelsInMeter = static_cast<float>(m_Scale/m_Model.MetricScale());                            // convert to pixels per meter
-    m_Matrix = io2d::matrix_2d::create_scale({m_Scale, -m_Scale} *
-               io2d::matrix_2d::create_translate({0.f, static_cast<float>(surface.dimensions(.y()))});)
-    
+    DisplayOn(surface);
+}
+
+void Render::Display(io2d::image_surface &surface)
+{
+    DisplayOn(surface);
+}
+
+template <class Surface>
+void Render::DisplayOn(Surface &surface)
+{
+    ROUTEMS_TRACE_SCOPE("render.display");
+    m_Scale = static_cast<float>(std::min(surface.dimensions().x(), surface.dimensions().y())) * m_Zoom;      // convert to float
+    m_PixelsInMeter = static_cast<float>(m_Scale/m_Model.MetricScale());                                    // convert to pixels per meter
+    m_Matrix = io2d::matrix_2d::create_translate({-m_Origin.x(), -m_Origin.y()}) *
+               io2d::matrix_2d::create_scale({m_Scale, -m_Scale}) *
+               io2d::matrix_2d::create_translate({0.f, static_cast<float>(surface.dimensions().y())});
+    for( m_Lod = 0; m_Lod + 1 < kLodTolerances.size() && kLodTolerances[m_Lod + 1] * m_Scale <= kLodPixelTolerance; ++m_Lod )
+        ;
+
+    auto frame = MakeFrame(m_Matrix, static_cast<float>(surface.dimensions().x()), static_cast<float>(surface.dimensions().y()));
+    if( m_Pool )
+        DisplayTiled(surface);
+    else
+        DrawBase(surface, frame);
+    DrawOverlay(surface, frame);
+}
+
+// The base map is assembled from tiles on a grid anchored at the model origin,
+// so the same tiles serve every view at one scale. Missing tiles are rendered
+// on the pool, composited row by row as they finish, and the ring of tiles
+// around the view is requested too so panning finds them ready.
+template <class Surface>
+void Render::DisplayTiled(Surface &surface)
+{
+    TileGrid grid{m_Scale, static_cast<float>(m_TileSize)};
+    auto tile = grid.size;
+    auto offset_x = -grid.PixelX(m_Origin.x());         // where m_Matrix puts the model origin
+    auto offset_y = static_cast<float>(surface.dimensions().y()) - grid.PixelY(m_Origin.y());
+
+    std::uint32_t scale;
+    static_assert(sizeof(scale) == sizeof(m_Scale));
+    std::memcpy(&scale, &m_Scale, sizeof(scale));
+    auto [x0, y0, x1, y1] = grid.Covering(-offset_x, -offset_y, static_cast<float>(surface.dimensions().x()),
+                                          static_cast<float>(surface.dimensions().y()));
+
+    for( auto y = y0; y <= y1; ++y )
+        for( auto x = x0; x <= x1; ++x )
+            RequestTile({scale, x, y});
+    if( m_Tiles.Capacity() > 0 )
+        for( auto y = y0 - 1; y <= y1 + 1; ++y )
+            for( auto x = x0 - 1; x <= x1 + 1; ++x )
+                if( y < y0 || y > y1 || x < x0 || x > x1 )
+                    RequestTile({scale, x, y});
+
+    for( auto y = y0; y <= y1; ++y )
+        for( auto x = x0; x <= x1; ++x ) {
+            TileKey key{scale, x, y};
+            std::optional<io2d::brush> brush;
+            if( auto cached = m_Tiles.Find(key) )
+                brush = *cached;
+            else if( auto pending = m_PendingTiles.find(key); pending != m_PendingTiles.end() ) {
+                brush = pending->second.get();
+                m_PendingTiles.erase(pending);
+                m_Tiles.Insert(key, *brush);
+            }
+            if( !brush )
+                continue;
+            auto left = offset_x + grid.Left(x), top = offset_y + grid.Top(y);
+            io2d::brush_props placement{io2d::wrap_mode::none, io2d::filter::fast, io2d::matrix_2d::create_translate({-left, -top})};
+            surface.paint(*brush, placement, std::nullopt, io2d::clip_props{io2d::bounding_box{left, top, tile, tile}});
+        }
+    CollectTiles(false);
+}
+
+void Render::RequestTile(const TileKey &key)
+{
+    if( m_Tiles.Contains(key) || m_PendingTiles.count(key) )
+        return;
+    TileGrid grid{m_Scale, static_cast<float>(m_TileSize)};
+    auto matrix = io2d::matrix_2d::create_scale({grid.scale, -grid.scale}) *               // PixelX(), PixelY()
+                  io2d::matrix_2d::create_translate({-grid.Left(key.x), -grid.Top(key.y)});
+    m_PendingTiles.emplace(key, m_Pool->Submit([this, key, frame = MakeFrame(matrix, grid.size, grid.size)]{
+        return RenderTile(key, frame);
+    }));
+}
+
+// Runs on the pool: reads the tile from the disk cache, or draws and stores it there.
+io2d::brush Render::RenderTile(const TileKey &key, const Frame &frame) const
+{
+    ROUTEMS_TRACE_SCOPE("render.tile");
+    auto path = TilePath(key);
+    std::error_code error;
+    if( !path.empty() && std::filesystem::exists(path, error) )
+        return io2d::brush{io2d::image_surface{path, io2d::image_file_format::png, io2d::format::argb32}};
+
+    io2d::image_surface image{io2d::format::argb32, m_TileSize, m_TileSize};
+    DrawBase(image, frame);
+    if( !path.empty() ) {
+        std::filesystem::create_directories(path.parent_path(), error);
+        if( !error )
+            image.save(path, io2d::image_file_format::png);
+    }
+    return io2d::brush{std::move(image)};
+}
+
+std::filesystem::path Render::TilePath(const TileKey &key) const
+{
+    if( m_TileDir.empty() )
+        return {};
+    char scale[16];
+    std::snprintf(scale, sizeof(scale), "%08x", key.scale);
+    return m_TileDir / scale / std::to_string(key.x) / (std::to_string(key.y) + ".png");
+}
+
+void Render::CollectTiles(bool wait)
+{
+    for( auto it = m_PendingTiles.begin(); it != m_PendingTiles.end(); ) {
+        if( !wait && it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready ) {
+            ++it;
+            continue;
+        }
+        auto brush = it->second.get();
+        m_Tiles.Insert(it->first, std::move(brush));
+        it = m_PendingTiles.erase(it);
+    }
+}
+
+// Same area as the viewport MakeFrame() gives the tile's frame.
+Box Render::TileBox(const TileKey &key) const
+{
+    TileGrid grid{0.f, static_cast<float>(m_TileSize)};
+    std::memcpy(&grid.scale, &key.scale, sizeof(grid.scale));
+    auto pixels_in_meter = static_cast<float>(grid.scale / m_Model.MetricScale());
+    return grid.Area(key.x, key.y, std::max(kMaxRoadMetricWidth * pixels_in_meter, 2.f) / grid.scale);
+}
+
+void Render::DropTiles(const std::vector<Box> &damaged)
+{
+    auto covers = [&](const TileKey &key) {
+        auto box = TileBox(key);
+        return std::any_of(damaged.begin(), damaged.end(), [&](const Box &d){ return d.Intersects(box); });
+    };
+    m_Tiles.EraseIf([&](const TileKey &key, const io2d::brush &){ return covers(key); });
+    if( m_TileDir.empty() )
+        return;
+
+    // <scale>/<x>/<y>.png, see TilePath()
+    std::vector<std::filesystem::path> stale;
+    std::error_code error;
+    for( auto it = std::filesystem::recursive_directory_iterator{m_TileDir, error};
+         !error && it != std::filesystem::recursive_directory_iterator{}; it.increment(error) ) {
+        auto &path = it->path();
+        if( it.depth() != 2 || path.extension() != ".png" )
+            continue;
+        auto scale = path.parent_path().parent_path().filename().string(), x = path.parent_path().filename().string(), y = path.stem().string();
+        char *scale_end, *x_end, *y_end;
+        TileKey key{static_cast<std::uint32_t>(std::strtoul(scale.c_str(), &scale_end, 16)),
+                    static_cast<std::int32_t>(std::strtol(x.c_str(), &x_end, 10)),
+                    static_cast<std::int32_t>(std::strtol(y.c_str(), &y_end, 10))};
+        if( *scale_end || *x_end || *y_end )
+            continue;
+        if( covers(key) )
+            stale.push_back(path);
+    }
+    for( auto &path: stale )
+        std::filesystem::remove(path, error);
+}
+
+// The target's corners taken back to the model, grown by the widest stroke.
+Render::Frame Render::MakeFrame(const io2d::matrix_2d &matrix, float width, float height) const
+{
+    Frame frame;
+    frame.matrix = matrix;
+    frame.props = io2d::render_props{io2d::antialias::good, matrix};
+    frame.scale = m_Scale;
+    frame.pixels_in_meter = m_PixelsInMeter;
+    frame.lod = m_Lod;
+
+    auto to_model = matrix.inverse();
+    auto corner0 = to_model.transform_pt({0.f, 0.f});
+    auto corner1 = to_model.transform_pt({width, height});
+    auto pad = std::max(kMaxRoadMetricWidth * m_PixelsInMeter, 2.f) / m_Scale;
+    Box box;
+    box.Extend(corner0.x(), corner0.y());
+    box.Extend(corner1.x(), corner1.y());
+    frame.viewport = {box.min_x - pad, box.min_y - pad, box.max_x + pad, box.max_y + pad};
+    return frame;
+}
+
+// Static map layers, the same for every route.
+template <class Surface>
+void Render::DrawBase(Surface &surface, const Frame &frame) const
+{
     surface.paint(m_BackgroundFillBrush);
-    DrawLanduses(surface);
-    DrawLeisure(surface);
-    DrawWater(surface);    
-    DrawRailways(surface);
-    DrawHighways(surface);    
-    DrawBuildings(surface);  
-    DrawPath(surface);
-    DrawStartPosition(surface);
-    DrawEndPosition(surface);
+    DrawLanduses(surface, frame);
+    DrawLeisure(surface, frame);
+    DrawWater(surface, frame);
+    DrawRailways(surface, frame);
+    DrawHighways(surface, frame);
+    DrawBuildings(surface, frame);
+}
+
+template <class Surface>
+void Render::DrawOverlay(Surface &surface, const Frame &frame) const
+{
+    DrawPath(surface, frame);
+    DrawStartPosition(surface, frame);
+    DrawEndPosition(surface, frame);
+}
+
+std::vector<std::uint32_t> Render::Visible(const Layer &layer, const Frame &frame) const
+{
+    std::vector<std::uint32_t> visible;
+    layer.index.Query(frame.viewport, visible);
+    auto min_extent = kMinFeaturePixels / frame.scale;
+    visible.erase(std::remove_if(visible.begin(), visible.end(), [&](auto i){
+        auto &box = layer.boxes[i];
+        return std::max(box.max_x - box.min_x, box.max_y - box.min_y) < min_extent;
+    }), visible.end());
+    return visible;
+}
+
+// Strokes of the cached paths are scaled by m_Matrix along with the geometry,
+// so widths and dash lengths given in pixels are taken back to model units.
+io2d::stroke_props Render::PixelStroke(const Frame &frame, float pixels, io2d::line_cap cap) const
+{
+    return io2d::stroke_props{pixels / frame.scale, cap};
+}
+
+io2d::dashes Render::PixelDashes(const Frame &frame, const std::vector<float> &pixels) const
+{
+    std::vector<float> lengths;
+    for( auto length: pixels )
+        lengths.push_back(length / frame.scale);
+    return io2d::dashes{0.f, lengths};
+}
+
+template <class Surface>
+void Render::DrawStartPosition(Surface &surface, const Frame &frame) const
+{
+    if( m_Route.nodes.empty() )
+        return;
+
+    io2d::render_props aliased{ io2d::antialias::none };
+    io2d::brush foreBrush{ io2d::rgba_color::green };
+
+    auto pb = io2d::path_builder{};
+    pb.matrix(frame.matrix);
+
+    pb.new_figure(ToPoint2D(m_Model.Nodes()[m_Route.nodes.front()]));
+    float constexpr l_marker = 0.01f;
+    pb.rel_line({l_marker, 0.f});
+    pb.rel_line({0.f, l_marker});
+    pb.rel_line({-l_marker, 0.f});
+    pb.rel_line({0.f, -l_marker});
+    pb.close_figure();
+
+    surface.fill(foreBrush, pb);
+    surface.stroke(foreBrush, io2d::interpreted_path{pb}, std::nullopt, std::nullopt, std::nullopt, aliased);
+}
+
+template <class Surface>
+void Render::DrawEndPosition(Surface &surface, const Frame &frame) const
+{
+    if( m_Route.nodes.empty() )
+        return;
+
+    io2d::render_props aliased{ io2d::antialias::none };
+    io2d::brush foreBrush{ io2d::rgba_color::red };
+
+    auto pb = io2d::path_builder{};
+    pb.matrix(frame.matrix);
+
+    pb.new_figure(ToPoint2D(m_Model.Nodes()[m_Route.nodes.back()]));
+    float constexpr l_marker = 0.01f;
+    pb.rel_line({l_marker, 0.f});
+    pb.rel_line({0.f, l_marker});
+    pb.rel_line({-l_marker, 0.f});
+    pb.rel_line({0.f, -l_marker});
+    pb.close_figure();
+
+    surface.fill(foreBrush, pb);
+    surface.stroke(foreBrush, io2d::interpreted_path{pb}, std::nullopt, std::nullopt, std::nullopt, aliased);
+}
+
+template <class Surface>
+void Render::DrawPath(Surface &surface, const Frame &frame) const
+{
+    if( m_Route.nodes.size() < 2 )
+        return;
+    ROUTEMS_TRACE_SCOPE("render.path");
+    instrument::Add(instrument::VerticesDrawn, m_Route.nodes.size());
+
+    io2d::brush foreBrush{ io2d::rgba_color::orange };
+    float width = 5.0f;
+    surface.stroke(foreBrush, PathFromRoute(frame), std::nullopt, io2d::stroke_props{width});
+}
+
+template <class Surface>
+void Render::DrawBuildings(Surface &surface, const Frame &frame) const
+{
+    ROUTEMS_TRACE_SCOPE("render.buildings");
+    instrument::Tally drawn{instrument::VerticesDrawn};
+    auto outline = PixelStroke(frame, m_BuildingOutlineWidth);
+    auto &buildings = m_Model.Buildings();
+    auto cached = !m_Buildings.paths[frame.lod].empty();
+    for( auto i: Visible(m_Buildings, frame) ) {
+        io2d::interpreted_path decoded;
+        std::uint32_t vertices = 0;
+        if( !cached )
+            decoded = PathFromMP(buildings[i], kLodTolerances[frame.lod], &vertices);
+        auto &path = cached ? m_Buildings.paths[frame.lod][i] : decoded;
+        drawn += cached ? m_Buildings.vertices[frame.lod][i] : vertices;
+        surface.fill(m_BuildingFillBrush, path, std::nullopt, frame.props);
+        surface.stroke(m_BuildingOutlineBrush, path, std::nullopt, outline, std::nullopt, frame.props);
+    }
+}
+
+template <class Surface>
+void Render::DrawLeisure(Surface &surface, const Frame &frame) const
+{
+    ROUTEMS_TRACE_SCOPE("render.leisure");
+    instrument::Tally drawn{instrument::VerticesDrawn};
+    auto outline = PixelStroke(frame, m_LeisureOutlineWidth);
+    for( auto i: Visible(m_Leisures, frame) ) {
+        auto &path = m_Leisures.paths[frame.lod][i];
+        drawn += m_Leisures.vertices[frame.lod][i];
+        surface.fill(m_LeisureFillBrush, path, std::nullopt, frame.props);
+        surface.stroke(m_LeisureOutlineBrush, path, std::nullopt, outline, std::nullopt, frame.props);
+    }
+}
+
+template <class Surface>
+void Render::DrawWater(Surface &surface, const Frame &frame) const
+{
+    ROUTEMS_TRACE_SCOPE("render.water");
+    instrument::Tally drawn{instrument::VerticesDrawn};
+    for( auto i: Visible(m_Waters, frame) ) {
+        surface.fill(m_WaterFillBrush, m_Waters.paths[frame.lod][i], std::nullopt, frame.props);
+        drawn += m_Waters.vertices[frame.lod][i];
+    }
+}
+
+template <class Surface>
+void Render::DrawLanduses(Surface &surface, const Frame &frame) const
+{
+    ROUTEMS_TRACE_SCOPE("render.landuses");
+    instrument::Tally drawn{instrument::VerticesDrawn};
+    auto &landuses = m_Model.Landuses();
+    for( auto i: Visible(m_Landuses, frame) )
+        if( auto br = m_LanduseBrushes.find(landuses[i].type); br != m_LanduseBrushes.end() ) {
+            surface.fill(br->second, m_Landuses.paths[frame.lod][i], std::nullopt, frame.props);
+            drawn += m_Landuses.vertices[frame.lod][i];
+        }
+}
+
+template <class Surface>
+void Render::DrawHighways(Surface &surface, const Frame &frame) const
+{
+    ROUTEMS_TRACE_SCOPE("render.highways");
+    instrument::Tally drawn{instrument::VerticesDrawn};
+    std::vector<std::uint32_t> visible;
+    m_RoadBatchIndex.Query(frame.viewport, visible);
+
+    const RoadRep *rep = nullptr;
+    auto type = Model::Road::Invalid;
+    io2d::stroke_props sp;
+    io2d::dashes dashes;
+    for( auto b: visible ) {
+        auto &batch = m_RoadBatches[b];
+        if( !rep || batch.type != type ) {          // the index returns the batches grouped by type
+            type = batch.type;
+            rep = &m_RoadReps.at(type);
+            auto width = rep->metric_width > 0.f ? (rep->metric_width * frame.pixels_in_meter) : 1.f;
+            sp = PixelStroke(frame, width, io2d::line_cap::round);
+            dashes = rep->dashes.empty() ? io2d::dashes{} : PixelDashes(frame, rep->dashes);
+        }
+        surface.stroke(rep->brush, batch.paths[frame.lod], std::nullopt, sp, dashes, frame.props);
+        drawn += batch.vertices[frame.lod];
+    }
+}
+
+template <class Surface>
+void Render::DrawRailways(Surface &surface, const Frame &frame) const
+{
+    ROUTEMS_TRACE_SCOPE("render.railways");
+    instrument::Tally drawn{instrument::VerticesDrawn};
+    auto outer = PixelStroke(frame, m_RailwayOuterWidth * frame.pixels_in_meter);
+    auto inner = PixelStroke(frame, m_RailwayInnerWidth * frame.pixels_in_meter);
+    auto dashes = PixelDashes(frame, m_RailwayDashes);
+    for( auto i: Visible(m_Railways, frame) ) {
+        auto &path = m_Railways.paths[frame.lod][i];
+        drawn += m_Railways.vertices[frame.lod][i];
+        surface.stroke(m_RailwayStrokeBrush, path, std::nullopt, outer, std::nullopt, frame.props);
+        surface.stroke(m_RailwayDashBrush, path, std::nullopt, inner, dashes, frame.props);
+    }
+}
+
+std::uint32_t Render::AppendWay(io2d::path_builder &pb, int way_num, float tolerance, bool close) const
+{
+    std::vector<Model::Node> points;
+    if( auto &geometry = m_Model.Geometry(); !geometry.Empty() ) {
+        points = geometry.Points(way_num);
+        Simplify(points, tolerance);
+    } else {
+        const auto nodes = m_Model.Nodes();
+        for( auto node: Simplify(nodes, m_Model.Ways()[way_num].nodes, tolerance) )
+            points.push_back(nodes[node]);
+    }
+    if( points.empty() )
+        return 0;
+
+    pb.new_figure( ToPoint2D(points.front()) );
+    for( auto it = ++points.begin(); it != end(points); ++it )
+        pb.line( ToPoint2D(*it) );
+    if( close )
+        pb.close_figure();
+    return static_cast<std::uint32_t>(points.size());
+}
+
+io2d::interpreted_path Render::PathFromWay(int way_num, float tolerance, std::uint32_t *vertices) const
+{
+    auto pb = io2d::path_builder{};
+    auto count = AppendWay(pb, way_num, tolerance, false);
+    if( vertices )
+        *vertices = count;
+    if( count == 0 )
+        return {};
+    return io2d::interpreted_path{pb};
+}
+
+io2d::interpreted_path Render::PathFromMP(const Model::Multipolygon &mp, float tolerance, std::uint32_t *vertices) const
+{
+    auto pb = io2d::path_builder{};
+    std::uint32_t count = 0;
+    for( auto way_num: mp.outer )
+        count += AppendWay(pb, way_num, tolerance, true);
+    for( auto way_num: mp.inner )
+        count += AppendWay(pb, way_num, tolerance, true);
+
+    if( vertices )
+        *vertices = count;
+    return io2d::interpreted_path{pb};
+}
+
+io2d::interpreted_path Render::PathFromRoute(const Frame &frame) const
+{
+    const auto nodes = m_Model.Nodes();
+
+    auto pb = io2d::path_builder{};
+    pb.matrix(frame.matrix);
+    pb.new_figure( ToPoint2D(nodes[m_Route.nodes.front()]) );
+    for( auto it = ++m_Route.nodes.begin(); it != end(m_Route.nodes); ++it )
+        pb.line( ToPoint2D(nodes[*it]) );
+    return io2d::interpreted_path{pb};
+}
+
+void Render::BuildRoadReps()
+{
+    using R = Model::Road;
+    auto types = {R::Motorway, R::Trunk, R::Primary,  R::Secondary, R::Tertiary,
+        R::Residential, R::Service, R::Unclassified, R::Footway};
+    for( auto type: types ) {
+        auto &rep = m_RoadReps[type];
+        rep.brush = RoadColor(type);
+        rep.dashes = RoadDashes(type);
+        rep.metric_width = RoadMetricWidth(type);
+    }
+}
+
+void Render::BuildLanduseBrushes()
+{
+    m_LanduseBrushes.insert_or_assign(Model::Landuse::Commercial, io2d::brush{io2d::rgba_color{233, 195, 196}});
+    m_LanduseBrushes.insert_or_assign(Model::Landuse::Construction, io2d::brush{io2d::rgba_color{187, 188, 165}});
+    m_LanduseBrushes.insert_or_assign(Model::Landuse::Grass, io2d::brush{io2d::rgba_color{197, 236, 148}});
+    m_LanduseBrushes.insert_or_assign(Model::Landuse::Forest, io2d::brush{io2d::rgba_color{158, 201, 141}});
+    m_LanduseBrushes.insert_or_assign(Model::Landuse::Industrial, io2d::brush{io2d::rgba_color{223, 197, 220}});
+    m_LanduseBrushes.insert_or_assign(Model::Landuse::Railway, io2d::brush{io2d::rgba_color{223, 197, 220}});
+    m_LanduseBrushes.insert_or_assign(Model::Landuse::Residential, io2d::brush{io2d::rgba_color{209, 209, 209}});
+}
+
+// Bounding boxes and paths of every feature at every level of detail, built
+// once so Display() only walks what is on screen and never rebuilds geometry.
+void Render::BuildLayers()
+{
+    auto all = [](auto &){ return true; };
+    for( auto layer: {&m_Landuses, &m_Leisures, &m_Waters, &m_Buildings, &m_Railways, &m_Roads} )
+        *layer = Layer{};
+    UpdateLayer(m_Landuses, m_Model.Landuses(), all, nullptr);
+    UpdateLayer(m_Leisures, m_Model.Leisures(), all, nullptr);
+    UpdateLayer(m_Waters, m_Model.Waters(), all, nullptr);
+    UpdateLayer(m_Buildings, m_Model.Buildings(), all, nullptr, m_Model.Geometry().Empty());
+    UpdateLayer(m_Railways, m_Model.Railways(), all, nullptr);
+    UpdateLayer(m_Roads, m_Model.Roads(), all, nullptr, false);
+    m_RoadBatches.clear();
+    m_RoadBatchKeys.clear();
+    UpdateRoadBatches(nullptr);
+}
+
+template <class Features, class Dirty>
+void Render::UpdateLayer(Layer &layer, const Features &features, Dirty dirty, std::vector<Box> *damaged, bool paths) const
+{
+    using Feature = typename Features::value_type;
+
+    auto update = [&](std::size_t i) {
+        auto &feature = features[i];
+        Box box;
+        if constexpr( std::is_base_of_v<Model::Multipolygon, Feature> ) {
+            for( auto way_num: feature.outer )       // the inner rings lie inside the outer ones
+                box.Extend(WayBox(way_num));
+        }
+        else
+            box = WayBox(feature.way);
+
+        auto replace = i < layer.boxes.size();
+        if( damaged ) {
+            if( replace )
+                damaged->push_back(layer.boxes[i]);
+            damaged->push_back(box);
+        }
+        if( replace )
+            layer.boxes[i] = box;
+        else
+            layer.boxes.push_back(box);
+        for( std::size_t lod = 0; paths && lod < kLodTolerances.size(); ++lod ) {
+            io2d::interpreted_path path;
+            std::uint32_t vertices = 0;
+            if constexpr( std::is_base_of_v<Model::Multipolygon, Feature> )
+                path = PathFromMP(feature, kLodTolerances[lod], &vertices);
+            else
+                path = PathFromWay(feature.way, kLodTolerances[lod], &vertices);
+            if( replace ) {
+                layer.paths[lod][i] = std::move(path);
+                layer.vertices[lod][i] = vertices;
+            } else {
+                layer.paths[lod].push_back(std::move(path));
+                layer.vertices[lod].push_back(vertices);
+            }
+        }
+    };
+
+    auto old_size = layer.boxes.size();
+    auto changed = features.size() != old_size;
+    for( std::size_t i = 0; i < old_size; ++i )
+        if( dirty(features[i]) ) {
+            update(i);
+            changed = true;
+        }
+    for( auto i = old_size; i < features.size(); ++i )
+        update(i);
+    if( changed )
+        layer.index = BoxIndex{layer.boxes};
+}
+
+// The cell of a road is the one its box centre falls in.
+std::uint32_t Render::RoadBatchKey(std::size_t road) const
+{
+    auto type = m_Model.Roads()[road].type;
+    auto &box = m_Roads.boxes[road];
+    if( !m_RoadReps.count(type) || box.Empty() )
+        return kNoRoadBatch;
+    auto cell = [](float centre) {
+        return static_cast<std::uint32_t>(std::clamp(static_cast<int>(centre * kRoadBatchGrid), 0, static_cast<int>(kRoadBatchGrid) - 1));
+    };
+    auto x = cell((box.min_x + box.max_x) / 2), y = cell((box.min_y + box.max_y) / 2);
+    return static_cast<std::uint32_t>(type) * kRoadBatchGrid * kRoadBatchGrid + y * kRoadBatchGrid + x;
+}
+
+void Render::UpdateRoadBatches(const std::vector<bool> *dirty_ways)
+{
+    const auto &roads = m_Model.Roads();
+    std::vector<std::uint32_t> keys(roads.size());
+    for( std::size_t i = 0; i < roads.size(); ++i )
+        keys[i] = RoadBatchKey(i);
+
+    auto changed = [&](std::size_t i){ return !dirty_ways || (*dirty_ways)[roads[i].way]; };
+    m_RoadBatches = UpdateBatches(m_RoadBatches, m_RoadBatchKeys, keys, changed, [&](std::uint32_t key, auto first, auto last) {
+        RoadBatch batch;
+        batch.key = key;
+        batch.type = roads[*first].type;
+        for( auto it = first; it != last; ++it )
+            batch.box.Extend(m_Roads.boxes[*it]);
+        for( std::size_t lod = 0; lod < kLodTolerances.size(); ++lod ) {
+            auto pb = io2d::path_builder{};
+            for( auto it = first; it != last; ++it )
+                batch.vertices[lod] += AppendWay(pb, roads[*it].way, kLodTolerances[lod], false);
+            batch.paths[lod] = io2d::interpreted_path{pb};
+        }
+        return batch;
+    });
+    m_RoadBatchKeys = std::move(keys);
+
+    std::vector<Box> boxes;
+    for( auto &batch: m_RoadBatches )
+        boxes.push_back(batch.box);
+    m_RoadBatchIndex = BoxIndex{boxes};
+}
+
+Box Render::WayBox(int way_num) const
+{
+    Box box;
+    if( auto &geometry = m_Model.Geometry(); !geometry.Empty() ) {    // area ways have no nodes any more then
+        geometry.Decode(way_num, [&](double x, double y) { box.Extend(static_cast<float>(x), static_cast<float>(y)); });
+        return box;
+    }
+    const auto nodes = m_Model.Nodes();
+    for( auto node: m_Model.Ways()[way_num].nodes )
+        box.Extend(static_cast<float>(nodes[node].x), static_cast<float>(nodes[node].y));
+    return box;
+}
+
+static float RoadMetricWidth(Model::Road::Type type)
+{
+    switch( type ) {
+        case Model::Road::Motorway:     return 6.f;
+        case Model::Road::Trunk:        return 6.f;
+        case Model::Road::Primary:      return 5.f;
+        case Model::Road::Secondary:    return 5.f;
+        case Model::Road::Tertiary:     return 4.f;
+        case Model::Road::Residential:  return 2.5f;
+        case Model::Road::Unclassified: return 2.5f;
+        case Model::Road::Service:      return 1.f;
+        case Model::Road::Footway:      return 0.f;
+        default:                        return 1.f;
+    }
+}
+
+static io2d::rgba_color RoadColor(Model::Road::Type type)
+{
+    switch( type ) {
+        case Model::Road::Motorway:     return io2d::rgba_color{226, 122, 143};
+        case Model::Road::Trunk:        return io2d::rgba_color{245, 161, 136};
+        case Model::Road::Primary:      return io2d::rgba_color{249, 207, 144};
+        case Model::Road::Secondary:    return io2d::rgba_color{244, 251, 173};
+        case Model::Road::Tertiary:     return io2d::rgba_color{244, 251, 173};
+        case Model::Road::Residential:  return io2d::rgba_color{254, 254, 254};
+        case Model::Road::Service:      return io2d::rgba_color{254, 254, 254};
+        case Model::Road::Footway:      return io2d::rgba_color{241, 106, 96};
+        case Model::Road::Unclassified: return io2d::rgba_color{254, 254, 254};
+        default:                        return io2d::rgba_color::grey;
+    }
+}
+
+static std::vector<float> RoadDashes(Model::Road::Type type)
+{
+    return type == Model::Road::Footway ? std::vector<float>{1.f, 2.f} : std::vector<float>{};
+}
+
+static io2d::point_2d ToPoint2D(const Model::Node &node) noexcept
+{
+    return io2d::point_2d(static_cast<float>(node.x), static_cast<float>(node.y));
 }
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <io2d.h>
+#include "box_index.h"
+#include "lru_cache.h"
+#include "route.h"
+#include "route_model.h"
+#include "thread_pool.h"
+
+class Render
+{
+public:
+    Render( RouteModel &model );
+    void Display( std::experimental::io2d::output_surface &surface );
+    void Display( std::experimental::io2d::image_surface &surface );      // offscreen, for headless rendering
+
+    // Part of the map to show: origin is the model point at the bottom left
+    // corner of the surface, zoom 1 fits the shorter side of the map.
+    void SetView( std::experimental::io2d::point_2d origin, float zoom );
+    void SetRoute( const Route &route );        // drawn on top of the map, with start and end markers
+
+    // Splits the base map into square tiles of tile_size pixels that are
+    // rasterized on a worker pool and composited in order, the route overlay is
+    // drawn on top; 0 draws the surface in one pass.
+    void SetTiling( int tile_size, unsigned threads = std::thread::hardware_concurrency() );
+
+    // Keeps up to capacity rendered base tiles in memory, and every tile as a
+    // PNG under disk_dir if one is given; the directory must belong to this
+    // model. Tiles around the view are rendered ahead in the background.
+    // Enables tiling with 256 pixel tiles if it is off.
+    void SetTileCache( std::size_t capacity, std::filesystem::path disk_dir = {} );
+
+    // Waits for the tiles still rasterizing in the background, which read the
+    // model. Must be called before the model is changed, e.g. by Apply();
+    // Display() must not run then until ModelChanged() was called.
+    void Quiesce();
+
+    // Rebuilds the cached feature geometry, needed only when the model itself changed.
+    void ModelChanged();
+
+    // Rebuilds only the features a diff touched and drops the cached tiles,
+    // in memory and on disk, that their old or new geometry covers. Quiesce()
+    // must have been called before the diff was applied.
+    void ModelChanged( const Model::Changes &changes );
+
+private:
+    void BuildRoadReps();
+    void BuildLanduseBrushes();
+    void BuildLayers();
+
+    // Per pass drawing state, one for the whole surface or one per tile. It
+    // is copied into the rasterizing tasks, so tiles can be drawn concurrently
+    // and in the background while the view changes.
+    struct Frame {
+        std::experimental::io2d::matrix_2d matrix;         // model to pixels of the target surface
+        std::experimental::io2d::render_props props;       // draws model space paths through matrix
+        Box viewport;                   // model area covered by the target surface
+        float scale;                    // pixels per model unit
+        float pixels_in_meter;
+        std::size_t lod;                // index into kLodTolerances
+    };
+
+    // Base tiles sit on a grid anchored at the model origin, in pixels of one scale.
+    struct TileKey {
+        std::uint32_t scale;            // bits of the float scale
+        std::int32_t x;
+        std::int32_t y;
+        bool operator==(const TileKey &other) const noexcept { return scale == other.scale && x == other.x && y == other.y; }
+    };
+    struct TileKeyHash {
+        std::size_t operator()(const TileKey &key) const noexcept {
+            return std::hash<std::uint64_t>{}((std::uint64_t(key.scale) << 32) ^ (std::uint64_t(std::uint32_t(key.x)) << 16) ^ std::uint32_t(key.y));
+        }
+    };
+
+    Frame MakeFrame(const std::experimental::io2d::matrix_2d &matrix, float width, float height) const;
+    template <class Surface> void DisplayOn(Surface &surface);
+    template <class Surface> void DisplayTiled(Surface &surface);
+    void RequestTile(const TileKey &key);           // starts rendering it unless cached or pending
+    std::experimental::io2d::brush RenderTile(const TileKey &key, const Frame &frame) const;
+    std::filesystem::path TilePath(const TileKey &key) const;
+    void CollectTiles(bool wait);                   // moves finished tiles into the cache
+    Box TileBox(const TileKey &key) const;          // model area the tile draws from
+    void DropTiles(const std::vector<Box> &damaged);
+
+    // Surface is the window's output_surface or a tile's image_surface.
+    template <class Surface> void DrawBase(Surface &surface, const Frame &frame) const;
+    template <class Surface> void DrawOverlay(Surface &surface, const Frame &frame) const;
+    template <class Surface> void DrawBuildings(Surface &surface, const Frame &frame) const;
+    template <class Surface> void DrawHighways(Surface &surface, const Frame &frame) const;
+    template <class Surface> void DrawRailways(Surface &surface, const Frame &frame) const;
+    template <class Surface> void DrawLeisure(Surface &surface, const Frame &frame) const;
+    template <class Surface> void DrawWater(Surface &surface, const Frame &frame) const;
+    template <class Surface> void DrawLanduses(Surface &surface, const Frame &frame) const;
+    template <class Surface> void DrawPath(Surface &surface, const Frame &frame) const;
+    template <class Surface> void DrawStartPosition(Surface &surface, const Frame &frame) const;
+    template <class Surface> void DrawEndPosition(Surface &surface, const Frame &frame) const;
+
+    // Simplification tolerances of the precomputed detail levels, model units.
+    // Display() picks the coarsest level whose tolerance stays below half a pixel.
+    static constexpr std::array<float, 4> kLodTolerances{0.f, 1.f / 16384, 1.f / 4096, 1.f / 1024};
+
+    // Features of one map layer: their bounding boxes and their paths at every
+    // level of detail, all in model coordinates. Paths are built once and drawn
+    // through m_Matrix, so changing the view never rebuilds them.
+    struct Layer {
+        BoxIndex index;
+        std::vector<Box> boxes;
+        std::array<std::vector<std::experimental::io2d::interpreted_path>, kLodTolerances.size()> paths;
+        std::array<std::vector<std::uint32_t>, kLodTolerances.size()> vertices;        // points in each path
+    };
+
+    // Refreshes the boxes and paths of the features dirty(feature) selects and
+    // adds those of features past the end of the layer. The replaced and the new
+    // boxes go to damaged if given; the index is rebuilt if anything changed.
+    // Without paths only the boxes and the index are kept, for layers drawn from batches.
+    template <class Features, class Dirty>
+    void UpdateLayer(Layer &layer, const Features &features, Dirty dirty, std::vector<Box> *damaged, bool paths = true) const;
+    Box WayBox(int way_num) const;
+
+    // Roads of one type inside one cell of a kRoadBatchGrid square grid over
+    // the map, in model order, merged into a single path per level of detail.
+    // DrawHighways() strokes a batch with one call and sets up the brush,
+    // width and dashes once per type, the grid keeps zoomed-in frames from
+    // transforming every road of the map.
+    static constexpr std::uint32_t kRoadBatchGrid = 16;
+    struct RoadBatch {
+        std::uint32_t key;              // type * kRoadBatchGrid^2 + cell, the drawing order
+        Model::Road::Type type;
+        Box box;
+        std::array<std::experimental::io2d::interpreted_path, kLodTolerances.size()> paths;
+        std::array<std::uint32_t, kLodTolerances.size()> vertices{};
+    };
+
+    // Regroups the roads after m_Roads was updated and rebuilds the batches
+    // that gained, lost or changed a road; every batch if dirty_ways is null.
+    void UpdateRoadBatches(const std::vector<bool> *dirty_ways);
+    std::uint32_t RoadBatchKey(std::size_t road) const;
+
+    // Features of a layer inside the frame that cover at least kMinFeaturePixels on screen.
+    std::vector<std::uint32_t> Visible(const Layer &layer, const Frame &frame) const;
+    std::experimental::io2d::stroke_props PixelStroke(const Frame &frame, float pixels, std::experimental::io2d::line_cap cap = std::experimental::io2d::line_cap::none) const;
+    std::experimental::io2d::dashes PixelDashes(const Frame &frame, const std::vector<float> &pixels) const;
+    // Way geometry comes from the model's compact WayGeometry if it has one.
+    std::uint32_t AppendWay(std::experimental::io2d::path_builder &pb, int way_num, float tolerance, bool close) const;     // points added
+    std::experimental::io2d::interpreted_path PathFromWay(int way_num, float tolerance = 0.f, std::uint32_t *vertices = nullptr) const;
+    std::experimental::io2d::interpreted_path PathFromMP(const Model::Multipolygon &mp, float tolerance = 0.f, std::uint32_t *vertices = nullptr) const;
+    std::experimental::io2d::interpreted_path PathFromRoute(const Frame &frame) const;
+
+    RouteModel &m_Model;
+    Route m_Route;
+    std::experimental::io2d::point_2d m_Origin{0.f, 0.f};
+    float m_Zoom = 1.f;
+    float m_Scale = 1.f;
+    float m_PixelsInMeter = 1.f;
+    std::experimental::io2d::matrix_2d m_Matrix;
+    std::size_t m_Lod = 0;               // index into kLodTolerances
+    int m_TileSize = 0;
+    LruCache<TileKey, std::experimental::io2d::brush, TileKeyHash> m_Tiles;
+    std::unordered_map<TileKey, std::future<std::experimental::io2d::brush>, TileKeyHash> m_PendingTiles;
+    std::filesystem::path m_TileDir;
+
+    // one per layer, indexed like the model containers
+    Layer m_Landuses;
+    Layer m_Leisures;
+    Layer m_Waters;
+    Layer m_Railways;
+    Layer m_Roads;                  // boxes only, drawn from m_RoadBatches
+    Layer m_Buildings;              // without paths when the model has compact geometry, decoded per frame
+
+    std::vector<RoadBatch> m_RoadBatches;           // sorted by key
+    std::vector<std::uint32_t> m_RoadBatchKeys;     // batch of every road, kNoRoadBatch if its type isn't drawn
+    BoxIndex m_RoadBatchIndex;
+
+    std::experimental::io2d::brush m_BackgroundFillBrush{ std::experimental::io2d::rgba_color{238, 235, 227} };
+
+    std::experimental::io2d::brush m_BuildingFillBrush{ std::experimental::io2d::rgba_color{208, 197, 190} };
+    std::experimental::io2d::brush m_BuildingOutlineBrush{ std::experimental::io2d::rgba_color{181, 167, 154} };
+    float m_BuildingOutlineWidth = 1.f;       // pixels
+
+    std::experimental::io2d::brush m_LeisureFillBrush{ std::experimental::io2d::rgba_color{189, 252, 193} };
+    std::experimental::io2d::brush m_LeisureOutlineBrush{ std::experimental::io2d::rgba_color{160, 248, 162} };
+    float m_LeisureOutlineWidth = 1.f;
+
+    std::experimental::io2d::brush m_WaterFillBrush{ std::experimental::io2d::rgba_color{155, 201, 215} };
+
+    std::experimental::io2d::brush m_RailwayStrokeBrush{ std::experimental::io2d::rgba_color{93,93,93} };
+    std::experimental::io2d::brush m_RailwayDashBrush{ std::experimental::io2d::rgba_color::white };
+    std::vector<float> m_RailwayDashes{3.f, 3.f};      // pixels
+    float m_RailwayOuterWidth = 3.f;
+    float m_RailwayInnerWidth = 2.f;
+
+    struct RoadRep {
+        std::experimental::io2d::brush brush{std::experimental::io2d::rgba_color::black};
+        std::vector<float> dashes;          // pixels, solid if empty
+        float metric_width = 1.f;
+    };
+    std::unordered_map<Model::Road::Type, RoadRep> m_RoadReps;
+
+    std::unordered_map<Model::Landuse::Type, std::experimental::io2d::brush> m_LanduseBrushes;
+
+    std::unique_ptr<ThreadPool> m_Pool;     // rasterizes the tiles, last so it is joined before the layers go away
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Key of a road that goes into no batch, e.g. because its type isn't drawn.
+inline constexpr std::uint32_t kNoRoadBatch = ~std::uint32_t{0};
+
+// Regroups roads into batches after some of them changed, for Render's road
+// batches but free of any drawing. keys[i] is the batch of road i now,
+// old_keys[i] the one it had when `batches` was built; roads past the end of
+// old_keys are new, and none are ever removed. A batch is rebuilt with
+// build(key, first, last) over the indices of its roads, in model order, if
+// a road joined, left or changed(i) in it, and moved over unchanged
+// otherwise. Returns the batches sorted by key, as `batches` must be, and
+// the same as rebuilding every batch would.
+template <typename Batch, typename Changed, typename Build>
+std::vector<Batch> UpdateBatches(std::vector<Batch> &batches, const std::vector<std::uint32_t> &old_keys,
+                                 const std::vector<std::uint32_t> &keys, Changed changed, Build build)
+{
+    std::vector<std::uint32_t> stale;
+    for( std::size_t i = 0; i < keys.size(); ++i ) {
+        auto known = i < old_keys.size();
+        if( !known || changed(i) || keys[i] != old_keys[i] ) {
+            stale.push_back(keys[i]);
+            if( known )
+                stale.push_back(old_keys[i]);
+        }
+    }
+    for( auto i = keys.size(); i < old_keys.size(); ++i )
+        stale.push_back(old_keys[i]);
+    std::sort(stale.begin(), stale.end());
+    stale.erase(std::unique(stale.begin(), stale.end()), stale.end());
+    auto is_stale = [&](std::uint32_t key){ return std::binary_search(stale.begin(), stale.end(), key); };
+
+    std::vector<std::uint32_t> order;           // the batched roads by key, in model order within one
+    for( std::uint32_t i = 0; i < keys.size(); ++i )
+        if( keys[i] != kNoRoadBatch )
+            order.push_back(i);
+    std::stable_sort(order.begin(), order.end(), [&](auto a, auto b){ return keys[a] < keys[b]; });
+
+    std::vector<Batch> updated;
+    auto old = batches.begin();
+    for( auto first = order.begin(); first != order.end(); ) {
+        auto key = keys[*first];
+        auto last = std::find_if(first, order.end(), [&](auto i){ return keys[i] != key; });
+        old = std::lower_bound(old, batches.end(), key, [](auto &batch, auto k){ return batch.key < k; });
+        if( !is_stale(key) && old != batches.end() && old->key == key )
+            updated.push_back(std::move(*old));
+        else
+            updated.push_back(build(key, first, last));
+        first = last;
+    }
+    return updated;
+}
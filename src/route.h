@@ -0,0 +1,10 @@
+#pragma once
+
+#include <vector>
+
+// Result of a point to point query, whichever engine answered it.
+struct Route {
+    std::vector<int> nodes;         // model node indices from start to end
+    float distance = 0.f;           // Web Mercator metres, see RouteGraph::Weight()
+    float duration = 0.f;           // seconds over those, only set when routing by travel time
+};
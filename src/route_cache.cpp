@@ -0,0 +1,77 @@
+#include "route_cache.h"
+#include "instrument.h"
+#include <algorithm>
+
+std::size_t RouteCache::KeyHash::operator()(const Key &key) const noexcept
+{
+    // the packed vertices xor the scaled version and engine, through the splitmix64
+    // finalizer; ShardOf() takes the hash modulo kShards and each shard's
+    // unordered_map the whole hash modulo its bucket count
+    auto h = (std::uint64_t{key.from} << 32 | key.to) ^ (key.version << 3 | key.engine) * 0x9e3779b97f4a7c15ull;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+    return static_cast<std::size_t>(h ^ (h >> 31));
+}
+
+RouteCache::RouteCache(std::size_t capacity) :
+    m_Capacity(capacity)
+{
+    // rounded up, so a small cache still keeps at least one route per shard
+    for( auto &shard: m_Shards )
+        shard.routes.SetCapacity((capacity + kShards - 1) / kShards);
+}
+
+std::size_t RouteCache::Size() const
+{
+    std::size_t size = 0;
+    for( auto &shard: m_Shards ) {
+        std::lock_guard<std::mutex> lock{shard.lock};
+        size += shard.routes.Size();
+    }
+    return size;
+}
+
+std::shared_ptr<const Route> RouteCache::Find(const Key &key)
+{
+    if( !Enabled() )
+        return nullptr;
+    std::shared_ptr<const Route> route;
+    {
+        auto &shard = ShardOf(key);
+        std::lock_guard<std::mutex> lock{shard.lock};
+        if( auto cached = shard.routes.Find(key) )
+            route = *cached;
+    }
+    instrument::Add(route ? instrument::RouteCacheHits : instrument::RouteCacheMisses, 1);
+    return route;
+}
+
+void RouteCache::Insert(const Key &key, std::shared_ptr<const Route> route)
+{
+    if( !Enabled() )
+        return;
+    auto &shard = ShardOf(key);
+    std::lock_guard<std::mutex> lock{shard.lock};
+    if( key.engine == Fastest )
+        shard.oldest_fastest = std::min(shard.oldest_fastest, key.version);
+    shard.routes.Insert(key, std::move(route));
+}
+
+void RouteCache::Invalidate(std::uint64_t version)
+{
+    for( auto &shard: m_Shards ) {
+        std::lock_guard<std::mutex> lock{shard.lock};
+        if( shard.oldest_fastest >= version )
+            continue;
+        auto oldest = UINT64_MAX;
+        shard.routes.EraseIf([version, &oldest](const Key &key, const std::shared_ptr<const Route> &) {
+            if( key.engine != Fastest )
+                return false;
+            if( key.version < version )
+                return true;
+            oldest = std::min(oldest, key.version);
+            return false;
+        });
+        shard.oldest_fastest = oldest;
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "lru_cache.h"
+#include "route.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+// Routes recently answered, for the skewed traffic of a server where the same
+// pairs come up again and again. Keyed on the snapped graph vertices, the
+// engine and the traffic version the route was found under, so a speed update
+// makes the travel time routes of older versions unreachable at once and
+// they age out of the LRU order. Invalidate() frees them right away: it takes
+// every shard's lock in turn but only scans the shards that hold routes of an
+// older version, so a speed update costs kShards uncontended locks when no
+// fastest routes are cached. The keys are spread over kShards independent
+// LRU caches with a mutex each, workers rarely contend for one.
+class RouteCache {
+public:
+    static constexpr std::size_t kShards = 16;
+    static constexpr std::size_t kDefaultCapacity = std::size_t{1} << 16;     // routes, over all shards
+
+    enum Engine : std::uint8_t { AStar, CH, Fastest, Bike, Foot };
+
+    struct Key {
+        std::uint32_t from;                 // graph vertices
+        std::uint32_t to;
+        Engine engine;
+        std::uint64_t version;              // traffic version for Fastest, 0 for engines that ignore traffic
+
+        bool operator==(const Key &other) const noexcept {
+            return from == other.from && to == other.to && engine == other.engine && version == other.version;
+        }
+    };
+
+    explicit RouteCache(std::size_t capacity = kDefaultCapacity);   // 0 disables the cache
+    RouteCache(const RouteCache &) = delete;
+    RouteCache &operator=(const RouteCache &) = delete;
+
+    bool Enabled() const noexcept { return m_Capacity > 0; }
+    std::size_t Size() const;
+
+    // The cached route, nullptr on a miss. The route stays valid while held,
+    // even if the entry is evicted meanwhile.
+    std::shared_ptr<const Route> Find(const Key &key);
+    void Insert(const Key &key, std::shared_ptr<const Route> route);
+
+    void Invalidate(std::uint64_t version);         // drops the Fastest routes of older traffic versions
+
+private:
+    struct KeyHash {
+        std::size_t operator()(const Key &key) const noexcept;
+    };
+
+    struct alignas(64) Shard {              // one cache line for the lock, shards don't share it
+        mutable std::mutex lock;
+        LruCache<Key, std::shared_ptr<const Route>, KeyHash> routes;
+        std::uint64_t oldest_fastest = UINT64_MAX;      // no Fastest route of an older version is cached; low after evictions
+    };
+
+    Shard &ShardOf(const Key &key) noexcept { return m_Shards[KeyHash{}(key) % kShards]; }
+
+    std::size_t m_Capacity;
+    std::array<Shard, kShards> m_Shards;
+};
@@ -0,0 +1,159 @@
+#include "route_graph.h"
+#include "hilbert.h"
+#include "instrument.h"
+#include "snapshot.h"
+#include "way_geometry.h"
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <tuple>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+RouteGraph::RouteGraph(const Model &model, const WayGeometry *geometry)
+{
+    ROUTEMS_TRACE_SCOPE("load.graph");
+    const auto nodes = model.Nodes();
+    const auto node_x = nodes.X(), node_y = nodes.Y();
+    const auto scale = model.MetricScale();
+
+    // every node of every road becomes a vertex, roads retired by a diff are skipped
+    std::vector<bool> on_road(nodes.size(), false);
+    for( auto &road: model.Roads() )
+        if( road.type != Model::Road::Invalid )
+            for( auto node: model.Ways()[road.way].nodes )
+                on_road[node] = true;
+
+    std::vector<std::int32_t> model_nodes;
+    for( int i = 0; i < (int)nodes.size(); ++i )
+        if( on_road[i] )
+            model_nodes.push_back(i);
+
+    // normalized coordinates are ~[0, 1] on the shorter side, clamp the longer one onto the grid
+    double max_coord = 1.;
+    for( auto i: model_nodes )
+        max_coord = std::max({max_coord, node_x[i], node_y[i]});
+    auto grid = [&](double c) { return (std::uint32_t)std::clamp(c / max_coord * 65535., 0., 65535.); };
+
+    std::vector<std::uint64_t> keys(nodes.size());
+    for( auto i: model_nodes )
+        keys[i] = HilbertIndex(grid(node_x[i]), grid(node_y[i]));
+    std::stable_sort(model_nodes.begin(), model_nodes.end(), [&](int a, int b){ return keys[a] < keys[b]; });
+
+    std::vector<std::uint32_t> vertices(nodes.size(), kNoVertex);
+    std::vector<float> xs, ys;
+    for( std::uint32_t v = 0; v < model_nodes.size(); ++v ) {
+        vertices[model_nodes[v]] = v;
+        xs.push_back((float)(node_x[model_nodes[v]] * scale));
+        ys.push_back((float)(node_y[model_nodes[v]] * scale));
+    }
+
+    // both directions of every road segment, parallel segments collapse to the shortest
+    struct Edge { std::uint32_t from, to; float weight; std::uint8_t type; };
+    std::vector<Edge> edges;
+    std::vector<float> lengths;
+    auto decode = geometry && !geometry->Empty();
+    for( auto &road: model.Roads() ) {
+        if( road.type == Model::Road::Invalid )
+            continue;
+        auto &way = model.Ways()[road.way].nodes;
+        lengths.clear();
+        if( decode )
+            geometry->Segments(road.way, [&](double metres) { lengths.push_back((float)metres); });
+        for( std::size_t i = 1; i < way.size(); ++i ) {
+            auto a = vertices[way[i - 1]], b = vertices[way[i]];
+            if( a == b )
+                continue;
+            auto weight = std::hypot(xs[a] - xs[b], ys[a] - ys[b]);
+            if( i <= lengths.size() )           // never below the straight line the A* heuristic measures
+                weight = std::max(weight, lengths[i - 1]);
+            edges.push_back({a, b, weight, (std::uint8_t)road.type});
+            edges.push_back({b, a, weight, (std::uint8_t)road.type});
+        }
+    }
+    std::sort(edges.begin(), edges.end(), [](auto &l, auto &r){
+        return std::tie(l.from, l.to, l.weight) < std::tie(r.from, r.to, r.weight);
+    });
+    edges.erase(std::unique(edges.begin(), edges.end(), [](auto &l, auto &r){
+        return l.from == r.from && l.to == r.to;
+    }), edges.end());
+
+    std::vector<std::uint32_t> offsets(model_nodes.size() + 1, 0), targets;
+    std::vector<float> weights;
+    std::vector<std::uint8_t> types;
+    for( auto &edge: edges ) {
+        ++offsets[edge.from + 1];
+        targets.push_back(edge.to);
+        weights.push_back(edge.weight);
+        types.push_back(edge.type);
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+    m_Offsets = std::move(offsets);
+    m_Targets = std::move(targets);
+    m_Weights = std::move(weights);
+    m_Types = std::move(types);
+    m_X = std::move(xs);
+    m_Y = std::move(ys);
+    m_ModelNodes = std::move(model_nodes);
+    m_Vertices = std::move(vertices);
+}
+
+RouteGraph::RouteGraph(const Snapshot &snapshot) :
+    m_Offsets(snapshot.Array<std::uint32_t>(Snapshot::GraphOffsets)),
+    m_Targets(snapshot.Array<std::uint32_t>(Snapshot::GraphTargets)),
+    m_Weights(snapshot.Array<float>(Snapshot::GraphWeights)),
+    m_Types(snapshot.Array<std::uint8_t>(Snapshot::GraphTypes)),
+    m_X(snapshot.Array<float>(Snapshot::GraphX)),
+    m_Y(snapshot.Array<float>(Snapshot::GraphY)),
+    m_ModelNodes(snapshot.Array<std::int32_t>(Snapshot::GraphModelNodes)),
+    m_Vertices(snapshot.Array<std::uint32_t>(Snapshot::GraphVertices))
+{
+    auto vertex_count = m_ModelNodes.size();
+    if( m_Offsets.size() != vertex_count + 1 || m_Offsets[vertex_count] != m_Targets.size() ||
+        m_Weights.size() != m_Targets.size() || m_Types.size() != m_Targets.size() ||
+        m_X.size() != vertex_count || m_Y.size() != vertex_count )
+        throw std::runtime_error("snapshot: malformed routing graph");
+
+    // searches index with these unchecked, so every one has to land inside the graph
+    auto malformed = m_Offsets[0] != 0;
+    for( std::size_t v = 0; v < vertex_count && !malformed; ++v )
+        malformed = m_Offsets[v] > m_Offsets[v + 1] || m_ModelNodes[v] < 0 ||
+                    (std::size_t)m_ModelNodes[v] >= m_Vertices.size() || m_Vertices[m_ModelNodes[v]] != v;
+    for( std::size_t e = 0; e < m_Targets.size() && !malformed; ++e )
+        malformed = m_Targets[e] >= vertex_count || m_Types[e] > Model::Road::Footway;
+    for( std::size_t node = 0; node < m_Vertices.size() && !malformed; ++node )
+        malformed = m_Vertices[node] != kNoVertex && (m_Vertices[node] >= vertex_count ||
+                                                      (std::size_t)m_ModelNodes[m_Vertices[node]] != node);
+    if( malformed )
+        throw std::runtime_error("snapshot: malformed routing graph");
+}
+
+void RouteGraph::TargetDistances(std::uint32_t first, std::uint32_t last, std::uint32_t to, float *out) const noexcept
+{
+    auto e = first;
+#if defined(__SSE2__)
+    const auto to_x = _mm_set1_ps(m_X[to]), to_y = _mm_set1_ps(m_Y[to]);
+    for( ; e + 4 <= last; e += 4, out += 4 ) {
+        auto t0 = m_Targets[e], t1 = m_Targets[e + 1], t2 = m_Targets[e + 2], t3 = m_Targets[e + 3];
+        auto dx = _mm_sub_ps(_mm_setr_ps(m_X[t0], m_X[t1], m_X[t2], m_X[t3]), to_x);
+        auto dy = _mm_sub_ps(_mm_setr_ps(m_Y[t0], m_Y[t1], m_Y[t2], m_Y[t3]), to_y);
+        _mm_storeu_ps(out, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy))));
+    }
+#endif
+    for( ; e < last; ++e )
+        *out++ = Distance(m_Targets[e], to);
+}
+
+void RouteGraph::Serialize(SnapshotWriter &writer) const
+{
+    writer.Add<std::uint32_t>(Snapshot::GraphOffsets, m_Offsets);
+    writer.Add<std::uint32_t>(Snapshot::GraphTargets, m_Targets);
+    writer.Add<float>(Snapshot::GraphWeights, m_Weights);
+    writer.Add<std::uint8_t>(Snapshot::GraphTypes, m_Types);
+    writer.Add<float>(Snapshot::GraphX, m_X);
+    writer.Add<float>(Snapshot::GraphY, m_Y);
+    writer.Add<std::int32_t>(Snapshot::GraphModelNodes, m_ModelNodes);
+    writer.Add<std::uint32_t>(Snapshot::GraphVertices, m_Vertices);
+}
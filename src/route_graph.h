@@ -0,0 +1,67 @@
+#pragma once
+
+#include "flat_array.h"
+#include "model.h"
+#include "profile.h"
+#include <cmath>
+#include <cstdint>
+
+class WayGeometry;
+
+// Road network in compressed sparse row form: the out edges of vertex v are
+// the edge ids [FirstEdge(v), FirstEdge(v + 1)). Vertices are the road nodes
+// of the model renumbered along a Hilbert curve, so nodes that are close on
+// the map are close in memory too. Weights and coordinates are projected
+// metres.
+class RouteGraph {
+public:
+    static constexpr std::uint32_t kNoVertex = 0xffffffffu;
+
+    RouteGraph() = default;
+    // With a geometry the edge weights are decoded from it instead of the node coordinates.
+    explicit RouteGraph(const Model &model, const WayGeometry *geometry = nullptr);
+    explicit RouteGraph(const Snapshot &snapshot);      // views into the snapshot, which must outlive the graph
+
+    void Serialize(SnapshotWriter &writer) const;
+
+    std::uint32_t VertexCount() const noexcept { return static_cast<std::uint32_t>(m_ModelNodes.size()); }
+    std::uint32_t EdgeCount() const noexcept { return static_cast<std::uint32_t>(m_Targets.size()); }
+
+    std::uint32_t FirstEdge(std::uint32_t v) const noexcept { return m_Offsets[v]; }
+    std::uint32_t Target(std::uint32_t e) const noexcept { return m_Targets[e]; }
+    // Lengths are Web Mercator metres like everywhere in the model, 1 / cos(latitude)
+    // times the length on the ground, so about 1.3 at New York. Durations are these
+    // divided by a speed, and run long by the same factor.
+    float Weight(std::uint32_t e) const noexcept { return m_Weights[e]; }
+    float Duration(std::uint32_t e) const noexcept { return m_Weights[e] / DefaultSpeed(Type(e)); }    // seconds
+    Model::Road::Type Type(std::uint32_t e) const noexcept { return static_cast<Model::Road::Type>(m_Types[e]); }
+
+    float X(std::uint32_t v) const noexcept { return m_X[v]; }
+    float Y(std::uint32_t v) const noexcept { return m_Y[v]; }
+    float Distance(std::uint32_t u, std::uint32_t v) const noexcept {
+        auto dx = m_X[u] - m_X[v], dy = m_Y[u] - m_Y[v];
+        return std::sqrt(dx * dx + dy * dy);
+    }
+
+    // Distance(Target(e), to) for the edges [first, last) into out, on SSE2
+    // four edges at a time; the results match Distance() exactly. Scores all
+    // neighbours of an expanded vertex in one call.
+    void TargetDistances(std::uint32_t first, std::uint32_t last, std::uint32_t to, float *out) const noexcept;
+
+    // Free flow car speed on a road type, metres per second.
+    static constexpr float DefaultSpeed(Model::Road::Type type) noexcept { return CarProfile::kSpeed[type]; }
+
+    int ModelNode(std::uint32_t v) const noexcept { return m_ModelNodes[v]; }
+    std::uint32_t Vertex(int model_node) const noexcept { return m_Vertices[model_node]; }       // kNoVertex if not on a road
+    std::size_t ModelNodeCount() const noexcept { return m_Vertices.size(); }
+
+private:
+    FlatArray<std::uint32_t> m_Offsets;         // VertexCount() + 1
+    FlatArray<std::uint32_t> m_Targets;
+    FlatArray<float> m_Weights;
+    FlatArray<std::uint8_t> m_Types;            // Model::Road::Type of the way the edge comes from
+    FlatArray<float> m_X;
+    FlatArray<float> m_Y;
+    FlatArray<std::int32_t> m_ModelNodes;       // vertex -> model node
+    FlatArray<std::uint32_t> m_Vertices;        // model node -> vertex
+};
@@ -0,0 +1,115 @@
+#include "route_model.h"
+#include <algorithm>
+#include <stdexcept>
+
+RouteModel::RouteModel(const MappedFile &osm_data) :
+    Model(osm_data),
+    m_Graph(*this)
+{
+    CollectRoadNodes();
+    m_RoadIndex = SpatialIndex{Nodes(), m_RoadNodes};
+}
+
+RouteModel::RouteModel(const std::filesystem::path &osm_file, const std::filesystem::path &scratch_dir) :
+    Model(osm_file, scratch_dir),
+    m_Graph(*this)
+{
+    CollectRoadNodes();
+    m_RoadIndex = SpatialIndex{Nodes(), m_RoadNodes};
+}
+
+RouteModel::RouteModel(const std::filesystem::path &osm_file) :
+    Model(osm_file),
+    m_Graph(*this)
+{
+    CollectRoadNodes();
+    m_RoadIndex = SpatialIndex{Nodes(), m_RoadNodes};
+}
+
+RouteModel::RouteModel(Snapshot snapshot) :
+    Model(snapshot),
+    m_Snapshot(std::move(snapshot)),
+    m_Graph(*m_Snapshot),
+    m_Hierarchy(*m_Snapshot),
+    m_Landmarks(*m_Snapshot),
+    m_Geometry(*m_Snapshot)
+{
+    if( m_Graph.ModelNodeCount() != Nodes().size() )
+        throw std::runtime_error("snapshot: routing graph doesn't match the nodes");
+    if( !m_Hierarchy.Empty() && m_Hierarchy.VertexCount() != m_Graph.VertexCount() )
+        throw std::runtime_error("snapshot: contraction hierarchy doesn't match the graph");
+    if( !m_Landmarks.Empty() && m_Landmarks.VertexCount() != m_Graph.VertexCount() )
+        throw std::runtime_error("snapshot: landmark tables don't match the graph");
+    if( !m_Geometry.Empty() && m_Geometry.WayCount() != Ways().size() )
+        throw std::runtime_error("snapshot: way geometry doesn't match the ways");
+    auto road_nodes = m_Snapshot->Array<std::int32_t>(Snapshot::RoadNodes);
+    m_RoadNodes.assign(road_nodes.begin(), road_nodes.end());
+    for( auto node: m_RoadNodes )           // snapping hands these to Graph().Vertex()
+        if( node < 0 || (std::size_t)node >= Nodes().size() || m_Graph.Vertex(node) == RouteGraph::kNoVertex )
+            throw std::runtime_error("snapshot: road nodes don't match the graph");
+    m_RoadIndex = SpatialIndex{Nodes(), m_RoadNodes};
+}
+
+void RouteModel::Serialize(SnapshotWriter &writer) const
+{
+    Model::Serialize(writer);
+    writer.Add(Snapshot::RoadNodes, m_RoadNodes);
+    m_Graph.Serialize(writer);
+    m_Hierarchy.Serialize(writer);
+    m_Landmarks.Serialize(writer);
+    m_Geometry.Serialize(writer);
+}
+
+Model::Changes RouteModel::Apply(const OsmChange &change)
+{
+    auto changes = Model::Apply(change);
+    if( !m_Geometry.Empty() && !changes.ways.empty() )
+        m_Geometry.Update(*this, changes.ways);
+    if( changes.roads.empty() )
+        return changes;
+
+    m_RoadNodes.clear();
+    CollectRoadNodes();
+    m_RoadIndex = SpatialIndex{Nodes(), m_RoadNodes};
+    m_Graph = RouteGraph{*this, &m_Geometry};
+    if( !m_Hierarchy.Empty() )
+        BuildHierarchy();
+    if( !m_Landmarks.Empty() )
+        BuildLandmarks(m_Landmarks.Count());
+    return changes;
+}
+
+void RouteModel::BuildHierarchy()
+{
+    m_Hierarchy = ContractionHierarchy{m_Graph};
+}
+
+void RouteModel::BuildLandmarks(std::size_t count)
+{
+    m_Landmarks = Landmarks{m_Graph, count};
+}
+
+void RouteModel::BuildGeometry()
+{
+    m_Geometry = WayGeometry{*this};
+    auto remap = DropAreaWays();
+    for( auto &node: m_RoadNodes )          // road nodes are all kept, in the same order
+        node = remap[node];
+    m_RoadIndex = SpatialIndex{Nodes(), m_RoadNodes};
+    m_Graph = RouteGraph{*this, &m_Geometry};
+    if( !m_Hierarchy.Empty() )
+        BuildHierarchy();
+    if( !m_Landmarks.Empty() )
+        BuildLandmarks(m_Landmarks.Count());
+}
+
+void RouteModel::CollectRoadNodes()
+{
+    for( auto &road: Roads() )
+        if( road.type != Model::Road::Footway && road.type != Model::Road::Invalid ) {
+            auto &nodes = Ways()[road.way].nodes;
+            m_RoadNodes.insert(m_RoadNodes.end(), nodes.begin(), nodes.end());
+        }
+    std::sort(m_RoadNodes.begin(), m_RoadNodes.end());
+    m_RoadNodes.erase(std::unique(m_RoadNodes.begin(), m_RoadNodes.end()), m_RoadNodes.end());
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "contraction_hierarchy.h"
+#include "landmarks.h"
+#include "model.h"
+#include "route_graph.h"
+#include "snapshot.h"
+#include "spatial_index.h"
+#include "way_geometry.h"
+#include <optional>
+#include <vector>
+
+// Model extended with what the router needs on top of the map features.
+class RouteModel : public Model {
+public:
+    explicit RouteModel(const MappedFile &osm_data);
+    RouteModel(const std::filesystem::path &osm_file, const std::filesystem::path &scratch_dir);    // streaming ingest, see Model
+    explicit RouteModel(const std::filesystem::path &osm_file);                         // overlapped reads, see Model
+    explicit RouteModel(Snapshot snapshot);         // keeps the mapping alive, the graph is used in place
+
+    void Serialize(SnapshotWriter &writer) const;
+
+    // Index of the road node closest to (x, y), in the model's normalized coordinates.
+    // Returns -1 if the model has no drivable roads.
+    int FindClosestNode(float x, float y) const { return m_RoadIndex.Nearest(x, y); }
+
+    auto &RoadNodes() const noexcept { return m_RoadNodes; }
+    auto &RoadIndex() const noexcept { return m_RoadIndex; }         // k-nearest and radius queries over RoadNodes()
+    auto &Graph() const noexcept { return m_Graph; }
+    auto &Hierarchy() const noexcept { return m_Hierarchy; }         // empty unless built or loaded
+    auto &GraphLandmarks() const noexcept { return m_Landmarks; }     // empty unless built or loaded
+    auto &Geometry() const noexcept { return m_Geometry; }            // empty unless built or loaded
+
+    void BuildHierarchy();          // offline step, the result is kept by Serialize()
+    void BuildLandmarks(std::size_t count = Landmarks::kDefaultCount);      // offline too, seconds per landmark on a state
+    // Compact way coordinates: the renderer then draws the areas from them, the
+    // graph decodes its edge lengths from them, and the node lists and nodes
+    // only areas used are dropped, see Model::DropAreaWays(). A hierarchy and
+    // landmarks built before are built again for the new weights.
+    void BuildGeometry();
+
+    // Model::Apply(), then the road nodes, their spatial index and the graph
+    // are rebuilt if any road changed; each is a linear pass or a sort over the
+    // roads, seconds at most on a state. A contraction hierarchy and landmarks
+    // can't be patched, so they are built again then, minutes on a state; a
+    // model that had them never routes without them. The compact geometry,
+    // if any, codes the changed ways again.
+    // Queries must not run concurrently, a Render must be quiesced before, and
+    // planners, CHQuery and TrafficWeights objects made before must be
+    // recreated. Throws std::runtime_error if the model has no OSM ids.
+    Changes Apply(const OsmChange &change);
+
+private:
+    void CollectRoadNodes();
+
+    std::optional<Snapshot> m_Snapshot;
+    std::vector<int> m_RoadNodes;       // nodes of drivable roads, sorted and unique
+    SpatialIndex m_RoadIndex;
+    RouteGraph m_Graph;
+    ContractionHierarchy m_Hierarchy;
+    Landmarks m_Landmarks;
+    WayGeometry m_Geometry;
+};
@@ -0,0 +1,144 @@
+#include "route_planner.h"
+#include "instrument.h"
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+
+RoutePlanner::RoutePlanner(const RouteModel &model) :
+    m_Model(model),
+    m_Graph(model.Graph()),
+    m_Landmarks(model.GraphLandmarks()),
+    m_Open(model.Graph().VertexCount()),
+    m_G(model.Graph().VertexCount(), std::numeric_limits<float>::infinity()),
+    m_Parent(model.Graph().VertexCount(), RouteGraph::kNoVertex),
+    m_ParentEdge(model.Graph().VertexCount(), RouteGraph::kNoVertex),
+    m_Closed(model.Graph().VertexCount(), false)
+{
+}
+
+std::optional<Route> RoutePlanner::AStarSearch(float start_x, float start_y, float end_x, float end_y)
+{
+    auto start = m_Model.FindClosestNode(start_x * 0.01f, start_y * 0.01f);
+    auto end = m_Model.FindClosestNode(end_x * 0.01f, end_y * 0.01f);
+    if( start < 0 || end < 0 )
+        return std::nullopt;
+    return AStarSearch(m_Graph.Vertex(start), m_Graph.Vertex(end));
+}
+
+template <typename Profile, typename Cost>
+bool RoutePlanner::Search(std::uint32_t from, std::uint32_t to, Cost cost, float heuristic_scale)
+{
+    // the landmark tables hold distances over the car's roads, other profiles may take shortcuts
+    auto landmarks = std::is_same_v<Profile, CarProfile> && !m_Landmarks.Empty();
+    auto heuristic = [&](std::uint32_t v, float straight) {
+        if( landmarks )
+            straight = std::max(straight, m_Landmarks.LowerBound(v, to));
+        return straight * heuristic_scale;
+    };
+
+    ROUTEMS_TRACE_SCOPE("route.astar");
+    instrument::Tally expanded{instrument::NodesExpanded}, relaxed{instrument::EdgesRelaxed};
+    instrument::Tally pushes{instrument::HeapPushes}, pops{instrument::HeapPops};
+
+    Reset();
+    m_G[from] = 0.f;
+    m_Touched.push_back(from);
+    m_Open.Push(from, heuristic(from, m_Graph.Distance(from, to)));
+    ++pushes;
+
+    while( !m_Open.Empty() ) {
+        auto v = m_Open.Pop();
+        ++pops;
+        if( v == to )
+            return true;
+        m_Closed[v] = true;
+        ++m_Expanded;
+        ++expanded;
+
+        auto first = m_Graph.FirstEdge(v), last = m_Graph.FirstEdge(v + 1);
+        relaxed += last - first;
+        m_Heuristics.resize(last - first);
+        m_Graph.TargetDistances(first, last, to, m_Heuristics.data());
+        for( auto e = first; e < last; ++e ) {
+            if( !Profile::kAccess[m_Graph.Type(e)] )
+                continue;
+            auto w = m_Graph.Target(e);
+            auto g = m_G[v] + cost(e);
+            if( m_Closed[w] || !(g < m_G[w]) )
+                continue;
+            if( m_G[w] == std::numeric_limits<float>::infinity() )
+                m_Touched.push_back(w);
+            m_G[w] = g;
+            m_Parent[w] = v;
+            m_ParentEdge[w] = e;
+            m_Open.Push(w, g + heuristic(w, m_Heuristics[e - first]));
+            ++pushes;
+        }
+    }
+    return false;
+}
+
+template <typename Profile>
+std::optional<Route> RoutePlanner::AStarSearch(std::uint32_t from, std::uint32_t to)
+{
+    if( !Search<Profile>(from, to, [&](std::uint32_t e){ return m_Graph.Weight(e); }, 1.f) )
+        return std::nullopt;
+    return ConstructFinalPath(to);
+}
+
+template <typename Profile>
+std::optional<Route> RoutePlanner::FastestSearch(std::uint32_t from, std::uint32_t to)
+{
+    auto seconds = [&](std::uint32_t e){ return m_Graph.Weight(e) / Profile::kSpeed[m_Graph.Type(e)]; };
+    if( !Search<Profile>(from, to, seconds, 1.f / Profile::kMaxSpeed) )
+        return std::nullopt;
+    return ConstructFastestPath(from, to);
+}
+
+std::optional<Route> RoutePlanner::FastestSearch(std::uint32_t from, std::uint32_t to, const TrafficWeights::Table &traffic)
+{
+    auto seconds = traffic.seconds.data();
+    if( !Search<CarProfile>(from, to, [seconds](std::uint32_t e){ return seconds[e]; }, 1.f / TrafficWeights::kMaxSpeed) )
+        return std::nullopt;
+    return ConstructFastestPath(from, to);
+}
+
+template std::optional<Route> RoutePlanner::AStarSearch<CarProfile>(std::uint32_t, std::uint32_t);
+template std::optional<Route> RoutePlanner::AStarSearch<BikeProfile>(std::uint32_t, std::uint32_t);
+template std::optional<Route> RoutePlanner::AStarSearch<FootProfile>(std::uint32_t, std::uint32_t);
+template std::optional<Route> RoutePlanner::FastestSearch<CarProfile>(std::uint32_t, std::uint32_t);
+template std::optional<Route> RoutePlanner::FastestSearch<BikeProfile>(std::uint32_t, std::uint32_t);
+template std::optional<Route> RoutePlanner::FastestSearch<FootProfile>(std::uint32_t, std::uint32_t);
+
+void RoutePlanner::Reset()
+{
+    for( auto v: m_Touched ) {
+        m_G[v] = std::numeric_limits<float>::infinity();
+        m_Parent[v] = RouteGraph::kNoVertex;
+        m_ParentEdge[v] = RouteGraph::kNoVertex;
+        m_Closed[v] = false;
+    }
+    m_Touched.clear();
+    m_Open.Clear();
+    m_Expanded = 0;
+}
+
+Route RoutePlanner::ConstructFinalPath(std::uint32_t to) const
+{
+    Route route;
+    route.distance = m_G[to];
+    for( auto v = to; v != RouteGraph::kNoVertex; v = m_Parent[v] )
+        route.nodes.push_back(m_Graph.ModelNode(v));
+    std::reverse(route.nodes.begin(), route.nodes.end());
+    return route;
+}
+
+Route RoutePlanner::ConstructFastestPath(std::uint32_t from, std::uint32_t to) const
+{
+    auto route = ConstructFinalPath(to);
+    route.duration = m_G[to];
+    route.distance = 0.f;
+    for( auto v = to; v != from; v = m_Parent[v] )
+        route.distance += m_Graph.Weight(m_ParentEdge[v]);
+    return route;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "open_list.h"
+#include "profile.h"
+#include "route.h"
+#include "route_model.h"
+#include "traffic.h"
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// A* search over the RouteModel's routing graph, with the straight line
+// distance to the goal as heuristic. The searches are templates over a
+// profile from profile.h, which decides the roads that may be used and, for
+// FastestSearch(), their speeds; the heuristic is then the distance at the
+// profile's top speed. They are instantiated for CarProfile, BikeProfile and
+// FootProfile. The traffic overload routes cars at live speeds. Car searches
+// take the larger of that and the landmark bound if the model has landmarks.
+class RoutePlanner {
+public:
+    explicit RoutePlanner(const RouteModel &model);
+
+    // Route between the road nodes closest to the given points, x and y in
+    // percent of the map as prompted from the user. nullopt if unreachable.
+    std::optional<Route> AStarSearch(float start_x, float start_y, float end_x, float end_y);
+    template <typename Profile = CarProfile>
+    std::optional<Route> AStarSearch(std::uint32_t from, std::uint32_t to);     // graph vertices
+    template <typename Profile = CarProfile>
+    std::optional<Route> FastestSearch(std::uint32_t from, std::uint32_t to);
+    std::optional<Route> FastestSearch(std::uint32_t from, std::uint32_t to, const TrafficWeights::Table &traffic);
+
+    std::size_t ExpandedNodes() const noexcept { return m_Expanded; }       // by the last search
+
+private:
+    template <typename Profile, typename Cost>
+    bool Search(std::uint32_t from, std::uint32_t to, Cost cost, float heuristic_scale);       // cost(e) of an edge
+    void Reset();
+    Route ConstructFinalPath(std::uint32_t to) const;
+    Route ConstructFastestPath(std::uint32_t from, std::uint32_t to) const;       // m_G holds seconds
+
+    const RouteModel &m_Model;
+    const RouteGraph &m_Graph;
+    const Landmarks &m_Landmarks;
+    OpenList m_Open;
+    std::vector<float> m_G;
+    std::vector<std::uint32_t> m_Parent;
+    std::vector<std::uint32_t> m_ParentEdge;
+    std::vector<bool> m_Closed;
+    std::vector<std::uint32_t> m_Touched;       // vertices whose state has to be reset
+    std::vector<float> m_Heuristics;            // of the out edges of the vertex being expanded
+    std::size_t m_Expanded = 0;
+};
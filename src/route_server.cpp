@@ -0,0 +1,296 @@
+#include "route_server.h"
+#include "instrument.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+bool SendAll(int fd, const std::string &data)
+{
+    for( std::size_t sent = 0; sent < data.size(); ) {
+        auto n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if( n <= 0 )
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+// Prometheus scrapes with a plain HTTP GET: answer after the request headers, then close.
+void ServeMetrics(int fd, std::string pending)
+{
+    char buffer[4096];
+    while( pending.find("\r\n\r\n") == std::string::npos && pending.find("\n\n") == std::string::npos ) {
+        if( pending.size() > 4 * RouteServer::kMaxLineLength )        // headers of a scraper are far shorter
+            return;
+        auto received = ::recv(fd, buffer, sizeof(buffer), 0);
+        if( received <= 0 )
+            return;
+        pending.append(buffer, received);
+    }
+    std::ostringstream body;
+    instrument::WritePrometheus(body);
+    auto text = body.str();
+    SendAll(fd, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                std::to_string(text.size()) + "\r\nConnection: close\r\n\r\n" + text);
+}
+
+}
+
+RouteServer::Context::Context(const RouteModel &model) :
+    planner(model)
+{
+    if( !model.Hierarchy().Empty() )
+        ch.emplace(model.Hierarchy(), model.Graph());
+}
+
+RouteServer::RouteServer(const RouteModel &model, unsigned threads, std::size_t cached_routes) :
+    m_Model(model),
+    m_Traffic(model.Graph(), model.Hierarchy()),
+    m_Cache(cached_routes)
+{
+    // contexts are built up front, a request never allocates search state
+    for( unsigned i = 0; i < std::max(threads, 1u); ++i )
+        m_Contexts.push_back(std::make_unique<Context>(model));
+}
+
+RouteServer::~RouteServer()
+{
+    Stop();
+    Wait();
+}
+
+bool RouteServer::Start(std::uint16_t port)
+{
+    m_Listener = ::socket(AF_INET, SOCK_STREAM, 0);
+    if( m_Listener < 0 )
+        return false;
+    int on = 1;
+    ::setsockopt(m_Listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if( ::bind(m_Listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        ::listen(m_Listener, SOMAXCONN) != 0 ) {
+        ::close(m_Listener);
+        m_Listener = -1;
+        return false;
+    }
+    socklen_t length = sizeof(address);
+    ::getsockname(m_Listener, reinterpret_cast<sockaddr*>(&address), &length);
+    m_Port = ntohs(address.sin_port);
+
+    // every worker blocks in accept() on the same socket, the kernel hands each connection to one of them
+    m_Connections.assign(m_Contexts.size(), -1);
+    for( unsigned i = 0; i < m_Contexts.size(); ++i )
+        m_Workers.emplace_back(&RouteServer::Worker, this, i);
+    return true;
+}
+
+void RouteServer::Wait()
+{
+    for( auto &worker: m_Workers )
+        worker.join();
+    m_Workers.clear();
+    if( m_Listener >= 0 ) {
+        ::close(m_Listener);
+        m_Listener = -1;
+    }
+}
+
+void RouteServer::Stop()
+{
+    if( m_Stopping.exchange(true) || m_Listener < 0 )
+        return;
+    ::shutdown(m_Listener, SHUT_RDWR);      // wakes up the workers blocked in accept()
+    std::lock_guard lock{m_ConnectionsMutex};
+    for( auto fd: m_Connections )           // and those blocked in recv()
+        if( fd >= 0 )
+            ::shutdown(fd, SHUT_RDWR);
+}
+
+void RouteServer::Worker(unsigned worker)
+{
+    while( !m_Stopping ) {
+        ++m_Accepting;
+        auto fd = ::accept(m_Listener, nullptr, nullptr);
+        --m_Accepting;
+        if( fd < 0 ) {
+            if( errno == EINTR || errno == ECONNABORTED )
+                continue;
+            break;
+        }
+        {
+            std::lock_guard lock{m_ConnectionsMutex};
+            if( m_Stopping ) {              // Stop() has already shut down the connections it saw
+                ::close(fd);
+                break;
+            }
+            m_Connections[worker] = fd;
+        }
+        ServeConnection(worker, fd);
+        std::lock_guard lock{m_ConnectionsMutex};       // closed under the lock, so Stop() never sees a reused fd
+        m_Connections[worker] = -1;
+        ::close(fd);
+    }
+}
+
+void RouteServer::ServeConnection(unsigned worker, int fd)
+{
+    std::string pending;
+    char buffer[4096];
+    auto deadline = std::chrono::steady_clock::now() + kIdleTimeout;
+    while( !m_Stopping ) {
+        if( !WaitForInput(fd, pending.empty(), deadline) )
+            return;
+        auto received = ::recv(fd, buffer, sizeof(buffer), 0);
+        if( received <= 0 )
+            return;
+        pending.append(buffer, received);
+
+        std::size_t begin = 0;
+        for( auto end = pending.find('\n'); end != std::string::npos; end = pending.find('\n', begin) ) {
+            auto line = pending.substr(begin, end - begin);
+            begin = end + 1;
+            if( !line.empty() && line.back() == '\r' )
+                line.pop_back();
+            if( line == "quit" )
+                return;
+            if( line.rfind("GET /metrics", 0) == 0 )
+                return ServeMetrics(fd, pending.substr(begin));
+            if( !SendAll(fd, HandleRequest(worker, line) + '\n') )
+                return;
+            deadline = std::chrono::steady_clock::now() + kIdleTimeout;
+        }
+        pending.erase(0, begin);
+        if( pending.size() > kMaxLineLength ) {
+            SendAll(fd, "err line too long\n");
+            return;
+        }
+    }
+}
+
+bool RouteServer::WaitForInput(int fd, bool between_requests, std::chrono::steady_clock::time_point deadline)
+{
+    constexpr std::chrono::milliseconds kRecheck{100};      // while other workers accept, how often to look again
+    for( ;; ) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if( left.count() <= 0 || m_Stopping )
+            return false;
+        // the listener stays readable until a connection is accepted, only watch it when nobody else will
+        auto yield = between_requests && m_Accepting == 0;
+        pollfd fds[2] = {{fd, POLLIN, 0}, {m_Listener, POLLIN, 0}};
+        auto ready = ::poll(fds, yield ? 2 : 1, static_cast<int>(yield ? left.count() : std::min(left, kRecheck).count()));
+        if( ready < 0 && errno != EINTR )
+            return false;
+        if( ready > 0 && fds[0].revents != 0 )
+            return true;                    // data, or the hang up recv() then reports
+        if( ready > 0 && yield && fds[1].revents != 0 && m_Accepting == 0 )
+            return false;                   // a new connection waits for this worker
+    }
+}
+
+std::string RouteServer::HandleRequest(unsigned worker, const std::string &line)
+{
+    ROUTEMS_TRACE_SCOPE("server.request");
+    auto started = std::chrono::steady_clock::now();
+    auto &context = *m_Contexts[worker];
+    std::istringstream request{line};
+    std::string command;
+    request >> command;
+
+    if( command == "stats" ) {
+        std::uint64_t requests = 0, micros = 0;
+        for( auto &c: m_Contexts ) {           // other workers' counters, a slightly stale sum is fine
+            requests += c->requests.load(std::memory_order_relaxed);
+            micros += c->total_micros.load(std::memory_order_relaxed);
+        }
+        std::ostringstream reply;
+        reply << "ok " << requests << ' ' << (requests ? micros / requests : 0);
+        return reply.str();
+    }
+    if( command == "speed" ) {
+        std::string update;
+        std::getline(request, update);
+        std::istringstream feed{update};
+        try {
+            if( m_Traffic.LoadFeed(feed) != 1 )
+                return "err expected: speed <edge id|road type> <km/h>";
+        } catch( const std::exception &e ) {
+            return std::string{"err "} + e.what();
+        }
+        auto version = m_Traffic.Version();
+        m_Cache.Invalidate(version);            // their keys can't match any more, only frees them
+        return "ok " + std::to_string(version) + (m_Model.Hierarchy().Empty() ? "" : " ch-by-distance");
+    }
+    if( command != "route" )
+        return "err unknown command";
+
+    float start_x, start_y, end_x, end_y;
+    std::string engine;
+    if( !(request >> start_x >> start_y >> end_x >> end_y) )
+        return "err expected: route <start x> <start y> <end x> <end y> [astar|ch|fastest|bike|foot]";
+    request >> engine;
+    auto timed = engine == "fastest" || engine == "bike" || engine == "foot";
+    if( !engine.empty() && engine != "astar" && engine != "ch" && !timed )
+        return "err unknown engine " + engine;
+
+    if( !std::isfinite(start_x) || !std::isfinite(start_y) || !std::isfinite(end_x) || !std::isfinite(end_y) )
+        return "err coordinates must be finite";
+    auto start = m_Model.FindClosestNode(start_x * 0.01f, start_y * 0.01f);
+    auto end = m_Model.FindClosestNode(end_x * 0.01f, end_y * 0.01f);
+    if( start < 0 || end < 0 )
+        return "err the map has no roads";
+    auto &graph = m_Model.Graph();
+    auto from = graph.Vertex(start), to = graph.Vertex(end);
+
+    // the table pinned here is the one searched, so the key's version matches the route
+    std::optional<TrafficWeights::Pin> traffic;
+    RouteCache::Key key{from, to, RouteCache::AStar, 0};
+    if( engine == "fastest" ) {
+        traffic.emplace(m_Traffic.Read());
+        key = {from, to, RouteCache::Fastest, (*traffic)->version};
+    } else if( engine == "bike" || engine == "foot" ) {
+        key.engine = engine == "bike" ? RouteCache::Bike : RouteCache::Foot;
+    } else if( engine != "astar" && context.ch ) {
+        key.engine = RouteCache::CH;
+    }
+
+    auto route = m_Cache.Find(key);
+    if( !route ) {
+        std::optional<Route> found;
+        switch( key.engine ) {
+            case RouteCache::Fastest: found = context.planner.FastestSearch(from, to, **traffic); break;
+            case RouteCache::Bike: found = context.planner.FastestSearch<BikeProfile>(from, to); break;
+            case RouteCache::Foot: found = context.planner.FastestSearch<FootProfile>(from, to); break;
+            case RouteCache::CH: found = context.ch->Search(from, to); break;
+            case RouteCache::AStar: found = context.planner.AStarSearch(from, to); break;
+        }
+        if( found ) {
+            route = std::make_shared<const Route>(std::move(*found));
+            m_Cache.Insert(key, route);
+        }
+    }
+
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count();
+    context.requests.store(context.requests.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    context.total_micros.store(context.total_micros.load(std::memory_order_relaxed) + micros, std::memory_order_relaxed);
+    if( !route )
+        return "err no route found";
+
+    std::ostringstream reply;
+    reply << "ok " << route->distance << ' ' << route->nodes.size() << ' ' << micros;
+    if( timed )
+        reply << ' ' << route->duration;
+    return reply.str();
+}
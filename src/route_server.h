@@ -0,0 +1,88 @@
+#pragma once
+
+#include "contraction_hierarchy.h"
+#include "route_cache.h"
+#include "route_model.h"
+#include "route_planner.h"
+#include "traffic.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Long lived routing service over TCP. The model is shared read-only; every
+// worker thread accepts connections on the same listening socket and owns a
+// preallocated search context, so queries never take a lock.
+//
+// Line based protocol, one reply line per request:
+//   route <start x> <start y> <end x> <end y> [astar|ch]    ->  ok <metres> <nodes> <micros>
+//   route <start x> <start y> <end x> <end y> fastest       ->  ok <metres> <nodes> <micros> <seconds>
+//   route <start x> <start y> <end x> <end y> bike|foot     ->  ok <metres> <nodes> <micros> <seconds>
+//   speed <edge id|road type> <km/h>                        ->  ok <traffic version> [ch-by-distance]
+//   stats                                                   ->  ok <requests> <mean micros>
+//   quit
+//   GET /metrics HTTP/1.x                                   ->  HTTP reply with the Prometheus metrics
+// Coordinates are percent of the map, like the interactive prompt. Errors
+// are answered with "err <reason>". Fastest car routes use the live speeds, a
+// speed update publishes a new traffic table without stalling the queries
+// in flight, see TrafficWeights. "ch" routes don't take traffic into account;
+// with a hierarchy the speed reply ends in "ch-by-distance" as a reminder that
+// the times customized for it follow paths chosen by distance. Repeated queries are answered from a
+// RouteCache without searching; <micros> then is the time of the lookup.
+// A line longer than kMaxLineLength is answered with "err line too long" and
+// the connection is closed. A worker serves one connection at a time: it
+// closes its connection after kIdleTimeout without a complete request, and at
+// once when the connection is idle between requests while a new one waits
+// and no other worker is in accept(); clients keeping connections open
+// reconnect then.
+class RouteServer {
+public:
+    static constexpr std::size_t kMaxLineLength = 4096;
+    static constexpr std::chrono::milliseconds kIdleTimeout{30000};
+
+    RouteServer(const RouteModel &model, unsigned threads = std::thread::hardware_concurrency(),
+                std::size_t cached_routes = RouteCache::kDefaultCapacity);             // 0 disables the cache
+    ~RouteServer();
+
+    bool Start(std::uint16_t port);         // false if the port can't be bound, 0 picks a free one
+    void Wait();                            // until Stop() was called
+    void Stop();                            // also shuts down the open connections
+
+    std::uint16_t Port() const noexcept { return m_Port; }         // bound by Start()
+
+    std::string HandleRequest(unsigned worker, const std::string &line);       // one request, exposed for tests
+
+    TrafficWeights &Traffic() noexcept { return m_Traffic; }
+    RouteCache &Cache() noexcept { return m_Cache; }
+
+private:
+    struct Context {
+        explicit Context(const RouteModel &model);
+
+        RoutePlanner planner;
+        std::optional<CHQuery> ch;
+        std::atomic<std::uint64_t> requests{0};         // written by the owning worker only
+        std::atomic<std::uint64_t> total_micros{0};
+    };
+
+    void Worker(unsigned worker);
+    void ServeConnection(unsigned worker, int fd);
+    bool WaitForInput(int fd, bool between_requests, std::chrono::steady_clock::time_point deadline);     // false: close it
+
+    const RouteModel &m_Model;
+    TrafficWeights m_Traffic;
+    RouteCache m_Cache;
+    std::vector<std::unique_ptr<Context>> m_Contexts;
+    std::vector<std::thread> m_Workers;
+    std::atomic<bool> m_Stopping{false};
+    std::atomic<unsigned> m_Accepting{0};   // workers blocked in accept(), free for a new connection
+    int m_Listener = -1;
+    std::uint16_t m_Port = 0;
+    std::mutex m_ConnectionsMutex;
+    std::vector<int> m_Connections;         // per worker, the fd it serves or -1
+};
@@ -0,0 +1,70 @@
+#include "simplify.h"
+#include <utility>
+
+// Squared distance of p from the segment a-b, which may be a single point.
+static double SegmentDistance2(const Model::Node &p, const Model::Node &a, const Model::Node &b)
+{
+    auto dx = b.x - a.x, dy = b.y - a.y;
+    auto length2 = dx * dx + dy * dy;
+    auto t = length2 > 0. ? ((p.x - a.x) * dx + (p.y - a.y) * dy) / length2 : 0.;
+    t = t < 0. ? 0. : t > 1. ? 1. : t;
+    auto ex = a.x + t * dx - p.x, ey = a.y + t * dy - p.y;
+    return ex * ex + ey * ey;
+}
+
+// Marks the points to keep, point(i) is the i-th of count.
+template <typename Point>
+static std::vector<bool> Keep(std::size_t count, Point point, double tolerance)
+{
+    std::vector<bool> keep(count, false);
+    keep.front() = keep.back() = true;
+    std::vector<std::pair<std::size_t, std::size_t>> stack{{0, count - 1}};
+    while( !stack.empty() ) {
+        auto [first, last] = stack.back();
+        stack.pop_back();
+        auto farthest = first;
+        auto max_distance2 = 0.;
+        for( auto i = first + 1; i < last; ++i ) {
+            auto d = SegmentDistance2(point(i), point(first), point(last));
+            if( d > max_distance2 ) {
+                max_distance2 = d;
+                farthest = i;
+            }
+        }
+        if( max_distance2 > tolerance * tolerance ) {
+            keep[farthest] = true;
+            stack.push_back({first, farthest});
+            stack.push_back({farthest, last});
+        }
+    }
+    return keep;
+}
+
+std::vector<int> Simplify(const Model::NodeArray &nodes, Span<const int> way, double tolerance)
+{
+    if( way.size() < 3 || tolerance <= 0. )
+        return {way.begin(), way.end()};
+
+    auto keep = Keep(way.size(), [&](std::size_t i){ return nodes[way[i]]; }, tolerance);
+    std::vector<int> simplified;
+    for( std::size_t i = 0; i < way.size(); ++i )
+        if( keep[i] )
+            simplified.push_back(way[i]);
+    if( way.front() == way.back() && simplified.size() < 4 )
+        simplified.clear();
+    return simplified;
+}
+
+void Simplify(std::vector<Model::Node> &points, double tolerance)
+{
+    if( points.size() < 3 || tolerance <= 0. )
+        return;
+
+    auto keep = Keep(points.size(), [&](std::size_t i){ return points[i]; }, tolerance);
+    auto closed = points.front().x == points.back().x && points.front().y == points.back().y;
+    std::size_t kept = 0;
+    for( std::size_t i = 0; i < points.size(); ++i )
+        if( keep[i] )
+            points[kept++] = points[i];
+    points.resize(closed && kept < 4 ? 0 : kept);
+}
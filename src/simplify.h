@@ -0,0 +1,12 @@
+#pragma once
+
+#include "model.h"
+#include "span.h"
+#include <vector>
+
+// Douglas-Peucker simplification of a way: the subset of its nodes that keeps
+// every dropped node within tolerance (model units) of the simplified line.
+// The end points are always kept, so closed rings stay closed; a ring that
+// collapses to fewer than three distinct nodes comes back empty.
+std::vector<int> Simplify(const Model::NodeArray &nodes, Span<const int> way, double tolerance);
+void Simplify(std::vector<Model::Node> &points, double tolerance);      // the same on decoded points, in place
@@ -0,0 +1,80 @@
+#include "snapshot.h"
+#include "instrument.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+static std::uint64_t AlignUp(std::uint64_t offset) {
+    return (offset + Snapshot::kAlignment - 1) / Snapshot::kAlignment * Snapshot::kAlignment;
+}
+
+Snapshot::Snapshot(MappedFile file) noexcept :
+    m_File(std::move(file)),
+    m_Header(reinterpret_cast<const Header *>(m_File.data())),
+    m_Sections(reinterpret_cast<const SectionEntry *>(m_File.data() + sizeof(Header)), m_Header->section_count)
+{
+}
+
+std::optional<Snapshot> Snapshot::Open(const std::string &path) {
+    ROUTEMS_TRACE_SCOPE("load.snapshot");
+    auto file = MappedFile::Open(path);
+    if(!file || file->size() < sizeof(Header))
+        return std::nullopt;
+
+    Header header;
+    std::memcpy(&header, file->data(), sizeof(header));
+    if(std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion)
+        return std::nullopt;
+
+    const auto size = static_cast<std::uint64_t>(file->size());
+    const auto table_end = sizeof(Header) + std::uint64_t{header.section_count} * sizeof(SectionEntry);
+    if(table_end > size)
+        return std::nullopt;
+
+    // validate every section once, so Array() can hand out views without checks
+    auto entries = reinterpret_cast<const SectionEntry *>(file->data() + sizeof(Header));
+    for(std::uint32_t i = 0; i < header.section_count; ++i) {
+        auto &entry = entries[i];
+        if(entry.offset % kAlignment != 0 || entry.offset > size || entry.element_size == 0 ||
+           entry.count > (size - entry.offset) / entry.element_size)
+            return std::nullopt;
+    }
+    return Snapshot{std::move(*file)};
+}
+
+const Snapshot::SectionEntry *Snapshot::Find(Section id) const noexcept {
+    auto it = std::find_if(m_Sections.begin(), m_Sections.end(), [id](auto &entry){ return entry.id == id; });
+    return it == m_Sections.end() ? nullptr : it;
+}
+
+bool SnapshotWriter::Save(const std::string &path) const {
+    Snapshot::Header header{};
+    std::memcpy(header.magic, Snapshot::kMagic, sizeof(header.magic));
+    header.version = Snapshot::kVersion;
+    header.section_count = static_cast<std::uint32_t>(m_Sections.size());
+    header.metric_scale = m_MetricScale;
+
+    std::vector<Snapshot::SectionEntry> table;
+    auto offset = AlignUp(sizeof(header) + m_Sections.size() * sizeof(Snapshot::SectionEntry));
+    for(auto &section : m_Sections) {
+        table.push_back({section.id, section.element_size, offset, section.count});
+        offset = AlignUp(offset + section.bytes.size());
+    }
+
+    std::ofstream os{path, std::ios::binary | std::ios::trunc};
+    if(!os)
+        return false;
+    os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    os.write(reinterpret_cast<const char *>(table.data()), table.size() * sizeof(table[0]));
+
+    const char padding[Snapshot::kAlignment] = {};
+    auto pad_to = [&](std::uint64_t target) {
+        auto pos = static_cast<std::uint64_t>(os.tellp());
+        os.write(padding, static_cast<std::streamsize>(target - pos));
+    };
+    for(std::size_t i = 0; i < m_Sections.size(); ++i) {
+        pad_to(table[i].offset);
+        os.write(m_Sections[i].bytes.data(), static_cast<std::streamsize>(m_Sections[i].bytes.size()));
+    }
+    return static_cast<bool>(os.flush());
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "mapped_file.h"
+#include "span.h"
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Flat, versioned file holding a fully built RouteModel. The file is a fixed
+// header, a section table and the section payloads, each 64-byte aligned.
+// Sections are plain arrays in host byte order, so a mapped snapshot is used
+// in place.
+class Snapshot {
+public:
+    static constexpr char kMagic[8] = {'R', 'O', 'U', 'T', 'E', 'M', 'S', '\0'};
+    static constexpr std::uint32_t kVersion = 4;
+    static constexpr std::size_t kAlignment = 64;
+
+    enum Section : std::uint32_t {
+        NodeX = 1, NodeY,                                           // double, normalized coordinates
+        WayOffsets, WayNodes,                                       // CSR: uint32 offsets, int32 node indices
+        RoadWays, RoadTypes,                                        // int32, uint8 Model::Road::Type
+        RailwayWays,                                                // int32
+        BuildingOffsets, BuildingRings, BuildingOuterCounts,        // CSR over way indices, outer rings first
+        LeisureOffsets, LeisureRings, LeisureOuterCounts,
+        WaterOffsets, WaterRings, WaterOuterCounts,
+        LanduseOffsets, LanduseRings, LanduseOuterCounts, LanduseTypes,
+        RoadNodes,                                                  // int32, RouteModel road nodes
+        GraphOffsets, GraphTargets, GraphWeights, GraphTypes,       // RouteGraph CSR: uint32, uint32, float, uint8
+        GraphX, GraphY, GraphModelNodes, GraphVertices,             // float metres, int32, uint32
+        CHRanks, CHOffsets, CHTargets, CHWeights, CHMiddles,        // optional ContractionHierarchy: uint32 ranks,
+        CHDirections, CHDurations,                                  // upward CSR with float weights, uint8 directions,
+                                                                    // float seconds along the edge
+        NodeIds, NodeIdIndices, WayIds, WayIdIndices,               // int64 OSM ids ascending, int32 model indices
+        Projection,                                                 // double Web Mercator metres of the model origin
+        LandmarkVertices, LandmarkFrom, LandmarkTo,                 // optional Landmarks: uint32 vertices, float metres
+                                                                    // vertex major, LandmarkTo only on asymmetric graphs
+        GeometryOffsets, GeometryData,                              // optional WayGeometry: uint64 offsets, uint8 coded ways
+    };
+
+    struct Header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t section_count;
+        double metric_scale;
+        std::uint64_t reserved;
+    };
+
+    struct SectionEntry {
+        std::uint32_t id;
+        std::uint32_t element_size;
+        std::uint64_t offset;           // from the start of the file
+        std::uint64_t count;
+    };
+
+    // nullopt if the file is missing, not a snapshot, of another version or truncated
+    static std::optional<Snapshot> Open(const std::string &path);
+
+    double MetricScale() const noexcept { return m_Header->metric_scale; }
+    bool Has(Section id) const noexcept { return Find(id) != nullptr; }
+
+    // Empty span if the section is absent, throws if it holds elements of another size.
+    template <typename T>
+    Span<const T> Array(Section id) const;
+
+private:
+    explicit Snapshot(MappedFile file) noexcept;
+    const SectionEntry *Find(Section id) const noexcept;
+
+    MappedFile m_File;
+    const Header *m_Header = nullptr;
+    Span<const SectionEntry> m_Sections;
+};
+
+// Collects sections in memory and writes them out as one snapshot file.
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(double metric_scale) : m_MetricScale(metric_scale) {}
+
+    template <typename T>
+    void Add(Snapshot::Section id, Span<const T> values);
+
+    template <typename T>
+    void Add(Snapshot::Section id, const std::vector<T> &values) { Add(id, Span<const T>{values}); }
+
+    bool Save(const std::string &path) const;     // false on I/O failure
+
+private:
+    struct Pending {
+        Snapshot::Section id;
+        std::uint32_t element_size;
+        std::uint64_t count;
+        std::vector<char> bytes;
+    };
+
+    double m_MetricScale;
+    std::vector<Pending> m_Sections;
+};
+
+template <typename T>
+Span<const T> Snapshot::Array(Section id) const {
+    static_assert(std::is_trivially_copyable_v<T>, "snapshot sections hold plain data");
+    auto entry = Find(id);
+    if(!entry)
+        return {};
+    if(entry->element_size != sizeof(T))
+        throw std::runtime_error{"snapshot: section " + std::to_string(id) + " has unexpected element size"};
+    return {reinterpret_cast<const T *>(m_File.data() + entry->offset), static_cast<std::size_t>(entry->count)};
+}
+
+template <typename T>
+void SnapshotWriter::Add(Snapshot::Section id, Span<const T> values) {
+    static_assert(std::is_trivially_copyable_v<T>, "snapshot sections hold plain data");
+    auto first = reinterpret_cast<const char *>(values.data());
+    m_Sections.push_back({id, sizeof(T), values.size(), std::vector<char>(first, first + values.size() * sizeof(T))});
+}
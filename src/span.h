@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+// Non-owning view of a contiguous array, a C++17 stand-in for std::span.
+template <typename T>
+class Span {
+public:
+    constexpr Span() noexcept = default;
+    constexpr Span(T *data, std::size_t size) noexcept : m_Data(data), m_Size(size) {}
+
+    template <typename U, typename = std::enable_if_t<std::is_same_v<std::remove_const_t<T>, U>>>
+    Span(const std::vector<U> &v) noexcept : m_Data(v.data()), m_Size(v.size()) {}
+
+    template <typename U, typename = std::enable_if_t<std::is_same_v<T, U>>>
+    Span(std::vector<U> &v) noexcept : m_Data(v.data()), m_Size(v.size()) {}
+
+    constexpr T *data() const noexcept { return m_Data; }
+    constexpr std::size_t size() const noexcept { return m_Size; }
+    constexpr bool empty() const noexcept { return m_Size == 0; }
+    constexpr T *begin() const noexcept { return m_Data; }
+    constexpr T *end() const noexcept { return m_Data + m_Size; }
+    std::reverse_iterator<T *> rbegin() const noexcept { return std::reverse_iterator<T *>{end()}; }
+    std::reverse_iterator<T *> rend() const noexcept { return std::reverse_iterator<T *>{begin()}; }
+    constexpr T &operator[](std::size_t i) const noexcept { return m_Data[i]; }
+    constexpr T &front() const noexcept { return m_Data[0]; }
+    constexpr T &back() const noexcept { return m_Data[m_Size - 1]; }
+    constexpr Span subspan(std::size_t offset, std::size_t count) const noexcept { return {m_Data + offset, count}; }
+
+private:
+    T *m_Data = nullptr;
+    std::size_t m_Size = 0;
+};
@@ -0,0 +1,162 @@
+#include "spatial_index.h"
+#include "instrument.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
+#include <utility>
+
+namespace {
+
+constexpr float kPointsPerCell = 2.f;
+
+}
+
+SpatialIndex::SpatialIndex(const Model::NodeArray &nodes, const std::vector<int> &indices)
+{
+    if( indices.empty() )
+        return;
+
+    auto max_x = std::numeric_limits<float>::lowest(), max_y = max_x;
+    m_MinX = m_MinY = std::numeric_limits<float>::max();
+    for( auto i: indices ) {
+        m_MinX = std::min(m_MinX, (float)nodes[i].x);
+        m_MinY = std::min(m_MinY, (float)nodes[i].y);
+        max_x = std::max(max_x, (float)nodes[i].x);
+        max_y = std::max(max_y, (float)nodes[i].y);
+    }
+
+    // square cells with a few points each, also sane if all points are on one line
+    auto width = max_x - m_MinX, height = max_y - m_MinY;
+    auto cells = std::max(indices.size() / kPointsPerCell, 1.f);
+    m_CellSize = std::max({std::sqrt(width * height / cells), std::max(width, height) / cells, 1e-9f});
+    m_Columns = (int)(width / m_CellSize) + 1;
+    m_Rows = (int)(height / m_CellSize) + 1;
+
+    // counting sort of the points by cell
+    m_CellBegin.assign((std::size_t)m_Columns * m_Rows + 1, 0);
+    std::vector<std::uint32_t> cell_of(indices.size());
+    for( std::size_t k = 0; k < indices.size(); ++k ) {
+        auto node = nodes[indices[k]];
+        cell_of[k] = CellY(node.y) * m_Columns + CellX(node.x);
+        ++m_CellBegin[cell_of[k] + 1];
+    }
+    for( std::size_t c = 1; c < m_CellBegin.size(); ++c )
+        m_CellBegin[c] += m_CellBegin[c - 1];
+
+    auto next = m_CellBegin;
+    m_Points.resize(indices.size());
+    m_Ids.resize(indices.size());
+    for( std::size_t k = 0; k < indices.size(); ++k ) {
+        auto slot = next[cell_of[k]]++;
+        auto node = nodes[indices[k]];
+        m_Points[slot] = {(float)node.x, (float)node.y};
+        m_Ids[slot] = indices[k];
+    }
+}
+
+// Clamped in floating point, far off or NaN coordinates don't fit an int.
+static int Cell(float offset, float cell_size, int count) noexcept
+{
+    auto cell = std::floor(offset / cell_size);
+    if( !(cell > 0.f) )
+        return 0;
+    return cell < (float)(count - 1) ? (int)cell : count - 1;
+}
+
+int SpatialIndex::CellX(float x) const noexcept
+{
+    return Cell(x - m_MinX, m_CellSize, m_Columns);
+}
+
+int SpatialIndex::CellY(float y) const noexcept
+{
+    return Cell(y - m_MinY, m_CellSize, m_Rows);
+}
+
+int SpatialIndex::Nearest(float x, float y) const
+{
+    ROUTEMS_TRACE_SCOPE("route.snap");
+    auto nearest = KNearest(x, y, 1);
+    return nearest.empty() ? -1 : nearest.front();
+}
+
+// Visits square rings of cells around the query cell, stopping once the k-th
+// best point is closer than anything outside the rings searched so far.
+std::vector<int> SpatialIndex::KNearest(float x, float y, std::size_t k) const
+{
+    std::vector<int> result;
+    if( Empty() || k == 0 || !std::isfinite(x) || !std::isfinite(y) )
+        return result;
+
+    using Candidate = std::pair<float, int>;        // squared distance, point slot
+    std::priority_queue<Candidate> best;            // worst candidate on top
+    auto visit = [&](int cx, int cy) {
+        auto c = cy * m_Columns + cx;
+        for( auto p = m_CellBegin[c]; p < m_CellBegin[c + 1]; ++p ) {
+            auto dx = m_Points[p].x - x, dy = m_Points[p].y - y;
+            auto d = dx * dx + dy * dy;
+            if( best.size() < k )
+                best.push({d, (int)p});
+            else if( d < best.top().first ) {
+                best.pop();
+                best.push({d, (int)p});
+            }
+        }
+    };
+
+    auto cx = CellX(x), cy = CellY(y);
+    constexpr auto kOpen = std::numeric_limits<float>::max();
+    for( int r = 0; ; ++r ) {
+        auto x0 = cx - r, x1 = cx + r, y0 = cy - r, y1 = cy + r;
+        for( auto i = std::max(x0, 0); i <= std::min(x1, m_Columns - 1); ++i ) {
+            if( y0 >= 0 )
+                visit(i, y0);
+            if( y1 < m_Rows && y1 != y0 )
+                visit(i, y1);
+        }
+        for( auto j = std::max(y0 + 1, 0); j <= std::min(y1 - 1, m_Rows - 1); ++j ) {
+            if( x0 >= 0 )
+                visit(x0, j);
+            if( x1 < m_Columns && x1 != x0 )
+                visit(x1, j);
+        }
+
+        // distance to the nearest cell not searched yet, sides at the grid border have none left
+        auto bound = kOpen;
+        if( x0 > 0 )
+            bound = std::min(bound, x - (m_MinX + x0 * m_CellSize));
+        if( x1 < m_Columns - 1 )
+            bound = std::min(bound, m_MinX + (x1 + 1) * m_CellSize - x);
+        if( y0 > 0 )
+            bound = std::min(bound, y - (m_MinY + y0 * m_CellSize));
+        if( y1 < m_Rows - 1 )
+            bound = std::min(bound, m_MinY + (y1 + 1) * m_CellSize - y);
+        if( bound == kOpen )
+            break;
+        if( best.size() == k && best.top().first <= bound * bound )
+            break;
+    }
+
+    result.resize(best.size());
+    for( auto i = result.size(); i-- > 0; best.pop() )
+        result[i] = m_Ids[best.top().second];
+    return result;
+}
+
+std::vector<int> SpatialIndex::Radius(float x, float y, float radius) const
+{
+    std::vector<int> result;
+    if( Empty() || !(radius >= 0.f) || !std::isfinite(x) || !std::isfinite(y) )
+        return result;
+    auto x0 = CellX(x - radius), x1 = CellX(x + radius);
+    auto y0 = CellY(y - radius), y1 = CellY(y + radius);
+    for( auto j = y0; j <= y1; ++j )
+        for( auto c = j * m_Columns + x0, last = j * m_Columns + x1; c <= last; ++c )
+            for( auto p = m_CellBegin[c]; p < m_CellBegin[c + 1]; ++p ) {
+                auto dx = m_Points[p].x - x, dy = m_Points[p].y - y;
+                if( dx * dx + dy * dy <= radius * radius )
+                    result.push_back(m_Ids[p]);
+            }
+    return result;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "model.h"
+#include <cstdint>
+#include <vector>
+
+// Static uniform grid over a set of model nodes, in compressed sparse row
+// form: the points of cell c are [m_CellBegin[c], m_CellBegin[c + 1]). Point
+// coordinates are copied next to each other in cell order, so a query only
+// touches the few cells around it. Queries take and return the model's
+// normalized coordinates and node indices.
+class SpatialIndex {
+public:
+    SpatialIndex() = default;
+    SpatialIndex(const Model::NodeArray &nodes, const std::vector<int> &indices);
+
+    bool Empty() const noexcept { return m_Ids.empty(); }
+
+    // Any finite point may be queried, also far outside the nodes' bounds;
+    // none is found for NaN or infinite coordinates.
+    int Nearest(float x, float y) const;                                    // -1 if empty
+    std::vector<int> KNearest(float x, float y, std::size_t k) const;       // closest first
+    std::vector<int> Radius(float x, float y, float radius) const;          // unordered
+
+private:
+    struct Point {
+        float x;
+        float y;
+    };
+
+    int CellX(float x) const noexcept;
+    int CellY(float y) const noexcept;
+
+    float m_MinX = 0.f;
+    float m_MinY = 0.f;
+    float m_CellSize = 1.f;
+    int m_Columns = 0;
+    int m_Rows = 0;
+    std::vector<std::uint32_t> m_CellBegin;         // m_Columns * m_Rows + 1
+    std::vector<Point> m_Points;                    // grouped by cell
+    std::vector<int> m_Ids;                         // model node of each point
+};
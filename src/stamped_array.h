@@ -0,0 +1,44 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Per-vertex values that are cleared in O(1) by bumping a generation counter.
+// A slot only holds a value if its stamp matches the current generation, so
+// search buffers can be reused across queries without touching the whole array.
+template <typename T>
+class StampedArray {
+public:
+    StampedArray() = default;
+    StampedArray(std::size_t size, T empty) : m_Values(size, empty), m_Stamps(size, 0), m_Empty(empty) {}
+
+    void Resize(std::size_t size, T empty) {
+        m_Values.assign(size, empty);
+        m_Stamps.assign(size, 0);
+        m_Empty = empty;
+        m_Generation = 1;
+    }
+
+    void Clear() noexcept {
+        if(++m_Generation == 0) {           // wrapped around, old stamps could match again
+            std::fill(m_Stamps.begin(), m_Stamps.end(), 0);
+            m_Generation = 1;
+        }
+    }
+
+    std::size_t Size() const noexcept { return m_Values.size(); }
+    bool Has(std::size_t i) const noexcept { return m_Stamps[i] == m_Generation; }
+    const T &Get(std::size_t i) const noexcept { return Has(i) ? m_Values[i] : m_Empty; }
+
+    void Set(std::size_t i, T value) noexcept {
+        m_Values[i] = value;
+        m_Stamps[i] = m_Generation;
+    }
+
+private:
+    std::vector<T> m_Values;
+    std::vector<std::uint32_t> m_Stamps;
+    T m_Empty{};
+    std::uint32_t m_Generation = 1;
+};
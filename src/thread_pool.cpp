@@ -0,0 +1,34 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(unsigned threads) {
+    if(threads == 0)
+        threads = 1;        // hardware_concurrency() may report 0
+    m_Workers.reserve(threads);
+    for(unsigned i = 0; i < threads; ++i)
+        m_Workers.emplace_back([this]{ Worker(); });
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock{m_Mutex};
+        m_Stop = true;
+    }
+    m_Wakeup.notify_all();
+    for(auto &worker : m_Workers)
+        worker.join();
+}
+
+void ThreadPool::Worker() {
+    for(;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock{m_Mutex};
+            m_Wakeup.wait(lock, [this]{ return m_Stop || !m_Tasks.empty(); });
+            if(m_Tasks.empty())
+                return;         // stopping and nothing left to do
+            task = std::move(m_Tasks.front());
+            m_Tasks.pop_front();
+        }
+        task();
+    }
+}
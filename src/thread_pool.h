@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed size pool of worker threads consuming a FIFO task queue.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threads = std::thread::hardware_concurrency());
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+    ~ThreadPool();      // finishes the queued tasks, then joins the workers
+
+    template <typename F>
+    auto Submit(F &&task) -> std::future<std::invoke_result_t<std::decay_t<F>>>;
+
+    unsigned Size() const noexcept { return static_cast<unsigned>(m_Workers.size()); }
+
+private:
+    void Worker();
+
+    std::vector<std::thread> m_Workers;
+    std::deque<std::function<void()>> m_Tasks;
+    std::mutex m_Mutex;
+    std::condition_variable m_Wakeup;
+    bool m_Stop = false;
+};
+
+// Calls body(i) for every i below count, on the calling thread and the pool.
+// Everyone pulls the next index when done, so uneven items don't stall a
+// whole share. Only helpers that got started are waited for: one still
+// queued behind other tasks finds the loop closed and returns untouched, so
+// a busy pool never holds up the caller. Rethrows the first exception.
+template <typename F>
+void ParallelFor(ThreadPool &pool, std::size_t count, F &&body);
+
+template <typename F>
+auto ThreadPool::Submit(F &&task) -> std::future<std::invoke_result_t<std::decay_t<F>>> {
+    using R = std::invoke_result_t<std::decay_t<F>>;
+    // packaged_task is move-only and std::function needs a copyable target
+    auto job = std::make_shared<std::packaged_task<R()>>(std::forward<F>(task));
+    auto result = job->get_future();
+    {
+        std::lock_guard<std::mutex> lock{m_Mutex};
+        m_Tasks.emplace_back([job]{ (*job)(); });
+    }
+    m_Wakeup.notify_one();
+    return result;
+}
+
+template <typename F>
+void ParallelFor(ThreadPool &pool, std::size_t count, F &&body) {
+    struct State {
+        std::atomic<std::size_t> next{0};
+        std::mutex mutex;
+        std::condition_variable idle;
+        unsigned running = 0;
+        bool closed = false;
+        std::exception_ptr error;
+    };
+    auto state = std::make_shared<State>();
+    auto work = [&body, count](State &s) {
+        try {
+            for(auto i = s.next++; i < count; i = s.next++)
+                body(i);
+        } catch(...) {
+            s.next = count;         // the others stop at their next item
+            std::lock_guard<std::mutex> lock{s.mutex};
+            if(!s.error)
+                s.error = std::current_exception();
+        }
+    };
+    for(std::size_t helper = 0; helper < pool.Size() && helper + 1 < count; ++helper)
+        pool.Submit([state, work]{
+            {
+                std::lock_guard<std::mutex> lock{state->mutex};
+                if(state->closed)
+                    return;         // the caller has moved on, `body` may be gone
+                ++state->running;
+            }
+            work(*state);
+            std::lock_guard<std::mutex> lock{state->mutex};
+            if(--state->running == 0)
+                state->idle.notify_all();
+        });
+    work(*state);
+    std::unique_lock<std::mutex> lock{state->mutex};
+    state->closed = true;
+    state->idle.wait(lock, [&]{ return state->running == 0; });
+    if(state->error)
+        std::rethrow_exception(state->error);
+}
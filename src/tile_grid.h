@@ -0,0 +1,37 @@
+#pragma once
+
+#include "box_index.h"
+#include <cmath>
+#include <cstdint>
+
+// Square tiles on a grid anchored at the model origin, at one scale. Pixels
+// are model units times scale with y pointing down, so the model origin is
+// pixel (0, 0) and tile (x, y) covers the pixels from (x, y) * size to
+// (x + 1, y + 1) * size. Render places, draws and invalidates its cached
+// tiles through this, so all three agree on what a tile shows.
+struct TileGrid {
+    struct Range {
+        std::int32_t x0, y0, x1, y1;                // inclusive
+    };
+
+    float scale = 1.f;                              // pixels per model unit
+    float size = 256.f;                             // pixels per tile side
+
+    float Left(std::int32_t x) const noexcept { return x * size; }
+    float Top(std::int32_t y) const noexcept { return y * size; }
+    float PixelX(float model_x) const noexcept { return model_x * scale; }
+    float PixelY(float model_y) const noexcept { return -model_y * scale; }
+
+    // Tiles touching the width x height pixels from left, top on.
+    Range Covering(float left, float top, float width, float height) const noexcept {
+        return {Index(left), Index(top), Index(left + width), Index(top + height)};
+    }
+
+    // Model area tile (x, y) draws, grown by pad model units on every side.
+    Box Area(std::int32_t x, std::int32_t y, float pad = 0.f) const noexcept {
+        return {Left(x) / scale - pad, -Top(y + 1) / scale - pad, Left(x + 1) / scale + pad, -Top(y) / scale + pad};
+    }
+
+private:
+    std::int32_t Index(float pixels) const noexcept { return static_cast<std::int32_t>(std::floor(pixels / size)); }
+};
@@ -0,0 +1,165 @@
+#include "traffic.h"
+#include <algorithm>
+#include <cctype>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace {
+
+constexpr std::pair<const char *, Model::Road::Type> kTypeNames[] = {
+    {"motorway", Model::Road::Motorway}, {"trunk", Model::Road::Trunk}, {"primary", Model::Road::Primary},
+    {"secondary", Model::Road::Secondary}, {"tertiary", Model::Road::Tertiary},
+    {"residential", Model::Road::Residential}, {"unclassified", Model::Road::Unclassified},
+    {"service", Model::Road::Service}, {"footway", Model::Road::Footway},
+};
+
+float ClampSpeed(float speed) noexcept
+{
+    return speed > 0.f ? std::min(speed, TrafficWeights::kMaxSpeed) : 0.f;     // NaN and negatives restore the default too
+}
+
+}
+
+TrafficWeights::Pin::~Pin()
+{
+    if( m_Slot )
+        m_Slot->store(kIdle, std::memory_order_release);         // the table reads happen before
+    else if( m_Owner )
+        m_Owner->Unpin(m_Epoch);
+}
+
+TrafficWeights::TrafficWeights(const RouteGraph &graph, const ContractionHierarchy &ch) :
+    m_Graph(graph),
+    m_CH(ch),
+    m_EdgeSpeeds(graph.EdgeCount(), 0.f)
+{
+    for( std::size_t type = 0; type < kRoadTypes; ++type )
+        m_TypeSpeeds[type] = ClampSpeed(RouteGraph::DefaultSpeed(static_cast<Model::Road::Type>(type)));
+    std::lock_guard lock{m_WriteLock};
+    Publish();
+}
+
+TrafficWeights::~TrafficWeights()
+{
+    delete m_Current.load();
+}
+
+TrafficWeights::Pin TrafficWeights::Read() const
+{
+    // Announcing the epoch comes before loading the table, and a writer bumps the
+    // epoch only after swapping the table, so whoever got an old table shows an
+    // epoch from before that swap until the pin is released.
+    auto slot = std::hash<std::thread::id>{}(std::this_thread::get_id()) % kReaderSlots;
+    for( std::size_t probe = 0; probe < kReaderSlots; ++probe, slot = (slot + 1) % kReaderSlots ) {
+        auto idle = kIdle;
+        if( m_Slots[slot].epoch.compare_exchange_strong(idle, m_Epoch.load()) )
+            return Pin{&m_Slots[slot].epoch, m_Current.load()};
+    }
+    // every slot is taken: the same order under the lock Publish() scans the list with
+    std::lock_guard lock{m_OverflowLock};
+    auto epoch = m_Epoch.load();
+    m_Overflow.push_back(epoch);
+    return Pin{this, epoch, m_Current.load()};
+}
+
+void TrafficWeights::Unpin(std::uint64_t epoch) const noexcept
+{
+    std::lock_guard lock{m_OverflowLock};
+    *std::find(m_Overflow.begin(), m_Overflow.end(), epoch) = m_Overflow.back();
+    m_Overflow.pop_back();
+}
+
+void TrafficWeights::SetSpeeds(const std::vector<SpeedUpdate> &updates)
+{
+    std::lock_guard lock{m_WriteLock};
+    for( auto &update: updates )
+        if( update.edge >= m_EdgeSpeeds.size() )
+            throw std::out_of_range("traffic: no edge " + std::to_string(update.edge));
+    for( auto &update: updates )
+        m_EdgeSpeeds[update.edge] = ClampSpeed(update.speed);
+    Publish();
+}
+
+void TrafficWeights::SetDefaultSpeed(Model::Road::Type type, float speed)
+{
+    std::lock_guard lock{m_WriteLock};
+    speed = ClampSpeed(speed);
+    m_TypeSpeeds[type] = speed > 0.f ? speed : ClampSpeed(RouteGraph::DefaultSpeed(type));
+    Publish();
+}
+
+std::size_t TrafficWeights::LoadFeed(std::istream &feed)
+{
+    std::vector<SpeedUpdate> edges;
+    std::vector<std::pair<Model::Road::Type, float>> types;
+    std::string line;
+    for( std::size_t number = 1; std::getline(feed, line); ++number ) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields{line};
+        std::string key;
+        float kmh;
+        if( !(fields >> key) )
+            continue;           // blank or comment
+        std::string rest;
+        if( !(fields >> kmh) || kmh < 0.f || fields >> rest )
+            throw std::runtime_error("traffic: line " + std::to_string(number) + ": expected <edge or road type> <km/h>");
+
+        if( std::all_of(key.begin(), key.end(), [](unsigned char c){ return std::isdigit(c); }) ) {
+            auto edge = std::stoull(key);
+            if( edge >= m_Graph.EdgeCount() )
+                throw std::runtime_error("traffic: line " + std::to_string(number) + ": no edge " + key);
+            edges.push_back({static_cast<std::uint32_t>(edge), kmh / 3.6f});
+            continue;
+        }
+        auto named = std::find_if(std::begin(kTypeNames), std::end(kTypeNames), [&](auto &t){ return key == t.first; });
+        if( named == std::end(kTypeNames) )
+            throw std::runtime_error("traffic: line " + std::to_string(number) + ": unknown road type " + key);
+        types.emplace_back(named->second, kmh / 3.6f);
+    }
+
+    if( types.empty() && edges.empty() )
+        return 0;
+    std::lock_guard lock{m_WriteLock};
+    for( auto [type, speed]: types ) {
+        speed = ClampSpeed(speed);
+        m_TypeSpeeds[type] = speed > 0.f ? speed : ClampSpeed(RouteGraph::DefaultSpeed(type));
+    }
+    for( auto &update: edges )
+        m_EdgeSpeeds[update.edge] = ClampSpeed(update.speed);
+    Publish();
+    return types.size() + edges.size();
+}
+
+void TrafficWeights::Publish()
+{
+    auto table = std::make_unique<Table>();
+    auto current = m_Current.load();
+    table->version = current ? current->version + 1 : 0;
+    table->seconds.resize(m_Graph.EdgeCount());
+    for( std::uint32_t e = 0; e < m_Graph.EdgeCount(); ++e ) {
+        auto speed = m_EdgeSpeeds[e] > 0.f ? m_EdgeSpeeds[e] : m_TypeSpeeds[m_Graph.Type(e)];
+        table->seconds[e] = m_Graph.Weight(e) / speed;
+    }
+    if( !m_CH.Empty() )
+        table->ch_seconds = m_CH.Durations(m_Graph, table->seconds);
+
+    auto replaced = m_Current.exchange(table.release());
+    auto epoch = m_Epoch.fetch_add(1) + 1;
+    if( replaced )
+        m_Retired.emplace_back(epoch, replaced);
+
+    // a retired table may still be pinned by the readers of epochs before its swap
+    auto oldest = kIdle;
+    for( auto &slot: m_Slots )
+        oldest = std::min(oldest, slot.epoch.load());
+    {
+        std::lock_guard lock{m_OverflowLock};
+        for( auto epoch: m_Overflow )
+            oldest = std::min(oldest, epoch);
+    }
+    m_Retired.erase(std::remove_if(m_Retired.begin(), m_Retired.end(), [&](auto &retired){ return retired.first <= oldest; }),
+                    m_Retired.end());
+}
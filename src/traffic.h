@@ -0,0 +1,119 @@
+#pragma once
+
+#include "contraction_hierarchy.h"
+#include "model.h"
+#include "route_graph.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Travel time of every graph edge under current traffic. An edge runs at the
+// speed its road type defaults to, RouteGraph::DefaultSpeed() until a feed
+// overrides it, unless the edge has a live speed of its own.
+//
+// Every update publishes a new immutable table with one pointer swap, after
+// customizing the hierarchy edge times for it. Readers pin the table current
+// when their query starts and keep it to the end; a pin announces the
+// reader's epoch in a slot of its own and takes no lock. Readers beyond the
+// slots announce it in a locked overflow list instead. A replaced table is
+// freed by a later update once no slot still shows an epoch from before the
+// swap, so writers never wait for readers either.
+//
+// Live speeds change travel times, and FastestSearch() picks its paths by
+// them. The hierarchy times are customized along the paths the hierarchy
+// chose by distance: a CH route or a matrix cell under traffic is the
+// shortest path, with its live travel time, not the fastest one.
+class TrafficWeights {
+public:
+    static constexpr float kMaxSpeed = 130.f / 3.6f;       // live speeds are clamped to this, it bounds the A* heuristic
+    static constexpr std::size_t kReaderSlots = 64;         // lock free pins held at once, more share the overflow list
+
+    struct Table {
+        std::uint64_t version = 0;          // 0 for the free flow table, +1 per update
+        std::vector<float> seconds;         // per graph edge
+        std::vector<float> ch_seconds;      // per hierarchy edge, its distance-chosen path; empty without a hierarchy
+    };
+
+    // Keeps one table alive, cheap to take once per query. Must not outlive
+    // the TrafficWeights it came from.
+    class Pin {
+    public:
+        Pin(Pin &&other) noexcept :
+            m_Slot(std::exchange(other.m_Slot, nullptr)), m_Owner(std::exchange(other.m_Owner, nullptr)),
+            m_Epoch(other.m_Epoch), m_Table(other.m_Table) {}
+        Pin(const Pin &) = delete;
+        Pin &operator=(const Pin &) = delete;
+        Pin &operator=(Pin &&) = delete;
+        ~Pin();
+
+        const Table &operator*() const noexcept { return *m_Table; }
+        const Table *operator->() const noexcept { return m_Table; }
+
+    private:
+        friend class TrafficWeights;
+        Pin(std::atomic<std::uint64_t> *slot, const Table *table) noexcept : m_Slot(slot), m_Table(table) {}
+        Pin(const TrafficWeights *owner, std::uint64_t epoch, const Table *table) noexcept :
+            m_Owner(owner), m_Epoch(epoch), m_Table(table) {}
+
+        std::atomic<std::uint64_t> *m_Slot = nullptr;
+        const TrafficWeights *m_Owner = nullptr;        // overflow pins only, released in its list
+        std::uint64_t m_Epoch = 0;
+        const Table *m_Table;
+    };
+
+    struct SpeedUpdate {
+        std::uint32_t edge;
+        float speed;                        // metres per second, 0 restores the road type's speed
+    };
+
+    // Free flow table; the graph and hierarchy must outlive this and not change.
+    TrafficWeights(const RouteGraph &graph, const ContractionHierarchy &ch);
+    TrafficWeights(const TrafficWeights &) = delete;
+    TrafficWeights &operator=(const TrafficWeights &) = delete;
+    ~TrafficWeights();              // no pins may be held any more
+
+    Pin Read() const;
+    std::uint64_t Version() const { return Read()->version; }
+
+    // Writers are serialized among themselves, each call publishes one table.
+    // Rebuilding it is a pass over the graph and one over the hierarchy, so
+    // feeds should batch their updates.
+    void SetSpeeds(const std::vector<SpeedUpdate> &updates);             // throws std::out_of_range on a bad edge
+    void SetDefaultSpeed(Model::Road::Type type, float speed);          // metres per second
+
+    // Applies a feed as one update. A line is "<edge id> <km/h>" or
+    // "<road type> <km/h>", e.g. "motorway 80"; 0 km/h restores the default
+    // and '#' starts a comment. Throws std::runtime_error on a malformed
+    // line, before anything was applied. Returns the number of speeds set.
+    std::size_t LoadFeed(std::istream &feed);
+
+private:
+    static constexpr auto kIdle = ~std::uint64_t{0};
+    static constexpr std::size_t kRoadTypes = Model::Road::Footway + 1;
+
+    struct alignas(64) Slot {               // one cache line each, readers don't share lines
+        std::atomic<std::uint64_t> epoch{kIdle};
+    };
+
+    void Publish();                 // with m_WriteLock held
+    void Unpin(std::uint64_t epoch) const noexcept;     // an overflow pin
+
+    const RouteGraph &m_Graph;
+    const ContractionHierarchy &m_CH;
+
+    std::atomic<const Table *> m_Current{nullptr};
+    std::atomic<std::uint64_t> m_Epoch{1};
+    mutable std::array<Slot, kReaderSlots> m_Slots;
+    mutable std::mutex m_OverflowLock;
+    mutable std::vector<std::uint64_t> m_Overflow;      // epochs of the overflow pins, unordered
+
+    std::mutex m_WriteLock;         // guards everything below
+    std::array<float, kRoadTypes> m_TypeSpeeds;
+    std::vector<float> m_EdgeSpeeds;        // 0 where the road type's speed applies
+    std::vector<std::pair<std::uint64_t, std::unique_ptr<const Table>>> m_Retired;     // epoch of the swap that replaced it
+};
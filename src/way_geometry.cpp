@@ -0,0 +1,118 @@
+#include "way_geometry.h"
+#include <stdexcept>
+
+namespace {
+
+void WriteVarint(std::vector<std::uint8_t> &out, std::uint64_t value)
+{
+    for( ; value >= 0x80; value >>= 7 )
+        out.push_back(static_cast<std::uint8_t>(value | 0x80));
+    out.push_back(static_cast<std::uint8_t>(value));
+}
+
+std::uint64_t Zigzag(std::int64_t value) noexcept
+{
+    return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+}
+
+// Appends the coded points of one way.
+void EncodeWay(const Model::NodeArray &nodes, Span<const int> way, double units, std::vector<std::uint8_t> &data)
+{
+    const auto tile = std::int64_t{1} << WayGeometry::kTileBits;
+    std::int64_t last_x = 0, last_y = 0;
+    for( std::size_t i = 0; i < way.size(); ++i ) {
+        auto node = nodes[way[i]];
+        auto x = std::llround(node.x * units), y = std::llround(node.y * units);
+        if( i == 0 ) {
+            // floor division, so the offsets inside the tile are never negative
+            auto tile_x = x >= 0 ? x / tile : -((-x + tile - 1) / tile);
+            auto tile_y = y >= 0 ? y / tile : -((-y + tile - 1) / tile);
+            WriteVarint(data, Zigzag(tile_x));
+            WriteVarint(data, Zigzag(tile_y));
+            WriteVarint(data, static_cast<std::uint64_t>(x - tile_x * tile));
+            WriteVarint(data, static_cast<std::uint64_t>(y - tile_y * tile));
+        } else {
+            WriteVarint(data, Zigzag(x - last_x));
+            WriteVarint(data, Zigzag(y - last_y));
+        }
+        last_x = x;
+        last_y = y;
+    }
+}
+
+}
+
+WayGeometry::WayGeometry(const Model &model) :
+    m_Units(model.MetricScale() * kUnitsPerMetre)
+{
+    std::vector<std::uint64_t> offsets{0};
+    std::vector<std::uint8_t> data;
+    for( auto &way: model.Ways() ) {
+        EncodeWay(model.Nodes(), way.nodes, m_Units, data);
+        offsets.push_back(data.size());
+    }
+    m_Offsets = std::move(offsets);
+    m_Data = std::move(data);
+}
+
+void WayGeometry::Update(const Model &model, const std::vector<int> &ways)
+{
+    // the other ways are copied over as they are coded
+    std::vector<std::uint64_t> offsets{0};
+    std::vector<std::uint8_t> data;
+    data.reserve(m_Data.size());
+    auto changed = ways.begin();
+    for( std::size_t way = 0; way < model.Ways().size(); ++way ) {
+        auto recode = changed != ways.end() && (std::size_t)*changed == way;
+        if( recode )
+            ++changed;
+        if( recode || way >= WayCount() )
+            EncodeWay(model.Nodes(), model.Ways()[way].nodes, m_Units, data);
+        else
+            data.insert(data.end(), m_Data.begin() + m_Offsets[way], m_Data.begin() + m_Offsets[way + 1]);
+        offsets.push_back(data.size());
+    }
+    m_Offsets = std::move(offsets);
+    m_Data = std::move(data);
+}
+
+WayGeometry::WayGeometry(const Snapshot &snapshot) :
+    m_Offsets(snapshot.Array<std::uint64_t>(Snapshot::GeometryOffsets)),
+    m_Data(snapshot.Array<std::uint8_t>(Snapshot::GeometryData)),
+    m_Units(snapshot.MetricScale() * kUnitsPerMetre)
+{
+    // Walk() trusts the coding: every way is empty or ends a varint pair, at least the two of the first point
+    auto malformed = !m_Offsets.empty() && (m_Offsets[0] != 0 || m_Offsets[m_Offsets.size() - 1] != m_Data.size());
+    for( std::size_t way = 0; way < WayCount() && !malformed; ++way ) {
+        auto first = m_Offsets[way], last = m_Offsets[way + 1];
+        std::size_t varints = 0;
+        for( auto i = first; i < last && last <= m_Data.size(); ++i )
+            varints += !(m_Data[i] & 0x80);
+        malformed = last < first || last > m_Data.size() || (last > first && (m_Data[last - 1] & 0x80)) ||
+                    varints % 2 != 0 || varints == 2;
+    }
+    if( malformed )
+        throw std::runtime_error("snapshot: malformed way geometry");
+}
+
+void WayGeometry::Serialize(SnapshotWriter &writer) const
+{
+    if( Empty() )
+        return;
+    writer.Add<std::uint64_t>(Snapshot::GeometryOffsets, m_Offsets);
+    writer.Add<std::uint8_t>(Snapshot::GeometryData, m_Data);
+}
+
+std::vector<Model::Node> WayGeometry::Points(std::size_t way) const
+{
+    std::vector<Model::Node> points;
+    Decode(way, [&](double x, double y) { points.push_back({x, y}); });
+    return points;
+}
+
+double WayGeometry::Length(std::size_t way) const
+{
+    auto length = 0.;
+    Segments(way, [&](double metres) { length += metres; });
+    return length;
+}
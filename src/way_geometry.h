@@ -0,0 +1,115 @@
+#pragma once
+
+#include "flat_array.h"
+#include "model.h"
+#include "snapshot.h"
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Compact copy of the way coordinates, for geometry that is only drawn.
+// Points are quantized to centimetres and every way is coded on its own:
+// the zigzag varint x and y of the kTileBits tile its first point falls in,
+// that point as varint offsets inside the tile, then the zigzag varint
+// deltas from point to point. Neighbouring points are metres apart, so most
+// take two to four bytes instead of the four byte node index plus sixteen
+// bytes of shared doubles. Ways are decoded on demand, straight into the
+// caller's path or sum; nothing is materialized.
+class WayGeometry {
+public:
+    static constexpr double kUnitsPerMetre = 100.;      // centimetre fixed point
+    static constexpr int kTileBits = 20;                // tiles of about 10 km
+
+    WayGeometry() = default;
+    explicit WayGeometry(const Model &model);           // every way of the model
+    explicit WayGeometry(const Snapshot &snapshot);     // views into the snapshot, empty if it has no geometry
+
+    void Serialize(SnapshotWriter &writer) const;
+
+    // Codes the listed ways (sorted, unique) again from their model nodes, and
+    // every way the model has beyond WayCount(); the others are kept as coded.
+    void Update(const Model &model, const std::vector<int> &ways);
+
+    bool Empty() const noexcept { return m_Offsets.empty(); }
+    std::size_t WayCount() const noexcept { return Empty() ? 0 : m_Offsets.size() - 1; }
+    std::size_t Bytes() const noexcept { return m_Data.size() + m_Offsets.size() * sizeof(std::uint64_t); }
+
+    // Calls point(x, y) with the normalized model coordinates of every point of the way.
+    template <typename F>
+    void Decode(std::size_t way, F &&point) const;
+    std::vector<Model::Node> Points(std::size_t way) const;
+    double Length(std::size_t way) const;               // metres, summed in the quantized grid
+    // Calls length(metres) for every segment of the way in order, measured in the quantized grid.
+    template <typename F>
+    void Segments(std::size_t way, F &&length) const;
+
+private:
+    // Walks the quantized points; at(qx, qy) gets centimetres from the model origin.
+    template <typename F>
+    void Walk(std::size_t way, F &&at) const;
+
+    FlatArray<std::uint64_t> m_Offsets;     // first byte of every way, plus the end
+    FlatArray<std::uint8_t> m_Data;
+    double m_Units = 1.;                    // centimetres per normalized unit
+};
+
+namespace way_geometry_detail {
+
+inline std::uint64_t ReadVarint(const std::uint8_t *&p) noexcept
+{
+    std::uint64_t value = 0;
+    for( int shift = 0;; shift += 7 ) {
+        auto byte = *p++;
+        value |= std::uint64_t{byte & 0x7fu} << shift;
+        if( !(byte & 0x80u) )
+            return value;
+    }
+}
+
+inline std::int64_t Unzigzag(std::uint64_t v) noexcept
+{
+    return static_cast<std::int64_t>(v >> 1) ^ -static_cast<std::int64_t>(v & 1);
+}
+
+}
+
+template <typename F>
+void WayGeometry::Walk(std::size_t way, F &&at) const
+{
+    using namespace way_geometry_detail;
+    auto p = m_Data.data() + m_Offsets[way], end = m_Data.data() + m_Offsets[way + 1];
+    if( p == end )
+        return;
+    auto x = Unzigzag(ReadVarint(p)) * (std::int64_t{1} << kTileBits);
+    auto y = Unzigzag(ReadVarint(p)) * (std::int64_t{1} << kTileBits);
+    x += static_cast<std::int64_t>(ReadVarint(p));
+    y += static_cast<std::int64_t>(ReadVarint(p));
+    at(x, y);
+    while( p != end ) {
+        x += Unzigzag(ReadVarint(p));
+        y += Unzigzag(ReadVarint(p));
+        at(x, y);
+    }
+}
+
+template <typename F>
+void WayGeometry::Segments(std::size_t way, F &&length) const
+{
+    auto first = true;
+    std::int64_t last_x = 0, last_y = 0;
+    Walk(way, [&](std::int64_t x, std::int64_t y) {
+        if( !first )
+            length(std::hypot(static_cast<double>(x - last_x), static_cast<double>(y - last_y)) / kUnitsPerMetre);
+        first = false;
+        last_x = x;
+        last_y = y;
+    });
+}
+
+template <typename F>
+void WayGeometry::Decode(std::size_t way, F &&point) const
+{
+    auto scale = 1. / m_Units;
+    Walk(way, [&](std::int64_t x, std::int64_t y) { point(static_cast<double>(x) * scale, static_cast<double>(y) * scale); });
+}
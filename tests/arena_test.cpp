@@ -0,0 +1,83 @@
+#include "arena.h"
+#include "test.h"
+#include <cstdint>
+#include <numeric>
+#include <string>
+#include <utility>
+
+namespace {
+
+bool Aligned(const void *p, std::size_t alignment)
+{
+    return reinterpret_cast<std::uintptr_t>(p) % alignment == 0;
+}
+
+}
+
+TEST(AlignsEveryListToItsElementType)
+{
+    Arena arena;
+    std::vector<char> bytes{'a', 'b', 'c'};
+    std::vector<double> doubles{1., 2., 3.};
+    std::vector<std::int16_t> shorts{4, 5};
+    std::vector<std::int64_t> longs{6};
+
+    auto b = arena.Copy(bytes);
+    auto d = arena.Copy(doubles);
+    auto s = arena.Copy(shorts);
+    auto l = arena.Copy(longs);
+    CHECK(Aligned(d.data(), alignof(double)));
+    CHECK(Aligned(s.data(), alignof(std::int16_t)));
+    CHECK(Aligned(l.data(), alignof(std::int64_t)));
+    CHECK_EQ(std::string(b.begin(), b.end()), std::string("abc"));
+    CHECK(std::vector<double>(d.begin(), d.end()) == doubles);
+    CHECK(std::vector<std::int16_t>(s.begin(), s.end()) == shorts);
+    CHECK_EQ(l[0], 6);
+    CHECK_EQ(arena.Capacity(), Arena::kBlockSize);         // all in the first block
+}
+
+TEST(EmptyListsTakeNoMemory)
+{
+    Arena arena;
+    auto empty = arena.Copy(std::vector<int>{});
+    CHECK(empty.empty());
+    CHECK_EQ(arena.Capacity(), 0u);
+}
+
+TEST(GrowsByBlocksAndKeepsEarlierLists)
+{
+    Arena arena;
+    std::vector<int> small(1000);
+    std::iota(small.begin(), small.end(), 0);
+    std::vector<Span<const int>> lists;
+    const auto per_block = Arena::kBlockSize / sizeof(small.front()) / small.size();
+    for( std::size_t i = 0; i <= per_block; ++i )       // one list more than a block holds
+        lists.push_back(arena.Copy(small));
+    CHECK_EQ(arena.Capacity(), 2 * Arena::kBlockSize);
+
+    std::vector<int> large(Arena::kBlockSize / sizeof(int) + 1, 7);
+    auto oversized = arena.Copy(large);
+    CHECK_EQ(arena.Capacity(), 3 * Arena::kBlockSize + sizeof(int));        // a block of its own
+    CHECK_EQ(oversized.size(), large.size());
+    CHECK_EQ(oversized.back(), 7);
+
+    auto after = arena.Copy(small);                     // the oversized block is full, a new one follows
+    CHECK_EQ(arena.Capacity(), 4 * Arena::kBlockSize + sizeof(int));
+    CHECK_EQ(after[999], 999);
+    for( auto list: lists ) {
+        REQUIRE(list.size() == small.size());
+        CHECK_EQ(list.front(), 0);
+        CHECK_EQ(list.back(), 999);
+    }
+}
+
+TEST(ListsSurviveMovingTheArena)
+{
+    Arena arena;
+    auto list = arena.Copy(std::vector<int>{1, 2, 3});
+    Arena moved{std::move(arena)};
+    auto more = moved.Copy(std::vector<int>{4});
+    CHECK_EQ(list[2], 3);
+    CHECK_EQ(more[0], 4);
+    CHECK_EQ(moved.Capacity(), Arena::kBlockSize);      // still filling the same block
+}
@@ -0,0 +1,33 @@
+#include "batch_render.h"
+#include "osm_fixture.h"
+#include "route_model.h"
+#include "test.h"
+#include <fstream>
+#include <sstream>
+
+// Built only with io2d. Renders the grid headless and checks the PNGs arrive.
+TEST(RendersRoutesToPng)
+{
+    TempDir dir;
+    GridExtract().Write(dir / "grid.osm.pbf");
+    RouteModel model{dir / "grid.osm.pbf"};
+    BatchRenderer renderer{model, 160, 120};
+    std::istringstream in{"# start x, start y, end x, end y\n10 10 90 80\n\n50 50 50 50\n"};
+    auto trips = BatchRenderer::ReadTrips(in);
+    REQUIRE(trips && trips->size() == 2u);
+
+    CHECK_EQ(renderer.Run(*trips, dir / "out"), 2u);
+    for( auto name: {"route_0.png", "route_1.png"} ) {
+        std::ifstream png{dir / "out" / name, std::ios::binary};
+        REQUIRE(png.is_open());
+        char magic[8] = {};
+        png.read(magic, sizeof(magic));
+        CHECK(png && std::string(magic + 1, 3) == "PNG");
+    }
+}
+
+TEST(RejectsMalformedTrips)
+{
+    std::istringstream in{"10 10 90\n"};
+    CHECK(!BatchRenderer::ReadTrips(in));
+}
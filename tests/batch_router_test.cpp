@@ -0,0 +1,115 @@
+#include "batch_router.h"
+#include "osm_fixture.h"
+#include "route_model.h"
+#include "route_planner.h"
+#include "test.h"
+#include <cmath>
+#include <random>
+
+namespace {
+
+// The jittered grid plus a street far off it, which no grid vertex reaches.
+std::unique_ptr<RouteModel> BuildModel(const TempDir &dir)
+{
+    GridOptions options;
+    options.size = 12;
+    options.jitter = 0.5;
+    options.split_ways = true;
+    auto writer = GridExtract(options);
+    writer.AddNode(9001, 40.78, -73.92);
+    writer.AddNode(9002, 40.78, -73.91);
+    writer.AddNode(9003, 40.79, -73.91);
+    writer.AddWay(9000, {9001, 9002, 9003}, {{"highway", "residential"}});
+    writer.Write(dir / "grid.osm.pbf");
+    return std::make_unique<RouteModel>(dir / "grid.osm.pbf");
+}
+
+// Random grid vertices, some repeated, the isolated street and an unsnapped entry.
+std::vector<std::uint32_t> PickVertices(const RouteModel &model, std::uint32_t seed)
+{
+    auto &graph = model.Graph();
+    std::mt19937 random{seed};
+    std::vector<std::uint32_t> vertices;
+    for( int i = 0; i < 12; ++i )
+        vertices.push_back(random() % graph.VertexCount());
+    vertices.push_back(vertices[3]);
+    vertices.push_back(vertices[0]);
+    vertices.push_back(graph.Vertex((int)model.Nodes().size() - 1));
+    vertices.push_back(RouteGraph::kNoVertex);
+    return vertices;
+}
+
+// Every cell against a pairwise search, infinity where that finds nothing.
+void MatchesPairwise(const RouteModel &model, const RouteMatrix &matrix,
+                     const std::vector<std::uint32_t> &sources, const std::vector<std::uint32_t> &targets)
+{
+    RoutePlanner planner{model};
+    REQUIRE(matrix.rows == sources.size() && matrix.cols == targets.size());
+    for( std::size_t i = 0; i < sources.size(); ++i )
+        for( std::size_t j = 0; j < targets.size(); ++j ) {
+            std::optional<Route> expected;
+            if( sources[i] != RouteGraph::kNoVertex && targets[j] != RouteGraph::kNoVertex )
+                expected = planner.AStarSearch(sources[i], targets[j]);
+            if( !expected ) {
+                CHECK(std::isinf(matrix.Distance(i, j)));
+                CHECK(std::isinf(matrix.Duration(i, j)));
+                continue;
+            }
+            CHECK_NEAR(matrix.Distance(i, j), expected->distance, 1e-3 + 1e-5 * expected->distance);
+            CHECK(matrix.Duration(i, j) >= 0.f && std::isfinite(matrix.Duration(i, j)));
+            if( sources[i] == targets[j] )
+                CHECK_EQ(matrix.Distance(i, j), 0.f);
+        }
+}
+
+}
+
+TEST(PlainMatrixMatchesPairwiseAStar)
+{
+    TempDir dir;
+    auto model = BuildModel(dir);
+    auto sources = PickVertices(*model, 3), targets = PickVertices(*model, 4);
+    BatchRouter router{*model, 3};
+    MatchesPairwise(*model, router.RouteVertices(sources, targets), sources, targets);
+    // the buffers are reused by a second call
+    MatchesPairwise(*model, router.RouteVertices(targets, sources), targets, sources);
+}
+
+TEST(BucketMatrixMatchesPairwiseAStarAndTheHierarchy)
+{
+    TempDir dir;
+    auto model = BuildModel(dir);
+    auto sources = PickVertices(*model, 5), targets = PickVertices(*model, 6);
+    auto plain = BatchRouter{*model, 2}.RouteVertices(sources, targets);
+    model->BuildHierarchy();
+    BatchRouter router{*model, 3};
+    auto buckets = router.RouteVertices(sources, targets);
+    MatchesPairwise(*model, buckets, sources, targets);
+
+    CHQuery query{model->Hierarchy(), model->Graph()};
+    for( std::size_t i = 0; i < sources.size(); ++i )
+        for( std::size_t j = 0; j < targets.size(); ++j ) {
+            if( std::isinf(plain.Duration(i, j)) )
+                CHECK(std::isinf(buckets.Duration(i, j)));
+            else
+                CHECK_NEAR(buckets.Duration(i, j), plain.Duration(i, j), 1e-2 + 1e-4 * plain.Duration(i, j));
+            if( sources[i] == RouteGraph::kNoVertex || targets[j] == RouteGraph::kNoVertex )
+                continue;
+            auto route = query.Search(sources[i], targets[j]);
+            CHECK_EQ(route.has_value(), std::isfinite(buckets.Distance(i, j)));
+            if( route )
+                CHECK_NEAR(buckets.Distance(i, j), route->distance, 1e-3 + 1e-5 * route->distance);
+        }
+    MatchesPairwise(*model, router.RouteVertices(targets, sources), targets, sources);
+}
+
+TEST(SnapsPointsToTheClosestRoads)
+{
+    TempDir dir;
+    auto model = BuildModel(dir);
+    BatchRouter router{*model, 2};
+    auto matrix = router.Route({{0.1f, 0.1f}, {0.5f, 0.5f}}, {{0.9f, 0.8f}, {0.1f, 0.1f}});
+    REQUIRE(matrix.rows == 2 && matrix.cols == 2);
+    CHECK_EQ(matrix.Distance(0, 1), 0.f);
+    CHECK(matrix.Distance(0, 0) > matrix.Distance(1, 0));
+}
@@ -0,0 +1,88 @@
+#include "box_index.h"
+#include "test.h"
+#include <algorithm>
+#include <random>
+
+namespace {
+
+std::vector<Box> RandomBoxes(std::uint32_t seed, std::size_t count)
+{
+    std::mt19937 random{seed};
+    std::uniform_real_distribution<float> unit{0.f, 1.f}, size{0.f, 0.05f};
+    std::vector<Box> boxes;
+    for( std::size_t i = 0; i < count; ++i ) {
+        Box box;
+        if( i % 17 != 0 ) {                 // every 17th stays empty, as a feature without nodes would
+            auto x = unit(random), y = unit(random);
+            box.Extend(x, y);
+            box.Extend(x + size(random), y + (i % 5 == 0 ? 0.f : size(random)));       // some are flat
+        }
+        boxes.push_back(box);
+    }
+    return boxes;
+}
+
+std::vector<std::uint32_t> BruteForce(const std::vector<Box> &boxes, const Box &query)
+{
+    std::vector<std::uint32_t> hits;
+    for( std::uint32_t i = 0; i < boxes.size(); ++i )
+        if( !boxes[i].Empty() && boxes[i].Intersects(query) )
+            hits.push_back(i);
+    return hits;
+}
+
+}
+
+TEST(QueriesMatchBruteForceInItemOrder)
+{
+    for( std::size_t count: {1u, 15u, 16u, 17u, 255u, 256u, 257u, 3000u} ) {
+        auto boxes = RandomBoxes(static_cast<std::uint32_t>(count), count);
+        BoxIndex index{boxes};
+        CHECK_EQ(index.Size(), static_cast<std::size_t>(std::count_if(boxes.begin(), boxes.end(), [](auto &b){ return !b.Empty(); })));
+        std::mt19937 random{99};
+        std::uniform_real_distribution<float> unit{-0.2f, 1.2f}, size{0.f, 0.4f};
+        for( int q = 0; q < 100; ++q ) {
+            Box query;
+            auto x = unit(random), y = unit(random);
+            query.Extend(x, y);
+            query.Extend(x + size(random), y + size(random));
+            std::vector<std::uint32_t> found{12345};        // appended to, what is there stays
+            index.Query(query, found);
+            REQUIRE(!found.empty() && found.front() == 12345);
+            found.erase(found.begin());
+            CHECK(found == BruteForce(boxes, query));
+        }
+        std::vector<std::uint32_t> all;
+        index.Query({-1.f, -1.f, 2.f, 2.f}, all);
+        CHECK_EQ(all.size(), index.Size());
+    }
+}
+
+TEST(TouchingBoxesIntersect)
+{
+    std::vector<Box> boxes{{0.f, 0.f, 1.f, 1.f}, {2.f, 2.f, 3.f, 3.f}};
+    BoxIndex index{boxes};
+    std::vector<std::uint32_t> found;
+    index.Query({1.f, 1.f, 2.f, 2.f}, found);               // shares a corner with both
+    CHECK(found == (std::vector<std::uint32_t>{0, 1}));
+    found.clear();
+    index.Query({1.1f, 1.1f, 1.9f, 1.9f}, found);
+    CHECK(found.empty());
+}
+
+TEST(EmptyIndexAndEmptyQueriesFindNothing)
+{
+    BoxIndex none;
+    std::vector<std::uint32_t> found;
+    none.Query({0.f, 0.f, 1.f, 1.f}, found);
+    CHECK(found.empty());
+
+    BoxIndex only_empty{std::vector<Box>(5)};
+    CHECK_EQ(only_empty.Size(), 0u);
+    only_empty.Query({-10.f, -10.f, 10.f, 10.f}, found);
+    CHECK(found.empty());
+
+    BoxIndex index{RandomBoxes(1, 100)};
+    index.Query(Box{}, found);
+    CHECK(found.empty());
+}
@@ -0,0 +1,69 @@
+#include "chunk_reader.h"
+#include "osm_fixture.h"
+#include "test.h"
+#include <fstream>
+#include <random>
+
+namespace {
+
+// more than two chunks and a partial one at the end
+std::vector<char> WriteFile(const std::string &path, std::size_t size)
+{
+    std::vector<char> bytes(size);
+    std::mt19937 random{9};
+    for( auto &b: bytes )
+        b = static_cast<char>(random());
+    std::ofstream out{path, std::ios::binary};
+    out.write(bytes.data(), bytes.size());
+    return bytes;
+}
+
+void ReadsEveryByteInOrder(ChunkReader::Backend backend, unsigned depth)
+{
+    TempDir dir;
+    auto path = (dir / "data.bin").string();
+    auto bytes = WriteFile(path, 2 * ChunkReader::kChunkSize + 12345);
+    auto reader = ChunkReader::Open(path, depth, backend);
+    REQUIRE(reader);
+    CHECK_EQ(reader->Size(), bytes.size());
+    if( backend == ChunkReader::Backend::Threads )
+        CHECK(!reader->UsesUring());
+
+    std::vector<char> read;
+    std::size_t chunks = 0;
+    for( auto chunk = reader->Next(); !chunk.empty(); chunk = reader->Next(), ++chunks ) {
+        CHECK(chunk.size() <= ChunkReader::kChunkSize);
+        auto first = reinterpret_cast<const char *>(chunk.data());
+        read.insert(read.end(), first, first + chunk.size());
+    }
+    CHECK_EQ(chunks, 3u);
+    CHECK(read == bytes);
+    CHECK(reader->Next().empty());          // stays at the end
+}
+
+}
+
+TEST(ReadsAFileThroughThePreferredBackend)
+{
+    ReadsEveryByteInOrder(ChunkReader::Backend::Auto, ChunkReader::kDepth);
+}
+
+TEST(ReadsAFileThroughTheThreadPool)
+{
+    ReadsEveryByteInOrder(ChunkReader::Backend::Threads, ChunkReader::kDepth);
+}
+
+TEST(ReadsWithFewerSlotsThanChunks)
+{
+    ReadsEveryByteInOrder(ChunkReader::Backend::Auto, 1);
+    ReadsEveryByteInOrder(ChunkReader::Backend::Threads, 2);
+}
+
+TEST(OpensOnlyNonEmptyRegularFiles)
+{
+    TempDir dir;
+    CHECK(!ChunkReader::Open((dir / "missing.bin").string()));
+    CHECK(!ChunkReader::Open(dir.Path().string()));
+    std::ofstream{dir / "empty.bin"};
+    CHECK(!ChunkReader::Open((dir / "empty.bin").string()));
+}
@@ -0,0 +1,123 @@
+#include "contraction_hierarchy.h"
+#include "mapped_file.h"
+#include "osm_fixture.h"
+#include "route_model.h"
+#include "route_planner.h"
+#include "snapshot.h"
+#include "test.h"
+#include <random>
+
+namespace {
+
+std::unique_ptr<RouteModel> BuildModel(const TempDir &dir, const GridOptions &options)
+{
+    GridExtract(options).Write(dir / "grid.osm.pbf");
+    auto model = std::make_unique<RouteModel>(dir / "grid.osm.pbf");
+    model->BuildHierarchy();
+    return model;
+}
+
+// CH and A* agree on the distance of random vertex pairs, and the CH route
+// runs from the start to the end over graph edges.
+void MatchesAStar(const RouteModel &model, std::uint32_t seed, int pairs)
+{
+    auto &graph = model.Graph();
+    REQUIRE(!model.Hierarchy().Empty());
+    REQUIRE(model.Hierarchy().VertexCount() == graph.VertexCount());
+    RoutePlanner planner{model};
+    CHQuery ch{model.Hierarchy(), graph};
+    std::mt19937 random{seed};
+    for( int i = 0; i < pairs; ++i ) {
+        auto from = random() % graph.VertexCount(), to = random() % graph.VertexCount();
+        auto expected = planner.AStarSearch(from, to);
+        auto found = ch.Search(from, to);
+        REQUIRE(expected.has_value() == found.has_value());
+        if( !found )
+            continue;
+        CHECK_NEAR(found->distance, expected->distance, 1e-3 + 1e-5 * expected->distance);
+        REQUIRE(!found->nodes.empty());
+        CHECK_EQ(found->nodes.front(), graph.ModelNode(from));
+        CHECK_EQ(found->nodes.back(), graph.ModelNode(to));
+        auto length = 0.f;
+        for( std::size_t n = 1; n < found->nodes.size(); ++n ) {
+            auto u = graph.Vertex(found->nodes[n - 1]), v = graph.Vertex(found->nodes[n]);
+            auto best = -1.f;
+            for( auto e = graph.FirstEdge(u); e < graph.FirstEdge(u + 1); ++e )
+                if( graph.Target(e) == v && (best < 0.f || graph.Weight(e) < best) )
+                    best = graph.Weight(e);
+            REQUIRE(best >= 0.f);            // consecutive route nodes are joined by an edge
+            length += best;
+        }
+        CHECK_NEAR(length, found->distance, 1e-3 + 1e-5 * expected->distance);
+    }
+}
+
+}
+
+TEST(MatchesAStarOnRandomPairs)
+{
+    TempDir dir;
+    GridOptions options;
+    options.size = 16;
+    options.jitter = 0.6;
+    options.split_ways = true;
+    auto model = BuildModel(dir, options);
+    MatchesAStar(*model, 11, 300);
+}
+
+TEST(KeepsPathsOverZeroLengthEdges)
+{
+    // every row crosses the middle column over two extra nodes at the same
+    // coordinates, the one in between only has edges of length 0
+    TempDir dir;
+    GridOptions options;
+    options.size = 12;
+    options.twins = true;
+    auto model = BuildModel(dir, options);
+    MatchesAStar(*model, 5, 300);
+
+    // rows far from anything else: only the twins join their halves
+    RoutePlanner planner{*model};
+    CHQuery ch{model->Hierarchy(), model->Graph()};
+    auto west = model->Graph().Vertex(model->FindClosestNode(0.f, 0.f));
+    auto east = model->Graph().Vertex(model->FindClosestNode(1.f, 0.f));
+    auto expected = planner.AStarSearch(west, east), found = ch.Search(west, east);
+    REQUIRE(expected && found);
+    CHECK_NEAR(found->distance, expected->distance, 1e-2);
+}
+
+TEST(LoadsFromASnapshot)
+{
+    TempDir dir;
+    GridOptions options;
+    options.jitter = 0.3;
+    auto built = BuildModel(dir, options);
+    SnapshotWriter writer{built->MetricScale()};
+    built->Serialize(writer);
+    REQUIRE(writer.Save((dir / "grid.rms").string()));
+    auto snapshot = Snapshot::Open((dir / "grid.rms").string());
+    REQUIRE(snapshot);
+    RouteModel loaded{std::move(*snapshot)};
+    CHECK_EQ(loaded.Hierarchy().EdgeCount(), built->Hierarchy().EdgeCount());
+    MatchesAStar(loaded, 3, 100);
+}
+
+TEST(RejectsAHierarchyOfAnotherGraph)
+{
+    TempDir dir;
+    GridOptions small, large;
+    large.size = 14;
+    auto a = BuildModel(dir, small);
+    auto b = BuildModel(dir, large);
+
+    // the sections of b's hierarchy under a's graph
+    SnapshotWriter writer{a->MetricScale()};
+    static_cast<const Model &>(*a).Serialize(writer);
+    writer.Add(Snapshot::RoadNodes, a->RoadNodes());
+    a->Graph().Serialize(writer);
+    b->Hierarchy().Serialize(writer);
+    REQUIRE(writer.Save((dir / "mixed.rms").string()));
+    auto snapshot = Snapshot::Open((dir / "mixed.rms").string());
+    REQUIRE(snapshot);
+    CHECK_THROWS(RouteModel{std::move(*snapshot)});
+}
@@ -0,0 +1,110 @@
+#include "instrument.h"
+#include "test.h"
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+// Built twice: as instrument_test with ROUTEMS_INSTRUMENT as configured, and,
+// when the option is off, as instrument_enabled_test with instrument.cpp and
+// the define added, so both the exporters and the empty stubs are covered.
+
+namespace {
+
+std::string Prometheus()
+{
+    std::ostringstream out;
+    instrument::WritePrometheus(out);
+    return out.str();
+}
+
+std::string ChromeTrace()
+{
+    std::ostringstream out;
+    instrument::WriteChromeTrace(out);
+    return out.str();
+}
+
+#ifdef ROUTEMS_INSTRUMENT
+
+// The value on the sample line that starts with `series`, or -1.
+long long Sample(const std::string &text, const std::string &series)
+{
+    std::istringstream in{text};
+    for( std::string line; std::getline(in, line); )
+        if( line.compare(0, series.size() + 1, series + ' ') == 0 )
+            return std::stoll(line.substr(series.size() + 1));
+    return -1;
+}
+
+void TimedScope()
+{
+    ROUTEMS_TRACE_SCOPE("instrument_test_scope");
+}
+
+#endif
+
+}
+
+#ifdef ROUTEMS_INSTRUMENT
+
+TEST(SumsTheCountersOfAllThreads)
+{
+    static_assert(instrument::kEnabled);
+    auto before = Sample(Prometheus(), "routems_heap_pops_total");
+    REQUIRE(before >= 0);
+    auto count = [] {
+        instrument::Tally pops{instrument::HeapPops};
+        for( int i = 0; i < 1000; ++i )
+            ++pops;
+        pops += 500;
+    };
+    std::thread first{count}, second{count};
+    first.join();
+    second.join();
+    instrument::Add(instrument::HeapPops, 7);
+    instrument::Add(instrument::HeapPops, 0);
+    CHECK_EQ(Sample(Prometheus(), "routems_heap_pops_total"), before + 2 * 1500 + 7);
+}
+
+TEST(CountsEveryTimedScopeInItsHistogram)
+{
+    for( int i = 0; i < 3; ++i )
+        TimedScope();
+    std::thread other{[] { TimedScope(); }};
+    other.join();
+    auto text = Prometheus();
+    CHECK(text.find("# TYPE routems_scope_seconds histogram") != std::string::npos);
+    CHECK_EQ(Sample(text, "routems_scope_seconds_count{scope=\"instrument_test_scope\"}"), 4);
+    CHECK_EQ(Sample(text, "routems_scope_seconds_bucket{scope=\"instrument_test_scope\",le=\"+Inf\"}"), 4);
+}
+
+TEST(TracesSpansOnceStarted)
+{
+    TimedScope();                                   // before StartTrace, not in the trace
+    CHECK(ChromeTrace().find("instrument_test_scope") == std::string::npos);
+    instrument::StartTrace();
+    TimedScope();
+    auto trace = ChromeTrace();
+    CHECK(trace.find("\"traceEvents\":[") != std::string::npos);
+    CHECK(trace.find("{\"name\":\"instrument_test_scope\",\"cat\":\"routems\",\"ph\":\"X\"") != std::string::npos);
+}
+
+#else
+
+TEST(CompilesToNothingWithoutTheDefine)
+{
+    static_assert(!instrument::kEnabled);
+    static_assert(std::is_empty_v<instrument::Tally>);
+    static_assert(std::is_trivially_destructible_v<instrument::Tally>);
+    instrument::Tally pops{instrument::HeapPops};
+    ++pops;
+    pops += 3;
+    instrument::Add(instrument::HeapPops, 1);
+    instrument::StartTrace();
+    ROUTEMS_TRACE_SCOPE("instrument_test_scope");
+    CHECK(Prometheus().empty());
+    CHECK_EQ(ChromeTrace(), std::string("{\"traceEvents\":[]}\n"));
+}
+
+#endif
@@ -0,0 +1,95 @@
+#include "landmarks.h"
+#include "osm_fixture.h"
+#include "route_model.h"
+#include "route_planner.h"
+#include "test.h"
+#include <cmath>
+#include <random>
+
+namespace {
+
+// The jittered grid with a street off it that nothing reaches, which the
+// landmark tables mark as out of reach.
+std::unique_ptr<RouteModel> BuildModel(const TempDir &dir)
+{
+    GridOptions options;
+    options.size = 14;
+    options.jitter = 0.7;
+    options.split_ways = true;
+    auto writer = GridExtract(options);
+    writer.AddNode(9001, 40.78, -73.92);
+    writer.AddNode(9002, 40.785, -73.91);
+    writer.AddWay(9000, {9001, 9002}, {{"highway", "residential"}});
+    writer.Write(dir / "grid.osm.pbf");
+    return std::make_unique<RouteModel>(dir / "grid.osm.pbf");
+}
+
+}
+
+TEST(BoundsNeverExceedTheRoadDistance)
+{
+    TempDir dir;
+    auto model = BuildModel(dir);
+    auto &graph = model->Graph();
+    std::mt19937 random{17};
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> pairs;
+    for( int i = 0; i < 400; ++i )
+        pairs.emplace_back(random() % graph.VertexCount(), random() % graph.VertexCount());
+    pairs.emplace_back(0, graph.VertexCount() - 1);             // into the unreachable street
+
+    // distances by plain A* on the straight line bound, before there are landmarks
+    std::vector<float> expected;
+    {
+        RoutePlanner planner{*model};
+        for( auto [from, to]: pairs ) {
+            auto route = planner.AStarSearch(from, to);
+            expected.push_back(route ? route->distance : std::numeric_limits<float>::infinity());
+        }
+    }
+
+    model->BuildLandmarks(6);
+    auto &landmarks = model->GraphLandmarks();
+    REQUIRE(landmarks.Count() == 6u);
+    REQUIRE(landmarks.VertexCount() == graph.VertexCount());
+    RoutePlanner planner{*model};
+    auto tighter = 0;
+    for( std::size_t i = 0; i < pairs.size(); ++i ) {
+        auto [from, to] = pairs[i];
+        auto bound = landmarks.LowerBound(from, to);
+        CHECK(!std::isnan(bound));
+        CHECK(bound <= expected[i] * (1.f + 1e-5f) + 1e-3f);
+        tighter += bound > graph.Distance(from, to);
+
+        auto route = planner.AStarSearch(from, to);
+        REQUIRE(route.has_value() == std::isfinite(expected[i]));
+        if( route )
+            CHECK_NEAR(route->distance, expected[i], 1e-3 + 1e-5 * expected[i]);
+    }
+    CHECK(tighter > 0);                 // the landmarks beat the straight line somewhere
+    CHECK_EQ(landmarks.LowerBound(5, 5), 0.f);
+}
+
+// Every vertex against every landmark: d(v, t) >= d(L, t) - d(L, v) only holds
+// if the tables are the exact road distances, so check them against A*.
+TEST(TablesHoldTheRoadDistancesFromTheLandmarks)
+{
+    TempDir dir;
+    auto model = BuildModel(dir);
+    model->BuildLandmarks(3);
+    auto &graph = model->Graph();
+    auto &landmarks = model->GraphLandmarks();
+    RoutePlanner planner{*model};
+    std::mt19937 random{23};
+    for( std::size_t l = 0; l < landmarks.Count(); ++l ) {
+        auto from = landmarks.Vertex(l);
+        for( int i = 0; i < 60; ++i ) {
+            auto to = random() % graph.VertexCount();
+            auto route = planner.AStarSearch(from, to);
+            auto bound = landmarks.LowerBound(from, to);     // a landmark bounds its own distances exactly
+            if( route )
+                CHECK_NEAR(bound, route->distance, 1e-3 + 1e-5 * route->distance);
+            else
+                CHECK(bound > 1e29f);               // the tables hold 1e30 for "no road"
+        }
+    }
+}
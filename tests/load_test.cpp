@@ -0,0 +1,116 @@
+#include "mapped_file.h"
+#include "osm_fixture.h"
+#include "route_model.h"
+#include "route_planner.h"
+#include "test.h"
+#include <algorithm>
+
+TEST(LoadsTheGridExtract)
+{
+    TempDir dir;
+    GridExtract().Write(dir / "grid.osm.pbf");
+    auto file = MappedFile::Open((dir / "grid.osm.pbf").string());
+    REQUIRE(file);
+    RouteModel model{*file};
+
+    CHECK_EQ(model.Nodes().size(), 100u);
+    CHECK_EQ(model.Roads().size(), 20u);
+    CHECK_EQ(model.Buildings().size(), 1u);
+    CHECK_EQ(model.Leisures().size(), 1u);
+    REQUIRE(model.Waters().size() == 1u);
+    CHECK_EQ(model.Waters()[0].outer.size(), 1u);       // the two open halves joined into one ring
+    REQUIRE(model.Landuses().size() == 1u);
+    CHECK_EQ(model.Landuses()[0].inner.size(), 1u);
+    CHECK(model.Landuses()[0].type == Model::Landuse::Grass);
+
+    RoutePlanner planner{model};
+    auto route = planner.AStarSearch(0.f, 0.f, 100.f, 100.f);
+    REQUIRE(route);
+    CHECK(route->nodes.size() >= 10u);
+    CHECK(route->distance > 0.f);
+}
+
+TEST(ReadsFromAPathLikeFromAMapping)
+{
+    TempDir dir;
+    GridOptions options;
+    options.jitter = 0.4;
+    options.split_ways = true;
+    auto writer = GridExtract(options);
+    writer.SetBlockSize(7);                 // many small blocks, some raw
+    writer.SetCompressed(false);
+    writer.Write(dir / "grid.osm.pbf");
+
+    auto file = MappedFile::Open((dir / "grid.osm.pbf").string());
+    REQUIRE(file);
+    RouteModel mapped{*file};
+    RouteModel read{dir / "grid.osm.pbf"};
+    CHECK_EQ(mapped.Nodes().size(), read.Nodes().size());
+    CHECK_EQ(mapped.Ways().size(), read.Ways().size());
+    CHECK_EQ(mapped.Roads().size(), read.Roads().size());
+    CHECK_EQ(mapped.Graph().EdgeCount(), read.Graph().EdgeCount());
+    for( std::size_t i = 0; i < mapped.Nodes().size(); ++i ) {
+        CHECK_EQ(mapped.Nodes()[i].x, read.Nodes()[i].x);
+        CHECK_EQ(mapped.Nodes()[i].y, read.Nodes()[i].y);
+    }
+}
+
+TEST(StreamsOnlyTheNodesTheWaysUse)
+{
+    TempDir dir, scratch;
+    GridOptions options;
+    options.jitter = 0.3;
+    auto writer = GridExtract(options);
+    for( std::int64_t id = 5000; id < 5050; ++id )      // points of interest, on no way
+        writer.AddNode(id, 40.75, -73.96);
+    writer.SetBlockSize(16);
+    writer.Write(dir / "grid.osm.pbf");
+
+    RouteModel loaded{dir / "grid.osm.pbf"};
+    RouteModel streamed{dir / "grid.osm.pbf", scratch.Path()};
+    CHECK_EQ(loaded.Nodes().size(), 150u);
+    REQUIRE(streamed.Nodes().size() == 100u);
+    for( std::size_t i = 0; i < streamed.Nodes().size(); ++i ) {    // ids 1..100 keep their order
+        CHECK_EQ(streamed.Nodes()[i].x, loaded.Nodes()[i].x);
+        CHECK_EQ(streamed.Nodes()[i].y, loaded.Nodes()[i].y);
+    }
+    REQUIRE(streamed.Ways().size() == loaded.Ways().size());
+    for( std::size_t way = 0; way < loaded.Ways().size(); ++way )
+        CHECK(std::equal(streamed.Ways()[way].nodes.begin(), streamed.Ways()[way].nodes.end(),
+                         loaded.Ways()[way].nodes.begin(), loaded.Ways()[way].nodes.end()));
+    CHECK_EQ(streamed.Waters()[0].outer.size(), 1u);
+    CHECK(std::filesystem::is_empty(scratch.Path()));          // the node file is gone with the ingest
+
+    RoutePlanner a{loaded}, b{streamed};
+    auto expected = a.AStarSearch(5.f, 5.f, 95.f, 90.f), route = b.AStarSearch(5.f, 5.f, 95.f, 90.f);
+    REQUIRE(expected && route);
+    CHECK_EQ(route->distance, expected->distance);
+    CHECK(route->nodes == expected->nodes);
+}
+
+// Blocks with more ways than one parse chunk go through the pool in several
+// pieces; the model must come out as if the ways were read one by one.
+TEST(SplitsWayHeavyBlocksWithoutChangingTheModel)
+{
+    TempDir dir;
+    GridOptions options;
+    options.size = 100;
+    options.split_ways = true;
+    auto writer = GridExtract(options);
+    writer.Write(dir / "heavy.osm.pbf");
+    writer.SetBlockSize(64);
+    writer.Write(dir / "small.osm.pbf");
+
+    RouteModel heavy{dir / "heavy.osm.pbf"}, small{dir / "small.osm.pbf"};
+    CHECK(heavy.Ways().size() > 2048u);          // three chunks and more
+    REQUIRE(heavy.Ways().size() == small.Ways().size());
+    for( std::size_t way = 0; way < heavy.Ways().size(); ++way )
+        CHECK(std::equal(heavy.Ways()[way].nodes.begin(), heavy.Ways()[way].nodes.end(),
+                         small.Ways()[way].nodes.begin(), small.Ways()[way].nodes.end()));
+    REQUIRE(heavy.Roads().size() == small.Roads().size());
+    for( std::size_t road = 0; road < heavy.Roads().size(); ++road ) {
+        CHECK_EQ(heavy.Roads()[road].way, small.Roads()[road].way);
+        CHECK(heavy.Roads()[road].type == small.Roads()[road].type);
+    }
+    CHECK_EQ(heavy.Graph().EdgeCount(), small.Graph().EdgeCount());
+}
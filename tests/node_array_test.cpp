@@ -0,0 +1,102 @@
+#include "flat_array.h"
+#include "mapped_file.h"
+#include "osm_fixture.h"
+#include "route_model.h"
+#include "snapshot.h"
+#include "test.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846264338327950288;
+
+double Lon2Xm(double lon) { return lon * kPi / 360. * 6378137.; }
+double Lat2Ym(double lat) { return std::log(std::tan(lat * kPi / 360. + kPi / 4)) / 2 * 6378137.; }
+
+}
+
+TEST(IndexingAssemblesTheNodeFromBothColumns)
+{
+    std::vector<double> xs{0.1, 0.2, 0.3}, ys{0.9, 0.8, 0.7};
+    Model::NodeArray nodes{xs, ys};
+    REQUIRE(nodes.size() == 3u);
+    CHECK(!nodes.empty());
+    for( std::size_t i = 0; i < nodes.size(); ++i ) {
+        CHECK_EQ(nodes[i].x, xs[i]);
+        CHECK_EQ(nodes[i].y, ys[i]);
+    }
+    CHECK(nodes.X().data() == xs.data());       // views, not copies
+    CHECK(nodes.Y().data() == ys.data());
+    CHECK(Model::NodeArray({}, {}).empty());
+}
+
+TEST(GridNodesKeepTheirIndexAndProjection)
+{
+    TempDir dir;
+    GridExtract().Write(dir / "grid.osm.pbf");
+    auto file = MappedFile::Open((dir / "grid.osm.pbf").string());
+    REQUIRE(file);
+    RouteModel model{*file};
+    auto nodes = model.Nodes();
+    const int n = 10;
+    REQUIRE(nodes.size() == std::size_t(n * n));
+    REQUIRE(nodes.X().size() == nodes.size() && nodes.Y().size() == nodes.size());
+
+    // The fixture's bounds, the shorter side spans 1.0.
+    const double min_lat = 40.70, min_lon = -74.02, lat_span = 0.1, lon_span = 0.12;
+    const auto scale = std::min(Lon2Xm(min_lon + lon_span) - Lon2Xm(min_lon), Lat2Ym(min_lat + lat_span) - Lat2Ym(min_lat));
+    CHECK_NEAR(model.MetricScale(), scale, 1e-6 * scale);
+    for( int row = 0; row < n; ++row )
+        for( int column = 0; column < n; ++column ) {
+            auto index = std::size_t(row * n + column);       // node id 1 + row * n + column, in file order
+            auto lat = min_lat + lat_span * row / (n - 1), lon = min_lon + lon_span * column / (n - 1);
+            CHECK_NEAR(nodes[index].x, (Lon2Xm(lon) - Lon2Xm(min_lon)) / scale, 1e-6);
+            CHECK_NEAR(nodes[index].y, (Lat2Ym(lat) - Lat2Ym(min_lat)) / scale, 1e-6);
+            CHECK_EQ(nodes[index].x, nodes.X()[index]);
+            CHECK_EQ(nodes[index].y, nodes.Y()[index]);
+        }
+}
+
+TEST(SnapshotNodesMatchTheLoadedOnes)
+{
+    TempDir dir;
+    GridExtract().Write(dir / "grid.osm.pbf");
+    auto file = MappedFile::Open((dir / "grid.osm.pbf").string());
+    REQUIRE(file);
+    RouteModel loaded{*file};
+    SnapshotWriter writer{loaded.MetricScale()};
+    loaded.Serialize(writer);
+    auto path = (dir / "grid.rms").string();
+    writer.Save(path);
+
+    auto snapshot = Snapshot::Open(path);
+    REQUIRE(snapshot);
+    RouteModel mapped{std::move(*snapshot)};
+    REQUIRE(mapped.Nodes().size() == loaded.Nodes().size());
+    for( std::size_t i = 0; i < mapped.Nodes().size(); ++i ) {
+        CHECK_EQ(mapped.Nodes()[i].x, loaded.Nodes()[i].x);
+        CHECK_EQ(mapped.Nodes()[i].y, loaded.Nodes()[i].y);
+    }
+}
+
+TEST(FlatArrayCopiesABorrowedViewBeforeModifying)
+{
+    std::vector<double> source{1., 2., 3.};
+    FlatArray<double> borrowed{Span<const double>{source}};
+    CHECK(borrowed.data() == source.data());
+    borrowed.Modify([](std::vector<double> &values) { values[1] = 20.; values.push_back(4.); });
+    CHECK(borrowed.data() != source.data());
+    CHECK_EQ(source[1], 2.);
+    REQUIRE(borrowed.size() == 4u);
+    CHECK_EQ(borrowed[1], 20.);
+    CHECK_EQ(borrowed[3], 4.);
+
+    FlatArray<double> owned{std::vector<double>{5., 6.}};
+    auto data = owned.data();
+    FlatArray<double> moved{std::move(owned)};
+    CHECK(moved.data() == data);                        // the view follows the moved buffer
+    moved.Modify([](std::vector<double> &values) { values[0] = 50.; });
+    CHECK_EQ(moved[0], 50.);
+    CHECK_EQ(moved.size(), 2u);
+}
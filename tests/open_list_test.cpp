@@ -0,0 +1,108 @@
+#include "open_list.h"
+#include "test.h"
+#include <algorithm>
+#include <map>
+#include <random>
+
+namespace {
+
+// Monotone workload like Dijkstra's: every push is at least the last popped
+// key, vertices are pushed again with smaller keys; checked against a map.
+template <typename Heap>
+void MatchesReference(std::uint32_t seed)
+{
+    constexpr std::uint32_t kVertices = 2000;
+    std::mt19937 random{seed};
+    Heap heap{kVertices};
+    std::map<std::uint32_t, float> queued;
+    std::vector<bool> done(kVertices, false);
+    auto last = 0.f;
+
+    auto push = [&](std::uint32_t v, float key) {
+        if( done[v] )
+            return;
+        heap.Push(v, key);
+        auto it = queued.find(v);
+        if( it == queued.end() )
+            queued.emplace(v, key);
+        else
+            it->second = std::min(it->second, key);
+    };
+    push(0, 0.f);
+    while( !heap.Empty() ) {
+        REQUIRE(!queued.empty());
+        auto expected = std::min_element(queued.begin(), queued.end(), [](auto &a, auto &b) { return a.second < b.second; });
+        CHECK_EQ(heap.TopKey(), expected->second);
+        auto key = heap.TopKey();
+        auto v = heap.Pop();
+        REQUIRE(queued.count(v));
+        CHECK_EQ(queued[v], key);           // ties may come out in any order, the key may not
+        CHECK(key >= last);
+        last = key;
+        queued.erase(v);
+        done[v] = true;
+        for( int i = 0; i < 4; ++i )
+            push(random() % kVertices, key + static_cast<float>(random() % 1000) * 0.5f);
+    }
+    CHECK(queued.empty());
+    CHECK(std::count(done.begin(), done.end(), true) > 100);
+}
+
+template <typename Heap>
+void DecreasesKeysAndClears()
+{
+    Heap heap{10};
+    heap.Push(3, 5.f);
+    heap.Push(4, 2.f);
+    heap.Push(3, 1.f);                      // decrease
+    heap.Push(4, 7.f);                      // not a decrease, ignored
+    CHECK(heap.Contains(3));
+    CHECK_EQ(heap.Key(3), 1.f);
+    CHECK_EQ(heap.Size(), 2u);
+    CHECK_EQ(heap.Pop(), 3u);
+    CHECK(!heap.Contains(3));
+    CHECK_EQ(heap.TopKey(), 2.f);
+    heap.Clear();
+    CHECK(heap.Empty());
+    CHECK(!heap.Contains(4));
+    heap.Push(4, 3.f);
+    CHECK_EQ(heap.Pop(), 4u);
+    CHECK(heap.Empty());
+}
+
+}
+
+TEST(IndexedHeapMatchesReference)
+{
+    for( std::uint32_t seed = 1; seed <= 3; ++seed )
+        MatchesReference<IndexedHeap>(seed);
+}
+
+TEST(RadixHeapMatchesReference)
+{
+    for( std::uint32_t seed = 1; seed <= 3; ++seed )
+        MatchesReference<RadixHeap>(seed);
+}
+
+TEST(IndexedHeapDecreasesKeysAndClears)
+{
+    DecreasesKeysAndClears<IndexedHeap>();
+}
+
+TEST(RadixHeapDecreasesKeysAndClears)
+{
+    DecreasesKeysAndClears<RadixHeap>();
+}
+
+TEST(RadixHeapClampsKeysBelowTheLastPop)
+{
+    RadixHeap heap{4};
+    heap.Push(0, 10.f);
+    CHECK_EQ(heap.Pop(), 0u);
+    heap.Push(1, 3.f);                      // would break monotonicity, clamped
+    heap.Push(2, -1.f);
+    CHECK_EQ(heap.TopKey(), 10.f);
+    heap.Pop();
+    heap.Pop();
+    CHECK(heap.Empty());
+}
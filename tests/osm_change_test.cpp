@@ -0,0 +1,155 @@
+#include "contraction_hierarchy.h"
+#include "osc_reader.h"
+#include "osm_fixture.h"
+#include "route_model.h"
+#include "route_planner.h"
+#include "test.h"
+#include <algorithm>
+
+namespace {
+
+// Grid ways are in file order: rows 1000.., then columns; row 5 is the primary.
+constexpr const char *kDiff = R"(<?xml version="1.0" encoding="UTF-8"?>
+<osmChange version="0.6" generator="test">
+  <create>
+    <node id="5000" version="1" lat="40.6990" lon="-74.0210"/>
+    <way id="9000" version="1">
+      <nd ref="5000"/>
+      <nd ref="1"/>
+      <tag k="highway" v="service"/>
+      <tag k="name" v="Alley &amp; Lane"/>
+    </way>
+  </create>
+  <modify>
+    <node id="12" version="2" lat="40.7115" lon="-74.0060"/>
+  </modify>
+  <delete>
+    <way id="1005" version="3"/>
+    <relation id="1" version="2"/>
+  </delete>
+</osmChange>
+)";
+
+struct Grid {
+    Grid()
+    {
+        GridExtract().Write(dir / "grid.osm.pbf");
+        model = std::make_unique<RouteModel>(dir / "grid.osm.pbf");
+    }
+
+    TempDir dir;
+    std::unique_ptr<RouteModel> model;
+};
+
+}
+
+TEST(ParsesCreateModifyAndDelete)
+{
+    auto change = ParseOsmChange(kDiff);
+    REQUIRE(change.nodes.size() == 2u);
+    CHECK_EQ(change.nodes[0].action, OsmChange::Create);
+    CHECK_EQ(change.nodes[0].id, 5000);
+    CHECK_NEAR(change.nodes[0].lat, 40.699, 1e-9);
+    CHECK_NEAR(change.nodes[0].lon, -74.021, 1e-9);
+    CHECK_EQ(change.nodes[1].action, OsmChange::Modify);
+    REQUIRE(change.ways.size() == 2u);
+    CHECK_EQ(change.ways[0].id, 9000);
+    CHECK(change.ways[0].refs == (std::vector<std::int64_t>{5000, 1}));
+    REQUIRE(change.ways[0].tags.size() == 2u);
+    CHECK_EQ(change.ways[0].tags[1].second, "Alley & Lane");
+    CHECK_EQ(change.ways[1].action, OsmChange::Delete);
+    CHECK_EQ(change.ways[1].id, 1005);
+    CHECK_EQ(change.relations, 1u);
+}
+
+TEST(RejectsMalformedDiffs)
+{
+    CHECK_THROWS(ParseOsmChange("<osm><node id=\"1\" lat=\"1\" lon=\"2\"/></osm>"));
+    CHECK_THROWS(ParseOsmChange("<osmChange><create><node id=\"x\" lat=\"1\" lon=\"2\"/></create></osmChange>"));
+    CHECK_THROWS(ParseOsmChange("<osmChange><create><node id=\"1\" lat=\"1\"/></create></osmChange>"));
+    CHECK_THROWS(ParseOsmChange("<osmChange><node id=\"1\" lat=\"1\" lon=\"2\"/></osmChange>"));
+    CHECK_THROWS(ParseOsmChange("<osmChange><create><way id=\"1\"><nd ref=\"1\"/>"));
+    CHECK_THROWS(ParseOsmChange("<osmChange><modify><node id=\"1\" lat=\"1\" lon=\"2\" user=\"&bogus;\"/></modify></osmChange>"));
+}
+
+TEST(AppliesNodesWaysAndRoads)
+{
+    Grid grid;
+    auto &model = *grid.model;
+    auto ways = model.Ways().size(), nodes = model.Nodes().size();
+    auto changes = model.Apply(ParseOsmChange(kDiff));
+    CHECK_EQ(model.Ways().size(), ways + 1);
+    CHECK_EQ(model.Nodes().size(), nodes + 1);
+    CHECK_EQ(changes.nodes.size(), 2u);             // node 12 moved, 5000 created
+    CHECK(std::is_sorted(changes.ways.begin(), changes.ways.end()));
+    CHECK(std::binary_search(changes.ways.begin(), changes.ways.end(), (int)ways));
+    CHECK(model.Ways()[5].nodes.empty());           // the deleted primary
+    CHECK_EQ(model.Roads()[5].type, Model::Road::Invalid);
+    CHECK_EQ(model.Roads().back().type, Model::Road::Service);
+
+    // the graph follows, the new node is routable and the primary is gone
+    auto created = model.Ways().back().nodes[0];
+    auto vertex = model.Graph().Vertex(created);
+    REQUIRE(vertex != RouteGraph::kNoVertex);
+    RoutePlanner planner{model};
+    auto route = planner.AStarSearch(vertex, model.Graph().Vertex(model.FindClosestNode(1.f, 1.f)));
+    REQUIRE(route);
+    CHECK_EQ(route->nodes.front(), created);
+}
+
+TEST(RebuildsTheHierarchyAndLandmarks)
+{
+    Grid grid;
+    auto &model = *grid.model;
+    model.BuildHierarchy();
+    model.BuildLandmarks(4);
+    model.Apply(ParseOsmChange(kDiff));
+    REQUIRE(!model.Hierarchy().Empty());
+    CHECK_EQ(model.Hierarchy().VertexCount(), model.Graph().VertexCount());
+    CHECK_EQ(model.GraphLandmarks().Count(), 4u);
+    CHECK_EQ(model.GraphLandmarks().VertexCount(), model.Graph().VertexCount());
+
+    RoutePlanner planner{model};
+    CHQuery ch{model.Hierarchy(), model.Graph()};
+    auto &graph = model.Graph();
+    for( std::uint32_t from = 0; from < graph.VertexCount(); from += 5 ) {
+        auto to = (from * 31 + 7) % graph.VertexCount();
+        auto expected = planner.AStarSearch(from, to), found = ch.Search(from, to);
+        REQUIRE(expected.has_value() == found.has_value());
+        if( found )
+            CHECK_NEAR(found->distance, expected->distance, 1e-3);
+    }
+}
+
+TEST(CodesOnlyTheChangedWaysAgain)
+{
+    Grid grid;
+    auto &model = *grid.model;
+    model.BuildGeometry();
+    std::vector<std::vector<Model::Node>> before;
+    for( std::size_t way = 0; way < model.Ways().size(); ++way )
+        before.push_back(model.Geometry().Points(way));
+
+    auto changes = model.Apply(ParseOsmChange(kDiff));
+    REQUIRE(model.Geometry().WayCount() == model.Ways().size());
+    for( std::size_t way = 0; way < before.size(); ++way ) {
+        auto points = model.Geometry().Points(way);
+        if( std::binary_search(changes.ways.begin(), changes.ways.end(), (int)way) ) {
+            CHECK_EQ(points.size(), model.Ways()[way].nodes.size());
+            continue;
+        }
+        REQUIRE(points.size() == before[way].size());       // the area rings too, which have no nodes any more
+        for( std::size_t i = 0; i < points.size(); ++i ) {
+            CHECK_EQ(points[i].x, before[way][i].x);
+            CHECK_EQ(points[i].y, before[way][i].y);
+        }
+    }
+    CHECK(model.Geometry().Points(5).empty());
+    CHECK_EQ(model.Geometry().Points(model.Ways().size() - 1).size(), 2u);
+
+    // row 1 runs through node 12, its geometry moved with it
+    auto row = model.Geometry().Points(1);
+    REQUIRE(row.size() == 10u);
+    CHECK_NEAR(row[1].x, model.Nodes()[model.Ways()[1].nodes[1]].x, 1e-6);
+    CHECK(row[1].x != before[1][1].x);
+}
@@ -0,0 +1,338 @@
+#include "osm_fixture.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace {
+
+// Protocol buffer encoding, just the wire types the reader understands.
+void Varint(std::string &out, std::uint64_t value)
+{
+    for( ; value >= 0x80; value >>= 7 )
+        out.push_back(static_cast<char>(value | 0x80));
+    out.push_back(static_cast<char>(value));
+}
+
+std::uint64_t Zigzag(std::int64_t value)
+{
+    return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+}
+
+void Key(std::string &out, int field, int wire_type)
+{
+    Varint(out, static_cast<std::uint64_t>(field) << 3 | wire_type);
+}
+
+void VarintField(std::string &out, int field, std::uint64_t value)
+{
+    Key(out, field, 0);
+    Varint(out, value);
+}
+
+void BytesField(std::string &out, int field, const std::string &bytes)
+{
+    Key(out, field, 2);
+    Varint(out, bytes.size());
+    out += bytes;
+}
+
+void PackedField(std::string &out, int field, const std::vector<std::uint64_t> &values)
+{
+    std::string packed;
+    for( auto value: values )
+        Varint(packed, value);
+    BytesField(out, field, packed);
+}
+
+std::vector<std::uint64_t> DeltaZigzag(const std::vector<std::int64_t> &values)
+{
+    std::vector<std::uint64_t> out;
+    std::int64_t last = 0;
+    for( auto value: values ) {
+        out.push_back(Zigzag(value - last));
+        last = value;
+    }
+    return out;
+}
+
+// One string table per block, index 0 is the empty string as the format requires.
+class StringTable {
+public:
+    std::uint64_t operator()(const std::string &s)
+    {
+        auto [it, added] = m_Index.emplace(s, m_Strings.size());
+        if( added )
+            m_Strings.push_back(s);
+        return it->second;
+    }
+
+    std::string Encode() const
+    {
+        std::string table;
+        for( auto &s: m_Strings )
+            BytesField(table, 1, s);
+        return table;
+    }
+
+private:
+    std::vector<std::string> m_Strings{""};
+    std::map<std::string, std::uint64_t> m_Index{{"", 0}};
+};
+
+std::string Frame(const std::string &type, const std::string &data, bool compressed)
+{
+    std::string blob;
+    if( compressed ) {
+        auto bound = compressBound(static_cast<uLong>(data.size()));
+        std::string packed(bound, '\0');
+        if( compress(reinterpret_cast<Bytef *>(packed.data()), &bound, reinterpret_cast<const Bytef *>(data.data()),
+                     static_cast<uLong>(data.size())) != Z_OK )
+            throw std::runtime_error("fixture: compress failed");
+        packed.resize(bound);
+        VarintField(blob, 2, data.size());
+        BytesField(blob, 3, packed);
+    } else {
+        BytesField(blob, 1, data);
+    }
+    std::string header;
+    BytesField(header, 1, type);
+    VarintField(header, 3, blob.size());
+
+    std::string frame;
+    auto size = static_cast<std::uint32_t>(header.size());
+    for( int shift = 24; shift >= 0; shift -= 8 )
+        frame.push_back(static_cast<char>(size >> shift));
+    return frame + header + blob;
+}
+
+std::string Block(const StringTable &strings, const std::string &group)
+{
+    std::string block;
+    BytesField(block, 1, strings.Encode());
+    BytesField(block, 2, group);
+    VarintField(block, 17, 100);            // granularity, nanodegrees
+    return block;
+}
+
+std::int64_t Fixed(double degrees)
+{
+    return std::llround(degrees * 1e7);     // units of the 100 nanodegree granularity
+}
+
+template <typename Entry>
+void Tags(std::string &out, StringTable &strings, const Entry &entry)
+{
+    std::vector<std::uint64_t> keys, values;
+    for( auto &tag: entry.tags ) {
+        keys.push_back(strings(tag.key));
+        values.push_back(strings(tag.value));
+    }
+    PackedField(out, 2, keys);
+    PackedField(out, 3, values);
+}
+
+}
+
+void PbfWriter::SetBounds(double min_lat, double min_lon, double max_lat, double max_lon)
+{
+    m_HasBounds = true;
+    m_Bounds[0] = min_lat;
+    m_Bounds[1] = min_lon;
+    m_Bounds[2] = max_lat;
+    m_Bounds[3] = max_lon;
+}
+
+void PbfWriter::AddNode(std::int64_t id, double lat, double lon)
+{
+    m_Nodes.push_back({id, lat, lon});
+}
+
+void PbfWriter::AddWay(std::int64_t id, std::vector<std::int64_t> refs, std::vector<Tag> tags)
+{
+    m_Ways.push_back({id, std::move(refs), std::move(tags)});
+}
+
+void PbfWriter::AddRelation(std::int64_t id, std::vector<Member> members, std::vector<Tag> tags)
+{
+    m_Relations.push_back({id, std::move(members), std::move(tags)});
+}
+
+std::string PbfWriter::Bytes() const
+{
+    std::string header;
+    if( m_HasBounds ) {
+        std::string bbox;
+        Key(bbox, 1, 0); Varint(bbox, Zigzag(std::llround(m_Bounds[1] * 1e9)));
+        Key(bbox, 2, 0); Varint(bbox, Zigzag(std::llround(m_Bounds[3] * 1e9)));
+        Key(bbox, 3, 0); Varint(bbox, Zigzag(std::llround(m_Bounds[2] * 1e9)));
+        Key(bbox, 4, 0); Varint(bbox, Zigzag(std::llround(m_Bounds[0] * 1e9)));
+        BytesField(header, 1, bbox);
+    }
+    BytesField(header, 4, "OsmSchema-V0.6");
+    BytesField(header, 4, "DenseNodes");
+    auto out = Frame("OSMHeader", header, m_Compressed);
+
+    auto block_size = std::max<std::size_t>(m_BlockSize, 1);
+    for( std::size_t first = 0; first < m_Nodes.size(); first += block_size ) {
+        auto last = std::min(m_Nodes.size(), first + block_size);
+        std::vector<std::int64_t> ids, lats, lons;
+        for( auto i = first; i < last; ++i ) {
+            ids.push_back(m_Nodes[i].id);
+            lats.push_back(Fixed(m_Nodes[i].lat));
+            lons.push_back(Fixed(m_Nodes[i].lon));
+        }
+        std::string dense, group;
+        PackedField(dense, 1, DeltaZigzag(ids));
+        PackedField(dense, 8, DeltaZigzag(lats));
+        PackedField(dense, 9, DeltaZigzag(lons));
+        BytesField(group, 2, dense);
+        out += Frame("OSMData", Block(StringTable{}, group), m_Compressed);
+    }
+
+    for( std::size_t first = 0; first < m_Ways.size(); first += block_size ) {
+        StringTable strings;
+        std::string group;
+        for( auto i = first; i < std::min(m_Ways.size(), first + block_size); ++i ) {
+            std::string way;
+            VarintField(way, 1, static_cast<std::uint64_t>(m_Ways[i].id));
+            Tags(way, strings, m_Ways[i]);
+            PackedField(way, 8, DeltaZigzag(m_Ways[i].refs));
+            BytesField(group, 3, way);
+        }
+        out += Frame("OSMData", Block(strings, group), m_Compressed);
+    }
+
+    for( std::size_t first = 0; first < m_Relations.size(); first += block_size ) {
+        StringTable strings;
+        std::string group;
+        for( auto i = first; i < std::min(m_Relations.size(), first + block_size); ++i ) {
+            auto &relation = m_Relations[i];
+            std::string encoded;
+            VarintField(encoded, 1, static_cast<std::uint64_t>(relation.id));
+            Tags(encoded, strings, relation);
+            std::vector<std::uint64_t> roles, types;
+            std::vector<std::int64_t> refs;
+            for( auto &member: relation.members ) {
+                roles.push_back(strings(member.role));
+                refs.push_back(member.ref);
+                types.push_back(member.type);
+            }
+            PackedField(encoded, 8, roles);
+            PackedField(encoded, 9, DeltaZigzag(refs));
+            PackedField(encoded, 10, types);
+            BytesField(group, 4, encoded);
+        }
+        out += Frame("OSMData", Block(strings, group), m_Compressed);
+    }
+    return out;
+}
+
+void PbfWriter::Write(const std::filesystem::path &path) const
+{
+    auto bytes = Bytes();
+    std::ofstream out{path, std::ios::binary};
+    if( !out.write(bytes.data(), static_cast<std::streamsize>(bytes.size())) )
+        throw std::runtime_error("fixture: cannot write " + path.string());
+}
+
+PbfWriter GridExtract(const GridOptions &options)
+{
+    const auto n = std::max(options.size, 2);
+    const double min_lat = 40.70, min_lon = -74.02, lat_span = 0.1, lon_span = 0.12;
+    std::mt19937 random{options.seed};
+    auto uniform = [&]{ return (random() >> 8) * (1. / 16777216.); };     // same sequence on every platform
+    auto id = [n](int row, int column) { return std::int64_t{1} + std::int64_t{row} * n + column; };
+
+    PbfWriter writer;
+    writer.SetBounds(min_lat, min_lon, min_lat + lat_span, min_lon + lon_span);
+    std::vector<std::pair<double, double>> coordinates;
+    for( int row = 0; row < n; ++row )
+        for( int column = 0; column < n; ++column ) {
+            auto lat = min_lat + lat_span * (row + options.jitter * (uniform() - .5)) / (n - 1);
+            auto lon = min_lon + lon_span * (column + options.jitter * (uniform() - .5)) / (n - 1);
+            writer.AddNode(id(row, column), lat, lon);
+            coordinates.emplace_back(lat, lon);
+        }
+    const std::int64_t twin_ids = id(n, 0) + 1000;
+    if( options.twins )
+        for( int row = 0; row < n; ++row ) {
+            auto [lat, lon] = coordinates[row * n + n / 2];
+            writer.AddNode(twin_ids + 2 * row, lat, lon);
+            writer.AddNode(twin_ids + 2 * row + 1, lat, lon);
+        }
+
+    std::int64_t way_id = 1000;
+    auto street = [&](std::vector<std::int64_t> refs, const std::string &type) {
+        std::vector<std::int64_t> piece{refs.front()};
+        for( std::size_t i = 1; i < refs.size(); ++i ) {
+            piece.push_back(refs[i]);
+            if( options.split_ways && i + 1 < refs.size() && uniform() < 0.2 ) {
+                writer.AddWay(way_id++, piece, {{"highway", type}});
+                piece.assign(1, refs[i]);
+            }
+        }
+        writer.AddWay(way_id++, piece, {{"highway", type}});
+    };
+    for( int row = 0; row < n; ++row ) {
+        auto type = row == n / 2 ? "primary" : "residential";
+        std::vector<std::int64_t> west, east;
+        for( int column = 0; column <= n / 2; ++column )
+            west.push_back(id(row, column));
+        if( !options.twins )
+            west.pop_back();
+        else
+            east.push_back(twin_ids + 2 * row + 1);
+        for( int column = options.twins ? n / 2 + 1 : n / 2; column < n; ++column )
+            east.push_back(id(row, column));
+        if( options.twins ) {
+            street(west, type);
+            writer.AddWay(way_id++, {id(row, n / 2), twin_ids + 2 * row, twin_ids + 2 * row + 1}, {{"highway", type}});
+            street(east, type);
+        } else {
+            west.insert(west.end(), east.begin(), east.end());
+            street(west, type);
+        }
+    }
+    for( int column = 0; column < n; ++column ) {
+        std::vector<std::int64_t> refs;
+        for( int row = 0; row < n; ++row )
+            refs.push_back(id(row, column));
+        street(refs, column == 1 ? "footway" : "residential");
+    }
+
+    if( options.areas && n >= 4 ) {
+        writer.AddWay(way_id++, {id(0, 0), id(0, 1), id(1, 1), id(1, 0), id(0, 0)}, {{"building", "yes"}});
+        writer.AddWay(way_id++, {id(2, 2), id(2, 3), id(3, 3), id(3, 2), id(2, 2)}, {{"leisure", "park"}});
+        // water from two open halves, landuse with a closed outer and inner ring
+        auto water_a = way_id++, water_b = way_id++, outer = way_id++, inner = way_id++;
+        writer.AddWay(water_a, {id(1, 2), id(1, 3), id(2, 3)}, {});
+        writer.AddWay(water_b, {id(1, 2), id(2, 2), id(2, 3)}, {});
+        writer.AddWay(outer, {id(0, 0), id(0, 3), id(3, 3), id(3, 0), id(0, 0)}, {});
+        writer.AddWay(inner, {id(1, 1), id(1, 2), id(2, 2), id(2, 1), id(1, 1)}, {});
+        writer.AddRelation(1, {{PbfWriter::Member::Way, water_a, "outer"}, {PbfWriter::Member::Way, water_b, "outer"}},
+                           {{"type", "multipolygon"}, {"natural", "water"}});
+        writer.AddRelation(2, {{PbfWriter::Member::Way, outer, "outer"}, {PbfWriter::Member::Way, inner, "inner"}},
+                           {{"type", "multipolygon"}, {"landuse", "grass"}});
+    }
+    return writer;
+}
+
+TempDir::TempDir()
+{
+    static std::atomic<int> counter{0};
+    m_Path = std::filesystem::temp_directory_path() /
+             ("routems-test-" + std::to_string(::getpid()) + "-" + std::to_string(counter++));
+    std::filesystem::create_directories(m_Path);
+}
+
+TempDir::~TempDir()
+{
+    std::error_code error;
+    std::filesystem::remove_all(m_Path, error);
+}
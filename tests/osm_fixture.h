@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Writes small .osm.pbf extracts for the tests: dense nodes, ways and
+// relations in sorted order, split into blocks of a given size, zlib
+// compressed or raw.
+class PbfWriter {
+public:
+    struct Tag {
+        std::string key;
+        std::string value;
+    };
+
+    struct Member {
+        enum Type { Node, Way, Relation };
+        Type type;
+        std::int64_t ref;
+        std::string role;
+    };
+
+    void SetBounds(double min_lat, double min_lon, double max_lat, double max_lon);
+    void SetBlockSize(std::size_t entities) { m_BlockSize = entities; }
+    void SetCompressed(bool compressed) { m_Compressed = compressed; }
+
+    void AddNode(std::int64_t id, double lat, double lon);
+    void AddWay(std::int64_t id, std::vector<std::int64_t> refs, std::vector<Tag> tags);
+    void AddRelation(std::int64_t id, std::vector<Member> members, std::vector<Tag> tags);
+
+    std::string Bytes() const;
+    void Write(const std::filesystem::path &path) const;        // throws std::runtime_error
+
+private:
+    struct NodeEntry { std::int64_t id; double lat, lon; };
+    struct WayEntry { std::int64_t id; std::vector<std::int64_t> refs; std::vector<Tag> tags; };
+    struct RelationEntry { std::int64_t id; std::vector<Member> members; std::vector<Tag> tags; };
+
+    bool m_HasBounds = false;
+    double m_Bounds[4] = {};
+    std::size_t m_BlockSize = 8000;
+    bool m_Compressed = true;
+    std::vector<NodeEntry> m_Nodes;
+    std::vector<WayEntry> m_Ways;
+    std::vector<RelationEntry> m_Relations;
+};
+
+// A size x size grid of streets around lower Manhattan: residential rows and
+// columns, the middle row primary. Node (row, column) has id 1 + row * size + column.
+struct GridOptions {
+    int size = 10;
+    double jitter = 0.;             // of the node positions, in grid cells
+    std::uint32_t seed = 7;
+    bool split_ways = false;        // cut the streets into several ways at random nodes
+    bool twins = false;             // route every row over two extra nodes at the coordinates of its middle node
+    bool areas = true;              // a building, a leisure way and water and landuse multipolygons with open rings
+};
+
+PbfWriter GridExtract(const GridOptions &options = {});
+
+// A fresh directory under the system temp directory, removed with everything in it.
+class TempDir {
+public:
+    TempDir();
+    TempDir(const TempDir &) = delete;
+    TempDir &operator=(const TempDir &) = delete;
+    ~TempDir();
+
+    const std::filesystem::path &Path() const noexcept { return m_Path; }
+    std::filesystem::path operator/(const std::string &name) const { return m_Path / name; }
+
+private:
+    std::filesystem::path m_Path;
+};
@@ -0,0 +1,159 @@
+#include "mapped_file.h"
+#include "osm_fixture.h"
+#include "pbf_reader.h"
+#include "route_model.h"
+#include "test.h"
+#include "thread_pool.h"
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+
+std::vector<std::byte> ToBytes(const std::string &s)
+{
+    std::vector<std::byte> bytes(s.size());
+    std::memcpy(bytes.data(), s.data(), s.size());
+    return bytes;
+}
+
+}
+
+TEST(HandsOutBlocksInFileOrderOnASharedPool)
+{
+    auto writer = GridExtract();
+    writer.SetBlockSize(3);
+    auto bytes = ToBytes(writer.Bytes());
+    PbfReader reader{bytes.data(), bytes.size()};
+    REQUIRE(reader.Bounds());
+    CHECK_NEAR(reader.Bounds()->min_lat, 40.70, 1e-9);
+
+    ThreadPool pool{4};
+    std::vector<std::int64_t> ids;
+    reader.Read([&](OsmBlock &block) {
+        for( auto &node: block.nodes )
+            ids.push_back(node.id);
+    }, pool);
+    REQUIRE(ids.size() == 100u);
+    for( std::size_t i = 0; i < ids.size(); ++i )
+        CHECK_EQ(ids[i], static_cast<std::int64_t>(i + 1));
+}
+
+TEST(RejectsTruncatedAndCorruptInput)
+{
+    auto bytes = ToBytes(GridExtract().Bytes());
+    auto truncated = bytes;
+    truncated.resize(bytes.size() - 10);
+    CHECK_THROWS(PbfReader(truncated.data(), truncated.size()));
+
+    auto corrupt = bytes;
+    for( std::size_t i = 40; i < corrupt.size(); i += 7 )
+        corrupt[i] = std::byte{0x5a};
+    CHECK_THROWS(PbfReader(corrupt.data(), corrupt.size()).Read([](OsmBlock &) {}));
+}
+
+TEST(ModelConstructionThrowsOnBadExtracts)
+{
+    TempDir dir;
+    {
+        std::ofstream out{dir / "garbage.osm.pbf", std::ios::binary};
+        out << "this is not a pbf file at all";
+    }
+    CHECK_THROWS(RouteModel{dir / "garbage.osm.pbf"});
+
+    PbfWriter empty;                        // a valid file without nodes
+    empty.Write(dir / "empty.osm.pbf");
+    auto file = MappedFile::Open((dir / "empty.osm.pbf").string());
+    REQUIRE(file);
+    auto threw = false;
+    try {
+        RouteModel model{*file};
+    } catch( const std::logic_error & ) {
+        threw = true;
+    }
+    CHECK(threw);
+}
+
+TEST(ReadFileMatchesTheMappedReader)
+{
+    TempDir dir;
+    GridOptions options;
+    options.size = 40;
+    auto writer = GridExtract(options);
+    writer.SetBlockSize(50);
+    writer.SetCompressed(true);
+    writer.Write(dir / "grid.osm.pbf");
+
+    auto file = MappedFile::Open((dir / "grid.osm.pbf").string());
+    REQUIRE(file);
+    PbfReader mapped{file->data(), file->size()};
+    std::vector<std::int64_t> expected, read;
+    auto collect = [](std::vector<std::int64_t> &ids) {
+        return [&ids](OsmBlock &block) {
+            for( auto &node: block.nodes )
+                ids.push_back(node.id);
+            for( auto &way: block.ways )
+                ids.push_back(-way.id);
+        };
+    };
+    mapped.Read(collect(expected), 2);
+    auto bounds = PbfReader::ReadFile((dir / "grid.osm.pbf").string(), collect(read), 2);
+    REQUIRE(bounds && mapped.Bounds());
+    CHECK_EQ(bounds->max_lon, mapped.Bounds()->max_lon);
+    CHECK(read.size() > 1600u + 80u);        // roads and the areas
+    CHECK(read == expected);
+    CHECK_THROWS(PbfReader::ReadFile((dir / "missing.osm.pbf").string(), [](OsmBlock &) {}));
+}
+
+TEST(ReadFileFailsOnCorruptBlobsWithoutStalling)
+{
+    TempDir dir;
+    auto writer = GridExtract();
+    writer.SetBlockSize(3);
+    writer.SetCompressed(true);
+    auto bytes = ToBytes(writer.Bytes());
+    {
+        PbfReader reader{bytes.data(), bytes.size()};
+        for( auto &frame: reader.Frames() )         // inside the zlib data, the frames stay intact
+            bytes[frame.data - bytes.data() + frame.size / 2] ^= std::byte{0xff};
+    }
+    {
+        std::ofstream out{dir / "corrupt.osm.pbf", std::ios::binary};
+        out.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    }
+    // every decode fails, ReadFile rethrows the first failure and gets all the buffers back
+    CHECK_THROWS(PbfReader::ReadFile((dir / "corrupt.osm.pbf").string(), [](OsmBlock &) {}, 1));
+}
+
+TEST(RejectsOversizedFramesBeforeAllocating)
+{
+    TempDir dir;
+    // a BlobHeader length over the 64 KiB limit, followed by enough bytes to hold it
+    std::string frame{"\x00\x02\x00\x00", 4};
+    frame.resize(4 + 0x20000, 'x');
+    {
+        std::ofstream out{dir / "header.osm.pbf", std::ios::binary};
+        out << frame;
+    }
+    auto bytes = ToBytes(frame);
+    CHECK_THROWS(PbfReader(bytes.data(), bytes.size()));
+    CHECK_THROWS(PbfReader::ReadFile((dir / "header.osm.pbf").string(), [](OsmBlock &) {}));
+
+    // a header length past the end of the file: 0xffffffff
+    auto huge = ToBytes(std::string{"\xff\xff\xff\xff", 4} + "abc");
+    CHECK_THROWS(PbfReader(huge.data(), huge.size()));
+
+    // a zlib blob claiming to inflate to 1 TiB
+    std::string blob = "\x10";
+    for( std::uint64_t v = std::uint64_t{1} << 40; v; v >>= 7 )
+        blob += static_cast<char>((v & 0x7f) | (v >= 0x80 ? 0x80 : 0));
+    blob += "\x1a\x03xyz";
+    auto blob_bytes = ToBytes(blob);
+    auto threw_early = false;
+    try {
+        PbfReader::Inflate({blob_bytes.data(), blob_bytes.size()});
+    } catch( const std::runtime_error &e ) {
+        threw_early = std::string{e.what()} == "pbf: inflated blob too large";
+    }
+    CHECK(threw_early);
+}
@@ -0,0 +1,109 @@
+#include "road_batches.h"
+#include "test.h"
+#include <random>
+
+namespace {
+
+struct Batch {
+    std::uint32_t key;
+    std::vector<std::uint32_t> roads;
+    std::vector<int> versions;          // of the roads when the batch was built
+    int built;                          // build call that made it
+};
+
+// Records the roads and their versions, and counts the calls in *calls as
+// UpdateBatches() takes it by value.
+struct Builder {
+    const std::vector<int> *versions;
+    int *calls;
+
+    template <typename It>
+    Batch operator()(std::uint32_t key, It first, It last) const {
+        Batch batch{key, {first, last}, {}, (*calls)++};
+        for( auto road: batch.roads )
+            batch.versions.push_back((*versions)[road]);
+        return batch;
+    }
+};
+
+bool SameContent(const std::vector<Batch> &a, const std::vector<Batch> &b)
+{
+    if( a.size() != b.size() )
+        return false;
+    for( std::size_t i = 0; i < a.size(); ++i )
+        if( a[i].key != b[i].key || a[i].roads != b[i].roads || a[i].versions != b[i].versions )
+            return false;
+    return true;
+}
+
+}
+
+TEST(IncrementalUpdatesMatchAFullRebuild)
+{
+    std::mt19937 random{8};
+    std::vector<std::uint32_t> keys, old_keys;
+    std::vector<int> versions;              // bumped when a road's geometry changes
+    for( int i = 0; i < 300; ++i ) {
+        keys.push_back(random() % 40 == 0 ? kNoRoadBatch : random() % 25);
+        versions.push_back(0);
+    }
+    auto calls = 0;
+    Builder builder{&versions, &calls};
+    auto all = [](std::size_t){ return true; };
+    std::vector<Batch> batches;
+    batches = UpdateBatches(batches, old_keys, keys, all, builder);
+
+    for( int round = 0; round < 50; ++round ) {
+        old_keys = keys;
+        std::vector<bool> dirty(keys.size(), false);
+        for( int edit = 0; edit < 4; ++edit ) {
+            auto road = random() % keys.size();
+            switch( random() % 4 ) {
+                case 0: ++versions[road]; dirty[road] = true; break;                  // moved nodes, same cell
+                case 1: keys[road] = random() % 25; ++versions[road]; dirty[road] = true; break;    // moved cells
+                case 2: keys[road] = kNoRoadBatch; dirty[road] = true; break;        // retired
+                default: keys[road] = random() % 25; break;                        // retyped, geometry the same
+            }
+        }
+        for( int added = random() % 3; added > 0; --added ) {
+            keys.push_back(random() % 30);
+            versions.push_back(0);
+        }
+
+        auto builds_before = calls;
+        auto incremental = UpdateBatches(batches, old_keys, keys, [&](std::size_t i){ return dirty[i]; }, builder);
+        auto rebuilt_now = calls - builds_before;
+        std::vector<Batch> empty;
+        auto full_calls = 0;
+        Builder full_builder{&versions, &full_calls};
+        auto full = UpdateBatches(empty, {}, keys, all, full_builder);
+        REQUIRE(SameContent(incremental, full));
+        CHECK(rebuilt_now > 0);
+        CHECK(rebuilt_now < full_calls);                  // some batches were moved over as they were
+        for( std::size_t b = 1; b < incremental.size(); ++b )
+            CHECK(incremental[b - 1].key < incremental[b].key);
+        batches = std::move(incremental);
+    }
+}
+
+TEST(UnchangedRoadsKeepTheirBatches)
+{
+    std::vector<std::uint32_t> keys{3, 1, 3, kNoRoadBatch, 1, 2};
+    std::vector<int> versions(keys.size(), 0);
+    auto calls = 0;
+    Builder builder{&versions, &calls};
+    std::vector<Batch> batches;
+    batches = UpdateBatches(batches, {}, keys, [](std::size_t){ return true; }, builder);
+    REQUIRE(batches.size() == 3u);
+    CHECK(batches[0].roads == (std::vector<std::uint32_t>{1, 4}));
+    CHECK(batches[2].roads == (std::vector<std::uint32_t>{0, 2}));
+
+    auto old_keys = keys;
+    keys[5] = 1;                            // leaves batch 2, which is gone, and joins batch 1
+    auto next = UpdateBatches(batches, old_keys, keys, [](std::size_t){ return false; }, builder);
+    REQUIRE(next.size() == 2u);
+    CHECK(next[0].roads == (std::vector<std::uint32_t>{1, 4, 5}));
+    CHECK(next[0].built == 3);              // rebuilt
+    CHECK_EQ(next[1].key, 3u);
+    CHECK(next[1].built == 2);              // moved over
+}
@@ -0,0 +1,132 @@
+#include "lru_cache.h"
+#include "route_cache.h"
+#include "test.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::shared_ptr<const Route> MakeRoute(float distance)
+{
+    auto route = std::make_shared<Route>();
+    route->distance = distance;
+    route->nodes = {1, 2, 3};
+    return route;
+}
+
+}
+
+TEST(LruCacheEvictsTheLeastRecentlyUsed)
+{
+    LruCache<int, int> cache{3};
+    cache.Insert(1, 10);
+    cache.Insert(2, 20);
+    cache.Insert(3, 30);
+    REQUIRE(cache.Find(1));                 // 2 is the oldest now
+    cache.Insert(4, 40);
+    CHECK_EQ(cache.Size(), 3u);
+    CHECK(!cache.Contains(2));
+    CHECK_EQ(*cache.Find(1), 10);
+    cache.Insert(3, 31);                    // replaces and refreshes
+    cache.Insert(5, 50);
+    CHECK(!cache.Contains(4));
+    CHECK_EQ(*cache.Find(3), 31);
+    cache.EraseIf([](int key, int) { return key % 2 == 1; });
+    CHECK_EQ(cache.Size(), 0u);
+    cache.Insert(6, 60);
+    cache.SetCapacity(0);
+    CHECK_EQ(cache.Size(), 0u);
+}
+
+TEST(FindsWhatWasInsertedUnderTheSameKey)
+{
+    RouteCache cache{64};
+    RouteCache::Key key{1, 2, RouteCache::AStar, 0};
+    CHECK(!cache.Find(key));
+    cache.Insert(key, MakeRoute(5.f));
+    auto found = cache.Find(key);
+    REQUIRE(found);
+    CHECK_EQ(found->distance, 5.f);
+
+    // every field takes part
+    CHECK(!cache.Find({2, 1, RouteCache::AStar, 0}));
+    CHECK(!cache.Find({1, 2, RouteCache::CH, 0}));
+    CHECK(!cache.Find({1, 2, RouteCache::AStar, 1}));
+    CHECK_EQ(cache.Size(), 1u);
+}
+
+TEST(IsOffAtCapacityZero)
+{
+    RouteCache cache{0};
+    CHECK(!cache.Enabled());
+    cache.Insert({1, 2, RouteCache::AStar, 0}, MakeRoute(1.f));
+    CHECK(!cache.Find({1, 2, RouteCache::AStar, 0}));
+    CHECK_EQ(cache.Size(), 0u);
+}
+
+TEST(StaysWithinItsCapacity)
+{
+    RouteCache cache{64};
+    RouteCache::Key first{0, 1, RouteCache::AStar, 0};
+    auto held = MakeRoute(7.f);
+    cache.Insert(first, held);
+    auto kept = cache.Find(first);
+    for( std::uint32_t i = 1; i < 10000; ++i )
+        cache.Insert({i, i + 1, RouteCache::AStar, 0}, MakeRoute(static_cast<float>(i)));
+    CHECK(cache.Size() <= 64u);
+    CHECK(cache.Size() >= 64u - RouteCache::kShards);
+    REQUIRE(kept);                          // evicted by now, but still valid while held
+    CHECK_EQ(kept->distance, 7.f);
+}
+
+TEST(InvalidateDropsOnlyOlderTrafficRoutes)
+{
+    RouteCache cache{256};
+    for( std::uint64_t version = 0; version < 4; ++version )
+        cache.Insert({1, 2, RouteCache::Fastest, version}, MakeRoute(1.f));
+    cache.Insert({1, 2, RouteCache::CH, 0}, MakeRoute(1.f));
+    cache.Insert({1, 2, RouteCache::Bike, 0}, MakeRoute(1.f));
+    cache.Invalidate(2);
+    CHECK(!cache.Find({1, 2, RouteCache::Fastest, 0}));
+    CHECK(!cache.Find({1, 2, RouteCache::Fastest, 1}));
+    CHECK(cache.Find({1, 2, RouteCache::Fastest, 2}));
+    CHECK(cache.Find({1, 2, RouteCache::Fastest, 3}));
+    CHECK(cache.Find({1, 2, RouteCache::CH, 0}));
+    CHECK(cache.Find({1, 2, RouteCache::Bike, 0}));
+    CHECK_EQ(cache.Size(), 4u);
+
+    cache.Invalidate(2);                    // nothing older left
+    CHECK_EQ(cache.Size(), 4u);
+    cache.Insert({3, 4, RouteCache::Fastest, 0}, MakeRoute(1.f));
+    cache.Invalidate(3);                    // the late old route and version 2 go
+    CHECK(!cache.Find({3, 4, RouteCache::Fastest, 0}));
+    CHECK(!cache.Find({1, 2, RouteCache::Fastest, 2}));
+    CHECK(cache.Find({1, 2, RouteCache::Fastest, 3}));
+    CHECK_EQ(cache.Size(), 3u);
+}
+
+TEST(TakesConcurrentWorkers)
+{
+    RouteCache cache{1024};
+    std::vector<std::thread> workers;
+    std::atomic<int> wrong{0};
+    for( std::uint32_t t = 0; t < 8; ++t )
+        workers.emplace_back([&, t] {
+            for( std::uint32_t i = 0; i < 5000; ++i ) {
+                RouteCache::Key key{i % 300, t, RouteCache::AStar, 0};
+                if( auto route = cache.Find(key) ) {
+                    if( route->distance != static_cast<float>(i % 300 + t) )
+                        ++wrong;
+                } else {
+                    cache.Insert(key, MakeRoute(static_cast<float>(i % 300 + t)));
+                }
+                if( t == 0 && i % 1000 == 0 )
+                    cache.Invalidate(i);
+            }
+        });
+    for( auto &worker: workers )
+        worker.join();
+    CHECK_EQ(wrong.load(), 0);
+    CHECK(cache.Size() <= 1024u);
+}
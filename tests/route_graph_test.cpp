@@ -0,0 +1,43 @@
+#include "osm_fixture.h"
+#include "route_model.h"
+#include "test.h"
+#include <random>
+
+// The vector kernel and its scalar tail must give Distance() bit for bit, for
+// every run length including those that aren't a multiple of four, and must
+// not write past the end of the run.
+TEST(TargetDistancesMatchDistanceForEveryRunLength)
+{
+    TempDir dir;
+    GridOptions options;
+    options.size = 12;
+    options.jitter = 0.8;
+    GridExtract(options).Write(dir / "grid.osm.pbf");
+    RouteModel model{dir / "grid.osm.pbf"};
+    auto &graph = model.Graph();
+    REQUIRE(graph.EdgeCount() > 64u);
+
+    std::mt19937 random{31};
+    constexpr float kCanary = -1.f;
+    std::vector<float> out;
+    for( std::uint32_t length = 0; length <= 19; ++length )
+        for( int trial = 0; trial < 25; ++trial ) {
+            auto first = random() % (graph.EdgeCount() - length + 1);
+            auto to = random() % graph.VertexCount();
+            out.assign(length + 4, kCanary);
+            graph.TargetDistances(first, first + length, to, out.data());
+            for( std::uint32_t i = 0; i < length; ++i )
+                CHECK_EQ(out[i], graph.Distance(graph.Target(first + i), to));
+            for( auto i = length; i < out.size(); ++i )
+                CHECK_EQ(out[i], kCanary);
+        }
+
+    // the out-edges of every vertex, as the search calls it
+    for( std::uint32_t v = 0; v < graph.VertexCount(); ++v ) {
+        auto first = graph.FirstEdge(v), last = graph.FirstEdge(v + 1);
+        out.assign(last - first, kCanary);
+        graph.TargetDistances(first, last, v, out.data());
+        for( auto e = first; e < last; ++e )
+            CHECK_EQ(out[e - first], graph.Distance(graph.Target(e), v));
+    }
+}
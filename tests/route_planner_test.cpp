@@ -0,0 +1,109 @@
+#include "osm_fixture.h"
+#include "route_model.h"
+#include "route_planner.h"
+#include "test.h"
+
+namespace {
+
+constexpr int kSize = 10;
+
+std::unique_ptr<RouteModel> BuildModel(const TempDir &dir)
+{
+    GridOptions options;
+    options.size = kSize;
+    options.areas = false;
+    GridExtract(options).Write(dir / "grid.osm.pbf");
+    return std::make_unique<RouteModel>(dir / "grid.osm.pbf");
+}
+
+// Grid node ids are 1 + row * size + column and come first, so this is their model index.
+std::uint32_t At(const RouteModel &model, int row, int column)
+{
+    return model.Graph().Vertex(row * kSize + column);
+}
+
+// True if every step of the route runs over an edge the profile may use.
+template <typename Profile>
+bool UsesOnlyOpenRoads(const RouteModel &model, const Route &route)
+{
+    auto &graph = model.Graph();
+    for( std::size_t n = 1; n < route.nodes.size(); ++n ) {
+        auto u = graph.Vertex(route.nodes[n - 1]), v = graph.Vertex(route.nodes[n]);
+        auto open = false;
+        for( auto e = graph.FirstEdge(u); e < graph.FirstEdge(u + 1); ++e )
+            open = open || (graph.Target(e) == v && Profile::kAccess[graph.Type(e)]);
+        if( !open )
+            return false;
+    }
+    return true;
+}
+
+}
+
+TEST(FootAndBikeTakeTheFootwayCarsMayNot)
+{
+    TempDir dir;
+    auto model = BuildModel(dir);
+    RoutePlanner planner{*model};
+    auto from = At(*model, 0, 1), to = At(*model, kSize - 1, 1);       // both ends of the footway column
+
+    auto car = planner.AStarSearch<CarProfile>(from, to);
+    auto foot = planner.AStarSearch<FootProfile>(from, to);
+    auto bike = planner.AStarSearch<BikeProfile>(from, to);
+    REQUIRE(car && foot && bike);
+    CHECK(UsesOnlyOpenRoads<CarProfile>(*model, *car));
+    CHECK_EQ(foot->nodes.size(), (std::size_t)kSize);          // straight down the column
+    for( auto node: foot->nodes )
+        CHECK_EQ(node % kSize, 1);
+    CHECK_EQ(bike->distance, foot->distance);
+    CHECK(car->distance > foot->distance * 1.1f);               // around over a neighbouring column
+}
+
+TEST(FastestLeavesTheShortestPathForThePrimaryRow)
+{
+    TempDir dir;
+    auto model = BuildModel(dir);
+    RoutePlanner planner{*model};
+    auto row = kSize / 2 - 1;                   // residential, the primary row runs next to it
+    auto from = At(*model, row, 0), to = At(*model, row, kSize - 1);
+
+    auto shortest = planner.AStarSearch<CarProfile>(from, to);
+    auto fastest = planner.FastestSearch<CarProfile>(from, to);
+    REQUIRE(shortest && fastest);
+    CHECK_EQ(shortest->nodes.size(), (std::size_t)kSize);
+    CHECK(fastest->distance > shortest->distance);
+    auto residential = shortest->distance / CarProfile::kSpeed[Model::Road::Residential];
+    CHECK(fastest->duration < residential * 0.9f);
+    auto on_primary = 0;
+    for( auto node: fastest->nodes )
+        on_primary += node / kSize == kSize / 2;
+    CHECK(on_primary >= kSize - 2);
+    CHECK(UsesOnlyOpenRoads<CarProfile>(*model, *fastest));
+
+    // walking has one speed everywhere, so the fastest path is the shortest
+    auto walk = planner.FastestSearch<FootProfile>(from, to);
+    REQUIRE(walk);
+    CHECK_NEAR(walk->distance, shortest->distance, 1e-2);
+    CHECK_NEAR(walk->duration, shortest->distance / FootProfile::kSpeed[Model::Road::Residential], 1e-1);
+}
+
+TEST(FastestAtDefaultSpeedsMatchesTheGraphDurations)
+{
+    TempDir dir;
+    auto model = BuildModel(dir);
+    RoutePlanner planner{*model};
+    auto &graph = model->Graph();
+    auto route = planner.FastestSearch<CarProfile>(At(*model, 0, 0), At(*model, kSize - 1, kSize - 1));
+    REQUIRE(route);
+    auto seconds = 0.f;
+    for( std::size_t n = 1; n < route->nodes.size(); ++n ) {
+        auto u = graph.Vertex(route->nodes[n - 1]), v = graph.Vertex(route->nodes[n]);
+        auto best = -1.f;
+        for( auto e = graph.FirstEdge(u); e < graph.FirstEdge(u + 1); ++e )
+            if( graph.Target(e) == v && CarProfile::kAccess[graph.Type(e)] && (best < 0.f || graph.Duration(e) < best) )
+                best = graph.Duration(e);
+        REQUIRE(best >= 0.f);
+        seconds += best;
+    }
+    CHECK_NEAR(route->duration, seconds, 1e-2 * seconds);
+}
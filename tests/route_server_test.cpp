@@ -0,0 +1,203 @@
+#include "osm_fixture.h"
+#include "route_server.h"
+#include "test.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+namespace {
+
+struct Grid {
+    Grid()
+    {
+        GridOptions options;
+        options.jitter = 0.3;
+        GridExtract(options).Write(dir / "grid.osm.pbf");
+        model = std::make_unique<RouteModel>(dir / "grid.osm.pbf");
+        model->BuildHierarchy();
+    }
+
+    TempDir dir;
+    std::unique_ptr<RouteModel> model;
+};
+
+std::vector<std::string> Fields(const std::string &reply)
+{
+    std::istringstream in{reply};
+    std::vector<std::string> fields;
+    for( std::string field; in >> field; )
+        fields.push_back(field);
+    return fields;
+}
+
+int Connect(std::uint16_t port)
+{
+    auto fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if( fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// one reply line, or "" if none came within five seconds
+std::string ReadLine(int fd)
+{
+    timeval timeout{5, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    std::string line;
+    char c;
+    while( ::recv(fd, &c, 1, 0) == 1 && c != '\n' )
+        line += c;
+    return line;
+}
+
+// everything the server sends until it closes the connection
+std::string ReadAll(int fd)
+{
+    std::string received;
+    char buffer[4096];
+    for( ssize_t n; (n = ::recv(fd, buffer, sizeof(buffer), 0)) > 0; )
+        received.append(buffer, n);
+    return received;
+}
+
+}
+
+TEST(AnswersRoutesOfEveryEngine)
+{
+    Grid grid;
+    RouteServer server{*grid.model, 1, 0};
+    auto astar = Fields(server.HandleRequest(0, "route 5 5 95 90 astar"));
+    auto ch = Fields(server.HandleRequest(0, "route 5 5 95 90 ch"));
+    auto fastest = Fields(server.HandleRequest(0, "route 5 5 95 90 fastest"));
+    REQUIRE(astar.size() == 4 && ch.size() == 4 && fastest.size() == 5);
+    CHECK_EQ(astar[0], "ok");
+    CHECK_EQ(ch[0], "ok");
+    CHECK_EQ(fastest[0], "ok");
+    CHECK_NEAR(std::stod(ch[1]), std::stod(astar[1]), 1e-2);
+    CHECK(std::stod(astar[1]) > 0.);
+    CHECK(std::stod(fastest[4]) > 0.);
+    for( auto engine: {"bike", "foot"} ) {
+        auto reply = Fields(server.HandleRequest(0, std::string{"route 5 5 95 90 "} + engine));
+        REQUIRE(reply.size() == 5);
+        CHECK_EQ(reply[0], "ok");
+    }
+}
+
+TEST(RejectsMalformedRequests)
+{
+    Grid grid;
+    RouteServer server{*grid.model, 1};
+    CHECK_EQ(server.HandleRequest(0, "hello"), "err unknown command");
+    CHECK_EQ(server.HandleRequest(0, "route 1 2 nine 4").rfind("err expected: route", 0), 0u);
+    CHECK_EQ(server.HandleRequest(0, "route 1 2 3 4 teleport"), "err unknown engine teleport");
+    CHECK_EQ(server.HandleRequest(0, "speed residential"), "err traffic: line 1: expected <edge or road type> <km/h>");
+    CHECK_EQ(server.HandleRequest(0, "speed").rfind("err expected: speed", 0), 0u);
+}
+
+TEST(SpeedUpdatesPublishANewVersion)
+{
+    Grid grid;
+    RouteServer server{*grid.model, 1};
+    auto before = Fields(server.HandleRequest(0, "route 5 5 95 90 fastest"));
+    auto version = server.Traffic().Version();
+    CHECK_EQ(server.HandleRequest(0, "speed residential 5"), "ok " + std::to_string(version + 1) + " ch-by-distance");
+    auto after = Fields(server.HandleRequest(0, "route 5 5 95 90 fastest"));
+    REQUIRE(before.size() == 5 && after.size() == 5);
+    CHECK(std::stod(after[4]) > std::stod(before[4]));
+    CHECK_EQ(server.HandleRequest(0, "speed 4000000000 30").rfind("err ", 0), 0u);
+}
+
+TEST(CountsRequestsInStats)
+{
+    Grid grid;
+    RouteServer server{*grid.model, 2};
+    CHECK_EQ(Fields(server.HandleRequest(1, "stats"))[1], "0");
+    server.HandleRequest(0, "route 5 5 95 90");
+    server.HandleRequest(1, "route 5 5 95 90");
+    server.HandleRequest(1, "route 5 5 95 90");
+    CHECK_EQ(Fields(server.HandleRequest(0, "stats"))[1], "3");
+}
+
+TEST(ServesLinesOverTcp)
+{
+    Grid grid;
+    RouteServer server{*grid.model, 1};
+    REQUIRE(server.Start(0));
+    REQUIRE(server.Port() != 0);
+    auto fd = Connect(server.Port());
+    REQUIRE(fd >= 0);
+    std::string requests = "stats\r\nroute 5 5 95 90\nquit\n";
+    REQUIRE(::send(fd, requests.data(), requests.size(), 0) == static_cast<ssize_t>(requests.size()));
+    auto replies = ReadAll(fd);
+    ::close(fd);
+    CHECK_EQ(replies.rfind("ok 0 0\nok ", 0), 0u);
+    CHECK_EQ(std::count(replies.begin(), replies.end(), '\n'), 2);
+    server.Stop();
+    server.Wait();
+}
+
+TEST(ClosesConnectionsPastTheLineLimit)
+{
+    Grid grid;
+    RouteServer server{*grid.model, 1};
+    REQUIRE(server.Start(0));
+    auto fd = Connect(server.Port());
+    REQUIRE(fd >= 0);
+    std::string line(RouteServer::kMaxLineLength + 100, 'x');
+    ::send(fd, line.data(), line.size(), MSG_NOSIGNAL);
+    CHECK_EQ(ReadAll(fd), "err line too long\n");
+    ::close(fd);
+    server.Stop();
+    server.Wait();
+}
+
+TEST(StopEndsIdleConnections)
+{
+    Grid grid;
+    RouteServer server{*grid.model, 2};
+    REQUIRE(server.Start(0));
+    auto first = Connect(server.Port()), second = Connect(server.Port());
+    REQUIRE(first >= 0 && second >= 0);
+    auto reply = std::string{"stats\n"};
+    ::send(first, reply.data(), reply.size(), 0);
+    char buffer[64];
+    CHECK(::recv(first, buffer, sizeof(buffer), 0) > 0);    // a worker is serving it, blocked in recv() now
+    server.Stop();
+    server.Wait();                          // returns although both clients keep their connections open
+    CHECK_EQ(ReadAll(first), "");
+    ::close(first);
+    ::close(second);
+}
+
+TEST(ServesMoreOpenConnectionsThanWorkers)
+{
+    Grid grid;
+    RouteServer server{*grid.model, 2};
+    REQUIRE(server.Start(0));
+    std::vector<int> clients;
+    for( int i = 0; i < 5; ++i ) {          // every client keeps its connection open after its reply
+        auto fd = Connect(server.Port());
+        REQUIRE(fd >= 0);
+        clients.push_back(fd);
+        auto request = std::string{"route 10 10 90 90\n"};
+        REQUIRE(::send(fd, request.data(), request.size(), 0) == static_cast<ssize_t>(request.size()));
+        auto fields = Fields(ReadLine(fd));
+        REQUIRE(!fields.empty());
+        CHECK_EQ(fields[0], "ok");
+    }
+    // the idle connections were given up for the newer ones, the first clients read the close
+    CHECK_EQ(ReadAll(clients[0]), "");
+    CHECK_EQ(ReadAll(clients[1]), "");
+    for( auto fd: clients )
+        ::close(fd);
+}
@@ -0,0 +1,86 @@
+#include "simplify.h"
+#include "test.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace {
+
+double SegmentDistance(const Model::Node &p, const Model::Node &a, const Model::Node &b)
+{
+    auto dx = b.x - a.x, dy = b.y - a.y, length2 = dx * dx + dy * dy;
+    auto t = length2 > 0. ? std::clamp(((p.x - a.x) * dx + (p.y - a.y) * dy) / length2, 0., 1.) : 0.;
+    return std::hypot(a.x + t * dx - p.x, a.y + t * dy - p.y);
+}
+
+// A wiggly line of count nodes, every node its own index.
+struct Line {
+    std::vector<double> xs, ys;
+    std::vector<int> way;
+
+    Line(std::size_t count, std::uint32_t seed) {
+        std::mt19937 random{seed};
+        std::normal_distribution<double> wiggle{0., 0.002};
+        for( std::size_t i = 0; i < count; ++i ) {
+            xs.push_back(i / double(count) + wiggle(random));
+            ys.push_back(0.3 * std::sin(i * 0.05) + wiggle(random));
+            way.push_back((int)i);
+        }
+    }
+    Model::NodeArray Nodes() const { return {xs, ys}; }
+};
+
+}
+
+TEST(KeepsEveryDroppedNodeWithinTheTolerance)
+{
+    Line line{500, 3};
+    auto nodes = line.Nodes();
+    for( auto tolerance: {1e-4, 1e-3, 1e-2, 0.1} ) {
+        auto simplified = Simplify(nodes, line.way, tolerance);
+        REQUIRE(simplified.size() >= 2u);
+        CHECK_EQ(simplified.front(), line.way.front());
+        CHECK_EQ(simplified.back(), line.way.back());
+        CHECK(std::is_sorted(simplified.begin(), simplified.end()));       // a subsequence
+        for( std::size_t k = 1; k < simplified.size(); ++k )
+            for( auto i = simplified[k - 1] + 1; i < simplified[k]; ++i )
+                CHECK(SegmentDistance(nodes[i], nodes[simplified[k - 1]], nodes[simplified[k]]) <= tolerance);
+    }
+    CHECK(Simplify(nodes, line.way, 0.1).size() < Simplify(nodes, line.way, 1e-3).size());
+    CHECK_EQ(Simplify(nodes, line.way, 0.).size(), line.way.size());
+    CHECK_EQ(Simplify(nodes, line.way, 10.).size(), 2u);
+}
+
+TEST(DecodedPointsSimplifyLikeNodeLists)
+{
+    Line line{300, 4};
+    auto nodes = line.Nodes();
+    auto indices = Simplify(nodes, line.way, 5e-3);
+    std::vector<Model::Node> points;
+    for( auto i: line.way )
+        points.push_back(nodes[i]);
+    Simplify(points, 5e-3);
+    REQUIRE(points.size() == indices.size());
+    for( std::size_t k = 0; k < points.size(); ++k ) {
+        CHECK_EQ(points[k].x, nodes[indices[k]].x);
+        CHECK_EQ(points[k].y, nodes[indices[k]].y);
+    }
+}
+
+TEST(RingsStayClosedOrVanish)
+{
+    // a square ring with a jagged edge, the first node repeated at the end
+    std::vector<double> xs{0., 0.5, 1., 1., 0.5, 0.}, ys{0., 0.001, 0., 1., 1., 1.};
+    Model::NodeArray nodes{xs, ys};
+    std::vector<int> ring{0, 1, 2, 3, 4, 5, 0};
+    auto square = Simplify(nodes, ring, 0.01);
+    CHECK(square == (std::vector<int>{0, 2, 3, 5, 0}));
+    CHECK(Simplify(nodes, ring, 2.).empty());                  // collapses to a line, not drawn
+
+    std::vector<Model::Node> points{{0., 0.}, {1., 0.}, {1., 1.}, {0., 0.}};
+    Simplify(points, 2.);
+    CHECK(points.empty());
+    std::vector<Model::Node> open{{0., 0.}, {0.5, 0.}, {1., 0.}};
+    Simplify(open, 2.);
+    CHECK_EQ(open.size(), 2u);                     // open ways keep their end points
+}
@@ -0,0 +1,173 @@
+#include "mapped_file.h"
+#include "osm_fixture.h"
+#include "route_model.h"
+#include "route_planner.h"
+#include "snapshot.h"
+#include "test.h"
+#include <fstream>
+
+namespace {
+
+// Saves the model of the grid extract as a snapshot, returns its path.
+std::string SaveGrid(const TempDir &dir, bool hierarchy = false)
+{
+    GridExtract().Write(dir / "grid.osm.pbf");
+    auto file = MappedFile::Open((dir / "grid.osm.pbf").string());
+    RouteModel model{*file};
+    if( hierarchy )
+        model.BuildHierarchy();
+    SnapshotWriter writer{model.MetricScale()};
+    model.Serialize(writer);
+    auto path = (dir / "grid.rms").string();
+    writer.Save(path);
+    return path;
+}
+
+// Overwrites element `index` of a section in the file, as a corrupt or hostile snapshot would have it.
+template <typename T>
+void Patch(const std::string &path, Snapshot::Section id, std::size_t index, T value)
+{
+    std::fstream file{path, std::ios::in | std::ios::out | std::ios::binary};
+    Snapshot::Header header;
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    for( std::uint32_t i = 0; i < header.section_count; ++i ) {
+        Snapshot::SectionEntry entry;
+        file.read(reinterpret_cast<char *>(&entry), sizeof(entry));
+        if( entry.id != id )
+            continue;
+        REQUIRE(entry.element_size == sizeof(T) && index < entry.count);
+        file.seekp(static_cast<std::streamoff>(entry.offset + index * sizeof(T)));
+        file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+        return;
+    }
+    REQUIRE(!"section not in the snapshot");
+}
+
+bool Loads(const std::string &path)
+{
+    auto snapshot = Snapshot::Open(path);
+    if( !snapshot )
+        return false;
+    try {
+        RouteModel model{std::move(*snapshot)};
+        return true;
+    } catch( const std::runtime_error & ) {
+        return false;
+    }
+}
+
+}
+
+TEST(RoundTripsTheModel)
+{
+    TempDir dir;
+    auto path = SaveGrid(dir);
+    auto file = MappedFile::Open((dir / "grid.osm.pbf").string());
+    RouteModel built{*file};
+    auto snapshot = Snapshot::Open(path);
+    REQUIRE(snapshot);
+    RouteModel loaded{std::move(*snapshot)};
+
+    CHECK_EQ(loaded.Nodes().size(), built.Nodes().size());
+    CHECK_EQ(loaded.Ways().size(), built.Ways().size());
+    CHECK_EQ(loaded.Graph().EdgeCount(), built.Graph().EdgeCount());
+    CHECK_EQ(loaded.Waters().size(), built.Waters().size());
+    RoutePlanner a{built}, b{loaded};
+    auto ra = a.AStarSearch(5.f, 5.f, 95.f, 90.f), rb = b.AStarSearch(5.f, 5.f, 95.f, 90.f);
+    REQUIRE(ra && rb);
+    CHECK_EQ(ra->distance, rb->distance);
+    CHECK(ra->nodes == rb->nodes);
+}
+
+TEST(RejectsMissingAndTruncatedFiles)
+{
+    TempDir dir;
+    CHECK(!Snapshot::Open((dir / "missing.rms").string()));
+    auto path = SaveGrid(dir);
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) / 2);
+    CHECK(!Snapshot::Open(path));
+}
+
+TEST(RejectsGraphEdgesOutsideTheGraph)
+{
+    TempDir dir;
+    auto path = SaveGrid(dir);
+    Patch<std::uint32_t>(path, Snapshot::GraphTargets, 3, 1u << 30);
+    CHECK(!Loads(path));
+}
+
+TEST(RejectsGraphVerticesOutsideTheGraph)
+{
+    TempDir dir;
+    auto path = SaveGrid(dir);
+    Patch<std::uint32_t>(path, Snapshot::GraphVertices, 5, 1u << 30);
+    CHECK(!Loads(path));
+}
+
+TEST(RejectsUnknownRoadTypes)
+{
+    TempDir dir;
+    auto path = SaveGrid(dir);
+    Patch<std::uint8_t>(path, Snapshot::GraphTypes, 0, 200);
+    CHECK(!Loads(path));
+}
+
+TEST(RejectsDecreasingOffsets)
+{
+    TempDir dir;
+    auto path = SaveGrid(dir);
+    Patch<std::uint32_t>(path, Snapshot::GraphOffsets, 1, 1u << 20);
+    CHECK(!Loads(path));
+}
+
+TEST(RejectsWayNodesOutsideTheNodeTable)
+{
+    TempDir dir;
+    auto path = SaveGrid(dir);
+    Patch<std::int32_t>(path, Snapshot::WayNodes, 4, 1 << 30);
+    CHECK(!Loads(path));
+    Patch<std::int32_t>(path, Snapshot::WayNodes, 4, -1);
+    CHECK(!Loads(path));
+}
+
+TEST(RejectsRoadsOutsideTheWayTableAndUnknownTypes)
+{
+    TempDir dir;
+    auto path = SaveGrid(dir);
+    Patch<std::int32_t>(path, Snapshot::RoadWays, 2, 1 << 30);
+    CHECK(!Loads(path));
+    path = SaveGrid(dir);
+    Patch<std::uint8_t>(path, Snapshot::RoadTypes, 2, 99);
+    CHECK(!Loads(path));
+    path = SaveGrid(dir);
+    Patch<std::uint8_t>(path, Snapshot::RoadTypes, 2, Model::Road::Invalid);
+    CHECK(!Loads(path));
+}
+
+TEST(RejectsAreaRingsOutsideTheWayTable)
+{
+    TempDir dir;
+    auto path = SaveGrid(dir);
+    Patch<std::int32_t>(path, Snapshot::WaterRings, 0, 1 << 30);
+    CHECK(!Loads(path));
+    path = SaveGrid(dir);
+    Patch<std::int32_t>(path, Snapshot::BuildingRings, 0, -5);
+    CHECK(!Loads(path));
+    path = SaveGrid(dir);
+    Patch<std::uint8_t>(path, Snapshot::LanduseTypes, 0, 77);
+    CHECK(!Loads(path));
+}
+
+TEST(RejectsIdIndicesOutsideTheirTables)
+{
+    TempDir dir;
+    auto path = SaveGrid(dir);
+    Patch<std::int32_t>(path, Snapshot::NodeIdIndices, 3, 1 << 30);
+    CHECK(!Loads(path));
+    path = SaveGrid(dir);
+    Patch<std::int32_t>(path, Snapshot::WayIdIndices, 3, -1);
+    CHECK(!Loads(path));
+    path = SaveGrid(dir);
+    Patch<std::int64_t>(path, Snapshot::NodeIds, 0, std::int64_t{1} << 40);     // no longer ascending
+    CHECK(!Loads(path));
+}
@@ -0,0 +1,118 @@
+#include "spatial_index.h"
+#include "test.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+namespace {
+
+// Two dense clusters in the unit square with empty cells between them, every
+// third node left out of the index.
+struct Cloud {
+    std::vector<double> xs, ys;
+    std::vector<int> indexed;
+
+    explicit Cloud(std::uint32_t seed) {
+        std::mt19937 random{seed};
+        std::uniform_real_distribution<double> unit{0., 1.}, cluster{0., 0.15};
+        for( int i = 0; i < 3000; ++i ) {
+            auto corner = i % 2 == 0 ? 0. : 0.85;
+            xs.push_back(i % 10 == 0 ? unit(random) : corner + cluster(random));
+            ys.push_back(i % 10 == 0 ? unit(random) : corner + cluster(random));
+            if( i % 3 != 0 )
+                indexed.push_back(i);
+        }
+    }
+
+    Model::NodeArray Nodes() const { return {xs, ys}; }
+
+    float Distance2(int i, float x, float y) const {
+        auto dx = (float)xs[i] - x, dy = (float)ys[i] - y;
+        return dx * dx + dy * dy;
+    }
+
+    std::vector<float> Nearest(float x, float y, std::size_t k) const {        // squared distances, closest first
+        std::vector<float> d;
+        for( auto i: indexed )
+            d.push_back(Distance2(i, x, y));
+        std::sort(d.begin(), d.end());
+        d.resize(std::min(k, d.size()));
+        return d;
+    }
+};
+
+}
+
+TEST(KNearestMatchesBruteForce)
+{
+    Cloud cloud{3};
+    SpatialIndex index{cloud.Nodes(), cloud.indexed};
+    std::mt19937 random{9};
+    std::uniform_real_distribution<float> around{-0.5f, 1.5f};       // also well outside the bounds
+    for( int q = 0; q < 400; ++q ) {
+        auto x = around(random), y = around(random);
+        auto k = 1 + q % 12;
+        auto found = index.KNearest(x, y, k);
+        auto expected = cloud.Nearest(x, y, k);
+        REQUIRE(found.size() == expected.size());
+        for( std::size_t i = 0; i < found.size(); ++i ) {
+            CHECK_EQ(cloud.Distance2(found[i], x, y), expected[i]);
+            CHECK(found[i] % 3 != 0);               // only indexed nodes come back
+        }
+        auto nearest = index.Nearest(x, y);
+        REQUIRE(nearest >= 0);
+        CHECK_EQ(cloud.Distance2(nearest, x, y), expected.front());
+    }
+    CHECK_EQ(index.KNearest(0.5f, 0.5f, 100000).size(), cloud.indexed.size());
+}
+
+TEST(RadiusMatchesBruteForce)
+{
+    Cloud cloud{4};
+    SpatialIndex index{cloud.Nodes(), cloud.indexed};
+    std::mt19937 random{10};
+    std::uniform_real_distribution<float> around{-0.5f, 1.5f}, radius{0.f, 0.3f};
+    for( int q = 0; q < 300; ++q ) {
+        auto x = around(random), y = around(random), r = radius(random);
+        auto found = index.Radius(x, y, r);
+        std::sort(found.begin(), found.end());
+        std::vector<int> expected;
+        for( auto i: cloud.indexed )
+            if( cloud.Distance2(i, x, y) <= r * r )
+                expected.push_back(i);
+        CHECK(found == expected);
+    }
+    CHECK(index.Radius(0.5f, 0.5f, 0.01f).empty());             // the empty middle of the square
+    CHECK(index.Radius(0.5f, 0.5f, -1.f).empty());
+}
+
+TEST(TakesAnyCoordinateWithoutOverflow)
+{
+    Cloud cloud{5};
+    SpatialIndex index{cloud.Nodes(), cloud.indexed};
+    auto inf = std::numeric_limits<float>::infinity(), nan = std::numeric_limits<float>::quiet_NaN();
+    for( auto far: {1e30f, -1e30f, 3e9f, std::numeric_limits<float>::max()} ) {
+        CHECK(index.Nearest(far, 0.5f) >= 0);
+        CHECK(index.Nearest(0.5f, far) >= 0);
+        CHECK(index.Radius(far, far, 1.f).empty());
+    }
+    CHECK_EQ(index.Nearest(nan, 0.5f), -1);
+    CHECK_EQ(index.Nearest(0.5f, inf), -1);
+    CHECK(index.KNearest(-inf, nan, 3).empty());
+    CHECK(index.Radius(0.5f, 0.5f, nan).empty());
+    CHECK(index.Radius(nan, 0.5f, 1.f).empty());
+    CHECK_EQ(index.Radius(0.5f, 0.5f, inf).size(), cloud.indexed.size());
+}
+
+TEST(HandlesEmptyAndDegenerateSets)
+{
+    SpatialIndex empty;
+    CHECK_EQ(empty.Nearest(0.f, 0.f), -1);
+    CHECK(empty.KNearest(0.f, 0.f, 4).empty());
+
+    std::vector<double> xs{0.2, 0.2, 0.2}, ys{0.1, 0.5, 0.9};       // all on one line
+    SpatialIndex line{Model::NodeArray{xs, ys}, {0, 1, 2}};
+    CHECK_EQ(line.Nearest(5.f, 0.45f), 1);
+    CHECK(line.KNearest(0.2f, 1.f, 2) == (std::vector<int>{2, 1}));
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <sstream>
+#include <string>
+
+// Minimal test harness. TEST(name) defines a case that is registered before
+// main() runs; test_main.cpp runs all of them, or the ones named on the
+// command line, and exits non-zero if a check failed. CHECK records a failure
+// and goes on, REQUIRE ends the case; an exception escaping a case fails it.
+namespace test {
+
+void Register(const char *name, void (*run)());
+void Fail(const char *file, int line, const std::string &what);
+
+struct Abort {};                    // thrown by REQUIRE, caught by the runner
+
+struct Registration {
+    Registration(const char *name, void (*run)()) { Register(name, run); }
+};
+
+template <typename A, typename B>
+std::string Describe(const char *expression, const A &a, const B &b)
+{
+    std::ostringstream out;
+    out << expression << " (" << a << " vs " << b << ")";
+    return out.str();
+}
+
+}
+
+#define TEST(name) \
+    static void name(); \
+    static const test::Registration name##_registration{#name, name}; \
+    static void name()
+
+#define CHECK(condition) \
+    do { if( !(condition) ) test::Fail(__FILE__, __LINE__, #condition); } while( 0 )
+
+#define REQUIRE(condition) \
+    do { if( !(condition) ) { test::Fail(__FILE__, __LINE__, #condition); throw test::Abort{}; } } while( 0 )
+
+#define CHECK_EQ(a, b) \
+    do { \
+        const auto &check_a_ = (a); const auto &check_b_ = (b); \
+        if( !(check_a_ == check_b_) ) test::Fail(__FILE__, __LINE__, test::Describe(#a " == " #b, check_a_, check_b_)); \
+    } while( 0 )
+
+#define CHECK_NEAR(a, b, tolerance) \
+    do { \
+        const double check_a_ = (a), check_b_ = (b); \
+        if( !(check_a_ - check_b_ <= (tolerance) && check_b_ - check_a_ <= (tolerance)) ) \
+            test::Fail(__FILE__, __LINE__, test::Describe(#a " ~= " #b, check_a_, check_b_)); \
+    } while( 0 )
+
+#define CHECK_THROWS(expression) \
+    do { \
+        auto check_threw_ = false; \
+        try { expression; } catch( ... ) { check_threw_ = true; } \
+        if( !check_threw_ ) test::Fail(__FILE__, __LINE__, "expected an exception from " #expression); \
+    } while( 0 )
@@ -0,0 +1,61 @@
+#include "test.h"
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Case {
+    const char *name;
+    void (*run)();
+};
+
+std::vector<Case> &Cases()
+{
+    static std::vector<Case> cases;         // filled from static initializers of the test files
+    return cases;
+}
+
+std::size_t g_Failures = 0;
+
+}
+
+void test::Register(const char *name, void (*run)())
+{
+    Cases().push_back({name, run});
+}
+
+void test::Fail(const char *file, int line, const std::string &what)
+{
+    ++g_Failures;
+    std::cout << file << ':' << line << ": check failed: " << what << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    std::size_t failed_cases = 0, run = 0;
+    for( auto &c: Cases() ) {
+        auto selected = argc < 2;
+        for( int i = 1; i < argc; ++i )
+            selected |= argv[i] == std::string{c.name};
+        if( !selected )
+            continue;
+
+        ++run;
+        auto before = g_Failures;
+        try {
+            c.run();
+        } catch( const test::Abort & ) {
+            // already reported
+        } catch( const std::exception &e ) {
+            test::Fail(c.name, 0, std::string{"unexpected exception: "} + e.what());
+        }
+        auto passed = g_Failures == before;
+        failed_cases += !passed;
+        std::cout << (passed ? "[pass] " : "[FAIL] ") << c.name << std::endl;
+    }
+    std::cout << run - failed_cases << '/' << run << " cases passed" << std::endl;
+    return failed_cases == 0 && run > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,58 @@
+#include "test.h"
+#include "thread_pool.h"
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <vector>
+
+TEST(RunsEveryItemOnce)
+{
+    ThreadPool pool{3};
+    std::vector<std::atomic<int>> hits(5000);
+    ParallelFor(pool, hits.size(), [&](std::size_t i) { ++hits[i]; });
+    for( auto &hit: hits )
+        CHECK_EQ(hit.load(), 1);
+    ParallelFor(pool, 0, [&](std::size_t) { CHECK(false); });
+}
+
+// A pool full of decodes must not hold the loop up: the caller does the
+// items on its own and the queued helpers return untouched later.
+TEST(DoesNotWaitForHelpersThatNeverStarted)
+{
+    ThreadPool pool{2};
+    std::promise<void> release;
+    auto gate = release.get_future().share();
+    std::vector<std::future<void>> blockers;
+    for( unsigned i = 0; i < pool.Size(); ++i )
+        blockers.push_back(pool.Submit([gate]{ gate.wait(); }));
+
+    std::atomic<std::size_t> done{0};
+    auto finished = std::async(std::launch::async, [&]{
+        ParallelFor(pool, 100, [&](std::size_t) { ++done; });
+    });
+    auto status = finished.wait_for(std::chrono::seconds(10));
+    release.set_value();
+    for( auto &blocker: blockers )
+        blocker.get();
+    REQUIRE(status == std::future_status::ready);
+    finished.get();
+    CHECK_EQ(done.load(), 100u);
+
+    // the stale helpers ran after the loop returned, the pool still works
+    CHECK_EQ(pool.Submit([]{ return 7; }).get(), 7);
+}
+
+TEST(RethrowsAfterEveryStartedHelperIsDone)
+{
+    ThreadPool pool{4};
+    std::atomic<int> active{0};
+    CHECK_THROWS(ParallelFor(pool, 1000, [&](std::size_t i) {
+        ++active;
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+        --active;
+        if( i == 10 )
+            throw std::runtime_error("item failed");
+    }));
+    CHECK_EQ(active.load(), 0);
+}
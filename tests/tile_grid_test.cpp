@@ -0,0 +1,63 @@
+#include "test.h"
+#include "tile_grid.h"
+#include <random>
+
+// Where the tile's matrix puts a model point on the tile's own surface:
+// scaled with y flipped, then moved by the tile's corner, as Render builds it.
+static float TileX(const TileGrid &grid, std::int32_t x, float model_x) { return grid.PixelX(model_x) - grid.Left(x); }
+static float TileY(const TileGrid &grid, std::int32_t y, float model_y) { return grid.PixelY(model_y) - grid.Top(y); }
+
+TEST(TileAreasAreWhatTheTileSurfacesShow)
+{
+    for( auto scale: {512.f, 1000.f, 3333.3f, 65536.f} ) {
+        TileGrid grid{scale, 256.f};
+        for( std::int32_t y = -3; y <= 3; ++y )
+            for( std::int32_t x = -3; x <= 3; ++x ) {
+                auto area = grid.Area(x, y);
+                // the surface corners map back to the area's corners
+                CHECK_NEAR(TileX(grid, x, area.min_x), 0., 1e-2);
+                CHECK_NEAR(TileX(grid, x, area.max_x), grid.size, 1e-2);
+                CHECK_NEAR(TileY(grid, y, area.max_y), 0., 1e-2);
+                CHECK_NEAR(TileY(grid, y, area.min_y), grid.size, 1e-2);
+                // neighbours share their edges, so areas tile the plane without gaps
+                CHECK_EQ(grid.Area(x + 1, y).min_x, area.max_x);
+                CHECK_EQ(grid.Area(x, y + 1).max_y, area.min_y);
+
+                auto padded = grid.Area(x, y, 0.01f);
+                CHECK_NEAR(padded.min_x, area.min_x - 0.01f, 1e-6);
+                CHECK_NEAR(padded.max_y, area.max_y + 0.01f, 1e-6);
+            }
+    }
+}
+
+TEST(CoveringTilesSpanTheViewExactly)
+{
+    std::mt19937 random{12};
+    std::uniform_real_distribution<float> origin{-2.f, 2.f}, zoom{0.5f, 64.f};
+    for( int q = 0; q < 200; ++q ) {
+        TileGrid grid{1024.f * zoom(random), 256.f};
+        float width = 100.f + q * 7 % 1500, height = 80.f + q * 13 % 900;
+        float left = grid.PixelX(origin(random)), top = grid.PixelY(origin(random)) - height;
+        auto range = grid.Covering(left, top, width, height);
+        REQUIRE(range.x0 <= range.x1 && range.y0 <= range.y1);
+
+        // the first and last tiles hold the view's corners, the ones past them don't reach in
+        CHECK(grid.Left(range.x0) <= left && left < grid.Left(range.x0 + 1));
+        CHECK(grid.Top(range.y0) <= top && top < grid.Top(range.y0 + 1));
+        CHECK(grid.Left(range.x1) <= left + width && left + width < grid.Left(range.x1 + 1));
+        CHECK(grid.Top(range.y1) <= top + height && top + height < grid.Top(range.y1 + 1));
+
+        // a model point in the view lands on the tile whose area holds it, inside its surface
+        std::uniform_real_distribution<float> across{0.f, 1.f};
+        for( int p = 0; p < 20; ++p ) {
+            auto px = left + across(random) * width, py = top + across(random) * height;
+            auto mx = px / grid.scale, my = -py / grid.scale;
+            auto tile = grid.Covering(px, py, 0.f, 0.f);
+            CHECK(range.x0 <= tile.x0 && tile.x0 <= range.x1 && range.y0 <= tile.y0 && tile.y0 <= range.y1);
+            auto area = grid.Area(tile.x0, tile.y0, 1e-6f);
+            CHECK(area.min_x <= mx && mx <= area.max_x && area.min_y <= my && my <= area.max_y);
+            auto tx = TileX(grid, tile.x0, mx), ty = TileY(grid, tile.y0, my);
+            CHECK(tx >= -0.05f && tx <= grid.size + 0.05f && ty >= -0.05f && ty <= grid.size + 0.05f);
+        }
+    }
+}
@@ -0,0 +1,93 @@
+#include "osm_fixture.h"
+#include "route_model.h"
+#include "route_planner.h"
+#include "test.h"
+#include "traffic.h"
+#include <sstream>
+#include <thread>
+
+namespace {
+
+struct Grid {
+    Grid()
+    {
+        GridExtract().Write(dir / "grid.osm.pbf");
+        model = std::make_unique<RouteModel>(dir / "grid.osm.pbf");
+    }
+
+    TempDir dir;
+    std::unique_ptr<RouteModel> model;
+};
+
+}
+
+TEST(PinsMoreReadersThanSlots)
+{
+    Grid grid;
+    TrafficWeights traffic{grid.model->Graph(), grid.model->Hierarchy()};
+    std::vector<TrafficWeights::Pin> pins;
+    for( std::size_t i = 0; i < 3 * TrafficWeights::kReaderSlots; ++i )
+        pins.push_back(traffic.Read());         // past the slots they go to the overflow list
+    CHECK_EQ(pins.back()->version, 0u);
+
+    // the overflow pins keep their tables alive across updates
+    traffic.SetDefaultSpeed(Model::Road::Residential, 5.f);
+    traffic.SetDefaultSpeed(Model::Road::Residential, 6.f);
+    for( auto &pin: pins ) {
+        CHECK_EQ(pin->version, 0u);
+        CHECK_EQ(pin->seconds.size(), grid.model->Graph().EdgeCount());
+    }
+    pins.clear();
+    CHECK_EQ(traffic.Version(), 2u);
+    traffic.SetDefaultSpeed(Model::Road::Residential, 7.f);
+    CHECK_EQ(traffic.Read()->version, 3u);
+}
+
+TEST(ReadersOnManyThreadsSeeWholeTables)
+{
+    Grid grid;
+    TrafficWeights traffic{grid.model->Graph(), grid.model->Hierarchy()};
+    auto edges = grid.model->Graph().EdgeCount();
+    std::atomic<bool> done{false};
+    std::atomic<int> bad{0};
+    std::vector<std::thread> readers;
+    for( std::size_t t = 0; t < TrafficWeights::kReaderSlots + 8; ++t )
+        readers.emplace_back([&] {
+            while( !done ) {
+                auto pin = traffic.Read();
+                auto again = traffic.Read();            // two pins on one thread
+                if( pin->seconds.size() != edges || again->version < pin->version )
+                    ++bad;
+            }
+        });
+    for( int i = 1; i <= 50; ++i )
+        traffic.SetDefaultSpeed(Model::Road::Residential, static_cast<float>(i));
+    done = true;
+    for( auto &reader: readers )
+        reader.join();
+    CHECK_EQ(bad.load(), 0);
+    CHECK_EQ(traffic.Version(), 50u);
+}
+
+TEST(FeedsChangeTheFastestTimes)
+{
+    Grid grid;
+    auto &graph = grid.model->Graph();
+    TrafficWeights traffic{graph, grid.model->Hierarchy()};
+    RoutePlanner planner{*grid.model};
+    auto from = graph.Vertex(grid.model->FindClosestNode(0.f, 0.f));
+    auto to = graph.Vertex(grid.model->FindClosestNode(1.f, 1.f));
+    auto before = planner.FastestSearch(from, to, *traffic.Read());
+
+    std::istringstream feed{"# rush hour\nresidential 10\n\nprimary 10 # slow too\n"};
+    CHECK_EQ(traffic.LoadFeed(feed), 2u);
+    auto after = planner.FastestSearch(from, to, *traffic.Read());
+    REQUIRE(before && after);
+    CHECK(after->duration > before->duration);
+
+    std::istringstream bad{"residential 20\nhighway 10\n"};
+    CHECK_THROWS(traffic.LoadFeed(bad));
+    CHECK_EQ(traffic.Version(), 1u);            // nothing of a malformed feed is applied
+    std::istringstream missing{std::to_string(graph.EdgeCount()) + " 50\n"};
+    CHECK_THROWS(traffic.LoadFeed(missing));
+}
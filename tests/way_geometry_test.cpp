@@ -0,0 +1,169 @@
+#include "contraction_hierarchy.h"
+#include "osm_fixture.h"
+#include "route_model.h"
+#include "route_planner.h"
+#include "snapshot.h"
+#include "test.h"
+#include "way_geometry.h"
+#include <cmath>
+#include <random>
+
+namespace {
+
+// Bytes of the node coordinates and way node lists, the part the geometry replaces.
+std::size_t CoordinateBytes(const Model &model)
+{
+    auto bytes = model.Nodes().size() * 2 * sizeof(double);
+    for( auto &way: model.Ways() )
+        bytes += way.nodes.size() * sizeof(int);
+    return bytes;
+}
+
+// A town of small buildings along the grid's streets, as in most extracts the coordinates are mostly theirs.
+PbfWriter Town(int buildings)
+{
+    auto writer = GridExtract();
+    std::mt19937 random{3};
+    std::int64_t node = 100000, way = 100000;
+    for( int b = 0; b < buildings; ++b ) {
+        auto lat = 40.701 + 1e-5 * (random() % 900), lon = -74.019 + 1e-5 * (random() % 900);
+        std::vector<std::int64_t> refs;
+        for( auto [dlat, dlon]: {std::pair{0., 0.}, {0., 1e-4}, {1e-4, 1e-4}, {1e-4, 0.}} ) {
+            writer.AddNode(node, lat + dlat, lon + dlon);
+            refs.push_back(node++);
+        }
+        refs.push_back(refs.front());
+        writer.AddWay(way++, refs, {{"building", "yes"}});
+    }
+    return writer;
+}
+
+}
+
+TEST(DecodesThePointsToTheCentimetre)
+{
+    TempDir dir;
+    GridOptions options;
+    options.jitter = 0.4;
+    GridExtract(options).Write(dir / "grid.osm.pbf");
+    RouteModel model{dir / "grid.osm.pbf"};
+    WayGeometry geometry{model};
+    REQUIRE(geometry.WayCount() == model.Ways().size());
+    auto tolerance = 0.0051 / model.MetricScale();      // half a centimetre, in normalized units
+    for( std::size_t way = 0; way < model.Ways().size(); ++way ) {
+        auto &nodes = model.Ways()[way].nodes;
+        auto points = geometry.Points(way);
+        REQUIRE(points.size() == nodes.size());
+        auto length = 0.;
+        for( std::size_t i = 0; i < points.size(); ++i ) {
+            auto node = model.Nodes()[nodes[i]];
+            CHECK_NEAR(points[i].x, node.x, tolerance);
+            CHECK_NEAR(points[i].y, node.y, tolerance);
+            if( i > 0 ) {
+                auto previous = model.Nodes()[nodes[i - 1]];
+                length += std::hypot(node.x - previous.x, node.y - previous.y) * model.MetricScale();
+            }
+        }
+        CHECK_NEAR(geometry.Length(way), length, 0.01 * points.size());
+    }
+}
+
+TEST(CodesNegativeAndFarCoordinates)
+{
+    // nodes outside the header bounds have negative coordinates, across several tiles
+    TempDir dir;
+    PbfWriter writer;
+    writer.SetBounds(40.70, -74.02, 40.71, -74.01);
+    writer.AddNode(1, 40.60, -74.20);
+    writer.AddNode(2, 40.70, -74.02);
+    writer.AddNode(3, 41.20, -73.50);
+    writer.AddNode(4, 40.705, -74.015);
+    writer.AddWay(1, {1, 2, 3, 4}, {{"highway", "primary"}});
+    writer.Write(dir / "wide.osm.pbf");
+    RouteModel model{dir / "wide.osm.pbf"};
+    WayGeometry geometry{model};
+    auto points = geometry.Points(0);
+    REQUIRE(points.size() == 4u);
+    for( int i = 0; i < 4; ++i ) {
+        CHECK_NEAR(points[i].x, model.Nodes()[model.Ways()[0].nodes[i]].x, 0.0051 / model.MetricScale());
+        CHECK_NEAR(points[i].y, model.Nodes()[model.Ways()[0].nodes[i]].y, 0.0051 / model.MetricScale());
+    }
+    CHECK(points[0].x < 0. && points[0].y < 0.);
+}
+
+TEST(DropsTheAreaNodesForLessMemory)
+{
+    TempDir dir;
+    Town(500).Write(dir / "town.osm.pbf");
+    RouteModel model{dir / "town.osm.pbf"};
+    RoutePlanner before_planner{model};
+    auto before = before_planner.AStarSearch(5.f, 5.f, 95.f, 90.f);
+    auto roads = model.RoadNodes().size();
+    auto nodes = model.Nodes().size();
+    auto bytes = CoordinateBytes(model);
+
+    model.BuildGeometry();
+    CHECK_EQ(model.RoadNodes().size(), roads);
+    CHECK(model.Nodes().size() <= nodes - 4 * 500);
+    auto compact = CoordinateBytes(model) + model.Geometry().Bytes();
+    CHECK(compact < bytes * 2 / 3);
+    for( auto &building: model.Buildings() )
+        for( auto way: building.outer ) {
+            CHECK(model.Ways()[way].nodes.empty());
+            CHECK(model.Geometry().Points(way).size() >= 4u);
+        }
+
+    // the road nodes keep their places, the graph now measures edges in the geometry
+    for( auto node: model.RoadNodes() )
+        CHECK(model.Graph().Vertex(node) != RouteGraph::kNoVertex);
+    RoutePlanner planner{model};
+    auto after = planner.AStarSearch(5.f, 5.f, 95.f, 90.f);
+    REQUIRE(before && after);
+    CHECK_NEAR(after->distance, before->distance, 0.01 * after->nodes.size());
+    auto &graph = model.Graph();
+    for( std::uint32_t v = 0; v < graph.VertexCount(); ++v )
+        for( auto e = graph.FirstEdge(v); e < graph.FirstEdge(v + 1); ++e )
+            CHECK(graph.Weight(e) >= graph.Distance(v, graph.Target(e)));
+}
+
+TEST(RebuildsTheHierarchyForTheDecodedWeights)
+{
+    TempDir dir;
+    GridOptions options;
+    options.jitter = 0.5;
+    GridExtract(options).Write(dir / "grid.osm.pbf");
+    RouteModel model{dir / "grid.osm.pbf"};
+    model.BuildHierarchy();
+    model.BuildGeometry();
+    REQUIRE(!model.Hierarchy().Empty());
+    RoutePlanner planner{model};
+    CHQuery ch{model.Hierarchy(), model.Graph()};
+    auto &graph = model.Graph();
+    for( std::uint32_t from = 0; from < graph.VertexCount(); from += 7 ) {
+        auto to = graph.VertexCount() - 1 - from;
+        auto expected = planner.AStarSearch(from, to), found = ch.Search(from, to);
+        REQUIRE(expected.has_value() == found.has_value());
+        if( found )
+            CHECK_NEAR(found->distance, expected->distance, 1e-3);
+    }
+}
+
+TEST(SnapshotKeepsTheCompactModel)
+{
+    TempDir dir;
+    GridExtract().Write(dir / "grid.osm.pbf");
+    RouteModel model{dir / "grid.osm.pbf"};
+    model.BuildGeometry();
+    SnapshotWriter writer{model.MetricScale()};
+    model.Serialize(writer);
+    REQUIRE(writer.Save((dir / "grid.rms").string()));
+    auto snapshot = Snapshot::Open((dir / "grid.rms").string());
+    REQUIRE(snapshot);
+    RouteModel loaded{std::move(*snapshot)};
+    REQUIRE(loaded.Geometry().WayCount() == model.Geometry().WayCount());
+    CHECK_EQ(loaded.Nodes().size(), model.Nodes().size());
+    for( std::size_t way = 0; way < model.Ways().size(); ++way ) {
+        CHECK_EQ(loaded.Geometry().Points(way).size(), model.Geometry().Points(way).size());
+        CHECK_EQ(loaded.Geometry().Length(way), model.Geometry().Length(way));
+    }
+}